@@ -1,2 +1,4 @@
-#include "../libs/simpleTCP/simpleTCP.hpp"
-#include "../libs/easyAuth/easyAuth.hpp"
\ No newline at end of file
+#include "../libs/simpleTCP/simpleTCP.hpp"
+#include "../libs/easyAuth/easyAuth.hpp"
+#include "../libs/easyAuth/shardedAuth.hpp"
+#include "../libs/easyAuth/replication.hpp"
\ No newline at end of file
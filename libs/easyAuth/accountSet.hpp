@@ -0,0 +1,347 @@
+// accountSet.hpp
+// A compact sorted set of account numbers, used by easyAuth's index from property value to accounts.
+// Account numbers are split by their high 16 bits into chunks of 65536. A chunk with few members stores them as a
+// sorted array of their low 16 bits (2 bytes per account), a dense chunk as a 65536 bit bitmap (8 KiB), whichever is
+// smaller. Counting is O(1), iteration is in ascending order, and intersecting or subtracting two sets works chunk by
+// chunk (merging arrays, ANDing bitmap words), so it costs about the size of the smaller side instead of a scan of
+// every account.
+
+#ifndef EasyAuth_ACCOUNT_SET_HPP
+#define EasyAuth_ACCOUNT_SET_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+class AccountSet {
+ private:
+    static constexpr std::size_t kArrayMax = 4096; // an array chunk bigger than this is bigger than a bitmap
+    static constexpr std::size_t kBitmapWords = 65536 / 64;
+
+    struct Chunk {
+        std::uint16_t key = 0;              // high 16 bits of the account numbers in it
+        std::uint32_t count = 0;
+        std::vector<std::uint16_t> array;   // sorted low 16 bits, used while bitmap is empty
+        std::vector<std::uint64_t> bitmap;  // kBitmapWords words once the chunk got dense
+
+        bool isBitmap() const {
+            return !bitmap.empty();
+        }
+
+        bool contains(std::uint16_t low) const {
+            if (isBitmap())
+                return (bitmap[low >> 6] >> (low & 63)) & 1;
+            return std::binary_search(array.begin(), array.end(), low);
+        }
+
+        void toBitmap() {
+            bitmap.assign(kBitmapWords, 0);
+            for (std::uint16_t low : array)
+                bitmap[low >> 6] |= std::uint64_t(1) << (low & 63);
+            array = std::vector<std::uint16_t>();
+        }
+
+        void toArray() {
+            array.clear();
+            array.reserve(count);
+            for (std::size_t w = 0; w < kBitmapWords; w++) {
+                for (std::uint64_t word = bitmap[w]; word != 0; word &= word - 1)
+                    array.push_back(static_cast<std::uint16_t>(w * 64 + __builtin_ctzll(word)));
+            }
+            bitmap = std::vector<std::uint64_t>();
+        }
+
+        // Picks the smaller representation for the current count.
+        void settle() {
+            if (isBitmap() && count <= kArrayMax)
+                toArray();
+            else if (!isBitmap() && count > kArrayMax)
+                toBitmap();
+        }
+
+        std::size_t memoryUsage() const {
+            return sizeof(Chunk) + array.capacity() * sizeof(std::uint16_t) + bitmap.capacity() * sizeof(std::uint64_t);
+        }
+    };
+
+    std::vector<Chunk> chunks; // sorted by key, none empty
+    std::size_t total = 0;
+
+    static std::uint16_t high(std::uint32_t account) {
+        return static_cast<std::uint16_t>(account >> 16);
+    }
+
+    static std::uint16_t low(std::uint32_t account) {
+        return static_cast<std::uint16_t>(account);
+    }
+
+    std::vector<Chunk>::iterator findChunk(std::uint16_t key) {
+        return std::lower_bound(chunks.begin(), chunks.end(), key, [](const Chunk& chunk, std::uint16_t k) { return chunk.key < k; });
+    }
+
+    std::vector<Chunk>::const_iterator findChunk(std::uint16_t key) const {
+        return std::lower_bound(chunks.begin(), chunks.end(), key, [](const Chunk& chunk, std::uint16_t k) { return chunk.key < k; });
+    }
+
+    void append(Chunk&& chunk) {
+        if (chunk.count == 0)
+            return;
+        chunk.settle();
+        total += chunk.count;
+        chunks.push_back(std::move(chunk));
+    }
+
+    static Chunk intersect(const Chunk& a, const Chunk& b) {
+        Chunk out;
+        out.key = a.key;
+        if (a.isBitmap() && b.isBitmap()) {
+            out.bitmap.resize(kBitmapWords);
+            for (std::size_t w = 0; w < kBitmapWords; w++) {
+                out.bitmap[w] = a.bitmap[w] & b.bitmap[w];
+                out.count += static_cast<std::uint32_t>(__builtin_popcountll(out.bitmap[w]));
+            }
+        } else if (a.isBitmap() || b.isBitmap()) {
+            const Chunk& sparse = a.isBitmap() ? b : a;
+            const Chunk& dense = a.isBitmap() ? a : b;
+            for (std::uint16_t value : sparse.array) {
+                if (dense.contains(value))
+                    out.array.push_back(value);
+            }
+            out.count = static_cast<std::uint32_t>(out.array.size());
+        } else {
+            std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+            out.count = static_cast<std::uint32_t>(out.array.size());
+        }
+        return out;
+    }
+
+    static Chunk subtract(const Chunk& a, const Chunk& b) {
+        Chunk out;
+        out.key = a.key;
+        if (a.isBitmap()) {
+            out.bitmap = a.bitmap;
+            if (b.isBitmap()) {
+                for (std::size_t w = 0; w < kBitmapWords; w++)
+                    out.bitmap[w] &= ~b.bitmap[w];
+            } else {
+                for (std::uint16_t value : b.array)
+                    out.bitmap[value >> 6] &= ~(std::uint64_t(1) << (value & 63));
+            }
+            for (std::uint64_t word : out.bitmap)
+                out.count += static_cast<std::uint32_t>(__builtin_popcountll(word));
+        } else if (b.isBitmap()) {
+            for (std::uint16_t value : a.array) {
+                if (!b.contains(value))
+                    out.array.push_back(value);
+            }
+            out.count = static_cast<std::uint32_t>(out.array.size());
+        } else {
+            std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(out.array));
+            out.count = static_cast<std::uint32_t>(out.array.size());
+        }
+        return out;
+    }
+
+ public:
+    // Forward iterator over the account numbers in ascending order.
+    class const_iterator {
+     public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::uint32_t*;
+        using reference = std::uint32_t;
+
+        const_iterator() = default;
+
+        std::uint32_t operator*() const {
+            return current;
+        }
+
+        const_iterator& operator++() {
+            position++;
+            seek();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return chunk == other.chunk && position == other.position;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+     private:
+        friend class AccountSet;
+
+        const_iterator(const std::vector<Chunk>* chunks, std::size_t chunk) : chunks(chunks), chunk(chunk) {
+            seek();
+        }
+
+        // Moves to the first member at or after (chunk, position): an array index, or a bit number in a bitmap.
+        void seek() {
+            for (; chunk < chunks->size(); chunk++, position = 0) {
+                const Chunk& c = (*chunks)[chunk];
+                if (!c.isBitmap()) {
+                    if (position < c.array.size()) {
+                        current = std::uint32_t(c.key) << 16 | c.array[position];
+                        return;
+                    }
+                    continue;
+                }
+                for (std::size_t w = position >> 6; w < kBitmapWords; w++) {
+                    std::uint64_t word = c.bitmap[w];
+                    if (w == position >> 6)
+                        word &= ~std::uint64_t(0) << (position & 63);
+                    if (word != 0) {
+                        position = w * 64 + __builtin_ctzll(word);
+                        current = std::uint32_t(c.key) << 16 | static_cast<std::uint32_t>(position);
+                        return;
+                    }
+                }
+            }
+            position = 0;
+        }
+
+        const std::vector<Chunk>* chunks = nullptr;
+        std::size_t chunk = 0;
+        std::size_t position = 0;
+        std::uint32_t current = 0;
+    };
+
+    const_iterator begin() const {
+        return const_iterator(&chunks, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(&chunks, chunks.size());
+    }
+
+    std::size_t size() const {
+        return total;
+    }
+
+    bool empty() const {
+        return total == 0;
+    }
+
+    void clear() {
+        chunks.clear();
+        total = 0;
+    }
+
+    bool contains(std::uint32_t account) const {
+        auto chunk = findChunk(high(account));
+        return chunk != chunks.end() && chunk->key == high(account) && chunk->contains(low(account));
+    }
+
+    // Returns false if it was already in the set. Adding in ascending order (e.g. building from the accounts) appends.
+    bool insert(std::uint32_t account) {
+        std::uint16_t key = high(account), value = low(account);
+        auto chunk = (!chunks.empty() && chunks.back().key == key) ? chunks.end() - 1 : findChunk(key);
+        if (chunk == chunks.end() || chunk->key != key) {
+            chunk = chunks.insert(chunk, Chunk());
+            chunk->key = key;
+        }
+        if (chunk->isBitmap()) {
+            std::uint64_t& word = chunk->bitmap[value >> 6];
+            std::uint64_t bit = std::uint64_t(1) << (value & 63);
+            if (word & bit)
+                return false;
+            word |= bit;
+        } else {
+            auto at = (chunk->array.empty() || chunk->array.back() < value)
+                ? chunk->array.end() : std::lower_bound(chunk->array.begin(), chunk->array.end(), value);
+            if (at != chunk->array.end() && *at == value)
+                return false;
+            chunk->array.insert(at, value);
+        }
+        chunk->count++;
+        total++;
+        if (!chunk->isBitmap() && chunk->count > kArrayMax)
+            chunk->toBitmap();
+        return true;
+    }
+
+    // Returns false if it wasnt in the set.
+    bool erase(std::uint32_t account) {
+        std::uint16_t key = high(account), value = low(account);
+        auto chunk = findChunk(key);
+        if (chunk == chunks.end() || chunk->key != key)
+            return false;
+        if (chunk->isBitmap()) {
+            std::uint64_t& word = chunk->bitmap[value >> 6];
+            std::uint64_t bit = std::uint64_t(1) << (value & 63);
+            if (!(word & bit))
+                return false;
+            word &= ~bit;
+        } else {
+            auto at = std::lower_bound(chunk->array.begin(), chunk->array.end(), value);
+            if (at == chunk->array.end() || *at != value)
+                return false;
+            chunk->array.erase(at);
+        }
+        chunk->count--;
+        total--;
+        if (chunk->count == 0)
+            chunks.erase(chunk);
+        else if (chunk->isBitmap() && chunk->count <= kArrayMax / 2) // not at kArrayMax, so one account going in and out doesnt convert every time
+            chunk->toArray();
+        return true;
+    }
+
+    // Accounts in both sets, e.g. PREMIUM and ADMIN.
+    AccountSet intersection(const AccountSet& other) const {
+        AccountSet out;
+        auto a = chunks.begin(), b = other.chunks.begin();
+        while (a != chunks.end() && b != other.chunks.end()) {
+            if (a->key < b->key) {
+                a++;
+            } else if (b->key < a->key) {
+                b++;
+            } else {
+                out.append(intersect(*a++, *b++));
+            }
+        }
+        return out;
+    }
+
+    // Accounts in this set but not in other, e.g. PREMIUM and not ADMIN.
+    AccountSet difference(const AccountSet& other) const {
+        AccountSet out;
+        auto b = other.chunks.begin();
+        for (const Chunk& a : chunks) {
+            while (b != other.chunks.end() && b->key < a.key)
+                b++;
+            if (b != other.chunks.end() && b->key == a.key) {
+                out.append(subtract(a, *b));
+            } else {
+                Chunk copy = a;
+                out.append(std::move(copy));
+            }
+        }
+        return out;
+    }
+
+    std::vector<std::uint32_t> toVector() const {
+        return std::vector<std::uint32_t>(begin(), end());
+    }
+
+    std::size_t memoryUsage() const {
+        std::size_t bytes = chunks.capacity() * sizeof(Chunk);
+        for (const Chunk& chunk : chunks)
+            bytes += chunk.memoryUsage() - sizeof(Chunk);
+        return bytes;
+    }
+};
+
+#endif // EasyAuth_ACCOUNT_SET_HPP
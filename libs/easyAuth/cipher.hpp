@@ -0,0 +1,146 @@
+// cipher.hpp
+// At-rest encryption of the database strings.
+// The keystream byte for a byte at offset `o` (from the start of the strings section) is key[o % key.length()],
+// so any range can be en/decrypted on its own given its offset: ranges can be split across threads, and each range is
+// XORed in wide chunks against a prebuilt window of the repeated key instead of one byte and one modulo at a time.
+// XOR with the same keystream decrypts again.
+
+#ifndef EasyAuth_CIPHER_HPP
+#define EasyAuth_CIPHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EasyAuth_CIPHER_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EasyAuth_CIPHER_AVX2 1 // compiled with a target attribute and picked at runtime
+#include <immintrin.h>
+#endif
+
+namespace Cipher {
+
+    // dst[i] ^= src[i] for n bytes, scalar version
+    inline void xorScalar(char* dst, const char* src, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            std::uint64_t a, b;
+            std::memcpy(&a, dst + i, 8);
+            std::memcpy(&b, src + i, 8);
+            a ^= b;
+            std::memcpy(dst + i, &a, 8);
+        }
+        for (; i < n; i++)
+            dst[i] ^= src[i];
+    }
+
+#ifdef EasyAuth_CIPHER_SSE2
+    inline void xorSse2(char* dst, const char* src, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 64 <= n; i += 64) {
+            for (std::size_t j = 0; j < 64; j += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i + j));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + j));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + j), _mm_xor_si128(a, b));
+            }
+        }
+        xorScalar(dst + i, src + i, n - i);
+    }
+#endif
+
+#ifdef EasyAuth_CIPHER_AVX2
+    __attribute__((target("avx2"))) inline void xorAvx2(char* dst, const char* src, std::size_t n) {
+        std::size_t i = 0;
+        for (; i + 128 <= n; i += 128) {
+            for (std::size_t j = 0; j < 128; j += 32) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i + j));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + j));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + j), _mm256_xor_si256(a, b));
+            }
+        }
+        xorScalar(dst + i, src + i, n - i);
+    }
+
+    inline bool hasAvx2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+#endif
+
+    // dst[i] ^= src[i] for n bytes with the widest instructions the cpu has.
+    inline void xorBytes(char* dst, const char* src, std::size_t n) {
+#ifdef EasyAuth_CIPHER_AVX2
+        if (hasAvx2()) {
+            xorAvx2(dst, src, n);
+            return;
+        }
+#endif
+#ifdef EasyAuth_CIPHER_SSE2
+        xorSse2(dst, src, n);
+#else
+        xorScalar(dst, src, n);
+#endif
+    }
+
+    class Keystream {
+     public:
+        static const std::size_t kWindow = 16384; // bytes XORed per step
+
+        explicit Keystream(const std::string& key) : keyLength(key.length()) {
+            if (key.empty())
+                throw std::invalid_argument("Encryption key cannot be empty");
+            // the key repeated so that a window of kWindow bytes can start at any key position
+            std::size_t length = kWindow + keyLength;
+            tile.resize(length);
+            for (std::size_t i = 0; i < length; i++)
+                tile[i] = key[i % keyLength];
+        }
+
+        // En/decrypts `length` bytes that sit at `offset` in the encrypted stream.
+        void apply(char* data, std::size_t length, std::uint64_t offset) const {
+            std::size_t phase = static_cast<std::size_t>(offset % keyLength);
+            while (length > 0) {
+                std::size_t n = length < kWindow ? length : kWindow;
+                xorBytes(data, tile.data() + phase, n);
+                data += n;
+                length -= n;
+                phase = (phase + n) % keyLength;
+            }
+        }
+
+        // Same as apply() but split across the cores for big ranges, e.g. a whole database at startup.
+        void applyParallel(char* data, std::size_t length, std::uint64_t offset) const {
+            const std::size_t minPerThread = std::size_t(4) << 20;
+            std::size_t threads = std::thread::hardware_concurrency();
+            if (threads > length / minPerThread)
+                threads = length / minPerThread;
+            if (threads <= 1) {
+                apply(data, length, offset);
+                return;
+            }
+            std::size_t part = (length / threads + 63) & ~std::size_t(63);
+            std::vector<std::thread> workers;
+            for (std::size_t start = part; start < length; start += part) {
+                std::size_t n = (length - start < part) ? length - start : part;
+                workers.emplace_back([this, data, start, n, offset] { apply(data + start, n, offset + start); });
+            }
+            apply(data, part < length ? part : length, offset);
+            for (auto &worker : workers)
+                worker.join();
+        }
+
+     private:
+        std::size_t keyLength;
+        std::vector<char> tile;
+    };
+
+} // namespace Cipher
+
+#endif // EasyAuth_CIPHER_HPP
@@ -0,0 +1,364 @@
+// compactFile.hpp
+// A compact database file for backups and for sending a database elsewhere (easyAuth::saveCompactBackup(), replica
+// snapshots). It is parsed on load instead of mapped, in exchange it is a fraction of the size of the mapped format:
+// no fixed size refs, no padding and no indexes (they are rebuilt on load), and deleted accounts are only a number
+// in the free list.
+//
+// The file is a header, a block table and the blocks. Every block decodes on its own, so a load spreads them over
+// the cores. All integers in the header and table are little endian, inside a block they are varints (7 bits a byte,
+// low bits first, the high bit set on every byte but the last).
+//   BLOCK_DICTIONARY  count, then per property value: length, bytes. The position is the dictionary id
+//   BLOCK_ACCOUNTS    the accounts numbered from block * kAccountsPerBlock up to the next block's, deleted ones left
+//                     out, sorted by username inside the block. Per account:
+//                     account number - the first of the block, bytes shared with the previous username (0 for the first),
+//                     length and bytes of the rest of the username,
+//                     length and bytes of every other credential,
+//                     for every property type: count, then the dictionary ids
+//   BLOCK_FREE_ACCOUNTS count, then the deleted account numbers in the order new accounts reuse them. Optional, files
+//                     without it (from before it was added) find the deleted accounts again in account order
+// A block can be compressed (BLOCK_COMPRESSED, with Lz below) and with FLAG_ENCRYPTED its stored bytes are XORed
+// with a Cipher::Keystream at the block's offset in the file. Every block has a crc32 of its stored bytes.
+// Since a block covers a fixed range of account numbers, the blocks can also fill their part of the Database at once.
+// Version 1 files sorted the usernames over the whole file instead, with the account numbers as they are.
+
+#ifndef EasyAuth_COMPACT_FILE_HPP
+#define EasyAuth_COMPACT_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "storage.hpp"
+
+namespace CompactFile {
+
+    const char MAGIC[8] = {'E', 'Z', 'A', 'U', 'T', 'H', 'C', 'F'};
+    const std::uint32_t VERSION = 2;
+    const std::size_t kAccountsPerBlock = 65536; // a Column block, so every block fills its own
+
+    enum BlockKind : std::uint32_t {
+        BLOCK_DICTIONARY = 1,
+        BLOCK_ACCOUNTS = 2,
+        BLOCK_FREE_ACCOUNTS = 3,
+    };
+
+    enum BlockFlags : std::uint32_t {
+        BLOCK_COMPRESSED = 1,
+    };
+
+    enum HeaderFlags : std::uint64_t {
+        FLAG_ENCRYPTED = 1,
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t blockCount;
+        std::uint64_t accountCount;  // account slots, deleted ones included
+        std::uint32_t credentialTypes;
+        std::uint32_t propertyTypes;
+        std::uint64_t journalLsn;    // last journal record included in this file
+        std::uint64_t flags;         // FLAG_* bits
+        std::uint64_t fileSize;
+        std::uint32_t tableCrc;      // crc32 of the block table
+        std::uint32_t reserved;
+    };
+    static_assert(sizeof(Header) == 64, "Header must stay 64 bytes");
+
+    struct BlockInfo {
+        std::uint32_t kind;
+        std::uint32_t flags;      // BLOCK_* bits
+        std::uint64_t offset;     // from the start of the file
+        std::uint32_t storedSize; // bytes in the file
+        std::uint32_t rawSize;    // bytes once decompressed
+        std::uint32_t entries;    // values or accounts
+        std::uint32_t crc;        // crc32 of the stored bytes
+    };
+    static_assert(sizeof(BlockInfo) == 32, "BlockInfo must stay 32 bytes");
+
+    inline bool hasMagic(const std::string& filename) {
+        char magic[sizeof(MAGIC)] = {};
+        std::FILE* file = std::fopen(filename.c_str(), "rb");
+        if (!file)
+            return false;
+        std::size_t read = std::fread(magic, 1, sizeof(magic), file);
+        std::fclose(file);
+        return read == sizeof(magic) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    inline void putVarint(std::string& out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // False if the varint runs past `end` or doesnt fit 64 bits.
+    inline bool getVarint(const char*& p, const char* end, std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7) {
+            std::uint8_t byte = static_cast<std::uint8_t>(*p++);
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // A small LZ77 block compressor in the style of LZ4: sequences of a token (literal count in the high 4 bits, match
+    // length - 4 in the low 4, 15 meaning more follows in bytes of 255), the literals, and a 2 byte offset back into
+    // the output for the match. The last sequence is only literals. Matches are found through a 4096 entry hash
+    // table of 4 byte prefixes, so it is fast rather than small; usernames and hash records compress mostly from
+    // their shared prefixes.
+    namespace Lz {
+
+        const std::size_t kMinMatch = 4;
+        const std::size_t kMaxOffset = 65535;
+
+        inline std::uint32_t read32(const char* p) {
+            std::uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        inline void putLength(std::string& out, std::size_t length) {
+            while (length >= 255) {
+                out.push_back(static_cast<char>(255));
+                length -= 255;
+            }
+            out.push_back(static_cast<char>(length));
+        }
+
+        inline void putSequence(std::string& out, const char* literals, std::size_t literalCount, std::size_t offset, std::size_t matchLength) {
+            std::size_t matchCode = matchLength == 0 ? 0 : matchLength - kMinMatch;
+            std::uint8_t token = static_cast<std::uint8_t>(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+            out.push_back(static_cast<char>(token));
+            if (literalCount >= 15)
+                putLength(out, literalCount - 15);
+            out.append(literals, literalCount);
+            if (matchLength == 0)
+                return;
+            out.push_back(static_cast<char>(offset & 0xFF));
+            out.push_back(static_cast<char>(offset >> 8));
+            if (matchCode >= 15)
+                putLength(out, matchCode - 15);
+        }
+
+        inline void compress(const char* src, std::size_t size, std::string& out) {
+            out.clear();
+            std::vector<std::uint32_t> table(4096, 0); // position + 1, 0 = empty
+            std::size_t pos = 0, anchor = 0;
+            while (pos + kMinMatch <= size) {
+                std::uint32_t prefix = read32(src + pos);
+                std::uint32_t& slot = table[(prefix * 2654435761u) >> 20];
+                std::size_t candidate = slot;
+                slot = static_cast<std::uint32_t>(pos + 1);
+                if (candidate == 0 || pos - (candidate - 1) > kMaxOffset || read32(src + candidate - 1) != prefix) {
+                    pos++;
+                    continue;
+                }
+                candidate--;
+                std::size_t length = kMinMatch;
+                while (pos + length < size && src[candidate + length] == src[pos + length])
+                    length++;
+                putSequence(out, src + anchor, pos - anchor, pos - candidate, length);
+                pos += length;
+                anchor = pos;
+            }
+            putSequence(out, src + anchor, size - anchor, 0, 0);
+        }
+
+        inline bool getLength(const char*& p, const char* end, std::size_t& length) {
+            while (true) {
+                if (p >= end)
+                    return false;
+                std::uint8_t byte = static_cast<std::uint8_t>(*p++);
+                length += byte;
+                if (byte != 255)
+                    return true;
+            }
+        }
+
+        // False unless `src` is a valid block that decodes to exactly rawSize bytes.
+        inline bool decompress(const char* src, std::size_t size, char* dst, std::size_t rawSize) {
+            const char* p = src;
+            const char* end = src + size;
+            std::size_t out = 0;
+            while (p < end) {
+                std::uint8_t token = static_cast<std::uint8_t>(*p++);
+                std::size_t literals = token >> 4;
+                if (literals == 15 && !getLength(p, end, literals))
+                    return false;
+                if (literals > static_cast<std::size_t>(end - p) || literals > rawSize - out)
+                    return false;
+                std::memcpy(dst + out, p, literals);
+                p += literals;
+                out += literals;
+                if (p == end)
+                    return out == rawSize; // the last sequence has no match
+                if (end - p < 2)
+                    return false;
+                std::size_t offset = static_cast<std::uint8_t>(p[0]) | (static_cast<std::size_t>(static_cast<std::uint8_t>(p[1])) << 8);
+                p += 2;
+                std::size_t length = token & 15;
+                if (length == 15 && !getLength(p, end, length))
+                    return false;
+                length += kMinMatch;
+                if (offset == 0 || offset > out || length > rawSize - out)
+                    return false;
+                // byte by byte, a match can overlap what it writes
+                for (std::size_t i = 0; i < length; i++, out++)
+                    dst[out] = dst[out - offset];
+            }
+            return out == rawSize;
+        }
+
+    } // namespace Lz
+
+    // Builds a BLOCK_ACCOUNTS block. Add the accounts in username order: addAccount() with the number relative to the
+    // block, then every credential (username first), then the ids of every property type.
+    class AccountBlockWriter {
+     public:
+        void addAccount(std::uint32_t accountNumber) {
+            putVarint(bytes, accountNumber);
+            entries++;
+        }
+
+        void addUsername(std::string_view username) {
+            std::size_t shared = 0;
+            while (shared < username.size() && shared < previous.size() && username[shared] == previous[shared])
+                shared++;
+            putVarint(bytes, shared);
+            putVarint(bytes, username.size() - shared);
+            bytes.append(username.data() + shared, username.size() - shared);
+            previous.assign(username.data(), username.size());
+        }
+
+        void addCredential(std::string_view value) {
+            putVarint(bytes, value.size());
+            bytes.append(value.data(), value.size());
+        }
+
+        void addProperties(const std::vector<std::uint32_t>& ids) {
+            putVarint(bytes, ids.size());
+            for (std::uint32_t id : ids)
+                putVarint(bytes, id);
+        }
+
+        const std::string& data() const {
+            return bytes;
+        }
+
+        std::uint32_t size() const {
+            return entries;
+        }
+
+        void clear() {
+            bytes.clear();
+            previous.clear();
+            entries = 0;
+        }
+
+     private:
+        std::string bytes;
+        std::string previous;
+        std::uint32_t entries = 0;
+    };
+
+    // A decoded BLOCK_ACCOUNTS block, accounts in file order. The credentials are laid out in `strings` the way a
+    // StringArena lays out its chunks (see StringArena::appendChunks()), so the block can become part of one as it is.
+    struct AccountBlock {
+        std::string strings;
+        std::vector<std::uint32_t> accountNumbers; // as stored, relative to the block since version 2
+        std::vector<StringRef> credentials;        // [account * credentialTypes + type], offsets into `strings`
+        std::vector<std::uint32_t> propertyEnds;   // [account * propertyTypes + type], end of its ids in `propertyIds`
+        std::vector<std::uint32_t> propertyIds;
+    };
+
+    // False if the block is malformed.
+    inline bool decodeAccounts(const char* data, std::size_t size, std::uint32_t entries, std::uint32_t credentialTypes,
+                               std::uint32_t propertyTypes, AccountBlock& block) {
+        const char* p = data;
+        const char* end = data + size;
+        StringRef previous;
+        block.strings.reserve(size + size / 2);
+        block.credentials.reserve(static_cast<std::size_t>(entries) * credentialTypes);
+        for (std::uint32_t account = 0; account < entries; account++) {
+            std::uint64_t accountNumber, shared, length;
+            if (!getVarint(p, end, accountNumber) || accountNumber > UINT32_MAX)
+                return false;
+            block.accountNumbers.push_back(static_cast<std::uint32_t>(accountNumber));
+            for (std::uint32_t t = 0; t < credentialTypes; t++) {
+                shared = 0;
+                if (t == 0 && (!getVarint(p, end, shared) || shared > previous.length))
+                    return false;
+                if (!getVarint(p, end, length) || length > static_cast<std::uint64_t>(end - p))
+                    return false;
+                std::size_t total = static_cast<std::size_t>(shared + length);
+                std::size_t begin = block.strings.size();
+                std::size_t inChunk = begin & StringArena::kChunkMask;
+                if (inChunk > 0 && inChunk + total > StringArena::kChunkSize)
+                    begin += StringArena::kChunkSize - inChunk;
+                if (begin + total > UINT32_MAX)
+                    return false;
+                block.strings.resize(begin + total);
+                // the shared part of the username is copied from the previous one
+                std::memcpy(&block.strings[begin], block.strings.data() + previous.offset, static_cast<std::size_t>(shared));
+                std::memcpy(&block.strings[begin + shared], p, static_cast<std::size_t>(length));
+                p += length;
+                StringRef ref{total > 0 ? static_cast<std::uint32_t>(begin) : 0, static_cast<std::uint32_t>(total)};
+                if (t == 0)
+                    previous = ref;
+                block.credentials.push_back(ref);
+            }
+            for (std::uint32_t t = 0; t < propertyTypes; t++) {
+                std::uint64_t count, id;
+                if (!getVarint(p, end, count) || count > static_cast<std::uint64_t>(end - p))
+                    return false;
+                for (std::uint64_t k = 0; k < count; k++) {
+                    if (!getVarint(p, end, id) || id > UINT32_MAX)
+                        return false;
+                    block.propertyIds.push_back(static_cast<std::uint32_t>(id));
+                }
+                block.propertyEnds.push_back(static_cast<std::uint32_t>(block.propertyIds.size()));
+            }
+        }
+        return p == end;
+    }
+
+    // Decodes a BLOCK_DICTIONARY block into its values, in id order.
+    inline bool decodeDictionary(const char* data, std::size_t size, std::uint32_t entries, std::vector<std::string>& values) {
+        const char* p = data;
+        const char* end = data + size;
+        for (std::uint32_t i = 0; i < entries; i++) {
+            std::uint64_t length;
+            if (!getVarint(p, end, length) || length > static_cast<std::uint64_t>(end - p))
+                return false;
+            values.emplace_back(p, static_cast<std::size_t>(length));
+            p += length;
+        }
+        return p == end;
+    }
+
+    // Decodes a BLOCK_FREE_ACCOUNTS block, in reuse order. The numbers are checked against the accounts by the caller.
+    inline bool decodeFreeAccounts(const char* data, std::size_t size, std::uint32_t entries, std::vector<std::uint32_t>& free) {
+        const char* p = data;
+        const char* end = data + size;
+        free.reserve(entries);
+        for (std::uint32_t i = 0; i < entries; i++) {
+            std::uint64_t accountNumber;
+            if (!getVarint(p, end, accountNumber) || accountNumber > UINT32_MAX)
+                return false;
+            free.push_back(static_cast<std::uint32_t>(accountNumber));
+        }
+        return p == end;
+    }
+
+} // namespace CompactFile
+
+#endif // EasyAuth_COMPACT_FILE_HPP
@@ -0,0 +1,59 @@
+// crc32.hpp
+// CRC-32 (IEEE 802.3 polynomial, same as zlib) used to detect torn or corrupted records on disk.
+
+#ifndef EasyAuth_CRC32_HPP
+#define EasyAuth_CRC32_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Crc32 {
+
+    // values[0] is the usual byte at a time table, values[k] is a byte followed by k zero bytes, so update() can
+    // fold in 8 bytes per step (slicing-by-8) instead of 1
+    struct Table {
+        std::uint32_t values[8][256];
+
+        Table() {
+            for (std::uint32_t i = 0; i < 256; i++) {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                values[0][i] = c;
+            }
+            for (std::uint32_t i = 0; i < 256; i++) {
+                for (int k = 1; k < 8; k++)
+                    values[k][i] = (values[k - 1][i] >> 8) ^ values[0][values[k - 1][i] & 0xFF];
+            }
+        }
+    };
+
+    inline std::uint32_t load32(const unsigned char* p) {
+        return static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8 |
+               static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+    }
+
+    // Continues a running crc, start with crc = 0.
+    inline std::uint32_t update(std::uint32_t crc, const void* data, std::size_t length) {
+        static const Table table;
+        const std::uint32_t (&t)[8][256] = table.values;
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        crc = ~crc;
+        for (; length >= 8; p += 8, length -= 8) {
+            std::uint32_t low = load32(p) ^ crc;
+            std::uint32_t high = load32(p + 4);
+            crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+                  t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        }
+        for (; length > 0; p++, length--)
+            crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    inline std::uint32_t compute(const void* data, std::size_t length) {
+        return update(0, data, length);
+    }
+
+} // namespace Crc32
+
+#endif // EasyAuth_CRC32_HPP
@@ -0,0 +1,197 @@
+// databaseFile.hpp
+// On-disk layout of the easyAuth database file (version 2) and a small read-only file mapping helper.
+//
+// The file is a header, a section table and a list of sections. Every section starts on a kSectionAlignment boundary
+// and holds a flat array, so once the file is mapped the tables can be used in place:
+//   SECTION_CREDENTIALS       StringRef[accountCount]          (one per credential type, `index` = credential type)
+//   SECTION_PROPERTY_LISTS    PropertyList[accountCount]       (one per property type, `index` = property index)
+//   SECTION_PROPERTY_VALUES   uint32 dictionary id[count]      (one per property type)
+//   SECTION_PROPERTY_MASKS    uint32[accountCount]             (one per property type, see PropertyColumn::masks)
+//   SECTION_DICTIONARY        StringRef[count]                 the PropertyDictionary, id = position
+//   SECTION_DICTIONARY_INDEX  PropertyDictionary::Slot[count]  (optional, rebuilt on load if missing)
+//   SECTION_USERNAME_INDEX    UsernameIndex::Slot[count]       (optional, rebuilt on load if missing)
+//   SECTION_FREE_ACCOUNTS     uint32 account number[count]     deleted accounts in the order they get reused
+//                                                              (optional, found by their empty username if missing)
+//   SECTION_USERNAME_FILTER   uint64[count]                    UsernameFilter of a username index partition, `index` = partition
+//                                                              (optional, only written while the filter is on)
+//   SECTION_STRINGS           char[count]                      every StringRef offset is relative to the start of this section
+// Version 1 files had a StringRef per property value in SECTION_PROPERTY_VALUES and no masks or dictionary, they
+// still load. All integers are little endian.
+
+#ifndef EasyAuth_DATABASE_FILE_HPP
+#define EasyAuth_DATABASE_FILE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace DatabaseFile {
+
+    const char MAGIC[8] = {'E', 'Z', 'A', 'U', 'T', 'H', 'D', 'B'};
+    const std::uint32_t VERSION = 2;
+    const std::uint64_t kSectionAlignment = 4096;
+
+    enum SectionKind : std::uint32_t {
+        SECTION_CREDENTIALS = 1,
+        SECTION_PROPERTY_LISTS = 2,
+        SECTION_PROPERTY_VALUES = 3,
+        SECTION_USERNAME_INDEX = 4,
+        SECTION_STRINGS = 5,
+        SECTION_PROPERTY_MASKS = 6,
+        SECTION_DICTIONARY = 7,
+        SECTION_DICTIONARY_INDEX = 8,
+        SECTION_FREE_ACCOUNTS = 9,
+        SECTION_USERNAME_FILTER = 10,
+    };
+
+    enum HeaderFlags : std::uint64_t {
+        FLAG_ENCRYPTED_STRINGS = 1, // SECTION_STRINGS is XORed with a Cipher::Keystream, offsets relative to the section
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t sectionCount;
+        std::uint64_t accountCount;
+        std::uint32_t credentialTypes;
+        std::uint32_t propertyTypes;
+        std::uint64_t indexEntries;  // number of usernames in SECTION_USERNAME_INDEX
+        std::uint64_t fileSize;
+        std::uint64_t journalLsn;    // last journal record included in this file, replay starts after it
+        std::uint64_t flags;         // FLAG_* bits
+    };
+    static_assert(sizeof(Header) == 64, "Header must stay 64 bytes");
+
+    struct Section {
+        std::uint32_t kind;
+        std::uint32_t index;
+        std::uint64_t offset; // from the start of the file
+        std::uint64_t count;  // number of elements
+    };
+    static_assert(sizeof(Section) == 24, "Section must stay 24 bytes");
+
+    inline std::uint64_t alignUp(std::uint64_t value) {
+        return (value + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+    }
+
+    // True if the first bytes of the file are the version 1+ magic. Older files start with the credential type count instead.
+    inline bool hasMagic(const std::string& filename) {
+        char magic[sizeof(MAGIC)] = {};
+        std::FILE* file = std::fopen(filename.c_str(), "rb");
+        if (!file)
+            return false;
+        std::size_t read = std::fread(magic, 1, sizeof(magic), file);
+        std::fclose(file);
+        return read == sizeof(magic) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    }
+
+    // Replaces `target` with `source`, so readers never see a half written database.
+    inline bool replaceFile(const std::string& source, const std::string& target) {
+#ifdef _WIN32
+        return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(source.c_str(), target.c_str()) == 0;
+#endif
+    }
+
+    // A whole file mapped copy-on-write: pages are read from disk when first touched and writes stay private to the process.
+    class MappedFile {
+     public:
+        // Returns nullptr if the file cant be opened or mapped.
+        static std::shared_ptr<MappedFile> open(const std::string& filename) {
+            std::shared_ptr<MappedFile> mapped(new MappedFile());
+#ifdef _WIN32
+            HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return nullptr;
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+                CloseHandle(file);
+                return nullptr;
+            }
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (!mapping)
+                return nullptr;
+            void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping);
+            if (!view)
+                return nullptr;
+            mapped->base = static_cast<char*>(view);
+            mapped->length = static_cast<std::size_t>(size.QuadPart);
+#else
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return nullptr;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                return nullptr;
+            }
+            void* view = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (view == MAP_FAILED)
+                return nullptr;
+            mapped->base = static_cast<char*>(view);
+            mapped->length = static_cast<std::size_t>(st.st_size);
+#endif
+            return mapped;
+        }
+
+        ~MappedFile() {
+            if (!base)
+                return;
+#ifdef _WIN32
+            UnmapViewOfFile(base);
+#else
+            munmap(base, length);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        char* data() const {
+            return base;
+        }
+
+        std::size_t size() const {
+            return length;
+        }
+
+        // Drops the process's pages of a range that was only read, e.g. after it was copied somewhere else.
+        // They are read from the file again if they are used after all.
+        void discard(char* data, std::size_t size) {
+            std::size_t page = 4096;
+            std::size_t begin = (reinterpret_cast<std::uintptr_t>(data) + page - 1) & ~(page - 1);
+            std::size_t end = (reinterpret_cast<std::uintptr_t>(data) + size) & ~(page - 1);
+            if (end <= begin)
+                return;
+#ifdef _WIN32
+            VirtualUnlock(reinterpret_cast<void*>(begin), end - begin);
+#else
+            madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+        }
+
+     private:
+        MappedFile() = default;
+
+        char* base = nullptr;
+        std::size_t length = 0;
+    };
+
+} // namespace DatabaseFile
+
+#endif // EasyAuth_DATABASE_FILE_HPP
@@ -1,428 +1,4423 @@
-/*
-VERSION 3.0
-Made by: Plinkon
-
-Changelog:
-V: 2.0
-- for version 2 i completely forgot to add a chanelog but basically i changed the DB structure to be only vectors
-V: 3.0
-- changed loadDatabase to be bool and not void so you can check if it successfully loads or not without throwing a error and stopping
-- added getUsername()
-- added getPassword()
-- added doesUserHaveProperty()
-- idk what else tbh a couple more small things
-*/
-
-#ifndef EasyAuth_HPP
-#define EasyAuth_HPP
-
-#include <iostream>
-#include <vector>
-#include <string>
-#include <fstream>
-#include <stdexcept>
-
-struct Database {
-    // credentials[credentialType][accountNumber] credentialType 0 = username, 1 = password
-    std::vector<std::vector<std::string>> credentials;
-    // properties[propertyIndex][accountNumber][propertyNumber] propertyIndex is the current property of the max number of properties each user can have
-    std::vector<std::vector<std::vector<std::string>>> properties;
-
-    void clear() {
-        credentials.clear();
-        properties.clear();
-    }
-
-    // Resize the outer vectors: one for credentials (e.g. username, password)
-    // and one for property types.
-    void resize(size_t credentialTypes, size_t propertyTypes) {
-        credentials.resize(credentialTypes);
-        properties.resize(propertyTypes);
-    }
-
-    // Adds a new account. Each credential type gets an empty string,
-    // and each property type gets an empty vector for that account.
-    int addAccount() {
-        int accountNumber = credentials.empty() ? 0 : credentials[0].size();
-        for (auto &cred : credentials) {
-            cred.push_back("");
-        }
-        for (auto &prop : properties) {
-            prop.push_back(std::vector<std::string>());
-        }
-        return accountNumber;
-    }
-
-    // “Delete” an account by marking its entries as empty.
-    // (Erasing from a vector would shift indices and change account numbers.)
-    void deleteAccount(int accountNumber) {
-        if (credentials.empty() || accountNumber < 0 || accountNumber >= credentials[0].size())
-            throw std::runtime_error("Account not found");
-        // Erase the credentials for the specified account.
-        for (auto &cred : credentials) {
-            cred.erase(cred.begin() + accountNumber);
-        }
-        // Erase the properties for the specified account.
-        for (auto &prop : properties) {
-            prop.erase(prop.begin() + accountNumber);
-        }
-    }
-};
-
-class easyAuth {
- private:
-    Database db;
-    int numberOfProperties;
- public:
-    const std::string XOR_KEY = "YOUR_KEY_HERE";
-    easyAuth() = default;
-    easyAuth(Database database) { // Option to initialize with an existing database.
-        this->db = database;
-    }
-    ~easyAuth() = default;
-
-    // Initialize with 2 credential types (username and password) and a given number of property types.
-    void initialize(int numberOfProperties) {
-        if (numberOfProperties < 0) {
-            throw std::invalid_argument("Number of properties cannot be negative");
-        }
-        db.resize(2, numberOfProperties);
-        this->numberOfProperties = numberOfProperties;
-    }
-
-    /* USERS / AUTH / CREDENTIALS */
-
-    bool checkCredentials(const std::string& username, const std::string& password) {
-        if (username.empty() || password.empty()) {
-            throw std::invalid_argument("Username and password cannot be empty");
-        }
-        // Iterate over all accounts (by index)
-        for (size_t accountNumber = 0; accountNumber < db.credentials[0].size(); ++accountNumber) {
-            if (db.credentials[0][accountNumber] == username) {
-                if (db.credentials[1][accountNumber] == password) {
-                    return true;
-                }
-            }
-        }
-        return false;
-    }
-
-    void addCredentials(const std::string& username, const std::string& password) {
-        if (username.empty() || password.empty()) {
-            throw std::invalid_argument("Username and password cannot be empty");
-        }
-        // Check if username already exists
-        for (const auto &name : db.credentials[0]) {
-            if (name == username) {
-                throw std::runtime_error("Username already exists");
-            }
-        }
-        // Add a new account and then set its credentials.
-        int accountNumber = db.addAccount();
-        db.credentials[0][accountNumber] = username;
-        db.credentials[1][accountNumber] = password;
-    }
-
-    void deleteCredentials(int accountNumber) {
-        if (accountNumber < 0 || accountNumber >= db.credentials[0].size() ||
-            db.credentials[0][accountNumber].empty())
-        {
-            throw std::runtime_error("Account not found");
-        }
-        db.deleteAccount(accountNumber);
-    }
-
-    void editCredentials(int accountNumber, const std::string& username, const std::string& password) {
-        if (accountNumber < 0 || accountNumber >= db.credentials[0].size() ||
-            db.credentials[0][accountNumber].empty())
-        {
-            throw std::runtime_error("Account not found");
-        }
-        db.credentials[0][accountNumber] = username;
-        db.credentials[1][accountNumber] = password;
-    }
-
-    Database getAllUsers() {
-        // Returns the entire database.
-        if (db.credentials.empty()) {
-            throw std::runtime_error("Database is empty");
-        }
-        return this->db;
-    }
-
-    int getAccountNumberOfUser(const std::string& username) {
-        if (username.empty()) {
-            throw std::invalid_argument("Username cannot be empty");
-        }
-        for (size_t i = 0; i < db.credentials[0].size(); ++i) {
-            if (db.credentials[0][i] == username) {
-                return static_cast<int>(i);
-            }
-        }
-        return -1;
-    }
-
-    std::string getPassword(int accountNumber) {
-        if (accountNumber < 0 || accountNumber >= db.credentials[0].size() ||
-            db.credentials[0][accountNumber].empty())
-        {
-            throw std::runtime_error("Account not found");
-        }
-        return db.credentials[1][accountNumber];
-    }
-
-    std::string getUsername(int accountNumber) {
-        if (accountNumber < 0 || accountNumber >= db.credentials[0].size() ||
-            db.credentials[0][accountNumber].empty())
-        {
-            throw std::runtime_error("Account not found");
-        }
-        return db.credentials[0][accountNumber];
-    }
-
-    /* USER PROPERTIES */
-
-    bool checkProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber, const std::string& property) {
-        if (propertyIndex >= db.properties.size())
-            throw std::runtime_error("Property index out of range");
-        if (accountNumber >= db.properties[propertyIndex].size())
-            throw std::runtime_error("Account not found");
-        if (propertyNumber >= db.properties[propertyIndex][accountNumber].size())
-            throw std::runtime_error("Property number out of range");
-
-        return db.properties[propertyIndex][accountNumber][propertyNumber] == property;
-    }
-
-    void addProperty(int accountNumber, std::size_t propertyIndex, const std::string& property) {
-        if (propertyIndex >= db.properties.size())
-            throw std::runtime_error("Property index out of range");
-        if (accountNumber >= db.properties[propertyIndex].size())
-            throw std::runtime_error("Account not found");
-
-        db.properties[propertyIndex][accountNumber].push_back(property);
-    }
-
-    void deleteProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber) {
-        if (propertyIndex >= db.properties.size())
-            throw std::runtime_error("Property index out of range");
-        if (accountNumber >= db.properties[propertyIndex].size())
-            throw std::runtime_error("Account not found");
-        if (propertyNumber >= db.properties[propertyIndex][accountNumber].size())
-            throw std::runtime_error("Property number out of range");
-
-        db.properties[propertyIndex][accountNumber].erase(db.properties[propertyIndex][accountNumber].begin() + propertyNumber);
-    }
-
-    void editProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber, const std::string& newProperty) {
-        if (propertyIndex >= db.properties.size())
-            throw std::runtime_error("Property index out of range");
-        if (accountNumber >= db.properties[propertyIndex].size())
-            throw std::runtime_error("Account not found");
-        if (propertyNumber >= db.properties[propertyIndex][accountNumber].size())
-            throw std::runtime_error("Property number out of range");
-
-        db.properties[propertyIndex][accountNumber][propertyNumber] = newProperty;
-    }
-
-    std::vector<std::vector<std::string>> getProperties(int accountNumber) {
-        std::vector<std::vector<std::string>> userProperties;
-        bool foundProperties = false;
-        for (size_t propIndex = 0; propIndex < db.properties.size(); ++propIndex) {
-            if (accountNumber < db.properties[propIndex].size()) {
-                userProperties.push_back(db.properties[propIndex][accountNumber]);
-                if (!db.properties[propIndex][accountNumber].empty())
-                    foundProperties = true;
-            } else {
-                userProperties.push_back(std::vector<std::string>());
-            }
-        }
-        if (!foundProperties)
-            userProperties.clear();
-        return userProperties;
-    }
-
-    std::size_t getPropertyNumber(int accountNumber, std::size_t propertyIndex, const std::string& property) {
-        if (property.empty()) {
-            throw std::invalid_argument("Property cannot be empty");
-        }
-        if (propertyIndex >= db.properties.size())
-            throw std::runtime_error("Property index out of range");
-        if (accountNumber >= db.properties[propertyIndex].size())
-            throw std::runtime_error("Account not found");
-
-        const auto &props = db.properties[propertyIndex][accountNumber];
-        for (std::size_t i = 0; i < props.size(); i++) {
-            if (props[i] == property) {
-                return i;
-            }
-        }
-        return static_cast<std::size_t>(-1);
-    }
-
-    std::size_t getPropertyIndex(int accountNumber, const std::string& property) {
-        if (property.empty()) {
-            throw std::invalid_argument("Property cannot be empty");
-        }
-        for (std::size_t propIndex = 0; propIndex < db.properties.size(); propIndex++) {
-            if (accountNumber < db.properties[propIndex].size()) {
-                const auto &props = db.properties[propIndex][accountNumber];
-                if (!props.empty() && props.back() == property) {
-                    return propIndex;
-                }
-            }
-        }
-        return static_cast<std::size_t>(-1);
-    }
-
-    std::size_t getPropertyIndexFromPropertyNumber(int accountNumber, std::size_t propertyNumber) {
-        for (std::size_t propIndex = 0; propIndex < db.properties.size(); propIndex++) {
-            if (accountNumber < db.properties[propIndex].size()) {
-                const auto &props = db.properties[propIndex][accountNumber];
-                if (propertyNumber < props.size()) {
-                    return propIndex;
-                }
-            }
-        }
-        return static_cast<std::size_t>(-1);
-    }
-
-    int getMaxNumberOfProperties() {
-        return this->numberOfProperties;
-    }
-
-    bool doesAccountHaveProperty(int accountNumber, std::string property) {
-        return getPropertyIndex(accountNumber, property) != static_cast<std::size_t>(-1);
-    }
-
-    /* SAVING / LOADING / ENCRYPTING / DECRYPTING DATABASE */
-
-    void saveDatabase(const std::string& filename) {
-        std::ofstream file(filename, std::ios::binary);
-        if (!file) {
-            throw std::runtime_error("Could not open file for writing: " + filename);
-        }
-
-        // Save credentials
-        size_t credentialTypes = db.credentials.size();
-        file.write(reinterpret_cast<const char*>(&credentialTypes), sizeof(credentialTypes));
-        for (const auto &credVector : db.credentials) {
-            size_t numAccounts = credVector.size();
-            file.write(reinterpret_cast<const char*>(&numAccounts), sizeof(numAccounts));
-            for (const auto &cred : credVector) {
-                size_t strLen = cred.length();
-                file.write(reinterpret_cast<const char*>(&strLen), sizeof(strLen));
-                file.write(cred.c_str(), strLen);
-            }
-        }
-
-        // Save properties
-        size_t propertyTypes = db.properties.size();
-        file.write(reinterpret_cast<const char*>(&propertyTypes), sizeof(propertyTypes));
-        for (const auto &propertyType : db.properties) {
-            size_t numAccounts = propertyType.size();
-            file.write(reinterpret_cast<const char*>(&numAccounts), sizeof(numAccounts));
-            for (const auto &props : propertyType) {
-                size_t numProperties = props.size();
-                file.write(reinterpret_cast<const char*>(&numProperties), sizeof(numProperties));
-                for (const auto &prop : props) {
-                    size_t strLen = prop.length();
-                    file.write(reinterpret_cast<const char*>(&strLen), sizeof(strLen));
-                    file.write(prop.c_str(), strLen);
-                }
-            }
-        }
-
-        file.close();
-    }
-
-    bool loadDatabase(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file) {
-            // cant open file
-            return false;
-        }
-
-        // Clear existing database.
-        db.credentials.clear();
-        db.properties.clear();
-
-        // Load credentials
-        size_t credentialTypes;
-        file.read(reinterpret_cast<char*>(&credentialTypes), sizeof(credentialTypes));
-        db.credentials.resize(credentialTypes);
-        for (size_t i = 0; i < credentialTypes; i++) {
-            size_t numAccounts;
-            file.read(reinterpret_cast<char*>(&numAccounts), sizeof(numAccounts));
-            db.credentials[i].resize(numAccounts);
-            for (size_t j = 0; j < numAccounts; j++) {
-                size_t strLen;
-                file.read(reinterpret_cast<char*>(&strLen), sizeof(strLen));
-                std::string cred(strLen, '\0');
-                file.read(&cred[0], strLen);
-                db.credentials[i][j] = cred;
-            }
-        }
-
-        // Load properties
-        size_t propertyTypes;
-        file.read(reinterpret_cast<char*>(&propertyTypes), sizeof(propertyTypes));
-        db.properties.resize(propertyTypes);
-        for (size_t i = 0; i < propertyTypes; i++) {
-            size_t numAccounts;
-            file.read(reinterpret_cast<char*>(&numAccounts), sizeof(numAccounts));
-            db.properties[i].resize(numAccounts);
-            for (size_t j = 0; j < numAccounts; j++) {
-                size_t numProperties;
-                file.read(reinterpret_cast<char*>(&numProperties), sizeof(numProperties));
-                db.properties[i][j].resize(numProperties);
-                for (size_t k = 0; k < numProperties; k++) {
-                    size_t strLen;
-                    file.read(reinterpret_cast<char*>(&strLen), sizeof(strLen));
-                    std::string prop(strLen, '\0');
-                    file.read(&prop[0], strLen);
-                    db.properties[i][j][k] = prop;
-                }
-            }
-        }
-
-        file.close();
-        return true;
-    }
-
-    void encryptDatabase() {
-        if (db.credentials.empty() && db.properties.empty()) {
-            throw std::runtime_error("Cannot encrypt empty database");
-        }
-        std::string key = XOR_KEY.empty() ? "XOR_KEY_HERE" : XOR_KEY;
-        size_t keyIndex = 0;
-
-        // Encrypt credentials
-        for (auto &credVector : db.credentials) {
-            for (auto &cred : credVector) {
-                for (char &c : cred) {
-                    c ^= key[keyIndex];
-                    keyIndex = (keyIndex + 1) % key.length();
-                }
-            }
-        }
-
-        // Encrypt properties
-        for (auto &propertyType : db.properties) {
-            for (auto &accountProps : propertyType) {
-                for (auto &prop : accountProps) {
-                    for (char &c : prop) {
-                        c ^= key[keyIndex];
-                        keyIndex = (keyIndex + 1) % key.length();
-                    }
-                }
-            }
-        }
-    }
-
-    void decryptDatabase() {
-        // XOR decryption is identical to encryption.
-        encryptDatabase();
-    }
-};
-
-#endif // EasyAuth_HPP
+/*
+VERSION 6.3
+Made by: Plinkon
+
+Changelog:
+V: 2.0
+- for version 2 i completely forgot to add a chanelog but basically i changed the DB structure to be only vectors
+V: 3.0
+- changed loadDatabase to be bool and not void so you can check if it successfully loads or not without throwing a error and stopping
+- added getUsername()
+- added getPassword()
+- added doesUserHaveProperty()
+- idk what else tbh a couple more small things
+V: 3.1
+- added a username -> account number hash index so checkCredentials, addCredentials and getAccountNumberOfUser dont scan every account anymore
+- editCredentials now throws if the new username is already taken by another account
+V: 4.0
+- the Database no longer stores a std::string per username/password/property, all string bytes live in a StringArena (see storage.hpp)
+  and accounts only hold offsets into it. Read the Database through its accessors (credential(), property(), accountCount()...)
+- getUsername(), getPassword() and getProperties() return std::string_view into the arena
+- the database file format did not change
+V: 4.1
+- new database file format (version 1, see databaseFile.hpp): a header with a magic number and version, a section table,
+  and page aligned flat tables. loadDatabase maps it and uses it in place instead of parsing it, so startup only reads
+  the pages lookups actually touch. The username index is saved too so it doesnt have to be rebuilt on load
+- saveDatabase writes the new format through a temp file + rename. loadDatabase still reads old files,
+  and saveLegacyDatabase() can still write them
+V: 4.2
+- added a write-ahead journal (journal.hpp). After openJournal() every add/edit/delete of credentials or properties is
+  appended to it before the call returns, with group commit so concurrent writers share one fsync.
+  saveDatabase stores the last journal lsn in the file and drops the journal records it covers,
+  openJournal replays whatever came after the last save
+V: 4.3
+- easyAuth is now safe to use from several threads (the server runs a thread per client): reads share a lock,
+  writes take it alone and wait for their journal fsync after letting go of it
+- added startSnapshot() / waitForSnapshot(): saves the database on a background thread while reads and writes keep going.
+  The snapshot shares the storage and only blocks that get written meanwhile are copied (copy-on-write), SnapshotStats
+  reports how long it took, how many bytes it wrote and how much extra memory it needed.
+  saveDatabase uses it too
+V: 4.4
+- the single lock from 4.3 is replaced by lock stripes: the username index is split in 64 partitions and the accounts
+  in 64 stripes, each with its own reader/writer lock, so logins and property reads of different users never wait
+  on each other and a write only blocks readers of its own stripe. See the comment at the top of class easyAuth
+- the username index is saved as one section per partition, files with a single index get it rebuilt on load
+- added src/benchmark/concurrencyBenchmark.cpp (1 to 32 threads)
+V: 4.5
+- added getSnapshot(): a shared, read-only DatabaseSnapshot of the whole database that shares storage instead of copying
+  it (copy-on-write), and is reused while nothing changes (getVersion()). getAllUsers() still returns a deep copy
+- added getAccountCount(), getPropertyTypeCount() and getPropertyCount(), the admin panel uses those instead of getAllUsers()
+V: 4.6
+- new at-rest encryption (cipher.hpp): saveDatabase(filename, true) and startSnapshot(filename, true) XOR the strings on
+  the way to disk with a keystream that depends only on the byte offset, and flag the file. loadDatabase decrypts a
+  flagged file while mapping it, SIMD and split across cores, so decryptDatabase() is only needed for files saved
+  after encryptDatabase() (wasDecryptedOnLoad() tells which). encryptDatabase() itself is unchanged on disk but no
+  longer does a modulo per byte
+V: 4.7
+- added importAccounts(): adds a whole Database of new accounts at once, skipping empty and duplicate usernames
+  (found by sorting the username hashes), with the index sized up front and the locks taken once
+- added src/importer/importer.cpp, a command line tool that imports accounts from CSV or newline delimited JSON
+V: 4.8
+- property values are interned: every distinct value is stored once in a PropertyDictionary and accounts hold its
+  32 bit id, so roles cost 4 bytes per account and comparing values compares ids
+- every property type also keeps a 32 bit mask per account for the 32 most used values (ids are renumbered by use
+  on save), added hasProperty() which checks a role with one lookup and one AND. The server uses it for BUY_PREMIUM
+- doesAccountHaveProperty() now finds the value in any position, not only as the last value of a property type
+- database file version 2 (ids, masks and the dictionary), version 1 files still load
+V: 4.9
+- added getAccountsWithProperty(), countAccountsWithProperty() and findAccounts() (e.g. PREMIUM and not ADMIN),
+  answered from an index of property value -> accounts that addProperty, editProperty and deleteProperty keep up to
+  date, instead of walking every account. The accounts come back as an AccountSet (accountSet.hpp), a compact sorted
+  set that can be iterated, counted and intersected. The index is built on the first query
+V: 5.0
+- deleteCredentials() leaves a tombstone instead of erasing the account, so it no longer shifts every later account
+  (account numbers held by other threads stay valid) and no longer takes every lock. Deleted slots are reused by new
+  accounts, oldest first. getAccountCount() counts the slots, getDeletedAccountCount() the empty ones.
+  The free slots are saved in the database file (an optional section, older files find them on load)
+  Journals written by 4.x that contain a delete cant be replayed anymore, save with the old version before updating
+- added compact() and startCompactor(): copies the strings and property values still in use into fresh storage
+  in the background and frees the garbage deletes and edits left behind, pausing readers and writers only to swap it in
+- getUsername(), getPassword() and getProperties() return std::string copies again: a compaction on another thread
+  frees the strings a string_view would point into. getSnapshot() still reads the strings without copying them
+- added src/benchmark/deleteBenchmark.cpp
+V: 5.1
+- passwords are no longer stored in plaintext: they are hashed with PBKDF2-HMAC-SHA256 and a random salt
+  (passwordHash.hpp, in the same record format as passlib's pbkdf2_sha256) and getPassword() returns that record.
+  The cost is stored in every record, setPasswordHashCost() raises it for new hashes and accounts are rehashed with
+  the new cost (plaintext ones from older databases too) the next time they log in, countOutdatedPasswords() says
+  how many are left
+- hashing runs on a pool of worker threads, one per core, with a bounded queue (hashPool.hpp), so threads serving
+  connections wait for a worker instead of all hashing at once. checkCredentialsAsync() returns a future,
+  configureHashing() sizes the pool and how long a caller waits for room in a full queue before it throws,
+  getHashingStats() reports the queue depth and latencies
+V: 5.2
+- added enableUsernameFilter(): a blocked Bloom filter in front of each username index partition (usernameFilter.hpp)
+  so a username that doesnt exist is usually rejected from one cache line. With it on, checkCredentials() answers
+  unknown usernames without a dummy hash. The filters are saved in the database file (an optional section per
+  partition) and used in place on load. The server turns it on
+V: 5.3
+- added sessions (sessionTable.hpp): login() / loginAsync() check the credentials and return a token,
+  resolveSession() turns it back into the account number without a username lookup. Sessions expire after
+  setSessionLifetime() (a timer wheel frees them without scanning the rest) and end when the account is deleted
+  or its credentials change
+- the server answers LOGIN and REGISTER with a token and GET_PROPERTIES, RESET_PASSWORD and BUY_PREMIUM take it
+  instead of a username
+V: 5.4
+- added ShardedAuth (shardedAuth.hpp): several easyAuth instances behind the same interface, a username always goes
+  to the same one. Every shard has its own locks, journal, hashing pool and database file, and loading, saving and
+  replaying the journals runs a thread per shard. Account numbers are global (local number * shards + shard)
+- ShardedAuth::migrateDatabase() moves a single database file, or one saved with another number of shards, into the
+  shards. The server and the importer use ShardedAuth and migrate an old database.db on their first start
+- migrating copies the passwords as they are (importAccounts() with hashPasswords = false), plaintext ones from an
+  old database get hashed when they log in instead of all of them before the server starts
+- the default is 8 shards on every machine instead of one per core, the count is in the file names and the account
+  numbers. The server and the importer open a store with the count it was saved with (savedShardCount()) and take
+  --shards to move it to another one, a replica asks its primary (Replica::primaryShardCount())
+- accountExists(), the admin panel checks account numbers with it instead of against getAccountCount(), which
+  counts deleted numbers and the gaps between the shards too
+V: 5.5
+- added replication (replication.hpp): a primary keeps its newest journal records in memory (replicationLog.hpp,
+  startReplicationLog()) and read-only replicas pull them over SimpleTCP after loading a snapshot of it
+  (startSnapshotCopy()). A replica that fell too far behind, or whose primary reloaded, gets a new snapshot
+- setReadOnly() makes every write throw, applyReplicated() applies a record from the primary
+- SimpleTCP can send length-prefixed frames instead of 512 byte messages, for snapshots and batches of records
+- the server takes --port, --replication-port and --replica-of <ip>:<port>, a replica answers logins and
+  GET_PROPERTIES and refuses writes with READ_ONLY_REPLICA. Choice 7 shows how far behind the replicas are
+V: 5.6
+- added enableTieredStorage(): credentials of accounts that werent used in a while move to a page file on disk
+  (pageFile.hpp) once the strings in memory grow past a budget, and come back when the account logs in. A CLOCK
+  sweep over one access bit per account picks them. Reads of a cold account go straight to the mapped page file.
+  Loading with it on leaves every account in the page file, so memory grows with the accounts in use instead of all of them
+- getTieredStorageStats() reports what is in memory, how many accounts are cold and how many moved each way
+- the server takes --memory-budget <MiB>
+V: 5.7
+- added saveCompactBackup(): a compact file format (compactFile.hpp) for backups and transfers. Usernames are sorted and
+  front coded in blocks of 16384 accounts, lengths and property ids are varints, deleted accounts are left out and
+  blocks can be compressed with a small LZ77 codec. Every block has a crc32 and decodes on its own, so loadDatabase()
+  decodes them on every core. Replicas get their snapshots in it
+- compact files keep the deleted accounts in the order they get reused, so a replica loading its snapshot gives new
+  accounts the same numbers as the primary. Files saved before that reuse them in account order
+- src/benchmark/formatBenchmark.cpp compares the size and save/load time of the legacy, mapped and compact formats
+V: 5.8
+- compact files are version 2: a block holds a fixed range of 65536 account numbers, so loading lets every block fill
+  its own slots, property runs and strings (StringArena::appendChunks()) on its own thread after checking its crc32.
+  Version 1 compact files still load, their blocks fill one after another
+- the username index is rebuilt a partition per thread, which every format that doesnt save the index uses
+- crc32 works on 8 bytes at a time (slicing-by-8), about 5x faster, for the journal and the compact file checksums
+
+V: 5.9
+- registerValue() gives a handle for a property value that is checked often (up to 64), hasKnownProperty() checks it
+  with the account's stripe lock only, no hashing the value and no dictionary lock. The handles survive loads and encrypt
+- TypedAuth<Schema> (typedAuth.hpp) fixes the property types and values at compile time, has<ROLE, PREMIUM>() is a
+  registered check with the indexes checked by static_assert. easyAuth is a private base, so properties only change
+  through add<>() and an importAccounts() that refuses values outside the schema
+- the records keep easyAuth's column layout, fixed-layout records per schema were dropped: the journal, snapshots,
+  tiering and every file format are built on the columns. The typed check is about as fast as hasKnownProperty()
+- the server registers PREMIUM for BUY_PREMIUM, schemaBenchmark compares the dynamic, registered and typed checks
+
+V: 6.0
+- getStats() reports the live and deleted account counts, the bytes of every component (strings, credential and
+  property columns, dictionary, indexes, sessions, replication log, tiering) and, per kind of operation (lookups,
+  logins, sessions, property reads, queries, writes, saves, loads), the number of calls and a latency histogram
+- the counters are per thread and added up when read (operationStats.hpp), a counted call costs a thread local load
+  and store, the fast calls are timed one in 64
+- the admin panel shows them (option 9)
+V: 6.1
+- SimpleTCP builds on Linux too. There the server runs its connections on a few epoll event loops (one per core)
+  instead of a thread each, define SimpleTCP_THREADS for the old backend
+- the epoll loops hand requests to a pool of worker threads and send the answers when they come back, a handler
+  given to start() as an AsyncRequestHandler can answer later from any thread
+- the server answers LOGIN, REGISTER and RESET_PASSWORD from the hashing thread (loginAsync(), addCredentials() and
+  editCredentials() with a callback) instead of waiting for the hash, so the requests waiting pile up in the hashing
+  queue and a full one is answered with SERVER_BUSY
+- Server::connectionCount(), a handler that throws closes its connection instead of the process
+- tcpBenchmark measures 100 to 50k idle and busy loopback connections
+V: 6.2
+- SimpleTCP::TAGGED: framed messages that start with a request id the answer repeats. The server answers every
+  complete frame of a read in order and sends the answers together, Client::sendRequests() sends a batch before
+  reading the answers (pipelining) and checks the ids. start() and connectToServer() take a Protocol, true is FRAMED
+- the server and the client talk TAGGED instead of 512 byte messages, pipelineBenchmark compares them
+V: 6.3
+- SimpleTCP::AsyncClient keeps many requests in flight on one connection from any number of threads:
+  sendRequestAsync() returns a future or takes a callback, sendRequests() sends a batch and gathers the answers
+- TCP_NODELAY on both ends, pipelined sends were stalling on Nagle and delayed ACKs
+- the client checks for premium with one GET_PROPERTIES instead of two (and only for option 4)
+*/
+
+#ifndef EasyAuth_HPP
+#define EasyAuth_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <exception>
+
+#include "storage.hpp"
+#include "databaseFile.hpp"
+#include "journal.hpp"
+#include "cipher.hpp"
+#include "accountSet.hpp"
+#include "passwordHash.hpp"
+#include "hashPool.hpp"
+#include "operationStats.hpp"
+#include "usernameFilter.hpp"
+#include "sessionTable.hpp"
+#include "replicationLog.hpp"
+#include "pageFile.hpp"
+#include "compactFile.hpp"
+#include "crc32.hpp"
+
+// FNV-1a, stable across runs and platforms, folded to 32 bits.
+inline std::uint32_t hashString(std::string_view s) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+}
+
+// Every distinct property value of a Database, stored once. Accounts hold a value's id (its position in refs())
+// instead of the string, so a role like "USER" costs 4 bytes per account and comparing values is comparing ids.
+// Ids are handed out in first seen order; saving renumbers them by how often they are used (see writeDatabaseFile),
+// so after a reload the most used values have the smallest ids. Values are never removed while loaded.
+class PropertyDictionary {
+ public:
+    struct Slot {
+        std::uint32_t hash;
+        std::int32_t id; // -1 = empty slot
+    };
+
+    // 32 KiB blocks, most databases only have a handful of values
+    using RefColumn = Column<StringRef, 12>;
+    using SlotColumn = Column<Slot, 12>;
+
+    static constexpr std::uint32_t kNotFound = UINT32_MAX;
+
+    void clear() {
+        refs.clear();
+        slots.clear();
+    }
+
+    std::size_t size() const {
+        return refs.size();
+    }
+
+    StringRef ref(std::uint32_t id) const {
+        return refs[id];
+    }
+
+    // Returns the id of value, or kNotFound.
+    std::uint32_t find(std::string_view value, const StringArena& strings) const {
+        if (slots.empty())
+            return kNotFound;
+        std::int32_t id = slots[findSlot(value, hashString(value), strings)].id;
+        return id < 0 ? kNotFound : static_cast<std::uint32_t>(id);
+    }
+
+    // Returns the id of value, adding it (its bytes go to strings) if it is new.
+    std::uint32_t intern(std::string_view value, StringArena& strings) {
+        std::uint32_t hash = hashString(value);
+        std::size_t pos = slots.empty() ? 0 : findSlot(value, hash, strings);
+        if (!slots.empty() && slots[pos].id >= 0)
+            return static_cast<std::uint32_t>(slots[pos].id);
+        return insert(strings.append(value), hash, strings);
+    }
+
+    // Same, but a new value keeps using the bytes at ref instead of getting a copy (e.g. values of a loaded file).
+    std::uint32_t internRef(StringRef ref, const StringArena& strings) {
+        std::string_view value = strings.view(ref);
+        std::uint32_t hash = hashString(value);
+        std::size_t pos = slots.empty() ? 0 : findSlot(value, hash, strings);
+        if (!slots.empty() && slots[pos].id >= 0)
+            return static_cast<std::uint32_t>(slots[pos].id);
+        return insert(ref, hash, strings);
+    }
+
+    // Uses a dictionary saved by saveDatabase in place. Without a usable slot table (slotCount 0) it is rebuilt.
+    void adopt(StringRef* refData, std::size_t refCount, Slot* slotData, std::size_t slotCount, std::shared_ptr<void> owner,
+               const StringArena& strings) {
+        clear();
+        refs.adopt(refData, refCount, owner);
+        if (slotCount >= 16 && (slotCount & (slotCount - 1)) == 0 && slotCount >= refCount * 2) {
+            slots.adopt(slotData, slotCount, owner);
+        } else {
+            rebuild(strings);
+        }
+    }
+
+    // Rebuilds the slot table from refs(), e.g. after the string bytes changed.
+    void rebuild(const StringArena& strings) {
+        slots.clear();
+        rehash(capacityFor(refs.size()));
+        for (std::size_t id = 0; id < refs.size(); id++) {
+            std::uint32_t hash = hashString(strings.view(refs[id]));
+            std::size_t pos = hash & mask();
+            while (slots[pos].id >= 0)
+                pos = (pos + 1) & mask();
+            slots.set(pos, Slot{hash, static_cast<std::int32_t>(id)});
+        }
+    }
+
+    const RefColumn& refTable() const {
+        return refs;
+    }
+
+    const SlotColumn& slotTable() const {
+        return slots;
+    }
+
+    static std::size_t capacityFor(std::size_t entries) {
+        std::size_t capacity = 16;
+        while (capacity < entries * 2)
+            capacity *= 2;
+        return capacity;
+    }
+
+    // Points the ids at other copies of the same strings (e.g. in a compacted arena), ids and hashes stay the same.
+    void replaceRefs(RefColumn&& moved) {
+        refs = std::move(moved);
+    }
+
+    PropertyDictionary share() const {
+        PropertyDictionary view;
+        view.refs = refs.share();
+        view.slots = slots.share();
+        return view;
+    }
+
+    std::size_t retiredBytes() const {
+        return refs.retiredBytes() + slots.retiredBytes();
+    }
+
+    void releaseRetired() {
+        refs.releaseRetired();
+        slots.releaseRetired();
+    }
+
+    std::size_t memoryUsage() const {
+        return refs.memoryUsage() + slots.memoryUsage();
+    }
+
+ private:
+    RefColumn refs;
+    SlotColumn slots;
+
+    std::size_t mask() const {
+        return slots.size() - 1;
+    }
+
+    std::size_t findSlot(std::string_view value, std::uint32_t hash, const StringArena& strings) const {
+        std::size_t pos = hash & mask();
+        while (slots[pos].id >= 0) {
+            if (slots[pos].hash == hash && strings.view(refs[slots[pos].id]) == value)
+                return pos;
+            pos = (pos + 1) & mask();
+        }
+        return pos;
+    }
+
+    std::uint32_t insert(StringRef ref, std::uint32_t hash, const StringArena& strings) {
+        if (refs.size() >= static_cast<std::size_t>(INT32_MAX))
+            throw std::runtime_error("Too many distinct property values");
+        std::uint32_t id = static_cast<std::uint32_t>(refs.size());
+        refs.push_back(ref);
+        // keep the load factor under 0.5
+        if (refs.size() * 2 > slots.size()) {
+            rehash(capacityFor(refs.size()));
+        }
+        std::size_t pos = findSlot(strings.view(ref), hash, strings);
+        slots.set(pos, Slot{hash, static_cast<std::int32_t>(id)});
+        return id;
+    }
+
+    // the position only depends on the stored hash, so this never reads a value
+    void rehash(std::size_t capacity) {
+        SlotColumn oldSlots = std::move(slots);
+        slots.clear();
+        slots.resize(capacity, Slot{0, -1});
+        for (std::size_t i = 0; i < oldSlots.size(); i++) {
+            const Slot& slot = oldSlots[i];
+            if (slot.id < 0)
+                continue;
+            std::size_t pos = slot.hash & mask();
+            while (slots[pos].id >= 0)
+                pos = (pos + 1) & mask();
+            slots.set(pos, slot);
+        }
+    }
+};
+
+// Where the property values of one account are inside PropertyColumn::values.
+struct PropertyList {
+    std::uint32_t begin = 0;
+    std::uint32_t count = 0;
+};
+
+// All values of one property type, as PropertyDictionary ids. The values of an account are one contiguous run in `values`.
+// masks[accountNumber] has bit i set if the account has the value with id i, for the first kMaskBits ids (the most used
+// values after a reload, i.e. the roles), so checking for one of those is a single AND instead of a scan.
+struct PropertyColumn {
+    static constexpr std::uint32_t kMaskBits = 32;
+
+    Column<PropertyList> lists;  // lists[accountNumber]
+    Column<std::uint32_t> values;
+    Column<std::uint32_t> masks; // masks[accountNumber]
+    std::size_t garbage = 0;     // values that no list points at anymore
+
+    static std::uint32_t bit(std::uint32_t id) {
+        return id < kMaskBits ? std::uint32_t(1) << id : 0;
+    }
+};
+
+// string_views handed out by the Database point into its StringArena (or its PageFile) and stay valid until the Database
+// is cleared or reloaded.
+struct Database {
+    StringArena strings;
+    // credentials[credentialType][accountNumber] credentialType 0 = username, 1 = password
+    std::vector<Column<StringRef>> credentials;
+    // properties[propertyIndex] holds the property values of every account for that property index
+    std::vector<PropertyColumn> properties;
+    // the strings of all property values
+    PropertyDictionary dictionary;
+    // Deleted accounts keep their number as an empty slot (a tombstone: empty credentials, no properties) so the numbers
+    // of the others never change. freeAccounts[freeHead..] are the tombstones, addAccount() reuses the oldest first.
+    Column<std::uint32_t> freeAccounts;
+    std::size_t freeHead = 0;
+    // The cold tier (see pageFile.hpp): credentials with PageFile::kColdBit in their ref are read from it instead of
+    // `strings`. Null unless easyAuth's tiered storage moved some there.
+    std::shared_ptr<PageFile> cold;
+    std::size_t coldAccounts = 0; // accounts whose username is in `cold`
+
+    void clear() {
+        strings.clear();
+        credentials.clear();
+        properties.clear();
+        dictionary.clear();
+        freeAccounts.clear();
+        freeHead = 0;
+        cold.reset();
+        coldAccounts = 0;
+    }
+
+    // Resize the outer vectors: one for credentials (e.g. username, password)
+    // and one for property types.
+    void resize(size_t credentialTypes, size_t propertyTypes) {
+        std::size_t accounts = accountCount();
+        credentials.resize(credentialTypes);
+        properties.resize(propertyTypes);
+        // new columns still need an (empty) entry for every existing account
+        for (auto &cred : credentials)
+            cred.resize(accounts);
+        for (auto &prop : properties) {
+            prop.lists.resize(accounts, PropertyList{static_cast<std::uint32_t>(prop.values.size()), 0});
+            prop.masks.resize(accounts, 0);
+        }
+    }
+
+    // Number of account slots, deleted ones included: account numbers go from 0 to accountCount() - 1.
+    std::size_t accountCount() const {
+        return credentials.empty() ? 0 : credentials[0].size();
+    }
+
+    std::size_t deletedCount() const {
+        return freeAccounts.size() - freeHead;
+    }
+
+    bool isDeleted(std::size_t accountNumber) const {
+        return credentials[0][accountNumber].length == 0;
+    }
+
+    // The account number the next addAccount() returns.
+    int nextAccountNumber() const {
+        return static_cast<int>(deletedCount() > 0 ? freeAccounts[freeHead] : accountCount());
+    }
+
+    // Finds the tombstones again from the accounts, for files that didnt save them.
+    void rebuildFreeAccounts() {
+        freeAccounts.clear();
+        freeHead = 0;
+        for (std::size_t i = 0; i < accountCount(); i++) {
+            if (isDeleted(i))
+                freeAccounts.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+
+    std::size_t credentialTypes() const {
+        return credentials.size();
+    }
+
+    std::size_t propertyTypes() const {
+        return properties.size();
+    }
+
+    // Adds a new account. Each credential type gets an empty string,
+    // and each property type gets an empty list for that account. A deleted account's slot is reused if there is one.
+    int addAccount() {
+        if (deletedCount() > 0) {
+            int reused = static_cast<int>(freeAccounts[freeHead++]);
+            if (freeHead == freeAccounts.size()) {
+                freeAccounts.clear();
+                freeHead = 0;
+            }
+            return reused;
+        }
+        int accountNumber = static_cast<int>(accountCount());
+        for (auto &cred : credentials) {
+            cred.push_back(StringRef{});
+        }
+        for (auto &prop : properties) {
+            prop.lists.push_back(PropertyList{static_cast<std::uint32_t>(prop.values.size()), 0});
+            prop.masks.push_back(0);
+        }
+        return accountNumber;
+    }
+
+    // “Delete” an account by marking its entries as empty, which leaves a tombstone for addAccount() to reuse.
+    // Erasing it would shift every later account and change their numbers.
+    void deleteAccount(int accountNumber) {
+        if (accountNumber < 0 || static_cast<std::size_t>(accountNumber) >= accountCount() || isDeleted(accountNumber))
+            throw std::runtime_error("Account not found");
+        if (isCold(accountNumber))
+            coldAccounts--;
+        for (auto &cred : credentials) {
+            releaseCredential(cred[accountNumber]);
+            cred.set(accountNumber, StringRef{});
+        }
+        for (auto &prop : properties) {
+            PropertyList list = prop.lists[accountNumber];
+            prop.garbage += list.count;
+            prop.lists.set(accountNumber, PropertyList{list.begin, 0});
+            prop.masks.set(accountNumber, 0);
+        }
+        freeAccounts.push_back(static_cast<std::uint32_t>(accountNumber));
+    }
+
+    /* CREDENTIALS */
+
+    std::string_view credential(std::size_t credentialType, std::size_t accountNumber) const {
+        StringRef ref = credentials[credentialType][accountNumber];
+        if (PageFile::isCold(ref))
+            return cold->view(ref);
+        return strings.view(ref);
+    }
+
+    void setCredential(std::size_t credentialType, std::size_t accountNumber, std::string_view value) {
+        if (credentialType == 0 && isCold(accountNumber))
+            coldAccounts--;
+        StringRef& ref = credentials[credentialType].mut(accountNumber);
+        releaseCredential(ref);
+        ref = strings.append(value);
+    }
+
+    /* COLD TIER */
+
+    // True if the account's username is in the page file. Its other credentials usually are too, but an edit only
+    // brings back the ones it changes.
+    bool isCold(std::size_t accountNumber) const {
+        return PageFile::isCold(credentials[0][accountNumber]);
+    }
+
+    // Bytes of the account's credentials that are in `strings`.
+    std::size_t residentCredentialBytes(std::size_t accountNumber) const {
+        std::size_t total = 0;
+        for (const auto &cred : credentials) {
+            if (!PageFile::isCold(cred[accountNumber]))
+                total += cred[accountNumber].length;
+        }
+        return total;
+    }
+
+    // Points the account's credentials at their copies in `cold` (refs[credentialType], flushed) and frees the ones in
+    // `strings`. Credentials that are empty or cold already are left alone.
+    void moveToCold(std::size_t accountNumber, const std::vector<StringRef>& refs) {
+        for (std::size_t t = 0; t < credentials.size(); t++) {
+            StringRef ref = credentials[t][accountNumber];
+            if (ref.length == 0 || PageFile::isCold(ref))
+                continue;
+            if (t == 0)
+                coldAccounts++;
+            strings.release(ref);
+            credentials[t].set(accountNumber, refs[t]);
+        }
+    }
+
+    // Copies the account's cold credentials back into `strings`. Returns the cold refs they had (an empty ref for the
+    // ones that werent cold), their records stay in the page file.
+    std::vector<StringRef> moveToMemory(std::size_t accountNumber) {
+        std::vector<StringRef> old(credentials.size());
+        for (std::size_t t = 0; t < credentials.size(); t++) {
+            StringRef ref = credentials[t][accountNumber];
+            if (!PageFile::isCold(ref))
+                continue;
+            if (t == 0)
+                coldAccounts--;
+            old[t] = ref;
+            credentials[t].set(accountNumber, strings.append(cold->view(ref)));
+        }
+        return old;
+    }
+
+    void releaseCredential(StringRef ref) {
+        if (PageFile::isCold(ref))
+            cold->release(ref);
+        else
+            strings.release(ref);
+    }
+
+    /* PROPERTIES */
+
+    std::size_t propertyCount(std::size_t propertyIndex, std::size_t accountNumber) const {
+        return properties[propertyIndex].lists[accountNumber].count;
+    }
+
+    std::string_view property(std::size_t propertyIndex, std::size_t accountNumber, std::size_t propertyNumber) const {
+        return strings.view(dictionary.ref(propertyId(propertyIndex, accountNumber, propertyNumber)));
+    }
+
+    std::uint32_t propertyId(std::size_t propertyIndex, std::size_t accountNumber, std::size_t propertyNumber) const {
+        const PropertyColumn& column = properties[propertyIndex];
+        return column.values[column.lists[accountNumber].begin + propertyNumber];
+    }
+
+    // True if the account has the value with this dictionary id for propertyIndex.
+    bool hasPropertyId(std::size_t propertyIndex, std::size_t accountNumber, std::uint32_t id) const {
+        const PropertyColumn& column = properties[propertyIndex];
+        if (id < PropertyColumn::kMaskBits)
+            return (column.masks[accountNumber] & PropertyColumn::bit(id)) != 0;
+        PropertyList list = column.lists[accountNumber];
+        for (std::uint32_t i = 0; i < list.count; i++) {
+            if (column.values[list.begin + i] == id)
+                return true;
+        }
+        return false;
+    }
+
+    void addProperty(std::size_t propertyIndex, std::size_t accountNumber, std::string_view value) {
+        addPropertyId(propertyIndex, accountNumber, dictionary.intern(value, strings));
+    }
+
+    void addPropertyId(std::size_t propertyIndex, std::size_t accountNumber, std::uint32_t id) {
+        PropertyColumn& column = properties[propertyIndex];
+        PropertyList list = column.lists[accountNumber];
+        if (list.begin + list.count != column.values.size()) {
+            // the run is not at the end of `values`, move it there so it can grow
+            std::uint32_t newBegin = static_cast<std::uint32_t>(column.values.size());
+            for (std::uint32_t i = 0; i < list.count; i++)
+                column.values.push_back(column.values[list.begin + i]);
+            column.garbage += list.count;
+            list.begin = newBegin;
+        }
+        column.values.push_back(id);
+        list.count++;
+        column.lists.set(accountNumber, list);
+        if (PropertyColumn::bit(id))
+            column.masks.mut(accountNumber) |= PropertyColumn::bit(id);
+    }
+
+    void setProperty(std::size_t propertyIndex, std::size_t accountNumber, std::size_t propertyNumber, std::string_view value) {
+        setPropertyId(propertyIndex, accountNumber, propertyNumber, dictionary.intern(value, strings));
+    }
+
+    void setPropertyId(std::size_t propertyIndex, std::size_t accountNumber, std::size_t propertyNumber, std::uint32_t id) {
+        PropertyColumn& column = properties[propertyIndex];
+        column.values.set(column.lists[accountNumber].begin + propertyNumber, id);
+        updateMask(propertyIndex, accountNumber);
+    }
+
+    void eraseProperty(std::size_t propertyIndex, std::size_t accountNumber, std::size_t propertyNumber) {
+        PropertyColumn& column = properties[propertyIndex];
+        PropertyList& list = column.lists.mut(accountNumber);
+        for (std::size_t i = list.begin + propertyNumber; i + 1 < list.begin + list.count; i++)
+            column.values.set(i, column.values[i + 1]);
+        list.count--;
+        column.garbage++;
+        updateMask(propertyIndex, accountNumber);
+    }
+
+    // Recomputes masks[accountNumber] from the account's values.
+    void updateMask(std::size_t propertyIndex, std::size_t accountNumber) {
+        PropertyColumn& column = properties[propertyIndex];
+        PropertyList list = column.lists[accountNumber];
+        std::uint32_t mask = 0;
+        for (std::uint32_t i = 0; i < list.count; i++)
+            mask |= PropertyColumn::bit(column.values[list.begin + i]);
+        if (column.masks[accountNumber] != mask)
+            column.masks.set(accountNumber, mask);
+    }
+
+    // Frozen view of the current contents that shares storage with this database instead of copying it.
+    Database share() const {
+        Database view;
+        view.strings = strings.share();
+        for (const auto &cred : credentials)
+            view.credentials.push_back(cred.share());
+        for (const auto &prop : properties)
+            view.properties.push_back(PropertyColumn{prop.lists.share(), prop.values.share(), prop.masks.share(), prop.garbage});
+        view.dictionary = dictionary.share();
+        view.freeAccounts = freeAccounts.share();
+        view.freeHead = freeHead;
+        view.cold = cold;
+        view.coldAccounts = coldAccounts;
+        return view;
+    }
+
+    // Old blocks kept since the last releaseRetired() because a view shared them when they were written, see storage.hpp.
+    std::size_t retiredBytes() const {
+        std::size_t total = 0;
+        for (const auto &cred : credentials)
+            total += cred.retiredBytes();
+        for (const auto &prop : properties)
+            total += prop.lists.retiredBytes() + prop.values.retiredBytes() + prop.masks.retiredBytes();
+        return total + dictionary.retiredBytes() + freeAccounts.retiredBytes();
+    }
+
+    void releaseRetired() {
+        for (auto &cred : credentials)
+            cred.releaseRetired();
+        for (auto &prop : properties) {
+            prop.lists.releaseRetired();
+            prop.values.releaseRetired();
+            prop.masks.releaseRetired();
+        }
+        dictionary.releaseRetired();
+        freeAccounts.releaseRetired();
+    }
+
+    // Bytes allocated for this database, including unused arena space.
+    std::size_t memoryUsage() const {
+        std::size_t total = strings.memoryUsage();
+        for (const auto &cred : credentials)
+            total += cred.memoryUsage();
+        for (const auto &prop : properties)
+            total += prop.lists.memoryUsage() + prop.values.memoryUsage() + prop.masks.memoryUsage();
+        return total + dictionary.memoryUsage() + freeAccounts.memoryUsage();
+    }
+
+    // Bytes of strings and property values that nothing points at anymore (deleted accounts, old values of edits).
+    // They stay allocated until the database is compacted or saved and loaded again.
+    std::size_t garbageBytes() const {
+        std::size_t total = strings.garbageBytes();
+        for (const auto &prop : properties)
+            total += prop.garbage * sizeof(std::uint32_t);
+        return total;
+    }
+
+    // Bytes of strings and property values, garbage included.
+    std::size_t storedBytes() const {
+        std::size_t total = strings.bytesUsed() + strings.garbageBytes();
+        for (const auto &prop : properties)
+            total += prop.values.size() * sizeof(std::uint32_t);
+        return total;
+    }
+};
+
+// A packed copy of the variable size parts of a Database (string bytes and property values) without the garbage, see
+// easyAuth::compact(). It is built from a view with copyAccounts()/copyValues(), accounts that changed meanwhile are
+// copied again from the live database, and install() swaps it in. Account numbers, ids, masks and the indexes dont change.
+struct CompactedStorage {
+    StringArena strings;
+    std::vector<Column<StringRef>> credentials;
+    std::vector<Column<PropertyList>> lists;
+    std::vector<Column<std::uint32_t>> values;
+    std::vector<std::size_t> garbage;
+    PropertyDictionary::RefColumn dictionary;
+
+    explicit CompactedStorage(const Database& from)
+        : credentials(from.credentialTypes()), lists(from.propertyTypes()), values(from.propertyTypes()), garbage(from.propertyTypes(), 0) {}
+
+    // Copies accounts [first, end) of `from`, the ones already copied are replaced (their old copy becomes garbage).
+    void copyAccounts(const Database& from, std::size_t first, std::size_t end) {
+        for (std::size_t t = 0; t < credentials.size(); t++) {
+            for (std::size_t j = first; j < end; j++) {
+                // credentials in the page file stay there, only the ref is copied
+                StringRef ref = from.credentials[t][j];
+                if (!PageFile::isCold(ref))
+                    ref = strings.append(from.credential(t, j));
+                if (j < credentials[t].size()) {
+                    if (!PageFile::isCold(credentials[t][j]))
+                        strings.release(credentials[t][j]);
+                    credentials[t].set(j, ref);
+                } else {
+                    credentials[t].push_back(ref);
+                }
+            }
+        }
+        for (std::size_t p = 0; p < lists.size(); p++) {
+            const PropertyColumn& column = from.properties[p];
+            for (std::size_t j = first; j < end; j++) {
+                PropertyList list = column.lists[j];
+                PropertyList packed{static_cast<std::uint32_t>(values[p].size()), list.count};
+                for (std::uint32_t k = 0; k < list.count; k++)
+                    values[p].push_back(column.values[list.begin + k]);
+                if (j < lists[p].size()) {
+                    garbage[p] += lists[p][j].count;
+                    lists[p].set(j, packed);
+                } else {
+                    lists[p].push_back(packed);
+                }
+            }
+        }
+    }
+
+    // Copies the strings of dictionary ids [dictionary.size(), from.dictionary.size()).
+    void copyValues(const Database& from) {
+        for (std::size_t id = dictionary.size(); id < from.dictionary.size(); id++)
+            dictionary.push_back(strings.append(from.strings.view(from.dictionary.ref(static_cast<std::uint32_t>(id)))));
+    }
+
+    // Swaps the copy into db. The old string arena is left in `strings`, so the caller decides when it is freed.
+    void install(Database& db) {
+        std::swap(db.strings, strings);
+        for (std::size_t t = 0; t < credentials.size(); t++)
+            db.credentials[t] = std::move(credentials[t]);
+        for (std::size_t p = 0; p < lists.size(); p++) {
+            db.properties[p].lists = std::move(lists[p]);
+            db.properties[p].values = std::move(values[p]);
+            db.properties[p].garbage = garbage[p];
+        }
+        db.dictionary.replaceRefs(std::move(dictionary));
+        // the used up front of the free list goes too
+        Column<std::uint32_t> freeAccounts;
+        for (std::size_t i = db.freeHead; i < db.freeAccounts.size(); i++)
+            freeAccounts.push_back(db.freeAccounts[i]);
+        db.freeAccounts = std::move(freeAccounts);
+        db.freeHead = 0;
+    }
+};
+
+// Result of a compaction (see easyAuth::compact()).
+struct CompactionStats {
+    bool ran = false;                  // false if there was nothing to compact or it was cancelled by a load
+    double seconds = 0;
+    double pauseSeconds = 0;           // how long reads and writes were blocked to swap the copy in
+    std::size_t garbageBytesBefore = 0;
+    std::size_t garbageBytesAfter = 0; // what writers left behind while the copy was being made
+    std::size_t memoryBefore = 0;      // Database::memoryUsage()
+    std::size_t memoryAfter = 0;
+    std::size_t deletedAccounts = 0;   // tombstones at the time, they keep their slot and are reused by new accounts
+};
+
+// Open addressing hash table that maps a username to its account number.
+// Slots only hold the account number and the low 32 bits of the hash, the username itself
+// is read back from the database when a hash matches, so usernames are not stored twice.
+// easyAuth splits its usernames over several of these by partition() so each one can have its own lock.
+class UsernameIndex {
+ public:
+    struct Slot {
+        std::uint32_t hash;
+        std::int32_t accountNumber; // -1 = empty slot
+    };
+
+    // 32 KiB blocks, easyAuth keeps many small indexes
+    using SlotColumn = Column<Slot, 12>;
+
+ private:
+    static const std::size_t kUnknownCount = static_cast<std::size_t>(-1);
+
+    SlotColumn slots;
+    std::size_t count = 0; // kUnknownCount for an adopted table until something needs it
+    UsernameFilter filter; // empty unless enableFilter()
+    std::size_t staleNames = 0; // names erased since the filter was built, they still pass it
+
+    std::size_t countSlots() const {
+        std::size_t used = 0;
+        slots.forEachBlock([&](const Slot* block, std::size_t length) {
+            for (std::size_t i = 0; i < length; i++)
+                used += block[i].accountNumber >= 0;
+        });
+        return used;
+    }
+
+    std::size_t mask() const {
+        return slots.size() - 1;
+    }
+
+    void buildFilter() {
+        if (count == kUnknownCount)
+            count = countSlots();
+        filter.reset(count * 2);
+        slots.forEachBlock([&](const Slot* block, std::size_t length) {
+            for (std::size_t i = 0; i < length; i++) {
+                if (block[i].accountNumber >= 0)
+                    filter.add(block[i].hash);
+            }
+        });
+        staleNames = 0;
+    }
+
+    // The slot position only depends on the stored hash, so growing never has to read a username.
+    void grow() {
+        rehash(slots.empty() ? 16 : slots.size() * 2);
+    }
+
+    void rehash(std::size_t capacity) {
+        SlotColumn oldSlots = std::move(slots);
+        slots.clear();
+        slots.resize(capacity, Slot{0, -1});
+        for (std::size_t i = 0; i < oldSlots.size(); i++) {
+            const Slot& slot = oldSlots[i];
+            if (slot.accountNumber < 0)
+                continue;
+            std::size_t pos = slot.hash & mask();
+            while (slots[pos].accountNumber >= 0)
+                pos = (pos + 1) & mask();
+            slots.set(pos, slot);
+        }
+    }
+
+    // Returns the slot holding username, or the empty slot where it would be inserted.
+    std::size_t findSlot(std::string_view username, std::uint32_t hash, const Database& db) const {
+        std::size_t pos = hash & mask();
+        while (slots[pos].accountNumber >= 0) {
+            if (slots[pos].hash == hash && db.credential(0, slots[pos].accountNumber) == username)
+                return pos;
+            pos = (pos + 1) & mask();
+        }
+        return pos;
+    }
+
+ public:
+    // Keeps the filter on if it was, just empty.
+    void clear() {
+        slots.clear();
+        count = 0;
+        if (!filter.empty())
+            filter.reset(0);
+        staleNames = 0;
+    }
+
+    std::size_t size() const {
+        return count == kUnknownCount ? countSlots() : count;
+    }
+
+    static std::uint32_t hashUsername(std::string_view username) {
+        return hashString(username);
+    }
+
+    // Which of `partitions` indexes username belongs to. Uses the high bits of the hash, the slot position uses the low ones.
+    static std::size_t partition(std::string_view username, std::size_t partitions) {
+        return partitionOfHash(hashUsername(username), partitions);
+    }
+
+    static std::size_t partitionOfHash(std::uint32_t hash, std::size_t partitions) {
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * partitions) >> 32);
+    }
+
+    // Returns the account number of username, or -1 if it is not indexed.
+    int find(std::string_view username, const Database& db) const {
+        if (slots.empty())
+            return -1;
+        std::uint32_t hash = hashUsername(username);
+        if (!filter.empty() && !filter.mayContain(hash))
+            return -1;
+        return slots[findSlot(username, hash, db)].accountNumber;
+    }
+
+    // Hints the cpu to load the slot a username with this hash starts probing at, for bulk inserts.
+    void prefetch(std::uint32_t hash) const {
+#if defined(__GNUC__)
+        if (!slots.empty())
+            __builtin_prefetch(&slots[hash & mask()]);
+#else
+        (void)hash;
+#endif
+    }
+
+    // Indexes the username of accountNumber. Returns false (and changes nothing) if the username is already indexed.
+    bool insert(int accountNumber, const Database& db) {
+        return insert(accountNumber, db.credential(0, accountNumber), db);
+    }
+
+    // Same, but only the usernames already indexed are read from db, so accountNumber can be added to db afterwards
+    // (e.g. only if this returns true).
+    bool insert(int accountNumber, std::string_view username, const Database& db) {
+        if (count == kUnknownCount)
+            count = countSlots();
+        // keep the load factor under 0.5 so probe sequences stay short
+        if ((count + 1) * 2 > slots.size())
+            grow();
+        std::uint32_t hash = hashUsername(username);
+        std::size_t pos = findSlot(username, hash, db);
+        if (slots[pos].accountNumber >= 0)
+            return false;
+        slots.set(pos, Slot{hash, accountNumber});
+        count++;
+        if (!filter.empty()) {
+            if (count + staleNames > filter.capacity())
+                buildFilter();
+            else
+                filter.add(hash);
+        }
+        return true;
+    }
+
+    // Removes username from the index. The username must still be readable at its account number.
+    void erase(std::string_view username, const Database& db) {
+        if (slots.empty())
+            return;
+        std::size_t pos = findSlot(username, hashUsername(username), db);
+        if (slots[pos].accountNumber < 0)
+            return;
+        if (count == kUnknownCount)
+            count = countSlots();
+        // backward shift deletion, moves later entries of the probe sequence into the hole
+        std::size_t next = (pos + 1) & mask();
+        while (slots[next].accountNumber >= 0) {
+            std::size_t home = slots[next].hash & mask();
+            if (((next - home) & mask()) >= ((next - pos) & mask())) {
+                slots.set(pos, slots[next]);
+                pos = next;
+            }
+            next = (next + 1) & mask();
+        }
+        slots.set(pos, Slot{0, -1});
+        count--;
+        // the erased name still passes the filter, once they pile up rebuild it so unknown names keep being rejected
+        if (!filter.empty() && ++staleNames > filter.capacity() / 4)
+            buildFilter();
+    }
+
+    // Sizes the index for `entries` usernames in total, so inserting up to that many never has to grow it.
+    void reserve(std::size_t entries) {
+        std::size_t capacity = 16;
+        while (capacity < entries * 2)
+            capacity *= 2;
+        if (capacity > slots.size()) {
+            if (count == kUnknownCount)
+                count = countSlots();
+            rehash(capacity);
+        }
+    }
+
+    // Uses a slot table saved by saveDatabase in place. Returns false if it doesnt look like one.
+    // The number of entries is counted the first time it is needed, so adopting doesnt read the whole table.
+    bool adopt(Slot* data, std::size_t capacity, std::shared_ptr<void> owner) {
+        if (capacity < 16 || (capacity & (capacity - 1)) != 0)
+            return false;
+        slots.adopt(data, capacity, owner);
+        count = kUnknownCount;
+        return true;
+    }
+
+    const SlotColumn& table() const {
+        return slots;
+    }
+
+    // Turns on the filter in front of find(), built from the stored hashes (no username is read).
+    // It is sized for twice the current names and rebuilt when it fills up or too many of its names were erased.
+    void enableFilter() {
+        buildFilter();
+    }
+
+    void disableFilter() {
+        filter.clear();
+        staleNames = 0;
+    }
+
+    bool hasFilter() const {
+        return !filter.empty();
+    }
+
+    // Uses a filter saved by saveDatabase in place. Returns false if it doesnt look like one.
+    bool adoptFilter(std::uint64_t* data, std::size_t words, std::shared_ptr<void> owner) {
+        staleNames = 0;
+        return filter.adopt(data, words, std::move(owner));
+    }
+
+    const UsernameFilter& usernameFilter() const {
+        return filter;
+    }
+
+    // Writes a fresh filter for the names in `index` to `out`, `words` whole blocks of it. Unlike the live filter
+    // it has no erased names in it.
+    static void writeFilter(const UsernameIndex& index, std::uint64_t* out, std::size_t words) {
+        std::fill(out, out + words, std::uint64_t(0));
+        index.slots.forEachBlock([&](const Slot* block, std::size_t length) {
+            for (std::size_t i = 0; i < length; i++) {
+                if (block[i].accountNumber >= 0)
+                    UsernameFilter::add(out, words, block[i].hash);
+            }
+        });
+    }
+
+    // The view has no filter, it is only used to save the slots (which writes a fresh filter anyway).
+    UsernameIndex share() const {
+        UsernameIndex view;
+        view.slots = slots.share();
+        view.count = count;
+        return view;
+    }
+
+    std::size_t retiredBytes() const {
+        return slots.retiredBytes();
+    }
+
+    void releaseRetired() {
+        slots.releaseRetired();
+    }
+
+    std::size_t memoryUsage() const {
+        return slots.memoryUsage() + filter.memoryUsage();
+    }
+};
+
+// Property value -> accounts that have it: one AccountSet per property type and dictionary id.
+// It is built from the accounts the first time it is needed and from then on updated by every property change,
+// so a server that never queries it doesnt pay for it at startup. Whatever renumbers accounts or ids (deleting an
+// account, loading, encrypting) just drops it with reset().
+class PropertyValueIndex {
+ public:
+    bool isBuilt() const {
+        return built;
+    }
+
+    void reset() {
+        sets.clear();
+        built = false;
+    }
+
+    void build(const Database& db) {
+        reset();
+        sets.resize(db.propertyTypes());
+        std::size_t accountCount = db.accountCount();
+        // accounts in ascending order, so every insert is an append
+        for (std::size_t p = 0; p < db.propertyTypes(); p++) {
+            sets[p].resize(db.dictionary.size());
+            for (std::size_t account = 0; account < accountCount; account++) {
+                std::size_t count = db.propertyCount(p, account);
+                for (std::size_t k = 0; k < count; k++)
+                    sets[p][db.propertyId(p, account, k)].insert(static_cast<std::uint32_t>(account));
+            }
+        }
+        built = true;
+    }
+
+    void add(std::size_t propertyIndex, std::size_t accountNumber, std::uint32_t id) {
+        std::vector<AccountSet>& byId = sets[propertyIndex];
+        if (id >= byId.size())
+            byId.resize(static_cast<std::size_t>(id) + 1);
+        byId[id].insert(static_cast<std::uint32_t>(accountNumber));
+    }
+
+    void remove(std::size_t propertyIndex, std::size_t accountNumber, std::uint32_t id) {
+        std::vector<AccountSet>& byId = sets[propertyIndex];
+        if (id < byId.size())
+            byId[id].erase(static_cast<std::uint32_t>(accountNumber));
+    }
+
+    // Empty for ids nobody has (kNotFound included).
+    const AccountSet& accounts(std::size_t propertyIndex, std::uint32_t id) const {
+        static const AccountSet none;
+        const std::vector<AccountSet>& byId = sets[propertyIndex];
+        return id < byId.size() ? byId[id] : none;
+    }
+
+    std::size_t memoryUsage() const {
+        std::size_t bytes = 0;
+        for (const auto &byId : sets) {
+            bytes += byId.capacity() * sizeof(AccountSet);
+            for (const auto &set : byId)
+                bytes += set.memoryUsage();
+        }
+        return bytes;
+    }
+
+ private:
+    bool built = false;
+    std::vector<std::vector<AccountSet>> sets; // [propertyIndex][dictionary id]
+};
+
+// Read-only view of the whole database at one point in time, see easyAuth::getSnapshot().
+struct DatabaseSnapshot {
+    Database data;
+    std::uint64_t version = 0; // easyAuth::getVersion() when it was taken
+};
+
+// Result of a database snapshot (see easyAuth::startSnapshot).
+struct SnapshotStats {
+    bool ok = false;
+    std::string error;
+    double seconds = 0;                // from capturing the view until the file was in place
+    std::uint64_t bytesWritten = 0;
+    std::size_t extraMemoryBytes = 0;  // old blocks the snapshot kept alive because writers changed them meanwhile
+    std::uint64_t lsn = 0;             // journal lsn the snapshot contains
+};
+
+// Result of easyAuth::importAccounts().
+struct ImportStats {
+    std::size_t added = 0;
+    std::size_t duplicates = 0; // username already taken, by an existing account or earlier in the batch
+    std::size_t invalid = 0;    // empty username or password
+    double seconds = 0;
+    double hashSeconds = 0;     // part of seconds spent hashing plaintext passwords
+};
+
+// Result of easyAuth::getTieredStorageStats().
+struct TieredStorageStats {
+    bool enabled = false;
+    std::size_t memoryBudget = 0;
+    std::size_t residentBytes = 0;      // string bytes in memory that count against the budget
+    std::size_t coldAccounts = 0;       // accounts whose credentials are in the page file
+    std::uint64_t promotions = 0;       // cold accounts brought back into memory because they were used
+    std::uint64_t evictions = 0;        // accounts moved to the page file
+    std::uint64_t pageFileBytes = 0;
+    std::uint64_t pageFileGarbage = 0;  // records nothing points at anymore, dropped when the database is loaded again
+    std::string lastError;              // last error of the tiering thread, empty if there was none
+};
+
+// A property value registered with easyAuth::registerValue(), for hasKnownProperty().
+struct KnownValue {
+    std::size_t index = 0;
+};
+
+// Bytes easyAuth has allocated, by component. See easyAuth::getStats().
+struct MemoryStats {
+    std::size_t strings = 0;        // the string arena (usernames, password records, property values), unused space included
+    std::size_t garbage = 0;        // bytes of strings and property runs nothing points at anymore, see compact()
+    std::size_t credentials = 0;    // a StringRef per account and credential type
+    std::size_t properties = 0;     // property lists, value runs and masks
+    std::size_t dictionary = 0;
+    std::size_t tombstones = 0;     // the deleted account numbers waiting to be reused
+    std::size_t usernameIndex = 0;  // username filters included
+    std::size_t valueIndex = 0;     // property value -> accounts, 0 until a property query builds it
+    std::size_t sessions = 0;
+    std::size_t replicationLog = 0;
+    std::size_t tiering = 0;        // access bits and the cold copies of promoted accounts, the page file is on disk
+
+    // garbage is part of strings and properties
+    std::size_t total() const {
+        return strings + credentials + properties + dictionary + tombstones + usernameIndex + valueIndex + sessions +
+               replicationLog + tiering;
+    }
+};
+
+// Result of easyAuth::getStats().
+struct AuthStats {
+    std::size_t accounts = 0;       // live accounts
+    std::size_t tombstones = 0;     // deleted accounts whose number isnt reused yet
+    std::size_t coldAccounts = 0;   // in the page file, see enableTieredStorage()
+    std::size_t sessions = 0;
+    std::uint64_t version = 0;
+    MemoryStats memory;
+    OperationTotals operations[OperationStats::kOperations]; // by OperationStats::Operation, since the start
+
+    void merge(const AuthStats& other) {
+        accounts += other.accounts;
+        tombstones += other.tombstones;
+        coldAccounts += other.coldAccounts;
+        sessions += other.sessions;
+        version += other.version;
+        MemoryStats& m = memory;
+        const MemoryStats& o = other.memory;
+        m.strings += o.strings;
+        m.garbage += o.garbage;
+        m.credentials += o.credentials;
+        m.properties += o.properties;
+        m.dictionary += o.dictionary;
+        m.tombstones += o.tombstones;
+        m.usernameIndex += o.usernameIndex;
+        m.valueIndex += o.valueIndex;
+        m.sessions += o.sessions;
+        m.replicationLog += o.replicationLog;
+        m.tiering += o.tiering;
+        for (std::size_t i = 0; i < OperationStats::kOperations; i++)
+            operations[i].merge(other.operations[i]);
+    }
+};
+
+class easyAuth {
+ private:
+    // Locking: usernames are split over kIndexPartitions indexes and accounts over kLockStripes stripes
+    // (accountNumber % kLockStripes), each with its own reader/writer lock, so readers of different users never touch
+    // the same lock. Writers also hold writeMutex because the arena and the columns are appended to by everyone.
+    //   reading an account:   account stripe (shared)
+    //   login / name lookup:  index partition (shared), then the account stripe (shared)
+    //   changing an account:  writeMutex, index partitions of the old and new username if it changes, account stripe
+    //   add account:          writeMutex, index partition
+    //   everything else (delete, load, encrypt, initialize): all of them, see AllLocked
+    // Locks are always taken in that order (writeMutex, partitions ascending, stripes ascending).
+    // valueIndexLock guards valueIndex (property value -> accounts): queries take it shared, writers take it alone
+    // to update it after changing an account, with writeMutex held.
+    // dictionaryLock comes last and is only held for a moment: readers take it shared to look a property value up
+    // in the dictionary, the writer takes it alone to add a value (see internValue()).
+    // sessions has its own lock, taken after any of these: a session is started with the account stripe held
+    // (shared) and the sessions of an account are ended while changing or deleting it. So does replicationLog, it is
+    // appended to with writeMutex held.
+    static const std::size_t kIndexPartitions = 64;
+    static const std::size_t kLockStripes = 64;
+
+    // padded to a cache line so threads on neighbouring stripes dont slow each other down
+    struct alignas(64) LockStripe {
+        std::shared_mutex lock;
+    };
+
+    Database db;
+    std::vector<UsernameIndex> usernameIndex = std::vector<UsernameIndex>(kIndexPartitions);
+    mutable LockStripe indexLocks[kIndexPartitions];
+    mutable LockStripe accountLocks[kLockStripes];
+    PropertyValueIndex valueIndex;
+    mutable std::shared_mutex valueIndexLock;
+    mutable std::shared_mutex dictionaryLock;
+    // Values from registerValue() and their dictionary ids (kNotFound while no account has had one). An id only changes
+    // with every lock held, or when the writer adds the value to the dictionary, so readers dont need dictionaryLock.
+    static const std::size_t kMaxKnownValues = 64;
+    std::vector<std::string> knownValues;
+    std::atomic<std::uint32_t> knownIds[kMaxKnownValues] = {};
+    std::mutex writeMutex;
+    std::atomic<std::size_t> accounts{0}; // account count readers may rely on, set once a new account is complete
+    int numberOfProperties;
+    std::string mappedFilename; // file the database is currently mapped from, if any
+    bool decryptedOnLoad = false; // the loaded file had FLAG_ENCRYPTED_STRINGS
+
+    Journal journal;
+    std::uint64_t snapshotLsn = 0; // journal lsn the loaded/saved database file contains
+    bool replaying = false;
+    bool journalSync = true;
+
+    std::atomic<std::uint64_t> version{0}; // bumped by every change, with writeMutex held
+    std::weak_ptr<const DatabaseSnapshot> latestSnapshot; // handed out by getSnapshot(), guarded by writeMutex
+
+    // Lets a DatabaseSnapshot that outlives its easyAuth know it is gone.
+    struct SnapshotOwner {
+        explicit SnapshotOwner(easyAuth* auth) : auth(auth) {}
+        std::mutex mutex;
+        easyAuth* auth;
+    };
+    std::shared_ptr<SnapshotOwner> snapshotOwner = std::make_shared<SnapshotOwner>(this);
+
+    std::mutex snapshotMutex; // snapshotThread and lastSnapshot
+    std::thread snapshotThread;
+    std::atomic<bool> snapshotRunning{false};
+    SnapshotStats lastSnapshot;
+
+    // compaction, see compact() and startCompactor()
+    static constexpr std::chrono::milliseconds kCompactorInterval{1000}; // how often the compactor checks the garbage
+    std::mutex compactionMutex; // one compaction at a time, loads and encryption wait for it. Taken before writeMutex
+    bool compactionActive = false; // guarded by writeMutex: while set, writers note the accounts they change
+    std::vector<std::uint32_t> compactionDirty;
+    CompactionStats lastCompaction; // guarded by compactionMutex
+    std::mutex compactorMutex; // the fields below
+    std::condition_variable compactorWake;
+    std::thread compactorThread;
+    bool compactorStop = false;
+    double compactionThreshold = 0;
+    std::size_t compactionMinBytes = 0;
+
+    // password hashing, see setPasswordHashCost() and configureHashing()
+    std::atomic<std::uint32_t> passwordHashCost{PasswordHash::kDefaultIterations};
+    std::atomic<std::int64_t> hashQueueWaitMs{500}; // how long a login waits for room in a full queue
+    std::atomic<bool> usernameFilterEnabled{false}; // changed with writeMutex held, see enableUsernameFilter()
+    std::mutex dummyRecordMutex;
+    std::string dummyRecord; // hashed against for usernames that dont exist, so they take as long as wrong passwords
+    SessionTable sessions;
+    ReplicationLog replicationLog; // see startReplicationLog()
+    std::atomic<bool> readOnly{false}; // see setReadOnly()
+    std::atomic<std::thread::id> replicaApplier{}; // the thread in applyReplicated(), the only one a read-only database lets write
+    std::uint64_t replicatingLsn = 0;              // lsn of the record it is applying, only touched by that thread
+
+    // tiered storage, see enableTieredStorage()
+    static constexpr std::chrono::milliseconds kTieringInterval{100};        // how often the budget is checked
+    static constexpr std::chrono::milliseconds kDropResidentInterval{10000}; // how often the page file leaves the working set
+    static const std::size_t kTieringBatch = 4096;   // accounts moved per writeMutex hold
+    static const std::size_t kMaxPromoteQueue = 65536;
+    std::atomic<bool> tiered{false}; // changed with every lock held, or writeMutex while enabling
+    std::string pageFilename;        // the fields below are guarded by writeMutex
+    std::size_t memoryBudget = 0;
+    std::size_t pageFileCount = 0;   // page files made so far, every one gets its own name
+    AccessClock accessClock;         // sized in publishAccountCount(), bits are set by readers with a stripe held
+    std::size_t clockHand = 0;       // next account the eviction sweep looks at
+    // the records a promoted account was read from, so it can go back without writing them again if it doesnt change
+    std::unordered_map<std::uint32_t, std::vector<StringRef>> coldCopies;
+    std::uint64_t promotions = 0;
+    std::uint64_t evictions = 0;
+    std::string tieringError;
+    std::mutex tieringMutex; // the fields below
+    std::condition_variable tieringWake;
+    std::thread tieringThread;
+    bool tieringStop = false;
+    std::vector<std::uint32_t> promoteQueue; // cold accounts readers just used
+    mutable OperationStats operationStats; // see getStats()
+    // declared after everything its jobs use, so it is destroyed (and its threads joined) first
+    HashPool hashPool;
+
+    enum JournalOp : std::uint8_t {
+        JOURNAL_ADD_CREDENTIALS = 1,
+        JOURNAL_EDIT_CREDENTIALS = 2,
+        JOURNAL_DELETE_CREDENTIALS = 3, // before 5.0, a delete that shifted the later account numbers
+        JOURNAL_ADD_PROPERTY = 4,
+        JOURNAL_EDIT_PROPERTY = 5,
+        JOURNAL_DELETE_PROPERTY = 6,
+        JOURNAL_DELETE_ACCOUNT = 7, // a delete that leaves a tombstone
+    };
+
+    // Appends a mutation that was just applied to the journal (if one is open) and returns its lsn, 0 if it wasnt logged.
+    // Called with writeMutex held so the journal order is the order the changes were applied in.
+    // A record from applyReplicated() isnt logged, its lsn becomes the one the database contains instead, in the same
+    // critical section as the change so a snapshot always has both or neither.
+    std::uint64_t logMutation(const JournalWriter& record) {
+        if (replicaApplier.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+            snapshotLsn = replicatingLsn;
+            return 0;
+        }
+        if (replaying || !journal.isOpen())
+            return 0;
+        std::uint64_t lsn = journal.append(record.str());
+        replicationLog.append(lsn, record.str());
+        return lsn;
+    }
+
+    // Journal lsn of the newest change the database has. Called with writeMutex held.
+    std::uint64_t currentLsn() {
+        return journal.isOpen() ? journal.lastLsn() : snapshotLsn;
+    }
+
+    // Throws for changes to a read-only database (a replica), unless they come from applyReplicated().
+    void checkWritable() const {
+        if (readOnly.load(std::memory_order_relaxed) && replicaApplier.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+            throw std::runtime_error("Database is read-only");
+        }
+    }
+
+    // Waits for a record from logMutation() to be on disk. Called after the locks are released, so writers that
+    // are waiting for their fsync dont block everyone else and can share one flush.
+    void waitDurable(std::uint64_t lsn) {
+        if (lsn != 0 && journalSync)
+            journal.waitDurable(lsn);
+    }
+
+    void applyJournalRecord(JournalReader& record) {
+        std::uint8_t op = record.getU8();
+        switch (op) {
+            case JOURNAL_ADD_CREDENTIALS: {
+                std::string username = record.getString();
+                std::string password = record.getString(); // a hash record, or plaintext from before 5.1
+                addHashedCredentials(username, password);
+                break;
+            }
+            case JOURNAL_EDIT_CREDENTIALS: {
+                int accountNumber = static_cast<int>(record.getU32());
+                std::string username = record.getString();
+                std::string password = record.getString();
+                editHashedCredentials(accountNumber, username, password);
+                break;
+            }
+            case JOURNAL_DELETE_CREDENTIALS:
+                // the records after it use the shifted account numbers, replaying them here would change the wrong accounts
+                throw std::runtime_error("Journal has a delete from before version 5.0, replay it with that version and save first");
+            case JOURNAL_DELETE_ACCOUNT:
+                deleteCredentials(static_cast<int>(record.getU32()));
+                break;
+            case JOURNAL_ADD_PROPERTY: {
+                int accountNumber = static_cast<int>(record.getU32());
+                std::size_t propertyIndex = record.getU32();
+                addProperty(accountNumber, propertyIndex, record.getString());
+                break;
+            }
+            case JOURNAL_EDIT_PROPERTY: {
+                int accountNumber = static_cast<int>(record.getU32());
+                std::size_t propertyIndex = record.getU32();
+                std::size_t propertyNumber = record.getU32();
+                editProperty(accountNumber, propertyIndex, propertyNumber, record.getString());
+                break;
+            }
+            case JOURNAL_DELETE_PROPERTY: {
+                int accountNumber = static_cast<int>(record.getU32());
+                std::size_t propertyIndex = record.getU32();
+                deleteProperty(accountNumber, propertyIndex, record.getU32());
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown journal record type");
+        }
+    }
+
+    // Holds every lock, for changes that touch all accounts at once.
+    class AllLocked {
+     public:
+        explicit AllLocked(easyAuth& auth) : auth(auth) {
+            auth.writeMutex.lock();
+            for (auto &stripe : auth.indexLocks)
+                stripe.lock.lock();
+            for (auto &stripe : auth.accountLocks)
+                stripe.lock.lock();
+            auth.valueIndexLock.lock();
+            auth.dictionaryLock.lock();
+        }
+
+        ~AllLocked() {
+            auth.dictionaryLock.unlock();
+            auth.valueIndexLock.unlock();
+            for (auto &stripe : auth.accountLocks)
+                stripe.lock.unlock();
+            for (auto &stripe : auth.indexLocks)
+                stripe.lock.unlock();
+            auth.writeMutex.unlock();
+        }
+
+        AllLocked(const AllLocked&) = delete;
+        AllLocked& operator=(const AllLocked&) = delete;
+
+     private:
+        easyAuth& auth;
+    };
+
+    // Dictionary id of a property value, added if it is new. Only called by the writer (writeMutex held): nobody else
+    // changes the dictionary, so looking up needs no lock and only adding a value has to keep readers out.
+    std::uint32_t internValue(std::string_view value) {
+        std::uint32_t id = db.dictionary.find(value, db.strings);
+        if (id == PropertyDictionary::kNotFound) {
+            std::unique_lock<std::shared_mutex> dictionaryGuard(dictionaryLock);
+            id = db.dictionary.intern(value, db.strings);
+            for (std::size_t i = 0; i < knownValues.size(); i++) {
+                if (knownValues[i] == value)
+                    knownIds[i] = id;
+            }
+        }
+        return id;
+    }
+
+    // Looks the registered values up again after the dictionary was replaced. Every lock is held.
+    void refreshKnownValues() {
+        for (std::size_t i = 0; i < knownValues.size(); i++)
+            knownIds[i] = db.dictionary.find(knownValues[i], db.strings);
+    }
+
+    // Dictionary id of a property value for readers, kNotFound if no account has ever had it.
+    std::uint32_t findValue(std::string_view value) const {
+        std::shared_lock<std::shared_mutex> dictionaryGuard(dictionaryLock);
+        return db.dictionary.find(value, db.strings);
+    }
+
+    // Called by writers (writeMutex held) for every existing account they change, so a running compaction copies it again.
+    void markChanged(int accountNumber) {
+        if (compactionActive)
+            compactionDirty.push_back(static_cast<std::uint32_t>(accountNumber));
+    }
+
+    // Called by writers (writeMutex held) that changed an account's credentials: the page file records it was promoted
+    // from are out of date, and with tiered storage on the account counts as used.
+    void credentialsChanged(int accountNumber) {
+        auto copy = coldCopies.find(static_cast<std::uint32_t>(accountNumber));
+        if (copy != coldCopies.end()) {
+            for (StringRef ref : copy->second)
+                db.cold->release(ref);
+            coldCopies.erase(copy);
+        }
+        if (tiered.load(std::memory_order_relaxed))
+            accessClock.touch(static_cast<std::size_t>(accountNumber));
+    }
+
+    // Called by readers with the account's stripe held. A cold account that wasnt used since the eviction sweep last
+    // passed it is queued for the tiering thread to bring back into memory, the reader itself reads the page file.
+    void noteAccess(int accountNumber) {
+        if (!tiered.load(std::memory_order_acquire) || !accessClock.touch(static_cast<std::size_t>(accountNumber)) ||
+            !db.isCold(accountNumber))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(tieringMutex);
+        if (promoteQueue.size() < kMaxPromoteQueue)
+            promoteQueue.push_back(static_cast<std::uint32_t>(accountNumber));
+        tieringWake.notify_one();
+    }
+
+    // Keep valueIndex up to date after the account's values for propertyIndex changed, called by the writer.
+    // Nothing to do while it isnt built, it is built from the accounts as they are then.
+    void indexValueAdded(std::size_t propertyIndex, int accountNumber, std::uint32_t id) {
+        if (!valueIndex.isBuilt())
+            return;
+        std::unique_lock<std::shared_mutex> valueGuard(valueIndexLock);
+        valueIndex.add(propertyIndex, accountNumber, id);
+    }
+
+    // The account can still have the value in another position, then it stays in the index.
+    void indexValueRemoved(std::size_t propertyIndex, int accountNumber, std::uint32_t id) {
+        if (!valueIndex.isBuilt() || db.hasPropertyId(propertyIndex, accountNumber, id))
+            return;
+        std::unique_lock<std::shared_mutex> valueGuard(valueIndexLock);
+        valueIndex.remove(propertyIndex, accountNumber, id);
+    }
+
+    // Returns valueIndexLock held shared, with valueIndex built. Building it needs writeMutex (nothing may change
+    // the accounts meanwhile), after that queries only ever take valueIndexLock.
+    std::shared_lock<std::shared_mutex> readValueIndex() {
+        std::shared_lock<std::shared_mutex> valueGuard(valueIndexLock);
+        while (!valueIndex.isBuilt()) {
+            valueGuard.unlock();
+            {
+                std::lock_guard<std::mutex> writeGuard(writeMutex);
+                std::unique_lock<std::shared_mutex> buildGuard(valueIndexLock);
+                if (!valueIndex.isBuilt())
+                    valueIndex.build(db);
+            }
+            valueGuard.lock(); // it can have been dropped again in between, hence the loop
+        }
+        return valueGuard;
+    }
+
+    std::size_t partitionOf(std::string_view username) const {
+        return UsernameIndex::partition(username, kIndexPartitions);
+    }
+
+    std::shared_mutex& indexLock(std::string_view username) const {
+        return indexLocks[partitionOf(username)].lock;
+    }
+
+    std::shared_mutex& accountLock(int accountNumber) const {
+        return accountLocks[static_cast<std::size_t>(accountNumber) % kLockStripes].lock;
+    }
+
+    // Call after the number of accounts changed, with the account fully written.
+    void publishAccountCount() {
+        if (tiered.load(std::memory_order_relaxed))
+            accessClock.resize(db.accountCount());
+        accounts.store(db.accountCount(), std::memory_order_release);
+    }
+
+    // Runs task(0) .. task(tasks - 1) on a thread per core (the calling one included), each thread takes the next task
+    // when it is done with one. The first exception a task throws is rethrown once they are all done.
+    template <typename F>
+    static void runParallel(std::size_t tasks, F task) {
+        std::size_t threads = (std::min)(tasks, static_cast<std::size_t>((std::max)(1u, std::thread::hardware_concurrency())));
+        std::atomic<std::size_t> next{0};
+        std::vector<std::exception_ptr> errors(threads);
+        auto run = [&](std::size_t thread) {
+            try {
+                for (std::size_t i = next++; i < tasks; i = next++)
+                    task(i);
+            } catch (...) {
+                errors[thread] = std::current_exception();
+                next = tasks;
+            }
+        };
+        std::vector<std::thread> workers;
+        for (std::size_t t = 1; t < threads; t++)
+            workers.emplace_back(run, t);
+        if (threads > 0)
+            run(0);
+        for (auto &worker : workers)
+            worker.join();
+        for (auto &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    // Rebuilds the username index from the database, on every core: the accounts are split into runs that sort their
+    // account numbers by partition, then every partition is filled by one thread, in account number order.
+    void rebuildIndex() {
+        const std::size_t kRun = 65536;
+        for (auto &index : usernameIndex) {
+            index.disableFilter(); // built once at the end instead of growing with every insert
+            index.clear();
+        }
+        std::size_t accountCount = db.credentials.empty() ? 0 : db.accountCount();
+        std::size_t runs = (accountCount + kRun - 1) / kRun;
+        std::vector<std::vector<std::vector<std::uint32_t>>> byPartition(runs); // [run][partition] account numbers
+        runParallel(runs, [&](std::size_t run) {
+            byPartition[run].resize(kIndexPartitions);
+            for (std::size_t i = run * kRun; i < (std::min)(accountCount, (run + 1) * kRun); i++) {
+                std::string_view username = db.credential(0, i);
+                if (!username.empty())
+                    byPartition[run][partitionOf(username)].push_back(static_cast<std::uint32_t>(i));
+            }
+        });
+        // empty usernames are skipped and for duplicates the first account wins, same as the old linear scan
+        auto fillPartition = [&](std::size_t partition) {
+            UsernameIndex& index = usernameIndex[partition];
+            std::size_t entries = 0;
+            for (const auto &run : byPartition)
+                entries += run[partition].size();
+            index.reserve(entries);
+            for (const auto &run : byPartition) {
+                for (std::uint32_t accountNumber : run[partition])
+                    index.insert(static_cast<int>(accountNumber), db);
+            }
+            if (usernameFilterEnabled)
+                index.enableFilter();
+        };
+        if (runs > 1) {
+            runParallel(kIndexPartitions, fillPartition);
+        } else {
+            for (std::size_t partition = 0; partition < kIndexPartitions; partition++)
+                fillPartition(partition);
+        }
+    }
+
+    bool isAccount(int accountNumber) const {
+        return accountNumber >= 0 && static_cast<std::size_t>(accountNumber) < accounts.load(std::memory_order_acquire);
+    }
+
+    bool isActiveAccount(int accountNumber) const {
+        return isAccount(accountNumber) && !db.isDeleted(accountNumber);
+    }
+
+    // The caller holds indexLock(username).
+    int findAccount(std::string_view username) const {
+        if (db.credentials.empty())
+            return -1;
+        return usernameIndex[partitionOf(username)].find(username, db);
+    }
+
+    // getAccountNumberOfUser() without counting it, for the calls easyAuth makes itself.
+    int lookupAccount(const std::string& username) const {
+        if (username.empty()) {
+            throw std::invalid_argument("Username cannot be empty");
+        }
+        std::shared_lock<std::shared_mutex> indexGuard(indexLock(username));
+        return findAccount(username);
+    }
+
+    std::chrono::milliseconds hashQueueWait() const {
+        return std::chrono::milliseconds(hashQueueWaitMs.load());
+    }
+
+    // Hashes a password on the pool with the current cost and returns the record to store.
+    std::string hashPassword(const std::string& password) {
+        std::uint32_t cost = passwordHashCost;
+        return hashPool.submitFor([password, cost] { return PasswordHash::hash(password, cost); }, hashQueueWait()).get();
+    }
+
+    // Runs on the pool. A record for a random password with the current cost, made once per cost.
+    std::string dummyRecordFor(std::uint32_t cost) {
+        std::lock_guard<std::mutex> guard(dummyRecordMutex);
+        if (PasswordHash::costOf(dummyRecord) != cost) {
+            unsigned char random[PasswordHash::kSaltBytes];
+            PasswordHash::randomSalt(random);
+            dummyRecord = PasswordHash::hash(PasswordHash::encode64(random, sizeof(random)), cost);
+        }
+        return dummyRecord;
+    }
+
+    // addCredentials() after hashing, and journal replay: `record` is stored as it is. Returns the new account number.
+    int addHashedCredentials(const std::string& username, const std::string& record) {
+        std::uint64_t lsn;
+        int accountNumber;
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            std::unique_lock<std::shared_mutex> indexGuard(indexLock(username));
+            // Check if username already exists
+            if (findAccount(username) >= 0) {
+                throw std::runtime_error("Username already exists");
+            }
+            // Add a new account and then set its credentials. Nobody can see a new slot before it is published, so that
+            // needs no stripe, but a reused one (a deleted account) can still be looked at
+            std::unique_lock<std::shared_mutex> accountGuard;
+            accountNumber = db.nextAccountNumber();
+            if (isAccount(accountNumber))
+                accountGuard = std::unique_lock<std::shared_mutex>(accountLock(accountNumber));
+            db.addAccount();
+            db.setCredential(0, accountNumber, username);
+            db.setCredential(1, accountNumber, record);
+            markChanged(accountNumber);
+            version++;
+            publishAccountCount();
+            usernameIndex[partitionOf(username)].insert(accountNumber, db);
+            credentialsChanged(accountNumber);
+            lsn = logMutation(JournalWriter().putU8(JOURNAL_ADD_CREDENTIALS).putString(username).putString(record));
+        }
+        waitDurable(lsn);
+        return accountNumber;
+    }
+
+    // editCredentials() after hashing, and journal replay.
+    void editHashedCredentials(int accountNumber, const std::string& username, const std::string& record) {
+        std::uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            if (!isActiveAccount(accountNumber)) {
+                throw std::runtime_error("Account not found");
+            }
+            // usernames only change with writeMutex held, so the old one can be read without the partition lock
+            std::string_view oldUsername = db.credential(0, accountNumber);
+            bool renamed = username != oldUsername;
+            std::size_t oldPartition = partitionOf(oldUsername);
+            std::size_t newPartition = partitionOf(username);
+            std::unique_lock<std::shared_mutex> firstGuard, secondGuard;
+            if (renamed) {
+                if (username.empty()) {
+                    throw std::invalid_argument("Username cannot be empty");
+                }
+                firstGuard = std::unique_lock<std::shared_mutex>(indexLocks[(std::min)(oldPartition, newPartition)].lock);
+                if (oldPartition != newPartition)
+                    secondGuard = std::unique_lock<std::shared_mutex>(indexLocks[(std::max)(oldPartition, newPartition)].lock);
+                int existing = findAccount(username);
+                if (existing >= 0 && existing != accountNumber) {
+                    throw std::runtime_error("Username already exists");
+                }
+            }
+            std::unique_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+            if (renamed) {
+                usernameIndex[oldPartition].erase(oldUsername, db);
+                db.setCredential(0, accountNumber, username);
+                usernameIndex[newPartition].insert(accountNumber, db);
+            }
+            db.setCredential(1, accountNumber, record);
+            sessions.removeAccount(accountNumber); // logged in with the old credentials
+            credentialsChanged(accountNumber);
+            markChanged(accountNumber);
+            version++;
+            lsn = logMutation(JournalWriter().putU8(JOURNAL_EDIT_CREDENTIALS).putU32(accountNumber).putString(username).putString(record));
+        }
+        waitDurable(lsn);
+    }
+
+    // Runs on the pool after a successful login with a record older than the current cost (or a plaintext password).
+    // Only replaces it if the account still has that record, a password change in the meantime wins. It isnt waited
+    // for in the journal: if it gets lost the next login upgrades it again.
+    void upgradePassword(int accountNumber, const std::string& username, const std::string& oldRecord, const std::string& newRecord) {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        if (!isActiveAccount(accountNumber) || db.credential(0, accountNumber) != username || db.credential(1, accountNumber) != oldRecord)
+            return;
+        std::unique_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        db.setCredential(1, accountNumber, newRecord);
+        credentialsChanged(accountNumber);
+        markChanged(accountNumber);
+        version++;
+        logMutation(JournalWriter().putU8(JOURNAL_EDIT_CREDENTIALS).putU32(accountNumber).putString(username).putString(newRecord));
+    }
+
+    // checkCredentialsAsync() and loginAsync(): the future holds onSuccess(accountNumber, stored record) if the
+    // password is right and Result() if not. `done` (if set) gets the same result once it is there, Result() if the
+    // check threw.
+    template <class Result, class OnSuccess>
+    std::future<Result> verifyCredentials(const std::string& username, const std::string& password, OnSuccess onSuccess,
+                                          std::function<void(const Result&)> done = nullptr) {
+        if (username.empty() || password.empty()) {
+            throw std::invalid_argument("Username and password cannot be empty");
+        }
+        auto started = std::chrono::steady_clock::now();
+        int accountNumber;
+        std::string stored; // copied, the job runs after the locks are gone
+        {
+            std::shared_lock<std::shared_mutex> indexGuard(indexLock(username));
+            accountNumber = findAccount(username);
+            if (accountNumber >= 0) {
+                std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+                stored = std::string(db.credential(1, accountNumber));
+                noteAccess(accountNumber);
+            }
+        }
+        if (accountNumber < 0 && usernameFilterEnabled) {
+            operationStats.record(OperationStats::LOGIN, std::chrono::steady_clock::now() - started);
+            std::promise<Result> unknown;
+            unknown.set_value(Result());
+            if (done)
+                done(Result());
+            return unknown.get_future();
+        }
+        std::uint32_t cost = passwordHashCost;
+        auto check = [this, accountNumber, username, password, stored, cost, onSuccess, started] {
+            OperationStats::Scope stat(operationStats, OperationStats::LOGIN, started);
+            if (accountNumber < 0) {
+                PasswordHash::verify(password, dummyRecordFor(cost));
+                return Result();
+            }
+            if (!PasswordHash::verify(password, stored))
+                return Result();
+            // before the upgrade, which changes the record onSuccess may check
+            Result result = onSuccess(accountNumber, stored);
+            // a replica leaves that to the primary, whose new record reaches it like any other change
+            if (PasswordHash::costOf(stored) < cost && !readOnly)
+                upgradePassword(accountNumber, username, stored, PasswordHash::hash(password, cost));
+            return result;
+        };
+        if (!done)
+            return hashPool.submitFor(check, hashQueueWait());
+        return hashPool.submitFor([check, done] {
+            Result result;
+            try {
+                result = check();
+            } catch (...) {
+                done(Result());
+                throw;
+            }
+            done(result);
+            return result;
+        }, hashQueueWait());
+    }
+
+    // Starts a session for a login that was checked against `record`, unless the account was deleted, renamed or got
+    // a new password since (those end its sessions, and with the stripe held that cant happen in between).
+    std::string startSession(int accountNumber, const std::string& username, const std::string& record) {
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        if (!isActiveAccount(accountNumber) || db.credential(0, accountNumber) != username || db.credential(1, accountNumber) != record)
+            return std::string();
+        return sessions.create(accountNumber);
+    }
+
+    void checkPropertyArgs(int accountNumber, std::size_t propertyIndex) const {
+        if (propertyIndex >= db.propertyTypes())
+            throw std::runtime_error("Property index out of range");
+        if (!isAccount(accountNumber))
+            throw std::runtime_error("Account not found");
+    }
+
+    void checkPropertyArgs(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber) const {
+        checkPropertyArgs(accountNumber, propertyIndex);
+        if (propertyNumber >= db.propertyCount(propertyIndex, accountNumber))
+            throw std::runtime_error("Property number out of range");
+    }
+
+    std::string encryptionKey() const {
+        return XOR_KEY.empty() ? "XOR_KEY_HERE" : XOR_KEY;
+    }
+
+    // Reads a size_t length followed by that many bytes straight into the arena.
+    static StringRef readString(std::ifstream& file, StringArena& strings) {
+        size_t strLen;
+        file.read(reinterpret_cast<char*>(&strLen), sizeof(strLen));
+        StringRef ref = strings.allocate(strLen);
+        file.read(strings.data(ref), strLen);
+        return ref;
+    }
+
+    static void writeString(std::ofstream& file, std::string_view s) {
+        size_t strLen = s.length();
+        file.write(reinterpret_cast<const char*>(&strLen), sizeof(strLen));
+        file.write(s.data(), strLen);
+    }
+
+    bool loadLegacyDatabase(const std::string& filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            // cant open file
+            return false;
+        }
+        mappedFilename.clear();
+        snapshotLsn = 0;
+
+        // Clear existing database.
+        db.clear();
+
+        // Load credentials
+        size_t credentialTypes;
+        file.read(reinterpret_cast<char*>(&credentialTypes), sizeof(credentialTypes));
+        db.credentials.resize(credentialTypes);
+        for (size_t i = 0; i < credentialTypes; i++) {
+            size_t numAccounts;
+            file.read(reinterpret_cast<char*>(&numAccounts), sizeof(numAccounts));
+            for (size_t j = 0; j < numAccounts; j++) {
+                db.credentials[i].push_back(readString(file, db.strings));
+            }
+        }
+
+        // Load properties
+        size_t propertyTypes;
+        file.read(reinterpret_cast<char*>(&propertyTypes), sizeof(propertyTypes));
+        db.properties.resize(propertyTypes);
+        for (size_t i = 0; i < propertyTypes; i++) {
+            PropertyColumn& column = db.properties[i];
+            size_t numAccounts;
+            file.read(reinterpret_cast<char*>(&numAccounts), sizeof(numAccounts));
+            for (size_t j = 0; j < numAccounts; j++) {
+                size_t numProperties;
+                file.read(reinterpret_cast<char*>(&numProperties), sizeof(numProperties));
+                column.lists.push_back(PropertyList{static_cast<std::uint32_t>(column.values.size()), static_cast<std::uint32_t>(numProperties)});
+                std::uint32_t mask = 0;
+                for (size_t k = 0; k < numProperties; k++) {
+                    std::uint32_t id = db.dictionary.internRef(readString(file, db.strings), db.strings);
+                    column.values.push_back(id);
+                    mask |= PropertyColumn::bit(id);
+                }
+                column.masks.push_back(mask);
+            }
+        }
+
+        file.close();
+        db.rebuildFreeAccounts();
+        publishAccountCount();
+        rebuildIndex();
+        return true;
+    }
+
+    // The dictionary ids in the order a saved file numbers them: by how often they are used over every property type,
+    // most used first, and without the values no account uses anymore. newId[old id] is the new one (kNotFound if dropped).
+    static std::vector<std::uint32_t> dictionaryByUse(const Database& source, std::vector<std::uint32_t>& newId) {
+        const PropertyDictionary& dictionary = source.dictionary;
+        std::vector<std::uint64_t> uses(dictionary.size(), 0);
+        for (std::size_t i = 0; i < source.propertyTypes(); i++) {
+            const PropertyColumn& column = source.properties[i];
+            for (std::size_t j = 0; j < source.accountCount(); j++) {
+                PropertyList list = column.lists[j];
+                for (std::uint32_t k = 0; k < list.count; k++)
+                    uses[column.values[list.begin + k]]++;
+            }
+        }
+        std::vector<std::uint32_t> byUse;
+        for (std::uint32_t id = 0; id < uses.size(); id++) {
+            if (uses[id] > 0)
+                byUse.push_back(id);
+        }
+        std::stable_sort(byUse.begin(), byUse.end(), [&](std::uint32_t a, std::uint32_t b) { return uses[a] > uses[b]; });
+        newId.assign(dictionary.size(), PropertyDictionary::kNotFound);
+        for (std::uint32_t id = 0; id < byUse.size(); id++)
+            newId[byUse[id]] = id;
+        return byUse;
+    }
+
+    // Writes `source` in the current format and returns the file size. If cipher is set the strings section is
+    // encrypted with it a buffer at a time as it is written, and the file gets FLAG_ENCRYPTED_STRINGS.
+    // The property dictionary is renumbered on the way out: the most used values get the smallest ids (and so the
+    // mask bits after a reload) and values no account uses anymore are left out.
+    // With usernameFilters every index partition also gets a freshly built UsernameFilter.
+    static std::uint64_t writeDatabaseFile(std::ofstream& file, const Database& source, const std::vector<UsernameIndex>& index,
+                                           std::uint64_t journalLsn, const Cipher::Keystream* cipher, bool usernameFilters) {
+        using namespace DatabaseFile;
+        std::size_t accounts = source.accountCount();
+        std::size_t credentialTypes = source.credentialTypes();
+        std::size_t propertyTypes = source.propertyTypes();
+
+        const PropertyDictionary& dictionary = source.dictionary;
+        std::vector<std::uint32_t> newId;
+        std::vector<std::uint32_t> byUse = dictionaryByUse(source, newId); // new id -> old id
+
+        std::vector<Section> sections;
+        std::size_t sectionCount = credentialTypes + propertyTypes * 3 + 2 + index.size() * (usernameFilters ? 2 : 1) + 2;
+        std::uint64_t position = alignUp(sizeof(Header) + sectionCount * sizeof(Section));
+        std::vector<char> zeros(kSectionAlignment, 0);
+
+        // starts a new section at the next aligned offset
+        auto beginSection = [&](std::uint32_t kind, std::uint32_t index, std::uint64_t count) {
+            file.seekp(static_cast<std::streamoff>(position));
+            sections.push_back(Section{kind, index, position, count});
+        };
+        auto endSection = [&](std::uint64_t bytes) {
+            std::uint64_t end = position + bytes;
+            position = alignUp(end);
+            file.write(zeros.data(), static_cast<std::streamsize>(position - end));
+        };
+
+        // strings are written packed in the same order their new refs are handed out, which also drops garbage
+        std::uint64_t stringBytes = 0;
+        auto packedRef = [&](StringRef ref) {
+            std::uint32_t length = PageFile::lengthOf(ref); // a cold credential is written like any other
+            StringRef packed{static_cast<std::uint32_t>(stringBytes), length};
+            stringBytes += length;
+            if (stringBytes > UINT32_MAX)
+                throw std::runtime_error("Database strings dont fit in 4 GiB");
+            return packed;
+        };
+
+        std::vector<StringRef> refBuffer;
+        auto flushRefs = [&]() {
+            file.write(reinterpret_cast<const char*>(refBuffer.data()), static_cast<std::streamsize>(refBuffer.size() * sizeof(StringRef)));
+            refBuffer.clear();
+        };
+
+        for (std::size_t i = 0; i < credentialTypes; i++) {
+            beginSection(SECTION_CREDENTIALS, static_cast<std::uint32_t>(i), accounts);
+            for (std::size_t j = 0; j < accounts; j++) {
+                refBuffer.push_back(packedRef(source.credentials[i][j]));
+                if (refBuffer.size() == 4096)
+                    flushRefs();
+            }
+            flushRefs();
+            endSection(accounts * sizeof(StringRef));
+        }
+
+        for (std::size_t i = 0; i < propertyTypes; i++) {
+            const PropertyColumn& column = source.properties[i];
+            std::vector<PropertyList> listBuffer;
+            std::uint32_t valueCount = 0;
+            beginSection(SECTION_PROPERTY_LISTS, static_cast<std::uint32_t>(i), accounts);
+            for (std::size_t j = 0; j < accounts; j++) {
+                PropertyList list = column.lists[j];
+                listBuffer.push_back(PropertyList{valueCount, list.count});
+                valueCount += list.count;
+                if (listBuffer.size() == 4096 || j + 1 == accounts) {
+                    file.write(reinterpret_cast<const char*>(listBuffer.data()), static_cast<std::streamsize>(listBuffer.size() * sizeof(PropertyList)));
+                    listBuffer.clear();
+                }
+            }
+            endSection(accounts * sizeof(PropertyList));
+
+            beginSection(SECTION_PROPERTY_VALUES, static_cast<std::uint32_t>(i), valueCount);
+            std::vector<std::uint32_t> idBuffer;
+            std::vector<std::uint32_t> masks;
+            masks.reserve(accounts);
+            auto flushIds = [&]() {
+                file.write(reinterpret_cast<const char*>(idBuffer.data()), static_cast<std::streamsize>(idBuffer.size() * sizeof(std::uint32_t)));
+                idBuffer.clear();
+            };
+            for (std::size_t j = 0; j < accounts; j++) {
+                PropertyList list = column.lists[j];
+                std::uint32_t mask = 0;
+                for (std::uint32_t k = 0; k < list.count; k++) {
+                    std::uint32_t id = newId[column.values[list.begin + k]];
+                    idBuffer.push_back(id);
+                    mask |= PropertyColumn::bit(id);
+                    if (idBuffer.size() == 4096)
+                        flushIds();
+                }
+                masks.push_back(mask);
+            }
+            flushIds();
+            endSection(static_cast<std::uint64_t>(valueCount) * sizeof(std::uint32_t));
+
+            beginSection(SECTION_PROPERTY_MASKS, static_cast<std::uint32_t>(i), accounts);
+            file.write(reinterpret_cast<const char*>(masks.data()), static_cast<std::streamsize>(masks.size() * sizeof(std::uint32_t)));
+            endSection(accounts * sizeof(std::uint32_t));
+        }
+
+        // the dictionary strings go after the credentials in the strings section
+        beginSection(SECTION_DICTIONARY, 0, byUse.size());
+        std::vector<PropertyDictionary::Slot> dictionarySlots(PropertyDictionary::capacityFor(byUse.size()), PropertyDictionary::Slot{0, -1});
+        for (std::uint32_t id = 0; id < byUse.size(); id++) {
+            StringRef ref = dictionary.ref(byUse[id]);
+            refBuffer.push_back(packedRef(ref));
+            if (refBuffer.size() == 4096)
+                flushRefs();
+            std::uint32_t hash = hashString(source.strings.view(ref));
+            std::size_t pos = hash & (dictionarySlots.size() - 1);
+            while (dictionarySlots[pos].id >= 0)
+                pos = (pos + 1) & (dictionarySlots.size() - 1);
+            dictionarySlots[pos] = PropertyDictionary::Slot{hash, static_cast<std::int32_t>(id)};
+        }
+        flushRefs();
+        endSection(byUse.size() * sizeof(StringRef));
+
+        beginSection(SECTION_DICTIONARY_INDEX, 0, dictionarySlots.size());
+        file.write(reinterpret_cast<const char*>(dictionarySlots.data()), static_cast<std::streamsize>(dictionarySlots.size() * sizeof(PropertyDictionary::Slot)));
+        endSection(dictionarySlots.size() * sizeof(PropertyDictionary::Slot));
+
+        std::uint64_t indexEntries = 0;
+        for (std::size_t i = 0; i < index.size(); i++) {
+            const UsernameIndex::SlotColumn& slots = index[i].table();
+            beginSection(SECTION_USERNAME_INDEX, static_cast<std::uint32_t>(i), slots.size());
+            slots.forEachBlock([&](const UsernameIndex::Slot* block, std::size_t length) {
+                file.write(reinterpret_cast<const char*>(block), static_cast<std::streamsize>(length * sizeof(UsernameIndex::Slot)));
+            });
+            endSection(slots.size() * sizeof(UsernameIndex::Slot));
+            indexEntries += index[i].size();
+        }
+
+        if (usernameFilters) {
+            std::vector<std::uint64_t> filterWords;
+            for (std::size_t i = 0; i < index.size(); i++) {
+                // sized like UsernameIndex::enableFilter() would, so the loaded filter has the same room to grow
+                filterWords.assign(UsernameFilter::wordsFor(index[i].size() * 2), 0);
+                UsernameIndex::writeFilter(index[i], filterWords.data(), filterWords.size());
+                beginSection(SECTION_USERNAME_FILTER, static_cast<std::uint32_t>(i), filterWords.size());
+                file.write(reinterpret_cast<const char*>(filterWords.data()), static_cast<std::streamsize>(filterWords.size() * sizeof(std::uint64_t)));
+                endSection(filterWords.size() * sizeof(std::uint64_t));
+            }
+        }
+
+        std::size_t freeCount = source.deletedCount();
+        beginSection(SECTION_FREE_ACCOUNTS, 0, freeCount);
+        std::vector<std::uint32_t> freeBuffer;
+        for (std::size_t i = source.freeHead; i < source.freeAccounts.size(); i++) {
+            freeBuffer.push_back(source.freeAccounts[i]);
+            if (freeBuffer.size() == 4096 || i + 1 == source.freeAccounts.size()) {
+                file.write(reinterpret_cast<const char*>(freeBuffer.data()), static_cast<std::streamsize>(freeBuffer.size() * sizeof(std::uint32_t)));
+                freeBuffer.clear();
+            }
+        }
+        endSection(freeCount * sizeof(std::uint32_t));
+
+        beginSection(SECTION_STRINGS, 0, stringBytes);
+        std::string out;
+        std::uint64_t flushed = 0; // string bytes already written, the keystream offset of out[0]
+        auto flushStrings = [&]() {
+            if (cipher)
+                cipher->apply(&out[0], out.size(), flushed);
+            file.write(out.data(), static_cast<std::streamsize>(out.size()));
+            flushed += out.size();
+            out.clear();
+        };
+        auto writeString = [&](std::string_view s) {
+            out.append(s.data(), s.size());
+            if (out.size() >= (1 << 20))
+                flushStrings();
+        };
+        for (std::size_t i = 0; i < credentialTypes; i++) {
+            for (std::size_t j = 0; j < accounts; j++) {
+                writeString(source.credential(i, j));
+            }
+        }
+        for (std::uint32_t oldId : byUse) {
+            writeString(source.strings.view(dictionary.ref(oldId)));
+        }
+        flushStrings();
+        endSection(stringBytes);
+
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.sectionCount = static_cast<std::uint32_t>(sections.size());
+        header.accountCount = accounts;
+        header.credentialTypes = static_cast<std::uint32_t>(credentialTypes);
+        header.propertyTypes = static_cast<std::uint32_t>(propertyTypes);
+        header.indexEntries = indexEntries;
+        header.fileSize = position;
+        header.journalLsn = journalLsn;
+        header.flags = cipher ? static_cast<std::uint64_t>(FLAG_ENCRYPTED_STRINGS) : 0;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sections.data()), static_cast<std::streamsize>(sections.size() * sizeof(Section)));
+        return position;
+    }
+
+    // Writes `source` as a compact file (compactFile.hpp) and returns its size. Every block sorts its accounts by
+    // username so it can front code them, property values are written as ids into the dictionary block (renumbered like
+    // writeDatabaseFile() does) and deleted accounts are left out, apart from their numbers in the free list block (in
+    // reuse order, so whoever loads the file hands out the same account numbers next). With compressed a block is stored
+    // compressed if that makes it smaller, with cipher its stored bytes are encrypted at their offset in the file.
+    static std::uint64_t writeCompactFile(std::ofstream& file, const Database& source, std::uint64_t journalLsn,
+                                          const Cipher::Keystream* cipher, bool compressed) {
+        using namespace CompactFile;
+        std::size_t credentialTypes = source.credentialTypes();
+        std::size_t propertyTypes = source.propertyTypes();
+
+        std::size_t accountCount = source.accountCount();
+        std::vector<std::uint32_t> newId;
+        std::vector<std::uint32_t> byUse = dictionaryByUse(source, newId);
+
+        std::size_t blockCount = 2 + (accountCount + kAccountsPerBlock - 1) / kAccountsPerBlock;
+        std::vector<BlockInfo> blocks;
+        std::uint64_t position = sizeof(Header) + blockCount * sizeof(BlockInfo);
+        file.seekp(static_cast<std::streamoff>(position));
+        std::string packed, stored;
+        auto writeBlock = [&](std::uint32_t kind, std::uint32_t entries, const std::string& raw) {
+            if (raw.size() > UINT32_MAX)
+                throw std::runtime_error("Compact file block doesnt fit in 4 GiB");
+            BlockInfo info = {};
+            info.kind = kind;
+            info.offset = position;
+            info.rawSize = static_cast<std::uint32_t>(raw.size());
+            info.entries = entries;
+            stored = raw;
+            if (compressed) {
+                Lz::compress(raw.data(), raw.size(), packed);
+                if (packed.size() < raw.size()) {
+                    stored.swap(packed);
+                    info.flags |= BLOCK_COMPRESSED;
+                }
+            }
+            if (cipher)
+                cipher->apply(&stored[0], stored.size(), position);
+            info.storedSize = static_cast<std::uint32_t>(stored.size());
+            info.crc = Crc32::compute(stored.data(), stored.size());
+            file.write(stored.data(), static_cast<std::streamsize>(stored.size()));
+            position += stored.size();
+            blocks.push_back(info);
+        };
+
+        std::string dictionaryBlock;
+        for (std::uint32_t oldId : byUse) {
+            std::string_view value = source.strings.view(source.dictionary.ref(oldId));
+            putVarint(dictionaryBlock, value.size());
+            dictionaryBlock.append(value.data(), value.size());
+        }
+        writeBlock(BLOCK_DICTIONARY, static_cast<std::uint32_t>(byUse.size()), dictionaryBlock);
+
+        AccountBlockWriter accounts;
+        std::vector<std::pair<std::string_view, std::uint32_t>> order; // (username, account number) of the block
+        std::vector<std::uint32_t> ids;
+        for (std::size_t first = 0; first < accountCount; first += kAccountsPerBlock) {
+            std::size_t last = (std::min)(accountCount, first + kAccountsPerBlock);
+            order.clear();
+            for (std::size_t i = first; i < last; i++) {
+                if (!source.isDeleted(i))
+                    order.emplace_back(source.credential(0, i), static_cast<std::uint32_t>(i));
+            }
+            std::sort(order.begin(), order.end());
+            for (const auto &entry : order) {
+                std::uint32_t accountNumber = entry.second;
+                accounts.addAccount(static_cast<std::uint32_t>(accountNumber - first));
+                accounts.addUsername(entry.first);
+                for (std::size_t t = 1; t < credentialTypes; t++)
+                    accounts.addCredential(source.credential(t, accountNumber));
+                for (std::size_t p = 0; p < propertyTypes; p++) {
+                    ids.clear();
+                    for (std::size_t k = 0; k < source.propertyCount(p, accountNumber); k++)
+                        ids.push_back(newId[source.propertyId(p, accountNumber, k)]);
+                    accounts.addProperties(ids);
+                }
+            }
+            writeBlock(BLOCK_ACCOUNTS, accounts.size(), accounts.data());
+            accounts.clear();
+        }
+
+        std::string freeBlock;
+        for (std::size_t i = source.freeHead; i < source.freeAccounts.size(); i++)
+            putVarint(freeBlock, source.freeAccounts[i]);
+        writeBlock(BLOCK_FREE_ACCOUNTS, static_cast<std::uint32_t>(source.deletedCount()), freeBlock);
+
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.blockCount = static_cast<std::uint32_t>(blocks.size());
+        header.accountCount = accountCount;
+        header.credentialTypes = static_cast<std::uint32_t>(credentialTypes);
+        header.propertyTypes = static_cast<std::uint32_t>(propertyTypes);
+        header.journalLsn = journalLsn;
+        header.flags = cipher ? static_cast<std::uint64_t>(FLAG_ENCRYPTED) : 0;
+        header.fileSize = position;
+        header.tableCrc = Crc32::compute(blocks.data(), blocks.size() * sizeof(BlockInfo));
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(blocks.data()), static_cast<std::streamsize>(blocks.size() * sizeof(BlockInfo)));
+        return position;
+    }
+
+    bool mapDatabase(const std::string& filename) {
+        using namespace DatabaseFile;
+        std::shared_ptr<MappedFile> mapped = MappedFile::open(filename);
+        if (!mapped || mapped->size() < sizeof(Header)) {
+            return false;
+        }
+        Header header;
+        std::memcpy(&header, mapped->data(), sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version < 1 || header.version > VERSION ||
+            header.fileSize > mapped->size() ||
+            sizeof(Header) + static_cast<std::uint64_t>(header.sectionCount) * sizeof(Section) > header.fileSize)
+        {
+            return false;
+        }
+        if (header.flags & ~static_cast<std::uint64_t>(FLAG_ENCRYPTED_STRINGS)) {
+            return false; // written by a newer version
+        }
+        // version 1 stored a StringRef per property value instead of a dictionary id, those get interned below
+        bool valueRefs = header.version == 1;
+
+        Database loaded;
+        loaded.credentials.resize(header.credentialTypes);
+        loaded.properties.resize(header.propertyTypes);
+        std::vector<UsernameIndex> loadedIndex(kIndexPartitions);
+        std::size_t indexSections = 0;
+        bool hasIndex = true;
+        std::vector<Section> filterSections(kIndexPartitions, Section{});
+        // lists, values and masks for each property type
+        std::vector<bool> found(header.credentialTypes + header.propertyTypes * 3, false);
+        std::vector<std::pair<const StringRef*, std::uint64_t>> oldValues(header.propertyTypes, {nullptr, 0});
+        Section dictionarySection = {}, dictionaryIndexSection = {}, freeSection = {}, stringsSection = {};
+        std::shared_ptr<void> owner = mapped;
+        bool coldLoad = tiered.load(std::memory_order_relaxed);
+
+        for (std::uint32_t i = 0; i < header.sectionCount; i++) {
+            Section section;
+            std::memcpy(&section, mapped->data() + sizeof(Header) + i * sizeof(Section), sizeof(section));
+            char* data = mapped->data() + section.offset;
+            std::uint64_t elementSize = 1;
+            switch (section.kind) {
+                case SECTION_CREDENTIALS: elementSize = sizeof(StringRef); break;
+                case SECTION_PROPERTY_LISTS: elementSize = sizeof(PropertyList); break;
+                case SECTION_PROPERTY_VALUES: elementSize = valueRefs ? sizeof(StringRef) : sizeof(std::uint32_t); break;
+                case SECTION_USERNAME_INDEX: elementSize = sizeof(UsernameIndex::Slot); break;
+                case SECTION_STRINGS: elementSize = 1; break;
+                case SECTION_PROPERTY_MASKS: elementSize = sizeof(std::uint32_t); break;
+                case SECTION_DICTIONARY: elementSize = sizeof(StringRef); break;
+                case SECTION_DICTIONARY_INDEX: elementSize = sizeof(PropertyDictionary::Slot); break;
+                case SECTION_FREE_ACCOUNTS: elementSize = sizeof(std::uint32_t); break;
+                case SECTION_USERNAME_FILTER: elementSize = sizeof(std::uint64_t); break;
+                default: continue; // unknown sections are skipped
+            }
+            if (section.offset % kSectionAlignment != 0 || section.offset > header.fileSize ||
+                section.count > (header.fileSize - section.offset) / elementSize)
+            {
+                return false;
+            }
+            bool credentialSection = section.kind == SECTION_CREDENTIALS;
+            bool propertySection = section.kind == SECTION_PROPERTY_LISTS || section.kind == SECTION_PROPERTY_VALUES ||
+                                   section.kind == SECTION_PROPERTY_MASKS;
+            if ((credentialSection && section.index >= header.credentialTypes) ||
+                (propertySection && section.index >= header.propertyTypes))
+            {
+                return false;
+            }
+
+            std::size_t propertySlot = header.credentialTypes + static_cast<std::size_t>(section.index) * 3;
+            switch (section.kind) {
+                case SECTION_CREDENTIALS:
+                    if (section.count != header.accountCount)
+                        return false;
+                    loaded.credentials[section.index].adopt(reinterpret_cast<StringRef*>(data), section.count, owner);
+                    found[section.index] = true;
+                    break;
+                case SECTION_PROPERTY_LISTS:
+                    if (section.count != header.accountCount)
+                        return false;
+                    loaded.properties[section.index].lists.adopt(reinterpret_cast<PropertyList*>(data), section.count, owner);
+                    found[propertySlot] = true;
+                    break;
+                case SECTION_PROPERTY_VALUES:
+                    if (valueRefs) {
+                        oldValues[section.index] = {reinterpret_cast<const StringRef*>(data), section.count};
+                        found[propertySlot + 2] = true; // masks are computed with the ids
+                    } else {
+                        loaded.properties[section.index].values.adopt(reinterpret_cast<std::uint32_t*>(data), section.count, owner);
+                    }
+                    found[propertySlot + 1] = true;
+                    break;
+                case SECTION_PROPERTY_MASKS:
+                    if (section.count != header.accountCount)
+                        return false;
+                    loaded.properties[section.index].masks.adopt(reinterpret_cast<std::uint32_t*>(data), section.count, owner);
+                    found[propertySlot + 2] = true;
+                    break;
+                case SECTION_DICTIONARY:
+                    dictionarySection = section;
+                    break;
+                case SECTION_DICTIONARY_INDEX:
+                    dictionaryIndexSection = section;
+                    break;
+                case SECTION_FREE_ACCOUNTS:
+                    freeSection = section;
+                    break;
+                case SECTION_USERNAME_INDEX:
+                    // a file saved with a different number of partitions gets its index rebuilt
+                    indexSections++;
+                    if (section.index >= kIndexPartitions ||
+                        !loadedIndex[section.index].adopt(reinterpret_cast<UsernameIndex::Slot*>(data), section.count, owner))
+                    {
+                        hasIndex = false;
+                    }
+                    break;
+                case SECTION_USERNAME_FILTER:
+                    if (section.index < kIndexPartitions)
+                        filterSections[section.index] = section;
+                    break;
+                case SECTION_STRINGS:
+                    if (coldLoad) {
+                        stringsSection = section; // goes to a page file below instead
+                        break;
+                    }
+                    // the mapping is private, so decrypting in place only copies these pages into this process
+                    if (header.flags & FLAG_ENCRYPTED_STRINGS)
+                        Cipher::Keystream(encryptionKey()).applyParallel(data, static_cast<std::size_t>(section.count), 0);
+                    loaded.strings.adopt(data, section.count, owner);
+                    break;
+            }
+        }
+        for (bool present : found) {
+            if (!present)
+                return false;
+        }
+
+        // With tiered storage on every account starts out cold: the strings section is copied (decrypted) into a new
+        // page file at the same offsets, so the credential refs only need the cold bit, and the arena only gets the
+        // property values back. It uses the page file until then.
+        std::shared_ptr<PageFile> pages;
+        if (stringsSection.count > 0) {
+            pages = createPageFile();
+            std::unique_ptr<Cipher::Keystream> cipher;
+            if (header.flags & FLAG_ENCRYPTED_STRINGS)
+                cipher.reset(new Cipher::Keystream(encryptionKey()));
+            char* data = mapped->data() + stringsSection.offset;
+            pages->fill(data, static_cast<std::size_t>(stringsSection.count), cipher.get());
+            mapped->discard(data, static_cast<std::size_t>(stringsSection.count));
+            loaded.strings.adopt(const_cast<char*>(pages->data()), static_cast<std::size_t>(stringsSection.count), pages);
+        }
+
+        if (valueRefs) {
+            for (std::size_t i = 0; i < header.propertyTypes; i++) {
+                PropertyColumn& column = loaded.properties[i];
+                for (std::uint64_t k = 0; k < oldValues[i].second; k++)
+                    column.values.push_back(loaded.dictionary.internRef(oldValues[i].first[k], loaded.strings));
+                column.masks.resize(header.accountCount, 0);
+                for (std::size_t j = 0; j < header.accountCount; j++)
+                    loaded.updateMask(i, j);
+            }
+        } else {
+            if (dictionarySection.kind != SECTION_DICTIONARY)
+                return false;
+            loaded.dictionary.adopt(reinterpret_cast<StringRef*>(mapped->data() + dictionarySection.offset), dictionarySection.count,
+                                    reinterpret_cast<PropertyDictionary::Slot*>(mapped->data() + dictionaryIndexSection.offset),
+                                    dictionaryIndexSection.count, owner, loaded.strings);
+        }
+
+        if (pages) {
+            StringArena values;
+            PropertyDictionary::RefColumn refs;
+            for (std::size_t id = 0; id < loaded.dictionary.size(); id++)
+                refs.push_back(values.append(loaded.strings.view(loaded.dictionary.ref(static_cast<std::uint32_t>(id)))));
+            loaded.dictionary.replaceRefs(std::move(refs));
+            loaded.strings = std::move(values);
+            for (auto &column : loaded.credentials) {
+                for (std::size_t j = 0; j < header.accountCount; j++) {
+                    if (column[j].length > 0)
+                        column.set(j, PageFile::coldRef(column[j]));
+                }
+            }
+            for (std::size_t j = 0; j < header.accountCount; j++) {
+                if (!loaded.isDeleted(j))
+                    loaded.coldAccounts++;
+            }
+            loaded.cold = pages;
+        }
+
+        if (freeSection.kind == SECTION_FREE_ACCOUNTS) {
+            const std::uint32_t* free = reinterpret_cast<const std::uint32_t*>(mapped->data() + freeSection.offset);
+            for (std::uint64_t i = 0; i < freeSection.count; i++) {
+                if (free[i] >= header.accountCount)
+                    return false;
+                loaded.freeAccounts.push_back(free[i]);
+            }
+        } else {
+            loaded.rebuildFreeAccounts();
+        }
+
+        db = std::move(loaded);
+        mappedFilename = filename;
+        snapshotLsn = header.journalLsn;
+        decryptedOnLoad = (header.flags & FLAG_ENCRYPTED_STRINGS) != 0;
+        publishAccountCount();
+        if (hasIndex && indexSections == kIndexPartitions) {
+            // the saved filters are only used with the filter on, a partition without one gets it built
+            for (std::size_t i = 0; i < kIndexPartitions && usernameFilterEnabled; i++) {
+                const Section& section = filterSections[i];
+                if (section.kind != SECTION_USERNAME_FILTER ||
+                    !loadedIndex[i].adoptFilter(reinterpret_cast<std::uint64_t*>(mapped->data() + section.offset), section.count, owner))
+                {
+                    loadedIndex[i].enableFilter();
+                }
+            }
+            usernameIndex = std::move(loadedIndex);
+        } else {
+            rebuildIndex();
+        }
+        return true;
+    }
+
+    // Loads a file written by writeCompactFile(). It is parsed into memory on every core: the blocks are checked and
+    // decoded, then each fills the slots of its accounts (and its run of every property column) while the others do
+    // the same, and the index is rebuilt a partition per thread. Returns false if the file is damaged or not one.
+    bool loadCompactDatabase(const std::string& filename) {
+        using namespace CompactFile;
+        std::shared_ptr<DatabaseFile::MappedFile> mapped = DatabaseFile::MappedFile::open(filename);
+        if (!mapped || mapped->size() < sizeof(Header)) {
+            return false;
+        }
+        Header header;
+        std::memcpy(&header, mapped->data(), sizeof(header));
+        std::uint64_t tableEnd = sizeof(Header) + static_cast<std::uint64_t>(header.blockCount) * sizeof(BlockInfo);
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version < 1 || header.version > VERSION ||
+            (header.flags & ~static_cast<std::uint64_t>(FLAG_ENCRYPTED)) || header.fileSize > mapped->size() ||
+            tableEnd > header.fileSize || header.accountCount > UINT32_MAX ||
+            (header.credentialTypes == 0 && header.accountCount > 0))
+        {
+            return false;
+        }
+        std::vector<BlockInfo> blocks(header.blockCount);
+        std::memcpy(blocks.data(), mapped->data() + sizeof(Header), blocks.size() * sizeof(BlockInfo));
+        if (Crc32::compute(blocks.data(), blocks.size() * sizeof(BlockInfo)) != header.tableCrc) {
+            return false;
+        }
+        // version 1 sorted the usernames over the whole file, its blocks can have any accounts and fill them one at a time
+        bool ranges = header.version >= 2;
+        std::size_t accountBlocks = 0;
+        for (const BlockInfo& info : blocks) {
+            if (info.offset < tableEnd || info.offset > header.fileSize || info.storedSize > header.fileSize - info.offset ||
+                (info.kind != BLOCK_DICTIONARY && info.kind != BLOCK_ACCOUNTS && info.kind != BLOCK_FREE_ACCOUNTS) ||
+                (!(info.flags & BLOCK_COMPRESSED) && info.storedSize != info.rawSize))
+            {
+                return false;
+            }
+            if (info.kind == BLOCK_ACCOUNTS)
+                accountBlocks++;
+        }
+        // the dictionary, the account blocks and, in files that have it, the free list
+        std::size_t accountEnd = 1 + accountBlocks;
+        bool freeBlock = blocks.size() == accountEnd + 1 && blocks.back().kind == BLOCK_FREE_ACCOUNTS;
+        if (blocks.empty() || blocks[0].kind != BLOCK_DICTIONARY || (blocks.size() != accountEnd && !freeBlock) ||
+            (ranges && accountBlocks != (header.accountCount + kAccountsPerBlock - 1) / kAccountsPerBlock))
+        {
+            return false;
+        }
+
+        // the mapping is private, so the blocks are decrypted in place
+        std::unique_ptr<Cipher::Keystream> cipher;
+        if (header.flags & FLAG_ENCRYPTED)
+            cipher.reset(new Cipher::Keystream(encryptionKey()));
+        std::vector<AccountBlock> decoded(blocks.size());
+        std::vector<std::string> values;
+        std::vector<std::uint32_t> freeAccounts;
+        std::vector<std::vector<std::uint64_t>> propertyValues(blocks.size()); // [block][type]
+        std::atomic<bool> failed{false};
+        runParallel(blocks.size(), [&](std::size_t i) {
+            const BlockInfo& info = blocks[i];
+            char* data = mapped->data() + info.offset;
+            if (failed || Crc32::compute(data, info.storedSize) != info.crc) {
+                failed = true;
+                return;
+            }
+            if (cipher)
+                cipher->apply(data, info.storedSize, info.offset);
+            const char* bytes = data;
+            std::string raw;
+            if (info.flags & BLOCK_COMPRESSED) {
+                raw.resize(info.rawSize);
+                if (!Lz::decompress(data, info.storedSize, &raw[0], info.rawSize)) {
+                    failed = true;
+                    return;
+                }
+                bytes = raw.data();
+            }
+            if (info.kind == BLOCK_DICTIONARY) {
+                if (!decodeDictionary(bytes, info.rawSize, info.entries, values))
+                    failed = true;
+                return;
+            }
+            if (info.kind == BLOCK_FREE_ACCOUNTS) {
+                if (!decodeFreeAccounts(bytes, info.rawSize, info.entries, freeAccounts))
+                    failed = true;
+                return;
+            }
+            AccountBlock& block = decoded[i];
+            if (!decodeAccounts(bytes, info.rawSize, info.entries, header.credentialTypes, header.propertyTypes, block)) {
+                failed = true;
+                return;
+            }
+            propertyValues[i].assign(header.propertyTypes, 0);
+            for (std::size_t a = 0; a < block.accountNumbers.size(); a++) {
+                std::uint32_t begin = a == 0 ? 0 : block.propertyEnds[a * header.propertyTypes - 1];
+                for (std::size_t p = 0; p < header.propertyTypes; p++) {
+                    std::uint32_t end = block.propertyEnds[a * header.propertyTypes + p];
+                    propertyValues[i][p] += end - begin;
+                    begin = end;
+                }
+            }
+        });
+        if (failed) {
+            return false;
+        }
+        mapped.reset();
+
+        // Every slot starts out as a tombstone and every block gets its own run of each property column, then the blocks
+        // fill their slots at once. Only the slots of a block are written while it runs, so they dont get in each
+        // others way (the columns are fresh, no view shares their blocks).
+        Database loaded;
+        loaded.resize(header.credentialTypes, header.propertyTypes);
+        for (auto &column : loaded.credentials)
+            column.resize(header.accountCount, StringRef{});
+        std::vector<std::vector<std::uint32_t>> valueBegin(blocks.size(), std::vector<std::uint32_t>(header.propertyTypes, 0));
+        for (std::size_t p = 0; p < header.propertyTypes; p++) {
+            PropertyColumn& column = loaded.properties[p];
+            column.lists.resize(header.accountCount, PropertyList{0, 0});
+            column.masks.resize(header.accountCount, 0);
+            std::uint64_t total = 0;
+            for (std::size_t i = 1; i < accountEnd; i++) {
+                valueBegin[i][p] = static_cast<std::uint32_t>(total);
+                total += propertyValues[i][p];
+                if (total > UINT32_MAX)
+                    return false;
+            }
+            column.values.resize(total, 0);
+        }
+        std::vector<std::uint64_t> stringBase(blocks.size(), 0);
+        for (std::size_t i = 1; i < accountEnd; i++) {
+            std::shared_ptr<std::string> strings = std::make_shared<std::string>(std::move(decoded[i].strings));
+            if (!strings->empty())
+                stringBase[i] = loaded.strings.appendChunks(&(*strings)[0], strings->size(), strings);
+            if (stringBase[i] + strings->size() > UINT32_MAX)
+                return false;
+        }
+        for (std::size_t id = 0; id < values.size(); id++) {
+            if (loaded.dictionary.intern(values[id], loaded.strings) != id)
+                return false; // the same value twice
+        }
+
+        auto fillBlock = [&](std::size_t i) {
+            const AccountBlock& block = decoded[i];
+            std::uint64_t first = ranges ? (i - 1) * kAccountsPerBlock : 0;
+            std::uint64_t last = ranges ? (std::min<std::uint64_t>)(first + kAccountsPerBlock, header.accountCount) : header.accountCount;
+            std::vector<std::uint32_t> nextValue = valueBegin[i];
+            std::size_t propertyValue = 0;
+            for (std::size_t a = 0; a < block.accountNumbers.size(); a++) {
+                std::uint64_t accountNumber = first + block.accountNumbers[a];
+                const StringRef* refs = &block.credentials[a * header.credentialTypes];
+                // every account once, and none of them a tombstone
+                if (accountNumber >= last || !loaded.isDeleted(accountNumber) || refs[0].length == 0) {
+                    failed = true;
+                    return;
+                }
+                for (std::size_t t = 0; t < header.credentialTypes; t++) {
+                    StringRef ref = refs[t];
+                    if (ref.length > 0)
+                        ref.offset += static_cast<std::uint32_t>(stringBase[i]);
+                    loaded.credentials[t].set(accountNumber, ref);
+                }
+                for (std::size_t p = 0; p < header.propertyTypes; p++) {
+                    PropertyColumn& column = loaded.properties[p];
+                    std::uint32_t begin = nextValue[p];
+                    std::uint32_t mask = 0;
+                    for (std::uint32_t end = block.propertyEnds[a * header.propertyTypes + p]; propertyValue < end; propertyValue++) {
+                        std::uint32_t id = block.propertyIds[propertyValue];
+                        if (id >= values.size()) {
+                            failed = true;
+                            return;
+                        }
+                        column.values.set(nextValue[p]++, id);
+                        mask |= PropertyColumn::bit(id);
+                    }
+                    column.lists.set(accountNumber, PropertyList{begin, nextValue[p] - begin});
+                    column.masks.set(accountNumber, mask);
+                }
+            }
+        };
+        if (ranges) {
+            runParallel(accountBlocks, [&](std::size_t i) { fillBlock(i + 1); });
+        } else {
+            for (std::size_t i = 1; i < accountEnd && !failed; i++)
+                fillBlock(i);
+        }
+        if (failed) {
+            return false;
+        }
+        if (freeBlock) {
+            // every tombstone exactly once
+            std::vector<bool> listed(header.accountCount, false);
+            for (std::uint32_t accountNumber : freeAccounts) {
+                if (accountNumber >= header.accountCount || !loaded.isDeleted(accountNumber) || listed[accountNumber])
+                    return false;
+                listed[accountNumber] = true;
+                loaded.freeAccounts.push_back(accountNumber);
+            }
+            for (std::size_t i = 0; i < header.accountCount; i++) {
+                if (loaded.isDeleted(i) && !listed[i])
+                    return false;
+            }
+        } else {
+            loaded.rebuildFreeAccounts();
+        }
+
+        db = std::move(loaded);
+        mappedFilename.clear();
+        snapshotLsn = header.journalLsn;
+        decryptedOnLoad = (header.flags & FLAG_ENCRYPTED) != 0;
+        publishAccountCount();
+        rebuildIndex();
+        return true;
+    }
+
+    // Writes a view captured by startSnapshot() and puts it in place of `filename`. Runs on the snapshot thread.
+    // A copy (see startSnapshotCopy()) doesnt become the database file, so the journal keeps its records. A compact copy
+    // is written with writeCompactFile() instead, its blocks compressed unless compressed = false.
+    void runSnapshot(Database view, std::vector<UsernameIndex> indexView, std::string filename, std::uint64_t lsn, bool encrypted,
+                     bool usernameFilters, bool copy, bool compact, bool compressed, std::chrono::steady_clock::time_point started) {
+        SnapshotStats stats;
+        stats.lsn = lsn;
+        std::string tempFilename = filename + ".tmp";
+        bool written = false;
+        try {
+            std::ofstream file(tempFilename, std::ios::binary);
+            if (!file) {
+                throw std::runtime_error("Could not open file for writing: " + tempFilename);
+            }
+            std::unique_ptr<Cipher::Keystream> cipher;
+            if (encrypted)
+                cipher.reset(new Cipher::Keystream(encryptionKey()));
+            if (compact)
+                stats.bytesWritten = writeCompactFile(file, view, lsn, cipher.get(), compressed);
+            else
+                stats.bytesWritten = writeDatabaseFile(file, view, indexView, lsn, cipher.get(), usernameFilters);
+            file.close();
+            if (!file) {
+                throw std::runtime_error("Could not write file: " + tempFilename);
+            }
+            written = true;
+        } catch (const std::exception& e) {
+            stats.error = e.what();
+        }
+        {
+            AllLocked lock(*this);
+            // the old blocks writers replaced while the view was being written are the extra memory it cost
+            stats.extraMemoryBytes = dropView(view, indexView);
+            if (written && copy) {
+                if (!DatabaseFile::replaceFile(tempFilename, filename))
+                    stats.error = "Could not replace file: " + filename;
+            } else if (written) {
+#ifdef _WIN32
+                // windows cant replace a file that is still mapped, so stop using the old one first
+                if (mappedFilename == filename) {
+                    detachMapping();
+                }
+#endif
+                if (DatabaseFile::replaceFile(tempFilename, filename)) {
+                    snapshotLsn = lsn;
+                } else {
+                    stats.error = "Could not replace file: " + filename;
+                }
+            }
+        }
+        // everything up to lsn is in the file now, so the journal doesnt need it anymore
+        if (stats.error.empty()) {
+            try {
+                if (journal.isOpen() && !copy) {
+                    journal.checkpoint(lsn);
+                }
+                stats.ok = true;
+            } catch (const std::exception& e) {
+                stats.error = e.what();
+            }
+        }
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        operationStats.record(OperationStats::SAVE, std::chrono::steady_clock::now() - started);
+        lastSnapshot = stats;
+        snapshotRunning = false;
+    }
+
+    // startSnapshot() and startSnapshotCopy().
+    bool beginSnapshot(const std::string& filename, bool encrypted, bool copy, bool compact, bool compressed = true) {
+        std::lock_guard<std::mutex> guard(snapshotMutex);
+        if (snapshotRunning) {
+            return false;
+        }
+        if (snapshotThread.joinable()) {
+            snapshotThread.join();
+        }
+        auto started = std::chrono::steady_clock::now();
+        Database view;
+        std::vector<UsernameIndex> indexView;
+        std::uint64_t lsn;
+        bool usernameFilters;
+        {
+            // only writers change anything, readers can keep going while the view is taken
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            view = db.share();
+            for (const auto &index : usernameIndex)
+                indexView.push_back(index.share());
+            lsn = currentLsn();
+            usernameFilters = usernameFilterEnabled;
+        }
+        snapshotRunning = true;
+        snapshotThread = std::thread(&easyAuth::runSnapshot, this, std::move(view), std::move(indexView), filename,
+                                     lsn, encrypted, usernameFilters, copy, compact, compressed, started);
+        return true;
+    }
+
+    // Views from share() are dropped with every lock held (AllLocked): a writer that later finds a block is no longer
+    // shared is then ordered after the last read of it (use_count() alone doesnt give that), and no reader can still be
+    // using a block replaced while the view was around, so those can be freed. Returns how many bytes that freed.
+    std::size_t dropView(Database& view, std::vector<UsernameIndex>& indexView) {
+        view.clear();
+        indexView.clear();
+        return releaseRetired();
+    }
+
+    std::size_t releaseRetired() {
+        std::size_t released = db.retiredBytes();
+        db.releaseRetired();
+        for (auto &index : usernameIndex) {
+            released += index.retiredBytes();
+            index.releaseRetired();
+        }
+        return released;
+    }
+
+    // One compaction, see compact(). The old string bytes are handed back in `old`, so they are freed after every lock
+    // is let go and not during the pause.
+    CompactionStats runCompaction(StringArena& old) {
+        std::lock_guard<std::mutex> compactGuard(compactionMutex);
+        auto started = std::chrono::steady_clock::now();
+        CompactionStats stats;
+        Database view;
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            if (db.credentials.empty()) {
+                lastCompaction = stats;
+                return stats;
+            }
+            view = db.share();
+            compactionDirty.clear();
+            compactionActive = true;
+            stats.garbageBytesBefore = db.garbageBytes();
+            stats.memoryBefore = db.memoryUsage();
+            stats.deletedAccounts = db.deletedCount();
+        }
+
+        // the copy is made from the view without holding any lock, readers and writers keep going meanwhile
+        CompactedStorage packed(view);
+        packed.copyValues(view);
+        packed.copyAccounts(view, 0, view.accountCount());
+
+        auto pauseStarted = std::chrono::steady_clock::now();
+        {
+            AllLocked lock(*this);
+            compactionActive = false;
+            // catch up with what writers did in the meantime
+            packed.copyValues(db);
+            packed.copyAccounts(db, view.accountCount(), db.accountCount());
+            std::sort(compactionDirty.begin(), compactionDirty.end());
+            compactionDirty.erase(std::unique(compactionDirty.begin(), compactionDirty.end()), compactionDirty.end());
+            for (std::uint32_t accountNumber : compactionDirty) {
+                if (accountNumber < view.accountCount())
+                    packed.copyAccounts(db, accountNumber, accountNumber + 1);
+            }
+            compactionDirty = std::vector<std::uint32_t>();
+            packed.install(db);
+            old = std::move(packed.strings);
+            // same as dropView(), the view goes with every lock held
+            view.clear();
+            releaseRetired();
+            stats.garbageBytesAfter = db.garbageBytes();
+            stats.memoryAfter = db.memoryUsage();
+        }
+        auto finished = std::chrono::steady_clock::now();
+        stats.ran = true;
+        stats.pauseSeconds = std::chrono::duration<double>(finished - pauseStarted).count();
+        stats.seconds = std::chrono::duration<double>(finished - started).count();
+        lastCompaction = stats;
+        return stats;
+    }
+
+    bool needsCompaction(double threshold, std::size_t minBytes) {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        std::size_t garbage = db.garbageBytes();
+        return garbage > 0 && garbage >= minBytes && garbage >= threshold * db.storedBytes();
+    }
+
+    void runCompactor() {
+        std::unique_lock<std::mutex> lock(compactorMutex);
+        while (!compactorStop) {
+            compactorWake.wait_for(lock, kCompactorInterval, [this] { return compactorStop; });
+            if (compactorStop)
+                break;
+            double threshold = compactionThreshold;
+            std::size_t minBytes = compactionMinBytes;
+            lock.unlock();
+            if (needsCompaction(threshold, minBytes))
+                compact();
+            lock.lock();
+        }
+    }
+
+    // Copies everything that still points into the mapped file into memory owned by this process.
+    void detachMapping() {
+        Database copy(db);
+        db = std::move(copy);
+        for (auto &index : usernameIndex) {
+            UsernameIndex indexCopy(index);
+            index = std::move(indexCopy);
+        }
+        mappedFilename.clear();
+    }
+
+    // A new page file for the cold tier. Every one gets its own name, an older one can still be open for a snapshot.
+    std::shared_ptr<PageFile> createPageFile() {
+        std::string filename = pageFilename + "." + std::to_string(pageFileCount++);
+        std::shared_ptr<PageFile> pages = PageFile::create(filename);
+        if (!pages)
+            throw std::runtime_error("Could not create page file " + filename);
+        return pages;
+    }
+
+    // Brings accounts readers found cold back into memory. Records arent copied, so if the account doesnt change
+    // before it is evicted again its refs just go back to them.
+    void promoteQueued(const std::vector<std::uint32_t>& queued) {
+        for (std::size_t first = 0; first < queued.size(); first += kTieringBatch) {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            std::size_t end = (std::min)(queued.size(), first + kTieringBatch);
+            for (std::size_t i = first; i < end; i++) {
+                int accountNumber = static_cast<int>(queued[i]);
+                if (!tiered || !isActiveAccount(accountNumber) || !db.isCold(accountNumber))
+                    continue;
+                // the index compares usernames with only the partition lock held, so changing the ref needs it too
+                std::unique_lock<std::shared_mutex> indexGuard(indexLock(db.credential(0, accountNumber)));
+                std::unique_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+                coldCopies[queued[i]] = db.moveToMemory(accountNumber);
+                markChanged(accountNumber);
+                promotions++;
+            }
+        }
+    }
+
+    // Moves accounts the sweep finds unused since it last passed them to the page file, until the strings in memory
+    // are at 7/8 of the budget so it doesnt start again right away. The arena bytes they leave behind are garbage
+    // for the compactor. Stops after two turns of the sweep, when everything left is in use.
+    void evictOverBudget() {
+        std::size_t steps = 0;
+        while (true) {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            std::size_t resident = db.strings.bytesUsed();
+            std::size_t accountCount = db.accountCount();
+            if (!tiered || resident <= memoryBudget || accountCount == 0 || steps >= 2 * accountCount)
+                return;
+            std::size_t target = memoryBudget - memoryBudget / 8;
+            if (!db.cold)
+                db.cold = createPageFile();
+
+            // the records are written first and the refs only swapped once they are in the file
+            std::vector<std::pair<int, std::vector<StringRef>>> victims;
+            while (resident > target && victims.size() < kTieringBatch && steps < 2 * accountCount) {
+                steps++;
+                if (clockHand >= accountCount)
+                    clockHand = 0;
+                std::size_t accountNumber = clockHand++;
+                if (db.isDeleted(accountNumber) || accessClock.clear(accountNumber))
+                    continue;
+                std::size_t bytes = db.residentCredentialBytes(accountNumber);
+                if (bytes == 0)
+                    continue;
+                std::vector<StringRef> refs(db.credentialTypes());
+                auto copy = coldCopies.find(static_cast<std::uint32_t>(accountNumber));
+                for (std::size_t t = 0; t < refs.size(); t++) {
+                    StringRef ref = db.credentials[t][accountNumber];
+                    if (ref.length == 0 || PageFile::isCold(ref))
+                        continue;
+                    if (copy != coldCopies.end() && copy->second[t].length != 0)
+                        refs[t] = copy->second[t];
+                    else
+                        refs[t] = db.cold->add(db.credential(t, accountNumber));
+                }
+                if (copy != coldCopies.end())
+                    coldCopies.erase(copy);
+                resident -= bytes;
+                victims.emplace_back(static_cast<int>(accountNumber), std::move(refs));
+            }
+            db.cold->flush();
+            for (auto &victim : victims) {
+                std::unique_lock<std::shared_mutex> indexGuard(indexLock(db.credential(0, victim.first)));
+                std::unique_lock<std::shared_mutex> accountGuard(accountLock(victim.first));
+                db.moveToCold(victim.first, victim.second);
+                markChanged(victim.first);
+                evictions++;
+            }
+            if (resident <= target)
+                return;
+        }
+    }
+
+    void runTiering() {
+        auto lastDrop = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(tieringMutex);
+        while (!tieringStop) {
+            tieringWake.wait_for(lock, kTieringInterval, [this] { return tieringStop || !promoteQueue.empty(); });
+            if (tieringStop)
+                break;
+            std::vector<std::uint32_t> queued;
+            queued.swap(promoteQueue);
+            lock.unlock();
+            try {
+                promoteQueued(queued);
+                evictOverBudget();
+                if (std::chrono::steady_clock::now() - lastDrop >= kDropResidentInterval) {
+                    lastDrop = std::chrono::steady_clock::now();
+                    std::lock_guard<std::mutex> writeGuard(writeMutex);
+                    if (db.cold)
+                        db.cold->dropResident();
+                }
+            } catch (const std::exception& e) {
+                // e.g. the disk is full: the accounts stay in memory and it is tried again next time
+                std::lock_guard<std::mutex> writeGuard(writeMutex);
+                tieringError = e.what();
+            }
+            lock.lock();
+        }
+    }
+
+    void stopTiering() {
+        std::thread stopping;
+        {
+            std::lock_guard<std::mutex> guard(tieringMutex);
+            tieringStop = true;
+            stopping = std::move(tieringThread);
+        }
+        tieringWake.notify_all();
+        if (stopping.joinable()) {
+            stopping.join();
+        }
+        std::lock_guard<std::mutex> guard(tieringMutex);
+        promoteQueue.clear();
+    }
+
+ protected:
+    // hasKnownProperty() once propertyIndex and the registered value are known to be in range, for TypedAuth whose
+    // schema checks them when it is compiled.
+    bool hasKnownValue(int accountNumber, std::size_t propertyIndex, std::size_t valueIndex) const {
+        OperationStats::Scope stat(operationStats, OperationStats::PROPERTY_READ);
+        if (!isAccount(accountNumber)) {
+            return false;
+        }
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        std::uint32_t id = knownIds[valueIndex].load(std::memory_order_relaxed);
+        return id != PropertyDictionary::kNotFound && db.hasPropertyId(propertyIndex, accountNumber, id);
+    }
+
+ public:
+    const std::string XOR_KEY = "YOUR_KEY_HERE";
+    easyAuth() = default;
+    easyAuth(Database database) { // Option to initialize with an existing database.
+        this->db = database;
+        publishAccountCount();
+        rebuildIndex();
+    }
+    ~easyAuth() {
+        stopTiering();
+        stopCompactor();
+        {
+            std::lock_guard<std::mutex> guard(snapshotOwner->mutex);
+            snapshotOwner->auth = nullptr;
+        }
+        waitForSnapshot();
+    }
+
+    // Initialize with 2 credential types (username and password) and a given number of property types.
+    void initialize(int numberOfProperties) {
+        if (numberOfProperties < 0) {
+            throw std::invalid_argument("Number of properties cannot be negative");
+        }
+        std::lock_guard<std::mutex> compactGuard(compactionMutex);
+        AllLocked lock(*this);
+        db.resize(2, numberOfProperties);
+        this->numberOfProperties = numberOfProperties;
+        valueIndex.reset();
+        sessions.clear();
+        coldCopies.clear();
+        version++;
+        publishAccountCount();
+        rebuildIndex();
+        replicationLog.reset(currentLsn());
+    }
+
+    /* USERS / AUTH / CREDENTIALS */
+
+    // Waits for checkCredentialsAsync().
+    bool checkCredentials(const std::string& username, const std::string& password) {
+        return checkCredentialsAsync(username, password).get();
+    }
+
+    // Looks the account up and hashes the password on the hashing pool, the future is ready once it is hashed.
+    // A username that doesnt exist is hashed against a dummy record, so it takes as long as a wrong password,
+    // unless the username filter is on (see enableUsernameFilter()): then it comes back false right away.
+    // After a successful login a record with a lower cost than the current one (or a plaintext password from before
+    // 5.1) is hashed again with the current cost and replaced.
+    // Throws std::runtime_error if the pool's queue stays full (see configureHashing()).
+    std::future<bool> checkCredentialsAsync(const std::string& username, const std::string& password) {
+        return verifyCredentials<bool>(username, password, [](int, const std::string&) { return true; });
+    }
+
+    // Waits for loginAsync().
+    std::string login(const std::string& username, const std::string& password) {
+        return loginAsync(username, password).get();
+    }
+
+    // checkCredentialsAsync() that also starts a session (see resolveSession()): the future holds its token, or an
+    // empty string if the username or password is wrong.
+    std::future<std::string> loginAsync(const std::string& username, const std::string& password) {
+        return verifyCredentials<std::string>(username, password, [this, username](int accountNumber, const std::string& record) {
+            return startSession(accountNumber, username, record);
+        });
+    }
+
+    // loginAsync() for callers that cant wait on a future, like a server event loop: `done` gets the token (or an
+    // empty string) on the hashing thread, or right away if the username filter already knows it is wrong.
+    // Throws std::runtime_error like loginAsync() if the pool's queue stays full, and `done` isnt called then.
+    void loginAsync(const std::string& username, const std::string& password, std::function<void(const std::string&)> done) {
+        verifyCredentials<std::string>(username, password, [this, username](int accountNumber, const std::string& record) {
+            return startSession(accountNumber, username, record);
+        }, std::move(done));
+    }
+
+    // Hashes the password (on the hashing pool, see configureHashing()) and adds the account.
+    void addCredentials(const std::string& username, const std::string& password) {
+        OperationStats::Scope stat(operationStats, OperationStats::WRITE);
+        checkWritable();
+        if (username.empty() || password.empty()) {
+            throw std::invalid_argument("Username and password cannot be empty");
+        }
+        // checked before hashing too so a taken name doesnt cost a hash, addHashedCredentials() checks again
+        if (lookupAccount(username) >= 0) {
+            throw std::runtime_error("Username already exists");
+        }
+        addHashedCredentials(username, hashPassword(password));
+    }
+
+    // addCredentials() for callers that cant wait for the hash, like loginAsync() with a callback: `done` gets the new
+    // account number on the hashing thread, or -1 if adding it failed there (the username was taken in the meantime).
+    // Throws like addCredentials() if the username is taken already or the pool's queue stays full, `done` isnt called then.
+    void addCredentials(const std::string& username, const std::string& password, std::function<void(int)> done) {
+        auto started = std::chrono::steady_clock::now();
+        checkWritable();
+        if (username.empty() || password.empty()) {
+            throw std::invalid_argument("Username and password cannot be empty");
+        }
+        if (lookupAccount(username) >= 0) {
+            throw std::runtime_error("Username already exists");
+        }
+        std::uint32_t cost = passwordHashCost;
+        hashPool.submitFor([this, username, password, cost, done, started] {
+            int accountNumber = -1;
+            {
+                OperationStats::Scope stat(operationStats, OperationStats::WRITE, started);
+                try {
+                    accountNumber = addHashedCredentials(username, PasswordHash::hash(password, cost));
+                } catch (const std::exception&) {
+                }
+            }
+            done(accountNumber);
+        }, hashQueueWait());
+    }
+
+    // Adds every account of `batch` at once, for migrations: build a Database with the same credential and property
+    // types as this one (addAccount, setCredential, addProperty) and pass it in. Accounts with an empty username or
+    // password are skipped, and so are usernames that are already taken or repeat earlier in the batch (the first one wins).
+    // Duplicates inside the batch are found by sorting the username hashes instead of probing one account at a time,
+    // the index is sized for the whole batch up front and the accounts are appended in one pass with the locks taken once.
+    // Plaintext passwords are hashed with the current cost on every pool thread first (hashSeconds), passwords that are
+    // PasswordHash records already are stored as they are. hashPasswords = false stores plaintext ones as they are too,
+    // they get hashed the next time they log in (see countOutdatedPasswords()).
+    ImportStats importAccounts(const Database& batch, bool hashPasswords = true) {
+        OperationStats::Scope stat(operationStats, OperationStats::WRITE);
+        checkWritable();
+        auto started = std::chrono::steady_clock::now();
+        ImportStats stats;
+        if (batch.credentialTypes() != 2 || batch.propertyTypes() != db.propertyTypes()) {
+            throw std::invalid_argument("Batch must have 2 credential types and the same property types as the database");
+        }
+        std::size_t count = batch.accountCount();
+        if (count > static_cast<std::size_t>(INT32_MAX)) {
+            throw std::invalid_argument("Batch is too big");
+        }
+
+        // (hash, position) sorted, so equal usernames end up next to each other with the first one in front
+        std::vector<std::uint64_t> order;
+        order.reserve(count);
+        for (std::size_t i = 0; i < count; i++) {
+            if (batch.credential(0, i).empty() || batch.credential(1, i).empty()) {
+                stats.invalid++;
+                continue;
+            }
+            std::uint64_t hash = UsernameIndex::hashUsername(batch.credential(0, i));
+            order.push_back(hash << 32 | i);
+        }
+        std::sort(order.begin(), order.end());
+
+        std::vector<bool> keep(count, false);
+        std::vector<std::uint32_t> hashes(count, 0);
+        std::vector<std::size_t> perPartition(kIndexPartitions, 0);
+        for (std::size_t i = 0; i < order.size(); i++) {
+            std::uint32_t hash = static_cast<std::uint32_t>(order[i] >> 32);
+            std::size_t position = static_cast<std::uint32_t>(order[i]);
+            bool repeated = false;
+            // different usernames can share a hash, so compare with every kept one in the run
+            for (std::size_t j = i; j > 0 && static_cast<std::uint32_t>(order[j - 1] >> 32) == hash && !repeated; j--) {
+                std::size_t earlier = static_cast<std::uint32_t>(order[j - 1]);
+                repeated = keep[earlier] && batch.credential(0, earlier) == batch.credential(0, position);
+            }
+            if (repeated) {
+                stats.duplicates++;
+                continue;
+            }
+            keep[position] = true;
+            hashes[position] = hash;
+            perPartition[UsernameIndex::partitionOfHash(hash, kIndexPartitions)]++;
+        }
+        // back in batch order, so account numbers follow the batch
+        std::vector<std::uint32_t> kept;
+        kept.reserve(order.size());
+        for (std::size_t i = 0; i < count; i++) {
+            if (keep[i])
+                kept.push_back(static_cast<std::uint32_t>(i));
+        }
+        order = std::vector<std::uint64_t>();
+        keep = std::vector<bool>();
+
+        // hash the plaintext passwords on the pool in chunks, before any lock is taken. Records that are hashed already
+        // (e.g. moved over from another database) are kept as they are. Names that are taken dont need one
+        auto hashStarted = std::chrono::steady_clock::now();
+        kept.erase(std::remove_if(kept.begin(), kept.end(), [&](std::uint32_t i) {
+            bool taken = lookupAccount(std::string(batch.credential(0, i))) >= 0;
+            stats.duplicates += taken;
+            return taken;
+        }), kept.end());
+        std::vector<std::string> records(kept.size());
+        if (!hashPasswords) {
+            for (std::size_t n = 0; n < kept.size(); n++)
+                records[n] = std::string(batch.credential(1, kept[n]));
+        } else {
+            std::uint32_t cost = passwordHashCost;
+            std::size_t chunks = (std::min)(kept.size(), hashPool.threads() * 4);
+            std::vector<std::future<void>> hashed;
+            for (std::size_t c = 0; c < chunks; c++) {
+                std::size_t first = kept.size() * c / chunks, last = kept.size() * (c + 1) / chunks;
+                hashed.push_back(hashPool.submit([&batch, &kept, &records, cost, first, last] {
+                    for (std::size_t n = first; n < last; n++) {
+                        std::string_view password = batch.credential(1, kept[n]);
+                        records[n] = PasswordHash::isRecord(password) ? std::string(password) : PasswordHash::hash(password, cost);
+                    }
+                }));
+            }
+            // every chunk has to be done before an exception leaves here, they point into this frame
+            for (auto &chunk : hashed)
+                chunk.wait();
+            for (auto &chunk : hashed)
+                chunk.get();
+        }
+        stats.hashSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - hashStarted).count();
+
+        std::uint64_t lsn = 0;
+        {
+            // like addCredentials: new accounts are invisible until published, so readers of existing ones keep going
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            std::vector<std::unique_lock<std::shared_mutex>> indexGuards;
+            for (auto &stripe : indexLocks)
+                indexGuards.emplace_back(stripe.lock);
+            if (db.credentials.empty()) {
+                throw std::runtime_error("Database is not initialized");
+            }
+            for (std::size_t p = 0; p < kIndexPartitions; p++)
+                usernameIndex[p].reserve(usernameIndex[p].size() + perPartition[p]);
+            std::vector<std::uint32_t> added;
+            added.reserve(kept.size());
+
+            // the slots are spread over the whole table, so ask for the ones a few accounts ahead while inserting this one
+            const std::size_t kPrefetchDistance = 16;
+            for (std::size_t n = 0; n < kept.size(); n++) {
+                if (n + kPrefetchDistance < kept.size()) {
+                    std::uint32_t ahead = hashes[kept[n + kPrefetchDistance]];
+                    usernameIndex[UsernameIndex::partitionOfHash(ahead, kIndexPartitions)].prefetch(ahead);
+                }
+                std::size_t i = kept[n];
+                std::string_view username = batch.credential(0, i);
+                // indexed under the next account number first, which also tells if the username is taken
+                int accountNumber = db.nextAccountNumber();
+                if (!usernameIndex[partitionOf(username)].insert(accountNumber, username, db)) {
+                    stats.duplicates++;
+                    continue;
+                }
+                // same as addCredentials(), a reused slot needs its stripe
+                std::unique_lock<std::shared_mutex> accountGuard;
+                if (isAccount(accountNumber))
+                    accountGuard = std::unique_lock<std::shared_mutex>(accountLock(accountNumber));
+                db.addAccount();
+                db.setCredential(0, accountNumber, username);
+                db.setCredential(1, accountNumber, records[n]);
+                for (std::size_t p = 0; p < db.propertyTypes(); p++) {
+                    std::size_t values = batch.propertyCount(p, i);
+                    for (std::size_t k = 0; k < values; k++)
+                        db.addPropertyId(p, accountNumber, internValue(batch.property(p, i, k)));
+                }
+                accountGuard = std::unique_lock<std::shared_mutex>();
+                markChanged(accountNumber);
+                added.push_back(static_cast<std::uint32_t>(accountNumber));
+                stats.added++;
+
+                // journaled as the same records addCredentials() and addProperty() write, with one fsync wait at the end
+                std::uint64_t logged = logMutation(JournalWriter().putU8(JOURNAL_ADD_CREDENTIALS).putString(username)
+                                                       .putString(records[n]));
+                for (std::size_t p = 0; p < db.propertyTypes() && logged != 0; p++) {
+                    std::size_t values = batch.propertyCount(p, i);
+                    for (std::size_t k = 0; k < values; k++) {
+                        logged = logMutation(JournalWriter().putU8(JOURNAL_ADD_PROPERTY).putU32(accountNumber)
+                                                 .putU32(static_cast<std::uint32_t>(p)).putString(batch.property(p, i, k)));
+                    }
+                }
+                lsn = logged != 0 ? logged : lsn;
+            }
+            if (stats.added > 0) {
+                if (valueIndex.isBuilt()) {
+                    std::unique_lock<std::shared_mutex> valueGuard(valueIndexLock);
+                    for (std::uint32_t account : added) {
+                        for (std::size_t p = 0; p < db.propertyTypes(); p++) {
+                            std::size_t values = db.propertyCount(p, account);
+                            for (std::size_t k = 0; k < values; k++)
+                                valueIndex.add(p, account, db.propertyId(p, account, k));
+                        }
+                    }
+                }
+                version++;
+                publishAccountCount();
+            }
+        }
+        waitDurable(lsn);
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return stats;
+    }
+
+    // Deletes the account. It leaves a tombstone (see Database::deleteAccount), so no other account number changes,
+    // and the number is given to a new account again later, the oldest deleted one first.
+    void deleteCredentials(int accountNumber) {
+        OperationStats::Scope stat(operationStats, OperationStats::WRITE);
+        checkWritable();
+        std::uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            if (!isActiveAccount(accountNumber)) {
+                throw std::runtime_error("Account not found");
+            }
+            std::string_view username = db.credential(0, accountNumber);
+            std::unique_lock<std::shared_mutex> indexGuard(indexLock(username));
+            std::unique_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+            usernameIndex[partitionOf(username)].erase(username, db);
+            // the ids it had, to take it out of valueIndex after
+            std::vector<std::vector<std::uint32_t>> ids(db.propertyTypes());
+            for (std::size_t p = 0; p < db.propertyTypes(); p++) {
+                for (std::size_t k = 0; k < db.propertyCount(p, accountNumber); k++)
+                    ids[p].push_back(db.propertyId(p, accountNumber, k));
+            }
+            db.deleteAccount(accountNumber);
+            credentialsChanged(accountNumber);
+            // before the number can go to a new account
+            sessions.removeAccount(accountNumber);
+            for (std::size_t p = 0; p < ids.size(); p++) {
+                for (std::uint32_t id : ids[p])
+                    indexValueRemoved(p, accountNumber, id);
+            }
+            markChanged(accountNumber);
+            version++;
+            lsn = logMutation(JournalWriter().putU8(JOURNAL_DELETE_ACCOUNT).putU32(accountNumber));
+        }
+        waitDurable(lsn);
+    }
+
+    // Hashes the new password and replaces both credentials.
+    void editCredentials(int accountNumber, const std::string& username, const std::string& password) {
+        OperationStats::Scope stat(operationStats, OperationStats::WRITE);
+        checkWritable();
+        if (!isAccount(accountNumber)) {
+            throw std::runtime_error("Account not found");
+        }
+        editHashedCredentials(accountNumber, username, hashPassword(password));
+    }
+
+    // editCredentials() with a callback, see addCredentials(): `done` gets the account number on the hashing thread,
+    // or -1 if the edit failed there (the account was deleted or the new username taken in the meantime).
+    void editCredentials(int accountNumber, const std::string& username, const std::string& password, std::function<void(int)> done) {
+        auto started = std::chrono::steady_clock::now();
+        checkWritable();
+        if (!isAccount(accountNumber)) {
+            throw std::runtime_error("Account not found");
+        }
+        std::uint32_t cost = passwordHashCost;
+        hashPool.submitFor([this, accountNumber, username, password, cost, done, started] {
+            bool edited = false;
+            {
+                OperationStats::Scope stat(operationStats, OperationStats::WRITE, started);
+                try {
+                    editHashedCredentials(accountNumber, username, PasswordHash::hash(password, cost));
+                    edited = true;
+                } catch (const std::exception&) {
+                }
+            }
+            done(edited ? accountNumber : -1);
+        }, hashQueueWait());
+    }
+
+    // Returns a deep copy of the entire database. Costs a copy of every string, use getSnapshot() to just look at it.
+    Database getAllUsers() {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        if (db.credentials.empty()) {
+            throw std::runtime_error("Database is empty");
+        }
+        return this->db;
+    }
+
+    // Returns a read-only view of the entire database as it is now. It shares storage with the live database
+    // (copy-on-write, see storage.hpp) instead of copying it, so taking one costs O(blocks), and while nothing changes
+    // every call returns the same one. Writers keep going while it is held; only the blocks they change get copied.
+    // Drop it when done, it keeps those old blocks alive.
+    std::shared_ptr<const DatabaseSnapshot> getSnapshot() {
+        std::shared_ptr<const DatabaseSnapshot> snapshot; // released after writeMutex, its deleter takes the locks
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        snapshot = latestSnapshot.lock();
+        if (snapshot && snapshot->version == version) {
+            return snapshot;
+        }
+        std::shared_ptr<SnapshotOwner> owner = snapshotOwner;
+        std::shared_ptr<const DatabaseSnapshot> fresh(new DatabaseSnapshot{db.share(), version}, [owner](const DatabaseSnapshot* old) {
+            std::lock_guard<std::mutex> guard(owner->mutex);
+            if (!owner->auth) {
+                delete old;
+                return;
+            }
+            // same as dropView()
+            AllLocked lock(*owner->auth);
+            delete old;
+            owner->auth->releaseRetired();
+        });
+        latestSnapshot = fresh;
+        return fresh;
+    }
+
+    // Changes every time the database does, so a snapshot can tell if it is still current.
+    std::uint64_t getVersion() const {
+        return version;
+    }
+
+    // Number of account slots, so account numbers go from 0 to getAccountCount() - 1. Deleted accounts keep their slot
+    // until it is reused, getDeletedAccountCount() of them are empty.
+    std::size_t getAccountCount() const {
+        return accounts.load(std::memory_order_acquire);
+    }
+
+    // False for a number out of range and for a deleted account, the calls that take an account number throw for those.
+    bool accountExists(int accountNumber) {
+        if (!isAccount(accountNumber)) {
+            return false;
+        }
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        return isActiveAccount(accountNumber);
+    }
+
+    std::size_t getDeletedAccountCount() {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        return db.deletedCount();
+    }
+
+    std::size_t getPropertyTypeCount() const {
+        std::shared_lock<std::shared_mutex> accountGuard(accountLocks[0].lock);
+        return db.propertyTypes();
+    }
+
+    // Number of values the account has for propertyIndex.
+    std::size_t getPropertyCount(int accountNumber, std::size_t propertyIndex) const {
+        checkPropertyArgs(accountNumber, propertyIndex);
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        return db.propertyCount(propertyIndex, accountNumber);
+    }
+
+    int getAccountNumberOfUser(const std::string& username) {
+        OperationStats::Scope stat(operationStats, OperationStats::LOOKUP);
+        return lookupAccount(username);
+    }
+
+    // The stored password: a PasswordHash record, or plaintext for an account that hasnt logged in since 5.1.
+    // Returns a copy, the stored bytes can be moved by a compaction (or an eviction) as soon as the lock is let go.
+    std::string getPassword(int accountNumber) {
+        if (!isAccount(accountNumber)) {
+            throw std::runtime_error("Account not found");
+        }
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        if (!isActiveAccount(accountNumber)) {
+            throw std::runtime_error("Account not found");
+        }
+        noteAccess(accountNumber);
+        return std::string(db.credential(1, accountNumber));
+    }
+
+    std::string getUsername(int accountNumber) {
+        if (!isAccount(accountNumber)) {
+            throw std::runtime_error("Account not found");
+        }
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        if (!isActiveAccount(accountNumber)) {
+            throw std::runtime_error("Account not found");
+        }
+        noteAccess(accountNumber);
+        return std::string(db.credential(0, accountNumber));
+    }
+
+    /* USER PROPERTIES */
+
+    bool checkProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber, const std::string& property) {
+        OperationStats::Scope stat(operationStats, OperationStats::PROPERTY_READ);
+        checkPropertyArgs(accountNumber, propertyIndex);
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        checkPropertyArgs(accountNumber, propertyIndex, propertyNumber);
+        return db.propertyId(propertyIndex, accountNumber, propertyNumber) == findValue(property);
+    }
+
+    void addProperty(int accountNumber, std::size_t propertyIndex, const std::string& property) {
+        OperationStats::Scope stat(operationStats, OperationStats::WRITE);
+        checkWritable();
+        std::uint64_t lsn;
+        {
+            // accounts and their property counts only change with writeMutex held, so the checks hold until we are done
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            checkPropertyArgs(accountNumber, propertyIndex);
+            if (!isActiveAccount(accountNumber)) {
+                throw std::runtime_error("Account not found");
+            }
+            std::uint32_t id = internValue(property);
+            std::unique_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+            db.addPropertyId(propertyIndex, accountNumber, id);
+            indexValueAdded(propertyIndex, accountNumber, id);
+            markChanged(accountNumber);
+            version++;
+            lsn = logMutation(JournalWriter().putU8(JOURNAL_ADD_PROPERTY).putU32(accountNumber)
+                                  .putU32(static_cast<std::uint32_t>(propertyIndex)).putString(property));
+        }
+        waitDurable(lsn);
+    }
+
+    void deleteProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber) {
+        OperationStats::Scope stat(operationStats, OperationStats::WRITE);
+        checkWritable();
+        std::uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            checkPropertyArgs(accountNumber, propertyIndex, propertyNumber);
+            std::unique_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+            std::uint32_t oldId = db.propertyId(propertyIndex, accountNumber, propertyNumber);
+            db.eraseProperty(propertyIndex, accountNumber, propertyNumber);
+            indexValueRemoved(propertyIndex, accountNumber, oldId);
+            markChanged(accountNumber);
+            version++;
+            lsn = logMutation(JournalWriter().putU8(JOURNAL_DELETE_PROPERTY).putU32(accountNumber)
+                                  .putU32(static_cast<std::uint32_t>(propertyIndex)).putU32(static_cast<std::uint32_t>(propertyNumber)));
+        }
+        waitDurable(lsn);
+    }
+
+    void editProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber, const std::string& newProperty) {
+        OperationStats::Scope stat(operationStats, OperationStats::WRITE);
+        checkWritable();
+        std::uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            checkPropertyArgs(accountNumber, propertyIndex, propertyNumber);
+            std::uint32_t id = internValue(newProperty);
+            std::unique_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+            std::uint32_t oldId = db.propertyId(propertyIndex, accountNumber, propertyNumber);
+            db.setPropertyId(propertyIndex, accountNumber, propertyNumber, id);
+            if (oldId != id) {
+                indexValueRemoved(propertyIndex, accountNumber, oldId);
+                indexValueAdded(propertyIndex, accountNumber, id);
+            }
+            markChanged(accountNumber);
+            version++;
+            lsn = logMutation(JournalWriter().putU8(JOURNAL_EDIT_PROPERTY).putU32(accountNumber)
+                                  .putU32(static_cast<std::uint32_t>(propertyIndex)).putU32(static_cast<std::uint32_t>(propertyNumber)).putString(newProperty));
+        }
+        waitDurable(lsn);
+    }
+
+    std::vector<std::vector<std::string>> getProperties(int accountNumber) {
+        OperationStats::Scope stat(operationStats, OperationStats::PROPERTY_READ);
+        std::shared_lock<std::shared_mutex> accountGuard;
+        if (isAccount(accountNumber))
+            accountGuard = std::shared_lock<std::shared_mutex>(accountLock(accountNumber));
+        std::vector<std::vector<std::string>> userProperties;
+        bool foundProperties = false;
+        for (size_t propIndex = 0; propIndex < db.propertyTypes(); ++propIndex) {
+            userProperties.push_back(std::vector<std::string>());
+            if (isAccount(accountNumber)) {
+                std::size_t count = db.propertyCount(propIndex, accountNumber);
+                for (std::size_t i = 0; i < count; i++)
+                    userProperties.back().emplace_back(db.property(propIndex, accountNumber, i));
+                if (count > 0)
+                    foundProperties = true;
+            }
+        }
+        if (!foundProperties)
+            userProperties.clear();
+        return userProperties;
+    }
+
+    std::size_t getPropertyNumber(int accountNumber, std::size_t propertyIndex, const std::string& property) {
+        OperationStats::Scope stat(operationStats, OperationStats::PROPERTY_READ);
+        if (property.empty()) {
+            throw std::invalid_argument("Property cannot be empty");
+        }
+        checkPropertyArgs(accountNumber, propertyIndex);
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+
+        std::uint32_t id = findValue(property);
+        std::size_t count = db.propertyCount(propertyIndex, accountNumber);
+        for (std::size_t i = 0; i < count; i++) {
+            if (db.propertyId(propertyIndex, accountNumber, i) == id) {
+                return i;
+            }
+        }
+        return static_cast<std::size_t>(-1);
+    }
+
+    std::size_t getPropertyIndex(int accountNumber, const std::string& property) {
+        OperationStats::Scope stat(operationStats, OperationStats::PROPERTY_READ);
+        if (property.empty()) {
+            throw std::invalid_argument("Property cannot be empty");
+        }
+        if (!isAccount(accountNumber)) {
+            return static_cast<std::size_t>(-1);
+        }
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        std::uint32_t id = findValue(property);
+        if (id == PropertyDictionary::kNotFound) {
+            return static_cast<std::size_t>(-1);
+        }
+        for (std::size_t propIndex = 0; propIndex < db.propertyTypes(); propIndex++) {
+            std::size_t count = db.propertyCount(propIndex, accountNumber);
+            if (count > 0 && db.propertyId(propIndex, accountNumber, count - 1) == id) {
+                return propIndex;
+            }
+        }
+        return static_cast<std::size_t>(-1);
+    }
+
+    std::size_t getPropertyIndexFromPropertyNumber(int accountNumber, std::size_t propertyNumber) {
+        if (!isAccount(accountNumber)) {
+            return static_cast<std::size_t>(-1);
+        }
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        for (std::size_t propIndex = 0; propIndex < db.propertyTypes(); propIndex++) {
+            if (propertyNumber < db.propertyCount(propIndex, accountNumber)) {
+                return propIndex;
+            }
+        }
+        return static_cast<std::size_t>(-1);
+    }
+
+    int getMaxNumberOfProperties() {
+        return this->numberOfProperties;
+    }
+
+    // True if any property type of the account has this value.
+    bool doesAccountHaveProperty(int accountNumber, std::string property) {
+        OperationStats::Scope stat(operationStats, OperationStats::PROPERTY_READ);
+        if (property.empty()) {
+            throw std::invalid_argument("Property cannot be empty");
+        }
+        if (!isAccount(accountNumber)) {
+            return false;
+        }
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        std::uint32_t id = findValue(property);
+        if (id == PropertyDictionary::kNotFound) {
+            return false;
+        }
+        for (std::size_t propIndex = 0; propIndex < db.propertyTypes(); propIndex++) {
+            if (db.hasPropertyId(propIndex, accountNumber, id)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // True if the account has this value for propertyIndex, e.g. hasProperty(account, 0, "PREMIUM") for a role.
+    // For the most used values (see PropertyColumn::masks) that is one dictionary lookup and a single AND.
+    bool hasProperty(int accountNumber, std::size_t propertyIndex, const std::string& property) const {
+        OperationStats::Scope stat(operationStats, OperationStats::PROPERTY_READ);
+        if (!isAccount(accountNumber)) {
+            return false;
+        }
+        checkPropertyArgs(accountNumber, propertyIndex);
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        std::uint32_t id = findValue(property);
+        return id != PropertyDictionary::kNotFound && db.hasPropertyId(propertyIndex, accountNumber, id);
+    }
+
+    // Registers a property value that gets checked often, like a role, and returns a handle for hasKnownProperty().
+    // Registering the same value again returns the same handle. At most kMaxKnownValues values.
+    KnownValue registerValue(const std::string& value) {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        for (std::size_t i = 0; i < knownValues.size(); i++) {
+            if (knownValues[i] == value)
+                return KnownValue{i};
+        }
+        if (knownValues.size() == kMaxKnownValues) {
+            throw std::runtime_error("Too many registered values");
+        }
+        std::size_t index = knownValues.size();
+        knownIds[index] = db.dictionary.find(value, db.strings); // the writer is the only one changing the dictionary
+        knownValues.push_back(value);
+        return KnownValue{index};
+    }
+
+    // hasProperty() for a registered value. Its dictionary id is kept up to date as the dictionary changes, so this is
+    // the account's stripe lock and a single AND (for the most used values), without hashing the value or taking the
+    // dictionary lock every reader shares.
+    bool hasKnownProperty(int accountNumber, std::size_t propertyIndex, KnownValue value) const {
+        if (propertyIndex >= db.propertyTypes()) {
+            throw std::runtime_error("Property index out of range");
+        }
+        if (value.index >= kMaxKnownValues) {
+            throw std::invalid_argument("Not a registered value");
+        }
+        return hasKnownValue(accountNumber, propertyIndex, value.index);
+    }
+
+    /* PROPERTY QUERIES */
+    // Answered from an index of property value -> accounts (see PropertyValueIndex) instead of walking every account,
+    // so they cost about the size of the result. The index is built the first time one of them is called.
+
+    // Accounts that have `property` for propertyIndex, e.g. getAccountsWithProperty(0, "ADMIN") lists every admin.
+    AccountSet getAccountsWithProperty(std::size_t propertyIndex, const std::string& property) {
+        return findAccounts(propertyIndex, {property});
+    }
+
+    std::size_t countAccountsWithProperty(std::size_t propertyIndex, const std::string& property) {
+        OperationStats::Scope stat(operationStats, OperationStats::QUERY);
+        if (propertyIndex >= getPropertyTypeCount()) {
+            throw std::runtime_error("Property index out of range");
+        }
+        std::shared_lock<std::shared_mutex> valueGuard = readValueIndex();
+        return valueIndex.accounts(propertyIndex, findValue(property)).size();
+    }
+
+    // Accounts that have every value in `required` and none in `excluded` for propertyIndex,
+    // e.g. findAccounts(0, {"PREMIUM"}, {"ADMIN"}) for premium accounts that arent admins.
+    // Starts from the smallest required set, so the work is bounded by it rather than by the number of accounts.
+    AccountSet findAccounts(std::size_t propertyIndex, const std::vector<std::string>& required,
+                            const std::vector<std::string>& excluded = {}) {
+        OperationStats::Scope stat(operationStats, OperationStats::QUERY);
+        if (required.empty()) {
+            throw std::invalid_argument("At least one required property is needed");
+        }
+        if (propertyIndex >= getPropertyTypeCount()) {
+            throw std::runtime_error("Property index out of range");
+        }
+        std::shared_lock<std::shared_mutex> valueGuard = readValueIndex();
+        std::vector<const AccountSet*> all;
+        for (const auto &property : required)
+            all.push_back(&valueIndex.accounts(propertyIndex, findValue(property)));
+        std::sort(all.begin(), all.end(), [](const AccountSet* a, const AccountSet* b) { return a->size() < b->size(); });
+
+        AccountSet result = *all[0];
+        for (std::size_t i = 1; i < all.size() && !result.empty(); i++)
+            result = result.intersection(*all[i]);
+        for (std::size_t i = 0; i < excluded.size() && !result.empty(); i++)
+            result = result.difference(valueIndex.accounts(propertyIndex, findValue(excluded[i])));
+        return result;
+    }
+
+    /* SAVING / LOADING / ENCRYPTING / DECRYPTING DATABASE */
+
+    // Saves in the mappable format described in databaseFile.hpp. The file is written next to `filename`
+    // and then renamed over it, so a crash while saving never leaves a half written database behind.
+    // With encrypted = true the strings are encrypted on the way to disk (see startSnapshot()).
+    void saveDatabase(const std::string& filename, bool encrypted = false) {
+        waitForSnapshot();
+        startSnapshot(filename, encrypted);
+        SnapshotStats stats = waitForSnapshot();
+        if (!stats.ok) {
+            throw std::runtime_error(stats.error);
+        }
+    }
+
+    // Starts saving the database to `filename` on a background thread and returns right away; reads and writes keep
+    // working while it runs. The snapshot is the state at the moment of the call: it shares the database storage and
+    // blocks are only copied when a writer changes them (copy-on-write), so it costs O(blocks) up front and only the
+    // memory of what gets changed meanwhile. With encrypted = true the strings are encrypted on the way to disk with
+    // the offset based keystream from cipher.hpp, so the in-memory database stays decrypted and loadDatabase()
+    // decrypts the file by itself.
+    // Returns false if a snapshot is already running. Use waitForSnapshot() to get the result.
+    bool startSnapshot(const std::string& filename, bool encrypted) {
+        return beginSnapshot(filename, encrypted, false, false);
+    }
+
+    // Like startSnapshot(), but the file is only a copy for someone else (a replica): it doesnt replace the database
+    // file this one loads from, and the journal keeps the records it contains. With compact = true it is written in
+    // the compact format (see saveCompactBackup()), a replica loads that just as well and it is much smaller to send.
+    bool startSnapshotCopy(const std::string& filename, bool encrypted, bool compact = false) {
+        return beginSnapshot(filename, encrypted, true, compact);
+    }
+
+    // Saves a backup in the compact format from compactFile.hpp: sorted and front coded usernames, varint lengths,
+    // property values as dictionary ids and compressed blocks, usually a fraction of the size of saveDatabase()'s file.
+    // loadDatabase() reads it, but it is parsed instead of mapped, so it suits backups and transfers better than the
+    // file the server runs from. Like startSnapshotCopy() it leaves the journal alone. compressed = false skips the
+    // block compression for a faster save and a bigger file.
+    void saveCompactBackup(const std::string& filename, bool encrypted = false, bool compressed = true) {
+        waitForSnapshot();
+        beginSnapshot(filename, encrypted, true, true, compressed);
+        SnapshotStats stats = waitForSnapshot();
+        if (!stats.ok) {
+            throw std::runtime_error(stats.error);
+        }
+    }
+
+    bool isSnapshotRunning() const {
+        return snapshotRunning;
+    }
+
+    // Blocks until the running snapshot (if any) is done and returns the result of the last one.
+    SnapshotStats waitForSnapshot() {
+        std::lock_guard<std::mutex> guard(snapshotMutex);
+        if (snapshotThread.joinable()) {
+            snapshotThread.join();
+        }
+        return lastSnapshot;
+    }
+
+    // Writes the pre 4.1 format (length prefixed strings), for tools that still need to read it.
+    void saveLegacyDatabase(const std::string& filename) {
+        OperationStats::Scope stat(operationStats, OperationStats::SAVE);
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Could not open file for writing: " + filename);
+        }
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+
+        std::size_t accounts = db.accountCount();
+
+        // Save credentials
+        size_t credentialTypes = db.credentialTypes();
+        file.write(reinterpret_cast<const char*>(&credentialTypes), sizeof(credentialTypes));
+        for (size_t i = 0; i < credentialTypes; i++) {
+            size_t numAccounts = accounts;
+            file.write(reinterpret_cast<const char*>(&numAccounts), sizeof(numAccounts));
+            for (size_t j = 0; j < numAccounts; j++) {
+                writeString(file, db.credential(i, j));
+            }
+        }
+
+        // Save properties
+        size_t propertyTypes = db.propertyTypes();
+        file.write(reinterpret_cast<const char*>(&propertyTypes), sizeof(propertyTypes));
+        for (size_t i = 0; i < propertyTypes; i++) {
+            size_t numAccounts = accounts;
+            file.write(reinterpret_cast<const char*>(&numAccounts), sizeof(numAccounts));
+            for (size_t j = 0; j < numAccounts; j++) {
+                size_t numProperties = db.propertyCount(i, j);
+                file.write(reinterpret_cast<const char*>(&numProperties), sizeof(numProperties));
+                for (size_t k = 0; k < numProperties; k++) {
+                    writeString(file, db.property(i, j, k));
+                }
+            }
+        }
+
+        file.close();
+    }
+
+    // Loads any format. Version 1 files are mapped and used in place, so only the pages that lookups
+    // actually touch are read from disk. Compact files and older files are parsed into memory.
+    bool loadDatabase(const std::string& filename) {
+        OperationStats::Scope stat(operationStats, OperationStats::LOAD);
+        waitForSnapshot();
+        std::lock_guard<std::mutex> compactGuard(compactionMutex);
+        AllLocked lock(*this);
+        version++;
+        decryptedOnLoad = false;
+        valueIndex.reset();
+        sessions.clear(); // the account numbers mean other accounts now
+        coldCopies.clear();
+        bool loaded;
+        if (DatabaseFile::hasMagic(filename))
+            loaded = mapDatabase(filename);
+        else if (CompactFile::hasMagic(filename))
+            loaded = loadCompactDatabase(filename);
+        else
+            loaded = loadLegacyDatabase(filename);
+        refreshKnownValues();
+        replicationLog.reset(currentLsn());
+        return loaded;
+    }
+
+    void encryptDatabase() {
+        // a running snapshot or compaction may still read the page file records this releases
+        waitForSnapshot();
+        std::lock_guard<std::mutex> compactGuard(compactionMutex);
+        AllLocked lock(*this);
+        if (db.credentials.empty() && db.properties.empty()) {
+            throw std::runtime_error("Cannot encrypt empty database");
+        }
+        Cipher::Keystream cipher(encryptionKey());
+        std::uint64_t offset = 0;
+        std::string value;
+
+        // the key index runs across every string in file order, so the output matches older versions.
+        // Neither the arena nor page file records are changed in place (getSnapshot() views and handed out
+        // string_views still read the old bytes), the encrypted string becomes a new one and the old one garbage.
+        auto encryptString = [&](Column<StringRef>& column, std::size_t j) {
+            StringRef ref = column[j];
+            if (PageFile::isCold(ref)) {
+                value.assign(db.cold->view(ref));
+                cipher.apply(&value[0], value.size(), offset);
+                column.set(j, db.cold->add(value));
+                db.cold->release(ref);
+            } else if (ref.length > 0) {
+                value.assign(db.strings.view(ref));
+                cipher.apply(&value[0], value.size(), offset);
+                column.set(j, db.strings.append(value));
+                db.strings.release(ref);
+            }
+            offset += PageFile::lengthOf(ref);
+        };
+
+        std::size_t accounts = db.accountCount();
+
+        // Encrypt credentials
+        for (auto &credVector : db.credentials) {
+            for (std::size_t j = 0; j < accounts; j++) {
+                encryptString(credVector, j);
+            }
+        }
+        if (db.cold)
+            db.cold->flush();
+        // their records hold the old strings now
+        for (auto &copy : coldCopies) {
+            for (StringRef ref : copy.second)
+                db.cold->release(ref);
+        }
+        coldCopies.clear();
+
+        // Encrypt properties. Every use of a value gets its own key position, so equal values dont stay equal:
+        // each one is encrypted on its own and interned again into a new dictionary (decrypting collapses them back).
+        PropertyDictionary dictionary;
+        for (std::size_t i = 0; i < db.propertyTypes(); i++) {
+            PropertyColumn& propertyType = db.properties[i];
+            for (std::size_t j = 0; j < accounts; j++) {
+                PropertyList list = propertyType.lists[j];
+                for (std::uint32_t k = 0; k < list.count; k++) {
+                    value.assign(db.property(i, j, k));
+                    cipher.apply(&value[0], value.size(), offset);
+                    offset += value.size();
+                    propertyType.values.set(list.begin + k, dictionary.intern(value, db.strings));
+                }
+            }
+        }
+        db.dictionary = std::move(dictionary);
+        refreshKnownValues();
+        valueIndex.reset();
+        for (std::size_t i = 0; i < db.propertyTypes(); i++) {
+            for (std::size_t j = 0; j < accounts; j++)
+                db.updateMask(i, j);
+        }
+
+        version++;
+        // usernames changed, so their hashes did too
+        rebuildIndex();
+        replicationLog.reset(currentLsn());
+    }
+
+    void decryptDatabase() {
+        // XOR decryption is identical to encryption.
+        encryptDatabase();
+    }
+
+    // True if the last loadDatabase() read a file saved with encrypted = true; it is already decrypted then,
+    // and decryptDatabase() must not be called on top.
+    bool wasDecryptedOnLoad() const {
+        return decryptedOnLoad;
+    }
+
+    /* SESSIONS */
+
+    // A session maps a token to an account, so requests after a login dont have to send or look up the username:
+    // resolveSession() is an array index and a compare (sessionTable.hpp). Tokens are 48 hex characters.
+    // Sessions end after getSessionLifetime() (30 minutes by default), with endSession(), and when the account is
+    // deleted or its credentials are edited. Loading or initializing the database ends all of them.
+
+    // Starts a session for an account the caller has already authenticated (e.g. one it just registered).
+    std::string createSession(int accountNumber) {
+        std::shared_lock<std::shared_mutex> accountGuard(accountLock(accountNumber));
+        if (!isActiveAccount(accountNumber)) {
+            throw std::runtime_error("Account not found");
+        }
+        return sessions.create(accountNumber);
+    }
+
+    // The account number of a session, -1 if the token is unknown or the session ended.
+    int resolveSession(std::string_view token) const {
+        OperationStats::Scope stat(operationStats, OperationStats::SESSION);
+        return sessions.resolve(token);
+    }
+
+    // Logs the session out. Returns false if it had already ended.
+    bool endSession(std::string_view token) {
+        return sessions.remove(token);
+    }
+
+    // For sessions started from now on.
+    void setSessionLifetime(std::chrono::seconds lifetime) {
+        sessions.setLifetime(lifetime);
+    }
+
+    std::chrono::seconds getSessionLifetime() const {
+        return sessions.getLifetime();
+    }
+
+    // Frees expired sessions. Starting a session does this too, so this is only needed when few are started.
+    std::size_t expireSessions() {
+        return sessions.expire();
+    }
+
+    std::size_t getSessionCount() const {
+        return sessions.size();
+    }
+
+    /* USERNAME FILTER */
+
+    // Puts a Bloom filter (usernameFilter.hpp) in front of every username index partition, so looking up a name that
+    // doesnt exist (a typo, a bot, a REGISTER checking the name is free) is usually answered from one cache line
+    // without probing the index or reading a username. It takes about 3 bytes per account and is saved with the
+    // database; loadDatabase() uses the saved one if the filter is already on, otherwise it is built from the index.
+    // With the filter on, checkCredentials() answers an unknown username right away instead of hashing the password
+    // against a dummy record, which saves a hash per bad login but lets a caller time whether a username exists.
+    // Only turn it on where that is public anyway, e.g. when REGISTER already says a name is taken.
+    void enableUsernameFilter(bool enabled) {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        usernameFilterEnabled = enabled;
+        for (std::size_t i = 0; i < kIndexPartitions; i++) {
+            std::unique_lock<std::shared_mutex> indexGuard(indexLocks[i].lock);
+            if (!enabled)
+                usernameIndex[i].disableFilter();
+            else if (!usernameIndex[i].hasFilter())
+                usernameIndex[i].enableFilter();
+        }
+    }
+
+    bool isUsernameFilterEnabled() const {
+        return usernameFilterEnabled;
+    }
+
+    // Bytes the username filters take, 0 while the filter is off.
+    std::size_t getUsernameFilterMemory() const {
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < kIndexPartitions; i++) {
+            std::shared_lock<std::shared_mutex> indexGuard(indexLocks[i].lock);
+            bytes += usernameIndex[i].usernameFilter().memoryUsage();
+        }
+        return bytes;
+    }
+
+    /* PASSWORD HASHING */
+
+    // Cost (PBKDF2 iterations) for passwords hashed from now on, PasswordHash::kDefaultIterations by default.
+    // Every record keeps its own cost, so raising it doesnt invalidate anything: an account is moved to the new cost
+    // the next time it logs in. Lower it only for tests and benchmarks.
+    void setPasswordHashCost(std::uint32_t iterations) {
+        if (iterations == 0 || iterations > PasswordHash::kMaxIterations) {
+            throw std::invalid_argument("Password hash cost out of range");
+        }
+        passwordHashCost = iterations;
+    }
+
+    std::uint32_t getPasswordHashCost() const {
+        return passwordHashCost;
+    }
+
+    // Sizes the hashing pool: `threads` workers (0 = one per core) and room for queueCapacity waiting hashes.
+    // A login or new password that finds the queue full waits up to maxQueueWait for room, then throws
+    // std::runtime_error so the caller can turn it away. Waits for hashes that are queued already.
+    void configureHashing(std::size_t threads, std::size_t queueCapacity, std::chrono::milliseconds maxQueueWait) {
+        if (maxQueueWait.count() < 0) {
+            throw std::invalid_argument("Hashing queue wait cannot be negative");
+        }
+        hashPool.configure(threads, queueCapacity);
+        hashQueueWaitMs = maxQueueWait.count();
+    }
+
+    // Queue depth and latency of the hashing pool.
+    HashPoolStats getHashingStats() const {
+        return hashPool.stats();
+    }
+
+    // Accounts whose password is still plaintext or hashed with a lower cost than the current one, i.e. the ones that
+    // havent logged in since the cost was raised. Scans a snapshot, so it doesnt block anyone.
+    std::size_t countOutdatedPasswords() {
+        OperationStats::Scope stat(operationStats, OperationStats::QUERY);
+        std::shared_ptr<const DatabaseSnapshot> snapshot = getSnapshot();
+        const Database& data = snapshot->data;
+        std::uint32_t cost = passwordHashCost;
+        std::size_t outdated = 0;
+        for (std::size_t i = 0; i < data.accountCount(); i++) {
+            if (!data.isDeleted(i) && PasswordHash::costOf(data.credential(1, i)) < cost)
+                outdated++;
+        }
+        return outdated;
+    }
+
+    /* COMPACTION */
+
+    // Strings and property values that were deleted or replaced stay in memory as garbage (see Database::garbageBytes()).
+    // Compacting copies what is still used into fresh storage and frees the rest. Account numbers dont change: deleted
+    // accounts keep their slot as a tombstone for the next new account.
+    // The copy is made without blocking reads or writes; they only wait while the accounts that changed in the meantime
+    // are copied again and the copy is swapped in (pauseSeconds). The old storage is freed right away: the getters
+    // return copies, and a getSnapshot() view keeps the chunks it shares alive by itself.
+    CompactionStats compact() {
+        StringArena old;
+        return runCompaction(old);
+    }
+
+    // Starts a background thread that runs compact() whenever the garbage is at least `threshold` of the stored bytes
+    // and at least minGarbageBytes.
+    void startCompactor(double threshold = 0.25, std::size_t minGarbageBytes = std::size_t(16) << 20) {
+        if (threshold <= 0 || threshold > 1) {
+            throw std::invalid_argument("Compaction threshold must be between 0 and 1");
+        }
+        stopCompactor();
+        std::lock_guard<std::mutex> guard(compactorMutex);
+        compactionThreshold = threshold;
+        compactionMinBytes = minGarbageBytes;
+        compactorStop = false;
+        compactorThread = std::thread(&easyAuth::runCompactor, this);
+    }
+
+    void stopCompactor() {
+        std::thread stopping;
+        {
+            std::lock_guard<std::mutex> guard(compactorMutex);
+            compactorStop = true;
+            stopping = std::move(compactorThread);
+        }
+        compactorWake.notify_all();
+        if (stopping.joinable()) {
+            stopping.join();
+        }
+    }
+
+    // Result of the last compaction, waits for a running one.
+    CompactionStats getLastCompaction() {
+        std::lock_guard<std::mutex> compactGuard(compactionMutex);
+        return lastCompaction;
+    }
+
+    // Garbage as a fraction of the stored string and property bytes, what startCompactor() compares with its threshold.
+    double getGarbageRatio() {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        std::size_t stored = db.storedBytes();
+        return stored == 0 ? 0 : static_cast<double>(db.garbageBytes()) / stored;
+    }
+
+    /* TIERED STORAGE */
+
+    // Keeps only the credentials of recently used accounts in memory: a background thread moves the ones that werent
+    // used for a while to a page file (pageFile.hpp, `pageFilename` plus a number) whenever the strings in memory grow
+    // past `memoryBudget` bytes, and brings an account back once it logs in or is read with getUsername() /
+    // getPassword(). Reads of a cold account go to the page file through a mapping, so they work at any time.
+    // Only credentials move: property values are dictionary ids (4 bytes an account) and the distinct values stay in
+    // memory, and so do the fixed size parts of every account (refs, lists, masks and the index, about 50 bytes).
+    // Enable it before loadDatabase() and the load leaves every account in the page file instead of reading the
+    // strings in, otherwise the accounts go there a batch at a time. The memory accounts leave behind is only freed by
+    // a compaction, so run the compactor too (startCompactor()). The page file is deleted when it is closed
+    // and made again by every load.
+    // Throws std::runtime_error if the page file cant be created, later errors are in getTieredStorageStats().
+    void enableTieredStorage(const std::string& pageFilename, std::size_t memoryBudget) {
+        if (pageFilename.empty()) {
+            throw std::invalid_argument("Page file name cannot be empty");
+        }
+        stopTiering();
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            this->pageFilename = pageFilename;
+            this->memoryBudget = memoryBudget;
+            // made up front, so a bad name throws here instead of on the tiering thread
+            if (!db.cold)
+                db.cold = createPageFile();
+            accessClock.resize(db.accountCount());
+            tiered.store(true, std::memory_order_release);
+        }
+        std::lock_guard<std::mutex> guard(tieringMutex);
+        tieringStop = false;
+        tieringThread = std::thread(&easyAuth::runTiering, this);
+    }
+
+    // Brings every account back into memory and stops moving them out. The page file stays open for string_views
+    // that were handed out, until the next load.
+    void disableTieredStorage() {
+        stopTiering();
+        std::lock_guard<std::mutex> compactGuard(compactionMutex);
+        AllLocked lock(*this);
+        if (!tiered)
+            return;
+        for (std::size_t i = 0; i < db.accountCount(); i++) {
+            if (!db.isDeleted(i))
+                db.moveToMemory(i);
+        }
+        for (auto &copy : coldCopies) {
+            for (StringRef ref : copy.second)
+                db.cold->release(ref);
+        }
+        coldCopies.clear();
+        tiered = false;
+        accessClock.reset();
+        clockHand = 0;
+    }
+
+    bool isTieredStorageEnabled() const {
+        return tiered;
+    }
+
+    TieredStorageStats getTieredStorageStats() {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        TieredStorageStats stats;
+        stats.enabled = tiered;
+        stats.memoryBudget = memoryBudget;
+        stats.residentBytes = db.strings.bytesUsed();
+        stats.coldAccounts = db.coldAccounts;
+        stats.promotions = promotions;
+        stats.evictions = evictions;
+        if (db.cold) {
+            stats.pageFileBytes = db.cold->size();
+            stats.pageFileGarbage = db.cold->garbageBytes();
+        }
+        stats.lastError = tieringError;
+        return stats;
+    }
+
+    /* STATS */
+
+    // What the database holds and what was done with it: account counts, bytes per component and, for every
+    // OperationStats::Operation, how many calls there were and how long they took (see operationStats.hpp, counting
+    // costs the calls a load and a store). Takes writeMutex for a moment to size the storage, like the other stats.
+    AuthStats getStats() {
+        AuthStats stats;
+        {
+            std::lock_guard<std::mutex> writeGuard(writeMutex);
+            stats.tombstones = db.deletedCount();
+            stats.accounts = db.accountCount() - stats.tombstones;
+            stats.coldAccounts = db.coldAccounts;
+            stats.version = version;
+            MemoryStats& memory = stats.memory;
+            memory.strings = db.strings.memoryUsage();
+            memory.garbage = db.garbageBytes();
+            for (const auto &cred : db.credentials)
+                memory.credentials += cred.memoryUsage();
+            for (const auto &prop : db.properties)
+                memory.properties += prop.lists.memoryUsage() + prop.values.memoryUsage() + prop.masks.memoryUsage();
+            memory.dictionary = db.dictionary.memoryUsage();
+            memory.tombstones = db.freeAccounts.memoryUsage();
+            for (const auto &partition : usernameIndex)
+                memory.usernameIndex += partition.memoryUsage();
+            memory.tiering = accessClock.memoryUsage();
+            for (const auto &copy : coldCopies)
+                memory.tiering += sizeof(copy) + copy.second.capacity() * sizeof(StringRef);
+            std::shared_lock<std::shared_mutex> valueGuard(valueIndexLock);
+            memory.valueIndex = valueIndex.memoryUsage();
+        }
+        stats.sessions = sessions.size();
+        stats.memory.sessions = sessions.memoryUsage();
+        stats.memory.replicationLog = replicationLog.stats().bytes;
+        for (std::size_t i = 0; i < OperationStats::kOperations; i++)
+            stats.operations[i] = operationStats.totals(static_cast<OperationStats::Operation>(i));
+        return stats;
+    }
+
+    /* JOURNAL */
+
+    // Replays the journal records that are newer than the loaded database, then logs every change from here on.
+    // Call it after loadDatabase() and decryptDatabase(), the records are replayed on top of the decrypted data.
+    bool openJournal(const std::string& filename) {
+        journal.setKey(XOR_KEY);
+        replaying = true;
+        bool opened;
+        try {
+            opened = journal.open(filename, snapshotLsn, [this](std::uint64_t, JournalReader& record) {
+                applyJournalRecord(record);
+            });
+        } catch (...) {
+            replaying = false;
+            throw;
+        }
+        replaying = false;
+        return opened;
+    }
+
+    void closeJournal() {
+        replicationLog.disable(); // no more records to give replicas
+        journal.close();
+    }
+
+    // If false, mutations return as soon as they are queued and the journal is flushed every few ms in the background.
+    void setJournalSync(bool waitForDisk) {
+        journalSync = waitForDisk;
+    }
+
+    /* REPLICATION */
+
+    // Keeps the newest journal records (up to maxBytes) in memory so replicas can pull them, see replication.hpp.
+    // Replicas follow the journal, so it has to be open. closeJournal() stops the log.
+    void startReplicationLog(std::size_t maxBytes = ReplicationLog::kDefaultMaxBytes) {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        if (!journal.isOpen()) {
+            throw std::runtime_error("Replication needs the journal open");
+        }
+        replicationLog.enable(maxBytes, journal.lastLsn());
+    }
+
+    void stopReplicationLog() {
+        replicationLog.disable();
+    }
+
+    // The records after afterLsn for a replica, see ReplicationLog::read(). False means it has to load a snapshot.
+    bool readReplicationLog(std::uint64_t epoch, std::uint64_t afterLsn, std::size_t maxBytes, std::chrono::milliseconds wait,
+                            std::vector<ReplicationLog::Record>& records) {
+        return replicationLog.read(epoch, afterLsn, maxBytes, wait, records);
+    }
+
+    ReplicationLogStats getReplicationLogStats() const {
+        return replicationLog.stats();
+    }
+
+    // Journal lsn of the newest change the database has: the journal's last record, or the lsn of the loaded file and
+    // the records applyReplicated() added on top.
+    std::uint64_t getJournalLsn() {
+        std::lock_guard<std::mutex> writeGuard(writeMutex);
+        return currentLsn();
+    }
+
+    // A read-only database (a replica) throws std::runtime_error for every change except the ones applyReplicated()
+    // makes, and logins dont upgrade old password records. Logins and sessions work as usual.
+    void setReadOnly(bool enabled) {
+        readOnly = enabled;
+    }
+
+    bool isReadOnly() const {
+        return readOnly;
+    }
+
+    // Applies a record the primary logged as `lsn` (see readReplicationLog()), from one thread at a time. Records the
+    // database already has are skipped and a gap throws, so does a record that doesnt apply (the replica has to load
+    // a snapshot then). A replica gets its changes from the primary, so its own journal has to be closed.
+    void applyReplicated(std::uint64_t lsn, std::string_view payload) {
+        if (journal.isOpen()) {
+            throw std::runtime_error("A replica cant have its own journal open");
+        }
+        std::uint64_t current = getJournalLsn();
+        if (lsn <= current)
+            return;
+        if (lsn != current + 1) {
+            throw std::runtime_error("Replication record out of order");
+        }
+        JournalReader record(payload);
+        replicatingLsn = lsn;
+        replicaApplier = std::this_thread::get_id();
+        try {
+            applyJournalRecord(record);
+        } catch (...) {
+            replicaApplier = std::thread::id();
+            throw;
+        }
+        replicaApplier = std::thread::id();
+    }
+};
+
+#endif // EasyAuth_HPP
@@ -0,0 +1,222 @@
+// hashPool.hpp
+// A fixed set of worker threads for password hashing, so the threads serving connections dont each burn a core on
+// the KDF: at most `threads` hashes run at once and the rest wait in a bounded queue. When the queue is full,
+// submitFor() waits up to a timeout for room and then throws, so a login burst is turned away early instead of
+// piling up requests that would time out anyway.
+// Stats report the queue depth and how long jobs waited and ran, as log2 histograms (percentiles are the upper
+// bound of their bucket, so they are within 2x).
+
+#ifndef EasyAuth_HASH_POOL_HPP
+#define EasyAuth_HASH_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct HashPoolStats {
+    std::size_t threads = 0;
+    std::size_t queueCapacity = 0;
+    std::size_t queueDepth = 0;      // jobs waiting right now
+    std::size_t maxQueueDepth = 0;   // most jobs waiting at once since the start
+    std::size_t running = 0;         // jobs being hashed right now
+    std::uint64_t completed = 0;
+    std::uint64_t rejected = 0;      // submitFor() calls that found the queue full for their whole timeout
+    double averageWaitMicros = 0;    // time in the queue
+    double averageRunMicros = 0;     // time hashing
+    double p50LatencyMicros = 0;     // queue + hashing
+    double p99LatencyMicros = 0;
+    double maxLatencyMicros = 0;
+};
+
+class HashPool {
+ public:
+    static constexpr std::size_t kDefaultQueueCapacity = 1024;
+
+    // threads = 0 uses one per core. The threads are started by the first job.
+    explicit HashPool(std::size_t threads = 0, std::size_t queueCapacity = kDefaultQueueCapacity) {
+        configure(threads, queueCapacity);
+    }
+
+    HashPool(const HashPool&) = delete;
+    HashPool& operator=(const HashPool&) = delete;
+
+    // Runs the jobs that are already queued, then stops.
+    ~HashPool() {
+        stop();
+    }
+
+    // Changes the size. Waits for the queued jobs to finish first.
+    void configure(std::size_t threads, std::size_t queueCapacity) {
+        if (queueCapacity == 0) {
+            throw std::invalid_argument("Hashing queue capacity cannot be 0");
+        }
+        stop();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threadCount = threads != 0 ? threads : (std::max)(1u, std::thread::hardware_concurrency());
+            capacity = queueCapacity;
+            stopping = false;
+        }
+        roomFree.notify_all();
+    }
+
+    // Queues `job` and returns its result as a future, waiting as long as it takes for room in the queue.
+    template <class Job>
+    std::future<typename std::invoke_result<Job>::type> submit(Job&& job) {
+        return enqueue(std::forward<Job>(job), nullptr);
+    }
+
+    // Same, but throws std::runtime_error if the queue is still full after `timeout`.
+    template <class Job>
+    std::future<typename std::invoke_result<Job>::type> submitFor(Job&& job, std::chrono::milliseconds timeout) {
+        return enqueue(std::forward<Job>(job), &timeout);
+    }
+
+    std::size_t threads() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return threadCount;
+    }
+
+    HashPoolStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        HashPoolStats out;
+        out.threads = threadCount;
+        out.queueCapacity = capacity;
+        out.queueDepth = queue.size();
+        out.maxQueueDepth = maxDepth;
+        out.running = running;
+        out.completed = completed;
+        out.rejected = rejected;
+        if (completed > 0) {
+            out.averageWaitMicros = waitMicros / completed;
+            out.averageRunMicros = runMicros / completed;
+            out.p50LatencyMicros = percentile(0.5);
+            out.p99LatencyMicros = percentile(0.99);
+        }
+        out.maxLatencyMicros = maxLatency;
+        return out;
+    }
+
+ private:
+    static constexpr std::size_t kBuckets = 40; // bucket b holds latencies below 2^b microseconds
+
+    struct Item {
+        std::function<void()> run;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    template <class Job>
+    std::future<typename std::invoke_result<Job>::type> enqueue(Job&& job, const std::chrono::milliseconds* timeout) {
+        using Result = typename std::invoke_result<Job>::type;
+        // std::function needs something copyable
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Job>(job));
+        std::future<Result> result = task->get_future();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        auto hasRoom = [this] { return !stopping && queue.size() < capacity; };
+        if (!timeout) {
+            roomFree.wait(lock, hasRoom);
+        } else if (!roomFree.wait_for(lock, *timeout, hasRoom)) {
+            rejected++;
+            throw std::runtime_error("Password hashing queue is full");
+        }
+        if (workers.empty()) {
+            for (std::size_t i = 0; i < threadCount; i++)
+                workers.emplace_back(&HashPool::work, this);
+        }
+        queue.push_back(Item{[task] { (*task)(); }, std::chrono::steady_clock::now()});
+        maxDepth = (std::max)(maxDepth, queue.size());
+        lock.unlock();
+        jobReady.notify_one();
+        return result;
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            jobReady.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return; // stopping, and everything queued is done
+            Item item = std::move(queue.front());
+            queue.pop_front();
+            running++;
+            lock.unlock();
+            roomFree.notify_one();
+
+            auto started = std::chrono::steady_clock::now();
+            item.run(); // a packaged_task, exceptions end up in the future
+            auto finished = std::chrono::steady_clock::now();
+
+            lock.lock();
+            running--;
+            completed++;
+            double waited = std::chrono::duration<double, std::micro>(started - item.queued).count();
+            double ran = std::chrono::duration<double, std::micro>(finished - started).count();
+            waitMicros += waited;
+            runMicros += ran;
+            maxLatency = (std::max)(maxLatency, waited + ran);
+            latencies[bucketOf(waited + ran)]++;
+        }
+    }
+
+    void stop() {
+        std::vector<std::thread> joining;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            joining.swap(workers);
+        }
+        jobReady.notify_all();
+        for (auto &worker : joining)
+            worker.join();
+    }
+
+    static std::size_t bucketOf(double micros) {
+        std::size_t bucket = 0;
+        while (bucket + 1 < kBuckets && micros >= static_cast<double>(std::uint64_t(1) << bucket))
+            bucket++;
+        return bucket;
+    }
+
+    double percentile(double p) const {
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b < kBuckets; b++) {
+            seen += latencies[b];
+            if (seen >= p * completed)
+                return (std::min)(static_cast<double>(std::uint64_t(1) << b), maxLatency);
+        }
+        return maxLatency;
+    }
+
+    mutable std::mutex mutex; // everything below
+    std::condition_variable jobReady;
+    std::condition_variable roomFree;
+    std::deque<Item> queue;
+    std::vector<std::thread> workers;
+    std::size_t threadCount = 1;
+    std::size_t capacity = kDefaultQueueCapacity;
+    bool stopping = false;
+
+    std::size_t running = 0;
+    std::size_t maxDepth = 0;
+    std::uint64_t completed = 0;
+    std::uint64_t rejected = 0;
+    double waitMicros = 0;
+    double runMicros = 0;
+    double maxLatency = 0;
+    std::uint64_t latencies[kBuckets] = {};
+};
+
+#endif // EasyAuth_HASH_POOL_HPP
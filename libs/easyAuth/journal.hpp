@@ -0,0 +1,395 @@
+// journal.hpp
+// Append-only write-ahead journal with group commit.
+// Every record is [u32 payload length][u32 crc32 of lsn + payload][u64 lsn][payload]. Records get increasing
+// log sequence numbers (lsn). Appends only copy the record into a buffer, a background thread writes everything
+// that piled up with one write + one fsync, and waitDurable() lets callers block until their record is on disk.
+// So many concurrent writers share a single fsync instead of paying one each.
+
+#ifndef EasyAuth_JOURNAL_HPP
+#define EasyAuth_JOURNAL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "crc32.hpp"
+#include "databaseFile.hpp"
+
+// Builds a record payload.
+class JournalWriter {
+ public:
+    JournalWriter& putU8(std::uint8_t value) {
+        data.push_back(static_cast<char>(value));
+        return *this;
+    }
+
+    JournalWriter& putU32(std::uint32_t value) {
+        char bytes[4];
+        for (int i = 0; i < 4; i++)
+            bytes[i] = static_cast<char>(value >> (i * 8));
+        data.append(bytes, 4);
+        return *this;
+    }
+
+    JournalWriter& putU64(std::uint64_t value) {
+        putU32(static_cast<std::uint32_t>(value));
+        return putU32(static_cast<std::uint32_t>(value >> 32));
+    }
+
+    JournalWriter& putString(std::string_view s) {
+        putU32(static_cast<std::uint32_t>(s.size()));
+        data.append(s.data(), s.size());
+        return *this;
+    }
+
+    const std::string& str() const {
+        return data;
+    }
+
+ private:
+    std::string data;
+};
+
+// Reads a record payload back. Reading past the end throws, so a record that decodes is complete.
+class JournalReader {
+ public:
+    explicit JournalReader(std::string_view payload) : data(payload) {}
+
+    std::uint8_t getU8() {
+        need(1);
+        return static_cast<std::uint8_t>(data[pos++]);
+    }
+
+    std::uint32_t getU32() {
+        need(4);
+        std::uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+            value |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[pos++])) << (i * 8);
+        return value;
+    }
+
+    std::uint64_t getU64() {
+        std::uint64_t low = getU32();
+        return low | (static_cast<std::uint64_t>(getU32()) << 32);
+    }
+
+    std::string getString() {
+        std::uint32_t length = getU32();
+        need(length);
+        std::string s(data.substr(pos, length));
+        pos += length;
+        return s;
+    }
+
+ private:
+    std::string_view data;
+    std::size_t pos = 0;
+
+    void need(std::size_t bytes) {
+        if (data.size() - pos < bytes)
+            throw std::runtime_error("Journal record is truncated");
+    }
+};
+
+class Journal {
+ public:
+    using ReplayHandler = std::function<void(std::uint64_t lsn, JournalReader& record)>;
+
+    static const std::size_t kRecordHeaderSize = 16;
+
+    Journal() = default;
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        close();
+    }
+
+    // Payload bytes are XORed with `key` (by position in the payload) so the journal isnt plaintext on disk.
+    void setKey(const std::string& newKey) {
+        key = newKey;
+    }
+
+    // How long an append may sit in the buffer when nobody is waiting for it.
+    void setFlushInterval(std::chrono::milliseconds interval) {
+        flushInterval = interval;
+    }
+
+    // Opens (or creates) the journal file and calls replay for every intact record with lsn > afterLsn, in order.
+    // A torn record at the end (crash mid write) and everything after it is dropped.
+    bool open(const std::string& filename, std::uint64_t afterLsn, const ReplayHandler& replay) {
+        close();
+        this->filename = filename;
+
+        std::vector<Record> records;
+        bool torn = false;
+        if (!readRecords(filename, records, torn))
+            return false;
+
+        std::uint64_t last = afterLsn;
+        for (auto &record : records) {
+            if (record.lsn <= afterLsn)
+                continue;
+            JournalReader reader(record.payload);
+            replay(record.lsn, reader);
+            last = record.lsn;
+        }
+
+        if (torn && !rewrite(records))
+            return false;
+
+        file = std::fopen(filename.c_str(), "ab");
+        if (!file)
+            return false;
+
+        nextLsn = last + 1;
+        durableLsn = last;
+        failed = false;
+        stopping = false;
+        opened = true;
+        flusher = std::thread(&Journal::flushLoop, this);
+        return true;
+    }
+
+    bool isOpen() const {
+        return opened;
+    }
+
+    // Queues a record and returns its lsn. It is written by the flush thread, call waitDurable() to wait for it.
+    std::uint64_t append(const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!opened)
+            throw std::runtime_error("Journal is not open");
+        std::uint64_t lsn = nextLsn++;
+        encode(pending, lsn, payload);
+        pendingLsn = lsn;
+        return lsn;
+    }
+
+    // Blocks until every record up to lsn is on disk.
+    void waitDurable(std::uint64_t lsn) {
+        std::unique_lock<std::mutex> lock(mutex);
+        waiters++;
+        flushWanted.notify_one();
+        durableChanged.wait(lock, [&] { return durableLsn >= lsn || failed || !opened; });
+        waiters--;
+        if (failed)
+            throw std::runtime_error("Journal write failed: " + filename);
+    }
+
+    // Drops every record with lsn <= checkpointLsn, once a snapshot containing them is safely on disk.
+    void checkpoint(std::uint64_t checkpointLsn) {
+        waitDurable(lastLsn());
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        std::vector<Record> records;
+        bool torn = false;
+        if (file)
+            std::fclose(file);
+        file = nullptr;
+        if (readRecords(filename, records, torn)) {
+            std::vector<Record> kept;
+            for (auto &record : records) {
+                if (record.lsn > checkpointLsn)
+                    kept.push_back(std::move(record));
+            }
+            // if it fails the old journal stays as it is, its records up to checkpointLsn are skipped on replay
+            rewrite(kept);
+        }
+        file = std::fopen(filename.c_str(), "ab");
+        if (!file) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = true;
+            durableChanged.notify_all();
+        }
+    }
+
+    // Flushes what is buffered and stops the flush thread.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            flushWanted.notify_one();
+        }
+        if (flusher.joinable())
+            flusher.join();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            opened = false;
+        }
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        if (file) {
+            std::fclose(file);
+            file = nullptr;
+        }
+        durableChanged.notify_all();
+    }
+
+    // Lsn of the newest record (0 if there never was one).
+    std::uint64_t lastLsn() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return nextLsn - 1;
+    }
+
+    // Number of write + fsync rounds so far; much lower than the record count under load thanks to group commit.
+    std::uint64_t flushCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return flushes;
+    }
+
+ private:
+    struct Record {
+        std::uint64_t lsn;
+        std::string payload;
+    };
+
+    std::string filename;
+    std::string key;
+    std::FILE* file = nullptr;        // only touched with fileMutex held
+    std::atomic<bool> opened{false};  // between open() and close(), file can be briefly closed by checkpoint()
+    std::thread flusher;
+    std::chrono::milliseconds flushInterval{5};
+
+    std::mutex mutex;     // pending, lsn counters, flags
+    std::mutex fileMutex; // the FILE*, so appends never wait for a disk write
+    std::condition_variable flushWanted;
+    std::condition_variable durableChanged;
+    std::string pending;
+    std::uint64_t nextLsn = 1;
+    std::uint64_t pendingLsn = 0;
+    std::uint64_t durableLsn = 0;
+    std::uint64_t flushes = 0;
+    int waiters = 0;
+    bool stopping = false;
+    bool failed = false;
+
+    void applyKey(char* data, std::size_t length) const {
+        if (key.empty())
+            return;
+        for (std::size_t i = 0; i < length; i++)
+            data[i] ^= key[i % key.length()];
+    }
+
+    void encode(std::string& out, std::uint64_t lsn, const std::string& payload) const {
+        std::string body = payload;
+        applyKey(&body[0], body.size());
+        JournalWriter header;
+        header.putU32(static_cast<std::uint32_t>(body.size()));
+        std::uint32_t crc = Crc32::update(Crc32::compute(&lsn, sizeof(lsn)), body.data(), body.size());
+        header.putU32(crc);
+        header.putU64(lsn);
+        out += header.str();
+        out += body;
+    }
+
+    // Flushes the stdio buffer and the OS cache of f, false if either failed (the data may not be on disk).
+    static bool syncFile(std::FILE* f) {
+        if (std::fflush(f) != 0)
+            return false;
+#ifdef _WIN32
+        return _commit(_fileno(f)) == 0;
+#else
+        return fsync(fileno(f)) == 0;
+#endif
+    }
+
+    // Reads every intact record. `torn` is set if the file ends in garbage.
+    bool readRecords(const std::string& path, std::vector<Record>& records, bool& torn) const {
+        std::FILE* in = std::fopen(path.c_str(), "rb");
+        if (!in)
+            return true; // no journal yet
+        std::vector<char> content;
+        char buffer[65536];
+        std::size_t read;
+        while ((read = std::fread(buffer, 1, sizeof(buffer), in)) > 0)
+            content.insert(content.end(), buffer, buffer + read);
+        std::fclose(in);
+
+        std::size_t pos = 0;
+        std::uint64_t previousLsn = 0;
+        while (pos < content.size()) {
+            if (content.size() - pos < kRecordHeaderSize)
+                break;
+            JournalReader header(std::string_view(content.data() + pos, kRecordHeaderSize));
+            std::uint32_t length = header.getU32();
+            std::uint32_t crc = header.getU32();
+            std::uint64_t lsn = header.getU64();
+            if (content.size() - pos - kRecordHeaderSize < length || lsn <= previousLsn)
+                break;
+            const char* body = content.data() + pos + kRecordHeaderSize;
+            if (Crc32::update(Crc32::compute(&lsn, sizeof(lsn)), body, length) != crc)
+                break;
+            Record record{lsn, std::string(body, length)};
+            applyKey(&record.payload[0], record.payload.size());
+            records.push_back(std::move(record));
+            previousLsn = lsn;
+            pos += kRecordHeaderSize + length;
+        }
+        torn = pos < content.size();
+        return true;
+    }
+
+    // Replaces the journal file with just `records`.
+    bool rewrite(const std::vector<Record>& records) const {
+        std::string tempFilename = filename + ".tmp";
+        std::FILE* out = std::fopen(tempFilename.c_str(), "wb");
+        if (!out)
+            return false;
+        std::string data;
+        for (const auto &record : records)
+            encode(data, record.lsn, record.payload);
+        bool ok = std::fwrite(data.data(), 1, data.size(), out) == data.size() && syncFile(out);
+        ok = std::fclose(out) == 0 && ok;
+        if (!ok) {
+            std::remove(tempFilename.c_str());
+            return false;
+        }
+        return DatabaseFile::replaceFile(tempFilename, filename);
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            flushWanted.wait_for(lock, flushInterval, [&] { return stopping || (waiters > 0 && !pending.empty()); });
+            if (pending.empty()) {
+                if (stopping)
+                    break;
+                continue;
+            }
+            // take everything that piled up since the last round, new appends keep going into `pending`
+            std::string batch;
+            batch.swap(pending);
+            std::uint64_t batchLsn = pendingLsn;
+            lock.unlock();
+            bool ok;
+            {
+                std::lock_guard<std::mutex> fileLock(fileMutex);
+                ok = file && std::fwrite(batch.data(), 1, batch.size(), file) == batch.size() && syncFile(file);
+            }
+            lock.lock();
+            if (!ok)
+                failed = true;
+            else
+                durableLsn = batchLsn;
+            flushes++;
+            durableChanged.notify_all();
+        }
+    }
+};
+
+#endif // EasyAuth_JOURNAL_HPP
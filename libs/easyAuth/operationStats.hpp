@@ -0,0 +1,262 @@
+// operationStats.hpp
+// Call counters and latency histograms cheap enough to leave on. Every thread gets a slot of its own (up to kSlots - 1
+// threads at once, the rest share the last slot), and only that thread writes its slot, so counting a call is a plain
+// load and store to memory no other core is writing: no locked instruction and no cache line bouncing between cores.
+// Reading adds the slots up. A thread that exits hands its slot to the next new thread, which keeps adding to it.
+// The slow operations (logins, queries, saves, loads) time every call. The fast ones time one call in kSampleEvery per
+// thread, so the clock reads dont cost more than the counting; their counts are still exact.
+// Latencies are log2 histograms in nanoseconds, percentiles are the upper bound of their bucket (within 2x).
+
+#ifndef EasyAuth_OPERATION_STATS_HPP
+#define EasyAuth_OPERATION_STATS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Calls of one kind of operation, see OperationStats.
+struct OperationTotals {
+    static constexpr std::size_t kBuckets = 40; // bucket b counts the timed calls that took less than 2^b nanoseconds
+
+    std::uint64_t calls = 0;
+    std::uint64_t timedCalls = 0; // calls the latencies come from: all of them for slow operations, a sample otherwise
+    std::uint64_t totalNanos = 0; // of the timed calls
+    std::uint64_t maxNanos = 0;
+    std::uint64_t histogram[kBuckets] = {};
+
+    void merge(const OperationTotals& other) {
+        calls += other.calls;
+        timedCalls += other.timedCalls;
+        totalNanos += other.totalNanos;
+        maxNanos = (std::max)(maxNanos, other.maxNanos);
+        for (std::size_t b = 0; b < kBuckets; b++)
+            histogram[b] += other.histogram[b];
+    }
+
+    double averageMicros() const {
+        return timedCalls > 0 ? totalNanos / 1000.0 / timedCalls : 0;
+    }
+
+    double percentileMicros(double fraction) const {
+        if (timedCalls == 0)
+            return 0;
+        std::uint64_t rank = static_cast<std::uint64_t>(fraction * (timedCalls - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t b = 0; b < kBuckets; b++) {
+            seen += histogram[b];
+            if (seen >= rank)
+                return (std::min)(static_cast<double>(std::uint64_t(1) << b), static_cast<double>(maxNanos)) / 1000.0;
+        }
+        return maxNanos / 1000.0;
+    }
+
+    double maxMicros() const {
+        return maxNanos / 1000.0;
+    }
+};
+
+class OperationStats {
+ public:
+    enum Operation : std::size_t {
+        LOOKUP,        // username -> account number
+        LOGIN,         // password checks and logins, from the call until the hash is checked
+        SESSION,       // resolving a session token
+        PROPERTY_READ, // property reads of one account
+        QUERY,         // property queries over every account (the value index)
+        WRITE,         // adding, changing or deleting accounts and properties, imports, journal replays and replicated changes
+        SAVE,          // database files and backups, the background snapshots included
+        LOAD,
+    };
+    static constexpr std::size_t kOperations = 8;
+    static constexpr std::uint32_t kSampleEvery = 64;
+    static constexpr std::size_t kSlots = 64;
+
+    OperationStats() = default;
+    OperationStats(const OperationStats&) = delete;
+    OperationStats& operator=(const OperationStats&) = delete;
+
+    static const char* name(Operation op) {
+        static const char* const names[kOperations] = {"lookup", "login", "session", "property read", "query",
+                                                       "write", "save", "load"};
+        return names[op];
+    }
+
+    static bool isSlow(Operation op) {
+        return op == LOGIN || op == QUERY || op == SAVE || op == LOAD;
+    }
+
+    // Counts one call of op when it goes out of scope, and times it if it is the thread's turn.
+    class Scope {
+     public:
+        Scope(OperationStats& stats, Operation op) : stats(stats), op(op) {
+            if (!isSlow(op) && --sampleCountdown() != 0)
+                return;
+            sampleCountdown() = kSampleEvery;
+            timed = true;
+            start = std::chrono::steady_clock::now();
+        }
+        // Times a call that started earlier, e.g. before it was queued for another thread.
+        Scope(OperationStats& stats, Operation op, std::chrono::steady_clock::time_point started)
+            : stats(stats), op(op), timed(true), start(started) {}
+        ~Scope() {
+            if (timed)
+                stats.record(op, std::chrono::steady_clock::now() - start);
+            else
+                stats.count(op);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+     private:
+        OperationStats& stats;
+        Operation op;
+        bool timed = false;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void count(Operation op) {
+        Slot& slot = mySlot();
+        bump(slot.ops[op].calls, 1, slot.shared);
+    }
+
+    // Counts a call that was timed elsewhere (e.g. on another thread).
+    void record(Operation op, std::chrono::steady_clock::duration took) {
+        std::uint64_t nanos = static_cast<std::uint64_t>((std::max)(std::int64_t(0),
+            static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count())));
+        std::size_t bucket = 0;
+        while (bucket + 1 < OperationTotals::kBuckets && (nanos >> bucket) != 0)
+            bucket++;
+        Slot& slot = mySlot();
+        Counters& counters = slot.ops[op];
+        bump(counters.calls, 1, slot.shared);
+        bump(counters.timedCalls, 1, slot.shared);
+        bump(counters.totalNanos, nanos, slot.shared);
+        bump(counters.histogram[bucket], 1, slot.shared);
+        std::uint64_t max = counters.maxNanos.load(std::memory_order_relaxed);
+        while (nanos > max && !counters.maxNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Adds the slots up. Calls that are being counted meanwhile may or may not be in it.
+    OperationTotals totals(Operation op) const {
+        OperationTotals out;
+        for (std::size_t i = 0; i < kSlots; i++) {
+            const Slot* slot = slots[i].load(std::memory_order_acquire);
+            if (!slot)
+                continue;
+            const Counters& counters = slot->ops[op];
+            out.calls += counters.calls.load(std::memory_order_relaxed);
+            out.timedCalls += counters.timedCalls.load(std::memory_order_relaxed);
+            out.totalNanos += counters.totalNanos.load(std::memory_order_relaxed);
+            out.maxNanos = (std::max)(out.maxNanos, counters.maxNanos.load(std::memory_order_relaxed));
+            for (std::size_t b = 0; b < OperationTotals::kBuckets; b++)
+                out.histogram[b] += counters.histogram[b].load(std::memory_order_relaxed);
+        }
+        return out;
+    }
+
+ private:
+    struct Counters {
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> timedCalls{0};
+        std::atomic<std::uint64_t> totalNanos{0};
+        std::atomic<std::uint64_t> maxNanos{0};
+        std::atomic<std::uint64_t> histogram[OperationTotals::kBuckets] = {};
+    };
+
+    struct alignas(64) Slot {
+        explicit Slot(bool shared) : shared(shared) {}
+        const bool shared; // the last slot, written by every thread that didnt get one of its own
+        Counters ops[kOperations];
+    };
+
+    static constexpr std::size_t kNoSlot = kSlots;
+
+    // Which slot the threads use, the same in every OperationStats. Never destroyed, threads may exit after main().
+    struct ThreadSlots {
+        std::mutex mutex;
+        std::vector<std::size_t> released;
+        std::size_t next = 0;
+    };
+
+    // Plain values, so the hot path reads them without a thread_local initialization check.
+    struct ThreadState {
+        std::size_t slot;
+        std::uint32_t countdown;
+    };
+
+    // Gives the thread's slot number back when it exits.
+    struct SlotRelease {
+        ~SlotRelease() {
+            std::size_t index = threadState().slot;
+            if (index == kSlots - 1)
+                return;
+            ThreadSlots& all = threadSlots();
+            std::lock_guard<std::mutex> lock(all.mutex);
+            all.released.push_back(index);
+        }
+    };
+
+    std::atomic<Slot*> slots[kSlots] = {};
+    std::unique_ptr<Slot> owned[kSlots];
+    std::mutex slotMutex; // making slots
+
+    static ThreadSlots& threadSlots() {
+        static ThreadSlots* all = new ThreadSlots();
+        return *all;
+    }
+
+    static ThreadState& threadState() {
+        thread_local ThreadState state = {kNoSlot, kSampleEvery};
+        return state;
+    }
+
+    static std::uint32_t& sampleCountdown() {
+        return threadState().countdown;
+    }
+
+    // The slot's owner is the only writer, so it doesnt need a locked add. The shared slot does.
+    static void bump(std::atomic<std::uint64_t>& counter, std::uint64_t by, bool shared) {
+        if (shared)
+            counter.fetch_add(by, std::memory_order_relaxed);
+        else
+            counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    Slot& mySlot() {
+        std::size_t index = threadState().slot;
+        Slot* slot = index != kNoSlot ? slots[index].load(std::memory_order_acquire) : nullptr;
+        return slot ? *slot : makeSlot();
+    }
+
+    // First call of the thread (in any OperationStats), or first one in this OperationStats.
+    Slot& makeSlot() {
+        ThreadState& state = threadState();
+        if (state.slot == kNoSlot) {
+            ThreadSlots& all = threadSlots();
+            {
+                std::lock_guard<std::mutex> lock(all.mutex);
+                if (!all.released.empty()) {
+                    state.slot = all.released.back();
+                    all.released.pop_back();
+                } else {
+                    state.slot = all.next < kSlots - 1 ? all.next++ : kSlots - 1;
+                }
+            }
+            thread_local SlotRelease release;
+        }
+        std::lock_guard<std::mutex> lock(slotMutex);
+        if (!owned[state.slot]) {
+            owned[state.slot].reset(new Slot(state.slot == kSlots - 1));
+            slots[state.slot].store(owned[state.slot].get(), std::memory_order_release);
+        }
+        return *owned[state.slot];
+    }
+};
+
+#endif // EasyAuth_OPERATION_STATS_HPP
@@ -0,0 +1,324 @@
+// pageFile.hpp
+// The cold tier of easyAuth's tiered storage (see easyAuth::enableTieredStorage()).
+//   PageFile:    credentials of accounts that werent used in a while are appended to a file and read back through a
+//                read-only mapping of it, so the OS brings in the page a record is on when it is read and can drop it again.
+//                The credential columns are the index: a cold StringRef has kColdBit set in its length and its offset
+//                is where the record is in this file.
+//   AccessClock: one bit per account that a lookup sets and the eviction sweep (CLOCK) clears, an account whose bit is
+//                still clear when the sweep comes back around hasnt been used since and goes to the page file.
+//
+// The page file only lives as long as the process: it is deleted when it is closed (on POSIX right after it is created)
+// and loading a database makes a new one. Records are never rewritten, a replaced one is only counted as garbage,
+// so a record can be read without any lock on the file as long as its ref is still held.
+// Threads: one writer at a time (easyAuth holds writeMutex), any number of readers.
+
+#ifndef EasyAuth_PAGE_FILE_HPP
+#define EasyAuth_PAGE_FILE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "storage.hpp"
+#include "cipher.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+class PageFile {
+ public:
+    static constexpr std::uint32_t kColdBit = 0x80000000u;
+    static constexpr std::uint64_t kMaxBytes = std::uint64_t(1) << 32; // offsets are 32 bit, like the arena's
+    static constexpr std::uint64_t kMinCapacity = std::uint64_t(1) << 20;
+
+    static bool isCold(StringRef ref) {
+        return (ref.length & kColdBit) != 0;
+    }
+
+    // Length of the string a ref points at, cold or not.
+    static std::uint32_t lengthOf(StringRef ref) {
+        return ref.length & ~kColdBit;
+    }
+
+    // The same bytes at the same offset, but in the page file.
+    static StringRef coldRef(StringRef ref) {
+        return ref.length == 0 ? ref : StringRef{ref.offset, ref.length | kColdBit};
+    }
+
+    // Creates an empty page file, an existing file with that name is replaced. Returns nullptr if it cant be created.
+    static std::shared_ptr<PageFile> create(const std::string& filename) {
+        std::shared_ptr<PageFile> pages(new PageFile());
+#ifdef _WIN32
+        pages->file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (pages->file == INVALID_HANDLE_VALUE)
+            return nullptr;
+#else
+        pages->fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (pages->fd < 0)
+            return nullptr;
+        ::unlink(filename.c_str()); // the name isnt needed anymore, the file goes away with the last descriptor
+#endif
+        return pages;
+    }
+
+    ~PageFile() {
+        for (const auto &view : views) {
+#ifdef _WIN32
+            UnmapViewOfFile(view.base);
+#else
+            munmap(const_cast<char*>(view.base), view.size);
+#endif
+        }
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    PageFile(const PageFile&) = delete;
+    PageFile& operator=(const PageFile&) = delete;
+
+    // Only for refs whose record was flushed. The view stays valid for as long as the PageFile.
+    std::string_view view(StringRef ref) const {
+        std::uint32_t length = lengthOf(ref);
+        if (length == 0)
+            return std::string_view();
+        return std::string_view(base.load(std::memory_order_acquire) + ref.offset, length);
+    }
+
+    // Start of the mapped file, nullptr while nothing was flushed.
+    const char* data() const {
+        return base.load(std::memory_order_acquire);
+    }
+
+    // Queues a record and returns its (cold) ref. It can only be read after the next flush().
+    StringRef add(std::string_view s) {
+        if (s.empty())
+            return StringRef{};
+        if (bytes + pending.size() + s.size() > kMaxBytes)
+            throw std::runtime_error("Page file is full");
+        StringRef ref{static_cast<std::uint32_t>(bytes + pending.size()), static_cast<std::uint32_t>(s.size()) | kColdBit};
+        pending.append(s.data(), s.size());
+        return ref;
+    }
+
+    // Writes the queued records. If it throws they are dropped and their refs must not be used.
+    void flush() {
+        if (pending.empty())
+            return;
+        try {
+            reserve(bytes + pending.size());
+            write(pending.data(), pending.size(), bytes);
+        } catch (...) {
+            pending.clear();
+            throw;
+        }
+        bytes += pending.size();
+        pending.clear();
+    }
+
+    // Fills an empty page file with `size` bytes of a database file's strings section, decrypting them on the way if
+    // `cipher` is set, so a credential ref of that file only needs the cold bit (see coldRef()).
+    void fill(const char* data, std::size_t size, const Cipher::Keystream* cipher) {
+        if (bytes != 0 || !pending.empty())
+            throw std::logic_error("Page file is not empty");
+        if (size > kMaxBytes)
+            throw std::runtime_error("Page file is full");
+        reserve(size);
+        std::vector<char> buffer(std::min<std::size_t>(size, kFillChunk));
+        for (std::size_t done = 0; done < size;) {
+            std::size_t n = std::min<std::size_t>(size - done, kFillChunk);
+            std::memcpy(buffer.data(), data + done, n);
+            if (cipher)
+                cipher->apply(buffer.data(), n, done);
+            write(buffer.data(), n, done);
+            done += n;
+        }
+        bytes = size;
+    }
+
+    void release(StringRef ref) {
+        garbage.fetch_add(lengthOf(ref), std::memory_order_relaxed);
+    }
+
+    // Takes the file's pages out of the process's working set. They usually stay in the OS file cache,
+    // so reading them again is cheap, but they stop counting as memory of this process.
+    void dropResident() {
+        for (const auto &view : views) {
+#ifdef _WIN32
+            VirtualUnlock(const_cast<char*>(view.base), view.size); // unlocking pages that arent locked trims them
+#else
+            madvise(const_cast<char*>(view.base), view.size, MADV_DONTNEED);
+#endif
+        }
+    }
+
+    // Bytes written to the file.
+    std::uint64_t size() const {
+        return bytes;
+    }
+
+    // Bytes of records nothing points at anymore, they go away when the database is loaded again.
+    std::uint64_t garbageBytes() const {
+        return garbage.load(std::memory_order_relaxed);
+    }
+
+ private:
+    static constexpr std::size_t kFillChunk = std::size_t(1) << 20;
+
+    struct View {
+        const char* base;
+        std::size_t size;
+    };
+
+    PageFile() = default;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    // Every mapping made so far. A bigger one replaces `base` when the file grows but the old ones stay mapped,
+    // a reader may still be using a pointer into them.
+    std::vector<View> views;
+    std::atomic<const char*> base{nullptr};
+    std::uint64_t capacity = 0;
+    std::uint64_t bytes = 0;
+    std::string pending;
+    std::atomic<std::uint64_t> garbage{0};
+
+    // Grows the file (doubling) and maps it again when `needed` bytes dont fit.
+    void reserve(std::uint64_t needed) {
+        if (needed <= capacity)
+            return;
+        std::uint64_t grown = std::max(std::max(needed, capacity * 2), kMinCapacity);
+        grown = std::min(grown, kMaxBytes);
+#ifdef _WIN32
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(grown);
+        if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+            throw std::runtime_error("Could not grow the page file");
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, static_cast<DWORD>(grown >> 32), static_cast<DWORD>(grown), nullptr);
+        if (!mapping)
+            throw std::runtime_error("Could not map the page file");
+        void* mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(grown));
+        CloseHandle(mapping);
+        if (!mapped)
+            throw std::runtime_error("Could not map the page file");
+#else
+        if (ftruncate(fd, static_cast<off_t>(grown)) != 0)
+            throw std::runtime_error("Could not grow the page file");
+        void* mapped = mmap(nullptr, static_cast<std::size_t>(grown), PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("Could not map the page file");
+#endif
+        views.push_back(View{static_cast<const char*>(mapped), static_cast<std::size_t>(grown)});
+        capacity = grown;
+        base.store(static_cast<const char*>(mapped), std::memory_order_release);
+    }
+
+    void write(const char* data, std::size_t size, std::uint64_t offset) {
+        while (size > 0) {
+#ifdef _WIN32
+            OVERLAPPED at = {};
+            at.Offset = static_cast<DWORD>(offset);
+            at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD n = 0;
+            DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, kFillChunk));
+            if (!WriteFile(file, data, chunk, &n, &at) || n == 0)
+                throw std::runtime_error("Could not write the page file");
+#else
+            ssize_t n = pwrite(fd, data, size, static_cast<off_t>(offset));
+            if (n <= 0)
+                throw std::runtime_error("Could not write the page file");
+#endif
+            data += n;
+            size -= static_cast<std::size_t>(n);
+            offset += static_cast<std::uint64_t>(n);
+        }
+    }
+};
+
+// One bit per account, set by lookups and cleared by the eviction sweep (CLOCK, a cheap approximation of LRU).
+// The bits are in blocks that never move, so setting one never waits for resize().
+class AccessClock {
+ public:
+    static constexpr std::size_t kBlockShift = 16; // 65536 accounts (8 KiB) per block
+    static constexpr std::size_t kMaxBlocks = 4096;
+
+    // Makes room for `accounts` bits. Only grows, and only one thread at a time may call it.
+    void resize(std::size_t accounts) {
+        std::size_t needed = (accounts + (std::size_t(1) << kBlockShift) - 1) >> kBlockShift;
+        if (needed > kMaxBlocks)
+            throw std::runtime_error("Too many accounts for the access clock");
+        if (needed > 0 && !blocks)
+            blocks.reset(new std::unique_ptr<std::atomic<std::uint64_t>[]>[kMaxBlocks]);
+        for (; blockCount < needed; blockCount++) {
+            std::size_t words = (std::size_t(1) << kBlockShift) / 64;
+            blocks[blockCount].reset(new std::atomic<std::uint64_t>[words]);
+            for (std::size_t i = 0; i < words; i++)
+                blocks[blockCount][i].store(0, std::memory_order_relaxed);
+        }
+        bits = blockCount << kBlockShift;
+    }
+
+    void reset() {
+        blocks.reset();
+        blockCount = 0;
+        bits = 0;
+    }
+
+    std::size_t size() const {
+        return bits;
+    }
+
+    // Marks the account as used. Returns true if it wasnt marked yet, the load first keeps repeated lookups of a hot
+    // account from writing the cache line every time.
+    bool touch(std::size_t accountNumber) {
+        std::atomic<std::uint64_t>& word = wordOf(accountNumber);
+        std::uint64_t bit = std::uint64_t(1) << (accountNumber & 63);
+        if (word.load(std::memory_order_relaxed) & bit)
+            return false;
+        return (word.fetch_or(bit, std::memory_order_relaxed) & bit) == 0;
+    }
+
+    // Unmarks the account. Returns true if it was marked (used since the last clear()).
+    bool clear(std::size_t accountNumber) {
+        std::atomic<std::uint64_t>& word = wordOf(accountNumber);
+        std::uint64_t bit = std::uint64_t(1) << (accountNumber & 63);
+        if ((word.load(std::memory_order_relaxed) & bit) == 0)
+            return false;
+        return (word.fetch_and(~bit, std::memory_order_relaxed) & bit) != 0;
+    }
+
+    std::size_t memoryUsage() const {
+        return (blocks ? kMaxBlocks * sizeof(blocks[0]) : 0) + blockCount * ((std::size_t(1) << kBlockShift) / 8);
+    }
+
+ private:
+    std::unique_ptr<std::unique_ptr<std::atomic<std::uint64_t>[]>[]> blocks;
+    std::size_t blockCount = 0;
+    std::size_t bits = 0;
+
+    std::atomic<std::uint64_t>& wordOf(std::size_t accountNumber) {
+        return blocks[accountNumber >> kBlockShift][(accountNumber & ((std::size_t(1) << kBlockShift) - 1)) / 64];
+    }
+};
+
+#endif // EasyAuth_PAGE_FILE_HPP
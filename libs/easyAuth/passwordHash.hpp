@@ -0,0 +1,402 @@
+// passwordHash.hpp
+// Salted password hashing with PBKDF2-HMAC-SHA256 (RFC 8018), deliberately slow so a stolen database file cant be
+// brute forced quickly. A stored password is a record in the same format as passlib's pbkdf2_sha256:
+//   $pbkdf2-sha256$<iterations>$<salt>$<hash>
+// with the salt (16 random bytes) and the 32 byte hash in base64 ('.' instead of '+', no padding). The iteration count
+// is the cost and is kept per record, so raising the cost only applies to new records and to old ones when their
+// owner logs in next (see easyAuth::setPasswordHashCost()).
+// Anything that isnt a valid record is a plaintext password from before hashing was added.
+
+#ifndef EasyAuth_PASSWORD_HASH_HPP
+#define EasyAuth_PASSWORD_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EasyAuth_SHA_NI 1 // compiled with a target attribute and picked at runtime, like the AVX2 path in cipher.hpp
+#include <immintrin.h>
+#endif
+
+namespace PasswordHash {
+
+    static constexpr std::uint32_t kDefaultIterations = 600000; // OWASP's recommendation for PBKDF2-HMAC-SHA256
+    static constexpr std::uint32_t kMaxIterations = 100000000;   // records asking for more are treated as invalid
+    static constexpr std::size_t kSaltBytes = 16;
+    static constexpr std::size_t kHashBytes = 32;
+    static constexpr const char* kPrefix = "$pbkdf2-sha256$";
+
+    class Sha256 {
+     public:
+        Sha256() {
+            reset();
+        }
+
+        void reset() {
+            static const std::uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+            std::memcpy(state, initial, sizeof(state));
+            length = 0;
+            buffered = 0;
+        }
+
+        void update(const void* data, std::size_t size) {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            length += size;
+            if (buffered > 0) {
+                std::size_t take = size < 64 - buffered ? size : 64 - buffered;
+                std::memcpy(buffer + buffered, p, take);
+                buffered += take;
+                p += take;
+                size -= take;
+                if (buffered < 64)
+                    return;
+                compress(state, buffer);
+                buffered = 0;
+            }
+            for (; size >= 64; p += 64, size -= 64)
+                compress(state, p);
+            std::memcpy(buffer, p, size);
+            buffered = size;
+        }
+
+        void finish(unsigned char out[32]) {
+            std::uint64_t bits = length * 8;
+            unsigned char pad = 0x80;
+            update(&pad, 1);
+            pad = 0;
+            while (buffered != 56)
+                update(&pad, 1);
+            unsigned char size[8];
+            for (int i = 0; i < 8; i++)
+                size[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+            update(size, 8);
+            for (int i = 0; i < 8; i++)
+                store32(out + 4 * i, state[i]);
+        }
+
+        // The chaining state, only meaningful after a multiple of 64 bytes (PBKDF2 takes it after the HMAC key block).
+        const std::uint32_t* stateWords() const {
+            return state;
+        }
+
+        // One 64 byte block, used directly by PBKDF2's inner loop so it doesnt go through the buffer.
+        // Uses the cpu's SHA instructions when it has them, which is most of the time spent hashing passwords.
+        static void compress(std::uint32_t state[8], const unsigned char block[64]) {
+#ifdef EasyAuth_SHA_NI
+            if (hasShaNi()) {
+                compressShaNi(state, block);
+                return;
+            }
+#endif
+            compressScalar(state, block);
+        }
+
+        static void compressScalar(std::uint32_t state[8], const unsigned char block[64]) {
+            const std::uint32_t* k = roundConstants();
+            std::uint32_t w[64];
+            for (int i = 0; i < 16; i++)
+                w[i] = load32(block + 4 * i);
+            for (int i = 16; i < 64; i++) {
+                std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++) {
+                std::uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+                std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+
+#ifdef EasyAuth_SHA_NI
+        static bool hasShaNi() {
+            static const bool supported = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+            return supported;
+        }
+
+        // Same as compressScalar() with the SHA extensions, two rounds per sha256rnds2. The state is kept in the
+        // ABEF/CDGH word order the instructions want and shuffled back at the end.
+        __attribute__((target("sha,sse4.1"))) static void compressShaNi(std::uint32_t state[8], const unsigned char block[64]) {
+            const std::uint32_t* k = roundConstants();
+            const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+            __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+            __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+            __m128i abef = _mm_alignr_epi8(dcba, efgh, 8);
+            __m128i cdgh = _mm_blend_epi16(efgh, dcba, 0xF0);
+            const __m128i abefStart = abef, cdghStart = cdgh;
+
+            __m128i message[4];
+            for (int i = 0; i < 16; i++) {
+                if (i < 4)
+                    message[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i)), byteSwap);
+                __m128i current = _mm_add_epi32(message[i & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(k + 4 * i)));
+                cdgh = _mm_sha256rnds2_epu32(cdgh, abef, current);
+                if (i >= 3 && i <= 14) { // schedule the words 4 rounds ahead
+                    __m128i& next = message[(i + 1) & 3];
+                    next = _mm_add_epi32(next, _mm_alignr_epi8(message[i & 3], message[(i - 1) & 3], 4));
+                    next = _mm_sha256msg2_epu32(next, message[i & 3]);
+                }
+                abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(current, 0x0E));
+                if (i >= 1 && i <= 12)
+                    message[(i - 1) & 3] = _mm_sha256msg1_epu32(message[(i - 1) & 3], message[i & 3]);
+            }
+
+            abef = _mm_add_epi32(abef, abefStart);
+            cdgh = _mm_add_epi32(cdgh, cdghStart);
+            __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+            __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+        }
+#endif
+
+        static std::uint32_t load32(const unsigned char* p) {
+            return std::uint32_t(p[0]) << 24 | std::uint32_t(p[1]) << 16 | std::uint32_t(p[2]) << 8 | p[3];
+        }
+
+        static void store32(unsigned char* p, std::uint32_t v) {
+            p[0] = static_cast<unsigned char>(v >> 24);
+            p[1] = static_cast<unsigned char>(v >> 16);
+            p[2] = static_cast<unsigned char>(v >> 8);
+            p[3] = static_cast<unsigned char>(v);
+        }
+
+     private:
+        static const std::uint32_t* roundConstants() {
+            static const std::uint32_t k[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+            return k;
+        }
+
+        static std::uint32_t rotr(std::uint32_t x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        std::uint32_t state[8];
+        std::uint64_t length;
+        unsigned char buffer[64];
+        std::size_t buffered;
+    };
+
+    // PBKDF2-HMAC-SHA256 with a 32 byte output (one block).
+    // The HMAC inner and outer key states are computed once, after that every iteration is two compressions of
+    // a single padded block instead of four.
+    inline void pbkdf2(std::string_view password, const unsigned char* salt, std::size_t saltLength, std::uint32_t iterations,
+                       unsigned char out[kHashBytes]) {
+        unsigned char key[64] = {};
+        if (password.size() > 64) {
+            Sha256 keyHash;
+            keyHash.update(password.data(), password.size());
+            keyHash.finish(key);
+        } else {
+            std::memcpy(key, password.data(), password.size());
+        }
+        unsigned char pad[64];
+        Sha256 inner, outer;
+        for (int i = 0; i < 64; i++)
+            pad[i] = key[i] ^ 0x36;
+        inner.update(pad, 64);
+        for (int i = 0; i < 64; i++)
+            pad[i] = key[i] ^ 0x5c;
+        outer.update(pad, 64);
+
+        // U1 = HMAC(password, salt || INT(1))
+        unsigned char u[32];
+        Sha256 first = inner;
+        first.update(salt, saltLength);
+        const unsigned char blockIndex[4] = {0, 0, 0, 1};
+        first.update(blockIndex, 4);
+        first.finish(u);
+        Sha256 firstOuter = outer;
+        firstOuter.update(u, 32);
+        firstOuter.finish(u);
+
+        std::uint32_t innerState[8], outerState[8], result[8], word[8];
+        std::memcpy(innerState, inner.stateWords(), sizeof(innerState));
+        std::memcpy(outerState, outer.stateWords(), sizeof(outerState));
+        for (int i = 0; i < 8; i++)
+            result[i] = word[i] = Sha256::load32(u + 4 * i);
+
+        // a 32 byte message after the 64 byte key block, padded to one block: 0x80, zeros, length (96 bytes = 768 bits)
+        unsigned char block[64] = {};
+        block[32] = 0x80;
+        block[62] = 0x03;
+        for (std::uint32_t n = 1; n < iterations; n++) {
+            std::uint32_t state[8];
+            for (int i = 0; i < 8; i++)
+                Sha256::store32(block + 4 * i, word[i]);
+            std::memcpy(state, innerState, sizeof(state));
+            Sha256::compress(state, block);
+            for (int i = 0; i < 8; i++)
+                Sha256::store32(block + 4 * i, state[i]);
+            std::memcpy(state, outerState, sizeof(state));
+            Sha256::compress(state, block);
+            for (int i = 0; i < 8; i++) {
+                word[i] = state[i];
+                result[i] ^= state[i];
+            }
+        }
+        for (int i = 0; i < 8; i++)
+            Sha256::store32(out + 4 * i, result[i]);
+    }
+
+    // base64 with passlib's alphabet ('.' instead of '+') and no padding
+    inline std::string encode64(const unsigned char* data, std::size_t length) {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789./";
+        std::string out;
+        out.reserve((length * 4 + 2) / 3);
+        for (std::size_t i = 0; i < length; i += 3) {
+            std::uint32_t chunk = std::uint32_t(data[i]) << 16;
+            if (i + 1 < length)
+                chunk |= std::uint32_t(data[i + 1]) << 8;
+            if (i + 2 < length)
+                chunk |= data[i + 2];
+            std::size_t chars = length - i >= 3 ? 4 : length - i + 1;
+            for (std::size_t c = 0; c < chars; c++)
+                out += alphabet[(chunk >> (18 - 6 * c)) & 63];
+        }
+        return out;
+    }
+
+    // Returns false if `text` isnt valid for encode64() or doesnt decode to exactly `length` bytes.
+    inline bool decode64(std::string_view text, unsigned char* out, std::size_t length) {
+        if (text.size() != (length * 4 + 2) / 3)
+            return false;
+        std::uint32_t bits = 0;
+        int count = 0;
+        std::size_t written = 0;
+        for (char ch : text) {
+            int value;
+            if (ch >= 'A' && ch <= 'Z') value = ch - 'A';
+            else if (ch >= 'a' && ch <= 'z') value = ch - 'a' + 26;
+            else if (ch >= '0' && ch <= '9') value = ch - '0' + 52;
+            else if (ch == '.') value = 62;
+            else if (ch == '/') value = 63;
+            else return false;
+            bits = bits << 6 | static_cast<std::uint32_t>(value);
+            count += 6;
+            if (count >= 8) {
+                count -= 8;
+                out[written++] = static_cast<unsigned char>(bits >> count);
+            }
+        }
+        return written == length;
+    }
+
+    struct Record {
+        std::uint32_t iterations = 0;
+        unsigned char salt[kSaltBytes];
+        unsigned char hash[kHashBytes];
+    };
+
+    // Returns false if `stored` isnt a record, i.e. it is a plaintext password.
+    inline bool parse(std::string_view stored, Record& record) {
+        std::string_view prefix(kPrefix);
+        if (stored.substr(0, prefix.size()) != prefix)
+            return false;
+        stored.remove_prefix(prefix.size());
+        std::size_t saltStart = stored.find('$');
+        if (saltStart == 0 || saltStart == std::string_view::npos || saltStart > 9)
+            return false;
+        std::uint64_t iterations = 0;
+        for (std::size_t i = 0; i < saltStart; i++) {
+            if (stored[i] < '0' || stored[i] > '9')
+                return false;
+            iterations = iterations * 10 + static_cast<std::uint64_t>(stored[i] - '0');
+        }
+        if (iterations == 0 || iterations > kMaxIterations)
+            return false;
+        record.iterations = static_cast<std::uint32_t>(iterations);
+        std::size_t hashStart = stored.find('$', saltStart + 1);
+        if (hashStart == std::string_view::npos)
+            return false;
+        return decode64(stored.substr(saltStart + 1, hashStart - saltStart - 1), record.salt, kSaltBytes) &&
+               decode64(stored.substr(hashStart + 1), record.hash, kHashBytes);
+    }
+
+    inline bool isRecord(std::string_view stored) {
+        Record record;
+        return parse(stored, record);
+    }
+
+    // Iterations of a record, 0 for a plaintext password.
+    inline std::uint32_t costOf(std::string_view stored) {
+        Record record;
+        return parse(stored, record) ? record.iterations : 0;
+    }
+
+    // Compares without stopping at the first difference, so the time doesnt tell how much of it matched.
+    inline bool equalConstantTime(const void* a, const void* b, std::size_t length) {
+        const unsigned char* x = static_cast<const unsigned char*>(a);
+        const unsigned char* y = static_cast<const unsigned char*>(b);
+        unsigned char difference = 0;
+        for (std::size_t i = 0; i < length; i++)
+            difference |= x[i] ^ y[i];
+        return difference == 0;
+    }
+
+    inline void randomSalt(unsigned char salt[kSaltBytes]) {
+        thread_local std::random_device device;
+        for (std::size_t i = 0; i < kSaltBytes; i += 4) {
+            std::uint32_t value = device();
+            std::memcpy(salt + i, &value, 4);
+        }
+    }
+
+    // Hashes `password` with a fresh salt and returns the record to store.
+    inline std::string hash(std::string_view password, std::uint32_t iterations = kDefaultIterations) {
+        if (iterations == 0 || iterations > kMaxIterations) {
+            throw std::invalid_argument("Password hash iterations out of range");
+        }
+        Record record;
+        record.iterations = iterations;
+        randomSalt(record.salt);
+        pbkdf2(password, record.salt, kSaltBytes, iterations, record.hash);
+        return kPrefix + std::to_string(iterations) + "$" + encode64(record.salt, kSaltBytes) + "$" + encode64(record.hash, kHashBytes);
+    }
+
+    // Checks `password` against a stored record, or against a plaintext password from before hashing.
+    inline bool verify(std::string_view password, std::string_view stored) {
+        Record record;
+        if (!parse(stored, record)) {
+            // plaintext, compare the whole length anyway
+            return password.size() == stored.size() && equalConstantTime(password.data(), stored.data(), stored.size());
+        }
+        unsigned char computed[kHashBytes];
+        pbkdf2(password, record.salt, kSaltBytes, record.iterations, computed);
+        return equalConstantTime(computed, record.hash, kHashBytes);
+    }
+
+} // namespace PasswordHash
+
+#endif // EasyAuth_PASSWORD_HASH_HPP
@@ -0,0 +1,488 @@
+// replication.hpp
+// Primary/replica replication of a ShardedAuth over any transport that sends a request and returns the response
+// (the server uses framed SimpleTCP connections, the messages are binary and can be large).
+//
+// Every shard replicates on its own, it has its own journal and lsns, so a replica has as many shards as its primary.
+// A replica shard starts from a snapshot of the primary shard, then pulls the journal records after the lsn it has, a
+// batch at a time. A pull waits on the primary until there is something new, so records arrive about as soon as they
+// are logged without the replica polling. A replica that falls behind further than the primary keeps records (see
+// replicationLog.hpp), or sees the epoch change, loads a new snapshot, which drops the sessions of that shard.
+// Replicas are read-only: they serve logins and reads and refuse every change (see easyAuth::setReadOnly()).
+//
+// Requests (text, fields separated by spaces) and their responses:
+//   REPL_HELLO                                 REPL_OK <shards>
+//   REPL_SNAPSHOT <shard>                      REPL_SNAPSHOT_READY <id> <epoch> <bytes>
+//   REPL_CHUNK <shard> <id> <offset>           REPL_DATA\n<at most kChunkBytes>, or REPL_GONE if a newer snapshot replaced it
+//   REPL_PULL <shard> <epoch> <lsn> <name>     REPL_RECORDS <primary lsn> <primary ms> <count>\n<records>, or REPL_SNAPSHOT_NEEDED
+// Anything that goes wrong on the primary is REPL_ERROR <message>. A record is [u64 lsn][u64 ms it was logged]
+// [u32 length][payload], little endian like the journal. <name> only tells the primary who is pulling, for getReplicas().
+
+#ifndef EasyAuth_REPLICATION_HPP
+#define EasyAuth_REPLICATION_HPP
+
+#include "shardedAuth.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <sstream>
+
+// A replica shard as the primary last saw it.
+struct ReplicaInfo {
+    std::string name;
+    std::size_t shard = 0;
+    std::uint64_t lsn = 0;        // what the replica had when it last pulled
+    std::uint64_t primaryLsn = 0; // what the primary had then
+    double secondsSinceSeen = 0;
+};
+
+// Primary side: answers the requests of replicas.
+class ReplicationSource {
+ public:
+    static constexpr std::size_t kChunkBytes = std::size_t(1) << 20;
+    static constexpr std::size_t kPullBytes = std::size_t(1) << 20;
+    static constexpr std::chrono::milliseconds kPullWait{250};
+
+    // Snapshots for replicas are written next to the database file `filename`, as "<filename>.replica.<shard>-of-<shards>".
+    // Start the replication log of `auth` (startReplicationLog()) before taking requests.
+    ReplicationSource(ShardedAuth& auth, std::string filename)
+        : auth(auth), filename(std::move(filename)), snapshots(auth.getShardCount()) {}
+
+    ReplicationSource(const ReplicationSource&) = delete;
+    ReplicationSource& operator=(const ReplicationSource&) = delete;
+
+    // Thread safe, pulls wait up to kPullWait.
+    std::string handle(const std::string& request) {
+        std::istringstream in(request);
+        std::string command;
+        in >> command;
+        try {
+            if (command == "REPL_HELLO")
+                return "REPL_OK " + std::to_string(auth.getShardCount());
+            std::size_t shard;
+            if (!(in >> shard) || shard >= auth.getShardCount())
+                return "REPL_ERROR Bad shard";
+            if (command == "REPL_SNAPSHOT")
+                return snapshot(shard);
+            if (command == "REPL_CHUNK") {
+                std::uint64_t id, offset;
+                if (!(in >> id >> offset))
+                    return "REPL_ERROR Bad request";
+                return chunk(shard, id, offset);
+            }
+            if (command == "REPL_PULL") {
+                std::uint64_t epoch, lsn;
+                std::string name;
+                if (!(in >> epoch >> lsn >> name))
+                    return "REPL_ERROR Bad request";
+                return pull(shard, epoch, lsn, name);
+            }
+        } catch (const std::exception& e) {
+            return std::string("REPL_ERROR ") + e.what();
+        }
+        return "REPL_ERROR Unknown request";
+    }
+
+    // Every replica shard that pulled so far, with how far behind it was.
+    std::vector<ReplicaInfo> getReplicas() const {
+        std::lock_guard<std::mutex> lock(replicasMutex);
+        std::vector<ReplicaInfo> result;
+        auto now = std::chrono::steady_clock::now();
+        for (const auto &entry : replicas) {
+            ReplicaInfo info = entry.second.info;
+            info.secondsSinceSeen = std::chrono::duration<double>(now - entry.second.seen).count();
+            result.push_back(info);
+        }
+        return result;
+    }
+
+ private:
+    struct SnapshotFile {
+        std::mutex mutex; // the fields, and the file while a chunk is read
+        std::uint64_t id = 0;
+        std::uint64_t epoch = 0;
+        std::uint64_t lsn = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    struct Seen {
+        ReplicaInfo info;
+        std::chrono::steady_clock::time_point seen;
+    };
+
+    ShardedAuth& auth;
+    std::string filename;
+    std::vector<SnapshotFile> snapshots;
+    std::atomic<std::uint64_t> nextId{0};
+    mutable std::mutex replicasMutex;
+    std::map<std::pair<std::string, std::size_t>, Seen> replicas;
+
+    std::string snapshotFilename(std::size_t shard) const {
+        return auth.shardFilename(filename + ".replica", shard);
+    }
+
+    // Replicas that start together share one snapshot, a new one is only written once the old one cant be caught up
+    // from anymore.
+    std::string snapshot(std::size_t shard) {
+        easyAuth& source = auth.shard(shard);
+        SnapshotFile& file = snapshots[shard];
+        std::lock_guard<std::mutex> lock(file.mutex);
+        ReplicationLogStats log = source.getReplicationLogStats();
+        if (!log.enabled) {
+            return "REPL_ERROR Replication is off";
+        }
+        if (file.id == 0 || file.epoch != log.epoch || file.lsn + 1 < log.firstLsn) {
+            for (int attempt = 0; ; attempt++) {
+                if (attempt == 5) {
+                    return "REPL_ERROR The database keeps changing under the snapshot";
+                }
+                std::uint64_t epoch = source.getReplicationLogStats().epoch;
+                source.waitForSnapshot(); // the server can be saving too, only one snapshot runs at a time
+                if (!source.startSnapshotCopy(snapshotFilename(shard), true, true)) // compact, a fraction of the bytes to send
+                    continue;
+                SnapshotStats stats = source.waitForSnapshot();
+                if (!stats.ok) {
+                    return "REPL_ERROR " + stats.error;
+                }
+                // the epoch only changes with writeMutex held, the same before and after means the view was taken in it
+                if (source.getReplicationLogStats().epoch != epoch)
+                    continue;
+                std::ifstream in(snapshotFilename(shard), std::ios::binary | std::ios::ate);
+                file.id = ++nextId;
+                file.epoch = epoch;
+                file.lsn = stats.lsn;
+                file.bytes = static_cast<std::uint64_t>(in.tellg());
+                break;
+            }
+        }
+        return "REPL_SNAPSHOT_READY " + std::to_string(file.id) + " " + std::to_string(file.epoch) + " " + std::to_string(file.bytes);
+    }
+
+    std::string chunk(std::size_t shard, std::uint64_t id, std::uint64_t offset) {
+        SnapshotFile& file = snapshots[shard];
+        std::lock_guard<std::mutex> lock(file.mutex);
+        if (id != file.id)
+            return "REPL_GONE";
+        if (offset > file.bytes)
+            return "REPL_ERROR Bad offset";
+        std::string data = "REPL_DATA\n";
+        std::size_t header = data.size();
+        std::size_t length = static_cast<std::size_t>((std::min)(static_cast<std::uint64_t>(kChunkBytes), file.bytes - offset));
+        data.resize(header + length);
+        std::ifstream in(snapshotFilename(shard), std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(offset));
+        if (length > 0 && !in.read(&data[header], static_cast<std::streamsize>(length))) {
+            return "REPL_ERROR Could not read " + snapshotFilename(shard);
+        }
+        return data;
+    }
+
+    std::string pull(std::size_t shard, std::uint64_t epoch, std::uint64_t lsn, const std::string& name) {
+        easyAuth& source = auth.shard(shard);
+        std::vector<ReplicationLog::Record> records;
+        bool ok = source.readReplicationLog(epoch, lsn, kPullBytes, kPullWait, records);
+        std::uint64_t primaryLsn = source.getReplicationLogStats().lastLsn;
+        {
+            std::lock_guard<std::mutex> lock(replicasMutex);
+            Seen& seen = replicas[std::make_pair(name, shard)];
+            seen.info.name = name;
+            seen.info.shard = shard;
+            seen.info.lsn = lsn;
+            seen.info.primaryLsn = primaryLsn;
+            seen.seen = std::chrono::steady_clock::now();
+        }
+        if (!ok)
+            return "REPL_SNAPSHOT_NEEDED";
+        JournalWriter body;
+        for (const auto &record : records)
+            body.putU64(record.lsn).putU64(static_cast<std::uint64_t>(record.timeMs)).putString(record.payload);
+        return "REPL_RECORDS " + std::to_string(primaryLsn) + " " + std::to_string(ReplicationLog::nowMs()) + " " +
+               std::to_string(records.size()) + "\n" + body.str();
+    }
+};
+
+// How far one replica shard is.
+struct ReplicaShardStats {
+    bool connected = false;
+    bool ready = false;            // has loaded a snapshot
+    std::uint64_t lsn = 0;         // newest record it has
+    std::uint64_t primaryLsn = 0;  // newest record the primary had at the last pull
+    double lagSeconds = 0;         // how long ago the primary logged the oldest record it doesnt have yet, 0 if none
+    double secondsSinceContact = 0;
+    std::uint64_t recordsApplied = 0;
+    std::uint64_t snapshotsLoaded = 0;
+    std::uint64_t bytesReceived = 0;
+    std::string lastError;
+};
+
+struct ReplicaStats {
+    std::vector<ReplicaShardStats> shards;
+    bool ready = false;             // every shard has loaded a snapshot
+    std::uint64_t lagRecords = 0;   // summed over the shards
+    double lagSeconds = 0;          // the worst shard
+};
+
+// Replica side: keeps a read-only ShardedAuth in step with a primary, a thread per shard.
+class Replica {
+ public:
+    // Sends a request and returns the response, "" if the connection is gone.
+    using Transport = std::function<std::string(const std::string& request)>;
+    // Opens a connection, an empty Transport if it couldnt. Every shard thread has its own.
+    using Connect = std::function<Transport()>;
+
+    static constexpr std::chrono::milliseconds kRetryDelay{500};
+
+    // The snapshots from the primary are stored as the files ShardedAuth would save `filename` to, with the snapshot
+    // id added. `name` tells the primary who is pulling.
+    Replica(ShardedAuth& auth, std::string filename, std::string name, Connect connect)
+        : auth(auth), filename(std::move(filename)), name(std::move(name)), connect(std::move(connect)),
+          shardStats(auth.getShardCount()), contacts(auth.getShardCount()) {}
+
+    Replica(const Replica&) = delete;
+    Replica& operator=(const Replica&) = delete;
+
+    // The number of shards of the primary (its REPL_OK), to make the replica's ShardedAuth with as many before it
+    // follows. Retries until `timeout`, 0 if the primary didnt answer by then.
+    static std::size_t primaryShardCount(const Connect& connect, std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true) {
+            Transport transport = connect ? connect() : Transport();
+            if (transport) {
+                std::istringstream hello(transport("REPL_HELLO"));
+                std::string status;
+                std::size_t shards;
+                if (hello >> status >> shards && status == "REPL_OK" && shards > 0 && shards <= ShardedAuth::kMaxShards)
+                    return shards;
+            }
+            if (std::chrono::steady_clock::now() + kRetryDelay > deadline)
+                return 0;
+            std::this_thread::sleep_for(kRetryDelay);
+        }
+    }
+
+    ~Replica() {
+        stop();
+    }
+
+    // Makes `auth` read-only and starts following the primary.
+    void start() {
+        stop();
+        auth.setReadOnly(true);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = false;
+        }
+        for (std::size_t i = 0; i < auth.getShardCount(); i++)
+            threads.emplace_back(&Replica::follow, this, i);
+    }
+
+    // Stops following, `auth` stays read-only with what it has.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+        threads.clear();
+    }
+
+    // Waits until every shard has loaded a snapshot from the primary, false if that took longer than `timeout`.
+    bool waitUntilReady(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return wake.wait_for(lock, timeout, [&] {
+            for (const auto &stats : shardStats) {
+                if (!stats.ready)
+                    return false;
+            }
+            return true;
+        });
+    }
+
+    ReplicaStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        ReplicaStats stats;
+        stats.ready = true;
+        auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < shardStats.size(); i++) {
+            ReplicaShardStats shard = shardStats[i];
+            shard.secondsSinceContact = std::chrono::duration<double>(now - contacts[i]).count();
+            stats.ready = stats.ready && shard.ready;
+            stats.lagRecords += shard.primaryLsn > shard.lsn ? shard.primaryLsn - shard.lsn : 0;
+            stats.lagSeconds = (std::max)(stats.lagSeconds, shard.lagSeconds);
+            stats.shards.push_back(shard);
+        }
+        return stats;
+    }
+
+ private:
+    ShardedAuth& auth;
+    std::string filename;
+    std::string name;
+    Connect connect;
+    std::vector<std::thread> threads;
+
+    mutable std::mutex mutex; // everything below
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<ReplicaShardStats> shardStats;
+    std::vector<std::chrono::steady_clock::time_point> contacts; // last answer from the primary, per shard
+
+    // Waits `delay` or until stop(). Returns false when stopping.
+    bool pause(std::chrono::milliseconds delay) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return !wake.wait_for(lock, delay, [&] { return stopping; });
+    }
+
+    bool isStopping() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stopping;
+    }
+
+    template <class F>
+    void update(std::size_t shard, F f) {
+        std::lock_guard<std::mutex> lock(mutex);
+        f(shardStats[shard]);
+        contacts[shard] = std::chrono::steady_clock::now();
+    }
+
+    void fail(std::size_t shard, const std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        shardStats[shard].lastError = error;
+    }
+
+    void follow(std::size_t shard) {
+        std::uint64_t epoch = 0; // 0 until a snapshot is loaded
+        std::string previousFile;
+        do {
+            Transport transport = connect ? connect() : Transport();
+            if (!transport) {
+                fail(shard, "Could not connect to the primary");
+                continue;
+            }
+            try {
+                std::string hello = transport("REPL_HELLO");
+                if (hello != "REPL_OK " + std::to_string(auth.getShardCount())) {
+                    fail(shard, hello.empty() ? "Connection lost" : "Primary has another number of shards: " + hello);
+                    continue;
+                }
+                update(shard, [](ReplicaShardStats& stats) { stats.connected = true; });
+                while (!isStopping()) {
+                    if (epoch == 0 && !loadSnapshot(shard, transport, epoch, previousFile))
+                        break;
+                    if (!pull(shard, transport, epoch))
+                        break;
+                }
+            } catch (const std::exception& e) {
+                fail(shard, e.what());
+            }
+            update(shard, [](ReplicaShardStats& stats) { stats.connected = false; });
+        } while (pause(kRetryDelay));
+    }
+
+    // Downloads the primary's snapshot of `shard` and loads it. False if the connection is gone or the primary
+    // replaced it meanwhile (the caller reconnects and asks again).
+    bool loadSnapshot(std::size_t shard, const Transport& transport, std::uint64_t& epoch, std::string& previousFile) {
+        std::istringstream ready(transport("REPL_SNAPSHOT " + std::to_string(shard)));
+        std::string status;
+        std::uint64_t id, newEpoch, bytes;
+        if (!(ready >> status >> id >> newEpoch >> bytes) || status != "REPL_SNAPSHOT_READY") {
+            fail(shard, "Primary didnt send a snapshot: " + ready.str());
+            return false;
+        }
+        std::string file = auth.shardFilename(filename, shard) + "." + std::to_string(id);
+        {
+            std::ofstream out(file, std::ios::binary | std::ios::trunc);
+            std::uint64_t offset = 0;
+            while (offset < bytes) {
+                std::string data = transport("REPL_CHUNK " + std::to_string(shard) + " " + std::to_string(id) + " " + std::to_string(offset));
+                const std::string prefix = "REPL_DATA\n";
+                if (data.compare(0, prefix.size(), prefix) != 0 || data.size() == prefix.size()) {
+                    fail(shard, data.empty() ? "Connection lost" : "Snapshot download failed: " + data.substr(0, 100));
+                    return false;
+                }
+                out.write(data.data() + prefix.size(), static_cast<std::streamsize>(data.size() - prefix.size()));
+                offset += data.size() - prefix.size();
+                update(shard, [&](ReplicaShardStats& stats) { stats.bytesReceived += data.size(); });
+            }
+            if (!out) {
+                fail(shard, "Could not write " + file);
+                return false;
+            }
+        }
+        easyAuth& target = auth.shard(shard);
+        if (!target.loadDatabase(file)) {
+            fail(shard, "Could not load the snapshot " + file);
+            return false;
+        }
+        if (!target.wasDecryptedOnLoad())
+            target.decryptDatabase();
+        // the old one isnt mapped anymore
+        if (!previousFile.empty() && previousFile != file)
+            std::remove(previousFile.c_str());
+        previousFile = file;
+        epoch = newEpoch;
+        std::uint64_t lsn = target.getJournalLsn();
+        update(shard, [&](ReplicaShardStats& stats) {
+            stats.ready = true;
+            stats.lsn = lsn;
+            stats.snapshotsLoaded++;
+        });
+        wake.notify_all();
+        return true;
+    }
+
+    // One pull: applies what the primary sent. False if the connection is gone, epoch is 0 again if the replica has
+    // to load a new snapshot.
+    bool pull(std::size_t shard, const Transport& transport, std::uint64_t& epoch) {
+        easyAuth& target = auth.shard(shard);
+        std::uint64_t lsn = target.getJournalLsn();
+        std::string response = transport("REPL_PULL " + std::to_string(shard) + " " + std::to_string(epoch) + " " +
+                                         std::to_string(lsn) + " " + name);
+        if (response.empty()) {
+            fail(shard, "Connection lost");
+            return false;
+        }
+        if (response == "REPL_SNAPSHOT_NEEDED") {
+            epoch = 0;
+            return true;
+        }
+        std::size_t newline = response.find('\n');
+        std::istringstream header(response.substr(0, newline));
+        std::string status;
+        std::uint64_t primaryLsn, count;
+        std::int64_t primaryMs;
+        if (newline == std::string::npos || !(header >> status >> primaryLsn >> primaryMs >> count) || status != "REPL_RECORDS") {
+            fail(shard, "Unexpected response: " + response.substr(0, 100));
+            return false;
+        }
+        JournalReader records(std::string_view(response).substr(newline + 1));
+        std::int64_t lastMs = primaryMs;
+        std::uint64_t applied = 0;
+        try {
+            for (std::uint64_t i = 0; i < count; i++) {
+                std::uint64_t recordLsn = records.getU64();
+                lastMs = static_cast<std::int64_t>(records.getU64());
+                target.applyReplicated(recordLsn, records.getString());
+                lsn = recordLsn;
+                applied++;
+            }
+        } catch (const std::exception& e) {
+            // it doesnt fit this database, so start over from a snapshot
+            fail(shard, std::string("Could not apply a record, loading a new snapshot: ") + e.what());
+            epoch = 0;
+        }
+        update(shard, [&](ReplicaShardStats& stats) {
+            stats.lsn = lsn;
+            stats.primaryLsn = primaryLsn;
+            stats.recordsApplied += applied;
+            stats.bytesReceived += response.size();
+            // the next record was logged after the last one it got, so that one's age is about how far behind it is
+            stats.lagSeconds = lsn < primaryLsn ? static_cast<double>(primaryMs - lastMs) / 1000 : 0;
+        });
+        return true;
+    }
+};
+
+#endif // EasyAuth_REPLICATION_HPP
@@ -0,0 +1,161 @@
+// replicationLog.hpp
+// The newest journal records of a primary, kept in memory so replicas can pull what they dont have yet
+// (see replication.hpp). Records have consecutive lsns, so finding where a replica left off is an index.
+// The log only goes back so far (maxBytes). A replica that fell further behind, or that comes from another epoch,
+// has to start over from a snapshot. The epoch is a random number that changes whenever the log starts and whenever
+// the database changes without a record (a load, initialize(), encrypting), so a replica can never mix records into a
+// database they dont belong to, e.g. after the primary restarted and lost records that werent on disk yet.
+
+#ifndef EasyAuth_REPLICATION_LOG_HPP
+#define EasyAuth_REPLICATION_LOG_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+struct ReplicationLogStats {
+    bool enabled = false;
+    std::uint64_t epoch = 0;
+    std::uint64_t firstLsn = 0; // oldest record a replica can still get, lastLsn + 1 when there is none
+    std::uint64_t lastLsn = 0;
+    std::size_t records = 0;
+    std::size_t bytes = 0;
+};
+
+class ReplicationLog {
+ public:
+    static constexpr std::size_t kDefaultMaxBytes = std::size_t(64) << 20;
+
+    struct Record {
+        std::uint64_t lsn;
+        std::int64_t timeMs; // nowMs() when it was logged
+        std::string payload;
+    };
+
+    ReplicationLog() = default;
+    ReplicationLog(const ReplicationLog&) = delete;
+    ReplicationLog& operator=(const ReplicationLog&) = delete;
+
+    // Starts keeping records, the next one has lsn lastLsn + 1.
+    void enable(std::size_t maxBytes, std::uint64_t lastLsn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->maxBytes = maxBytes;
+        enabled = true;
+        restart(lastLsn);
+    }
+
+    void disable() {
+        std::lock_guard<std::mutex> lock(mutex);
+        enabled = false;
+        restart(0);
+    }
+
+    bool isEnabled() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return enabled;
+    }
+
+    // The database changed without a record, every replica has to start over. lastLsn is where the lsns are now.
+    void reset(std::uint64_t lastLsn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (enabled)
+            restart(lastLsn);
+    }
+
+    void append(std::uint64_t lsn, const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enabled)
+            return;
+        if (lsn != last + 1) { // cant happen while every record comes through here, but never hand out a gap
+            restart(lsn - 1);
+        }
+        records.push_back(Record{lsn, nowMs(), payload});
+        bytes += payload.size() + sizeof(Record);
+        last = lsn;
+        while (bytes > maxBytes && records.size() > 1) {
+            bytes -= records.front().payload.size() + sizeof(Record);
+            records.pop_front();
+        }
+        appended.notify_all();
+    }
+
+    // Copies the records after afterLsn into `out`, as many as fit in maxBytes (at least one). If there are none yet
+    // it waits up to `wait` for one. Returns false if the replica has to start over from a snapshot: another epoch,
+    // records it needs are gone, or it is ahead of the log.
+    bool read(std::uint64_t epoch, std::uint64_t afterLsn, std::size_t maxBytes, std::chrono::milliseconds wait,
+              std::vector<Record>& out) {
+        std::unique_lock<std::mutex> lock(mutex);
+        appended.wait_for(lock, wait, [&] { return !usable(epoch, afterLsn) || last > afterLsn; });
+        if (!usable(epoch, afterLsn))
+            return false;
+        std::size_t taken = 0;
+        for (std::size_t i = static_cast<std::size_t>(afterLsn + 1 - firstLsn()); i < records.size(); i++) {
+            if (taken > 0 && taken + records[i].payload.size() > maxBytes)
+                break;
+            taken += records[i].payload.size();
+            out.push_back(records[i]);
+        }
+        return true;
+    }
+
+    std::uint64_t getEpoch() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return epoch;
+    }
+
+    ReplicationLogStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        ReplicationLogStats stats;
+        stats.enabled = enabled;
+        stats.epoch = epoch;
+        stats.firstLsn = firstLsn();
+        stats.lastLsn = last;
+        stats.records = records.size();
+        stats.bytes = bytes;
+        return stats;
+    }
+
+    // Milliseconds on a clock only this process uses, so lag is only ever computed from two readings of it.
+    static std::int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+ private:
+    mutable std::mutex mutex; // everything below
+    std::condition_variable appended;
+    std::deque<Record> records;
+    std::size_t bytes = 0;
+    std::size_t maxBytes = kDefaultMaxBytes;
+    std::uint64_t last = 0;  // lsn of the newest record, or where the log started if there is none
+    std::uint64_t epoch = 0; // 0 while disabled, replicas never use it
+    bool enabled = false;
+
+    std::uint64_t firstLsn() const {
+        return records.empty() ? last + 1 : records.front().lsn;
+    }
+
+    bool usable(std::uint64_t replicaEpoch, std::uint64_t afterLsn) const {
+        return enabled && replicaEpoch == epoch && afterLsn + 1 >= firstLsn() && afterLsn <= last;
+    }
+
+    void restart(std::uint64_t lastLsn) {
+        records.clear();
+        bytes = 0;
+        last = lastLsn;
+        epoch = 0;
+        if (enabled) {
+            std::random_device device;
+            while (epoch == 0)
+                epoch = (static_cast<std::uint64_t>(device()) << 32) | device();
+        }
+        appended.notify_all();
+    }
+};
+
+#endif // EasyAuth_REPLICATION_LOG_HPP
@@ -0,0 +1,312 @@
+// sessionTable.hpp
+// In-memory login sessions: a token handed out after a login resolves straight to the account number.
+// A token is the hex of the session's slot in the table, the slot's generation (bumped every time the slot is reused,
+// so an old token cant resolve to a new session) and 128 random bits, so resolving it is an array index and two
+// compares instead of a lookup.
+// Sessions live for a fixed time from their creation. Expiry is tracked in a hashed timer wheel of one second ticks:
+// a session sits in the bucket of the tick it expires at, and sweeping only walks the buckets of the ticks that
+// passed since the last sweep, so it costs what expired (plus the sessions that are more than a wheel turn away and
+// happen to share those buckets), never a pass over every session. resolve() checks the expiry itself, so a session
+// that is due but not swept yet is already rejected.
+
+#ifndef EasyAuth_SESSION_TABLE_HPP
+#define EasyAuth_SESSION_TABLE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class SessionTable {
+ public:
+    static constexpr std::size_t kWheelSlots = 4096; // one second each, so a wheel turn is a bit over an hour
+    static constexpr std::size_t kTokenLength = 48;  // hex: 8 slot, 8 generation, 32 secret
+
+    explicit SessionTable(std::chrono::seconds lifetime = std::chrono::minutes(30))
+        : started(std::chrono::steady_clock::now()) {
+        setLifetime(lifetime);
+        for (auto &head : wheel)
+            head = kNone;
+    }
+
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+
+    // For sessions created from now on.
+    void setLifetime(std::chrono::seconds lifetime) {
+        if (lifetime.count() <= 0) {
+            throw std::invalid_argument("Session lifetime must be positive");
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        lifetimeTicks = lifetime.count();
+    }
+
+    std::chrono::seconds getLifetime() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return std::chrono::seconds(lifetimeTicks);
+    }
+
+    // Starts a session for accountNumber and returns its token. Sweeps the expired sessions first.
+    std::string create(std::int32_t accountNumber) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        std::int64_t now = tick();
+        sweep(now);
+        std::uint32_t index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            if (sessions.size() >= kNone)
+                throw std::runtime_error("Session table is full");
+            index = static_cast<std::uint32_t>(sessions.size());
+            sessions.emplace_back();
+        }
+        Session& session = sessions[index];
+        session.accountNumber = accountNumber;
+        session.expiresAt = now + lifetimeTicks;
+        randomSecret(session.secret);
+        linkWheel(index);
+        linkAccount(index);
+        live++;
+        return tokenOf(index);
+    }
+
+    // The account of a live session, or -1 for a token that is malformed, ended or expired.
+    std::int32_t resolve(std::string_view token) const {
+        std::uint32_t index, generation;
+        std::uint64_t secret[2];
+        if (!parse(token, index, generation, secret))
+            return -1;
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return resolveLocked(index, generation, secret);
+    }
+
+    // Ends the session of `token` (logout). Returns false if it wasnt live.
+    bool remove(std::string_view token) {
+        std::uint32_t index, generation;
+        std::uint64_t secret[2];
+        if (!parse(token, index, generation, secret))
+            return false;
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (resolveLocked(index, generation, secret) < 0)
+            return false;
+        release(index);
+        return true;
+    }
+
+    // Ends every session of accountNumber, e.g. when it is deleted or its password changes. Returns how many.
+    std::size_t removeAccount(std::int32_t accountNumber) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto found = byAccount.find(accountNumber);
+        if (found == byAccount.end())
+            return 0;
+        std::size_t removed = 0;
+        std::uint32_t index = found->second;
+        while (index != kNone) {
+            std::uint32_t next = sessions[index].accountNext;
+            release(index);
+            removed++;
+            index = next;
+        }
+        return removed;
+    }
+
+    // Frees the sessions that expired since the last sweep. create() does this too, call it on a timer if sessions
+    // are created rarely. Returns how many it freed.
+    std::size_t expire() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        return sweep(tick());
+    }
+
+    // Ends every session.
+    void clear() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (std::uint32_t i = 0; i < sessions.size(); i++) {
+            if (sessions[i].accountNumber >= 0)
+                release(i);
+        }
+    }
+
+    // Sessions not ended or swept yet, expired ones that are still waiting for a sweep included.
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return live;
+    }
+
+    std::size_t memoryUsage() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return sessions.capacity() * sizeof(Session) + freeSlots.capacity() * sizeof(std::uint32_t) + sizeof(wheel) +
+               byAccount.size() * (sizeof(std::pair<const std::int32_t, std::uint32_t>) + 2 * sizeof(void*)) +
+               byAccount.bucket_count() * sizeof(void*);
+    }
+
+ private:
+    static constexpr std::uint32_t kNone = UINT32_MAX;
+
+    struct Session {
+        std::uint64_t secret[2] = {0, 0};
+        std::int64_t expiresAt = 0;            // tick
+        std::int32_t accountNumber = -1;       // -1 = free slot
+        std::uint32_t generation = 0;
+        std::uint32_t wheelPrev = kNone, wheelNext = kNone;     // sessions in the same wheel bucket
+        std::uint32_t accountPrev = kNone, accountNext = kNone; // sessions of the same account
+    };
+
+    mutable std::shared_mutex mutex; // everything below
+    std::vector<Session> sessions;
+    std::vector<std::uint32_t> freeSlots;
+    std::uint32_t wheel[kWheelSlots];                     // first session of each bucket
+    std::unordered_map<std::int32_t, std::uint32_t> byAccount; // first session of each account that has one
+    std::chrono::steady_clock::time_point started;
+    std::int64_t lifetimeTicks = 0;
+    std::int64_t sweptTick = 0; // every bucket up to this tick has been swept
+    std::size_t live = 0;
+
+    // resolve() for a parsed token, with the lock held.
+    std::int32_t resolveLocked(std::uint32_t index, std::uint32_t generation, const std::uint64_t secret[2]) const {
+        if (index >= sessions.size())
+            return -1;
+        const Session& session = sessions[index];
+        // no early exit on the secret, so the time doesnt say how much of it was right
+        std::uint64_t diff = (session.secret[0] ^ secret[0]) | (session.secret[1] ^ secret[1]);
+        if (session.accountNumber < 0 || session.generation != generation || diff != 0 || session.expiresAt <= tick())
+            return -1;
+        return session.accountNumber;
+    }
+
+    std::int64_t tick() const {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    std::size_t sweep(std::int64_t now) {
+        std::size_t freed = 0;
+        // after a whole turn every bucket has been walked once, more rounds would find nothing new
+        std::int64_t from = (std::max)(sweptTick + 1, now - static_cast<std::int64_t>(kWheelSlots) + 1);
+        for (std::int64_t t = from; t <= now; t++) {
+            std::uint32_t index = wheel[static_cast<std::size_t>(t) % kWheelSlots];
+            while (index != kNone) {
+                std::uint32_t next = sessions[index].wheelNext;
+                if (sessions[index].expiresAt <= now) {
+                    release(index);
+                    freed++;
+                }
+                index = next;
+            }
+        }
+        sweptTick = (std::max)(sweptTick, now);
+        return freed;
+    }
+
+    void linkWheel(std::uint32_t index) {
+        Session& session = sessions[index];
+        std::uint32_t& head = wheel[static_cast<std::size_t>(session.expiresAt) % kWheelSlots];
+        session.wheelPrev = kNone;
+        session.wheelNext = head;
+        if (head != kNone)
+            sessions[head].wheelPrev = index;
+        head = index;
+    }
+
+    void linkAccount(std::uint32_t index) {
+        Session& session = sessions[index];
+        auto inserted = byAccount.emplace(session.accountNumber, index);
+        session.accountPrev = kNone;
+        session.accountNext = inserted.second ? kNone : inserted.first->second;
+        if (!inserted.second) {
+            sessions[inserted.first->second].accountPrev = index;
+            inserted.first->second = index;
+        }
+    }
+
+    // Unlinks the session from its bucket and account and puts the slot up for reuse with a new generation.
+    void release(std::uint32_t index) {
+        Session& session = sessions[index];
+        if (session.wheelPrev != kNone)
+            sessions[session.wheelPrev].wheelNext = session.wheelNext;
+        else
+            wheel[static_cast<std::size_t>(session.expiresAt) % kWheelSlots] = session.wheelNext;
+        if (session.wheelNext != kNone)
+            sessions[session.wheelNext].wheelPrev = session.wheelPrev;
+
+        if (session.accountPrev != kNone)
+            sessions[session.accountPrev].accountNext = session.accountNext;
+        else if (session.accountNext != kNone)
+            byAccount[session.accountNumber] = session.accountNext;
+        else
+            byAccount.erase(session.accountNumber);
+        if (session.accountNext != kNone)
+            sessions[session.accountNext].accountPrev = session.accountPrev;
+
+        session.accountNumber = -1;
+        session.generation++;
+        session.secret[0] = session.secret[1] = 0;
+        freeSlots.push_back(index);
+        live--;
+    }
+
+    static void randomSecret(std::uint64_t secret[2]) {
+        thread_local std::random_device device;
+        for (int i = 0; i < 2; i++)
+            secret[i] = (static_cast<std::uint64_t>(device()) << 32) | device();
+    }
+
+    static void putHex(std::string& out, std::uint64_t value, int digits) {
+        static const char hex[] = "0123456789abcdef";
+        for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+            out += hex[(value >> shift) & 15];
+    }
+
+    // A table instead of comparing ranges: digits and letters come in random order, so those branches mispredict
+    // about every other character. Anything that isnt a lowercase hex digit maps to 16 and fails the check at the end.
+    static bool getHex(std::string_view in, std::uint64_t& value) {
+        struct Table {
+            std::uint8_t digit[256];
+            Table() {
+                for (int c = 0; c < 256; c++)
+                    digit[c] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 16;
+            }
+        };
+        static const Table table;
+        value = 0;
+        unsigned invalid = 0;
+        for (char c : in) {
+            unsigned digit = table.digit[static_cast<unsigned char>(c)];
+            invalid |= digit;
+            value = (value << 4) | (digit & 15);
+        }
+        return (invalid & 16) == 0;
+    }
+
+    std::string tokenOf(std::uint32_t index) const {
+        const Session& session = sessions[index];
+        std::string token;
+        token.reserve(kTokenLength);
+        putHex(token, index, 8);
+        putHex(token, session.generation, 8);
+        putHex(token, session.secret[0], 16);
+        putHex(token, session.secret[1], 16);
+        return token;
+    }
+
+    static bool parse(std::string_view token, std::uint32_t& index, std::uint32_t& generation, std::uint64_t secret[2]) {
+        std::uint64_t slot, gen;
+        if (token.size() != kTokenLength || !getHex(token.substr(0, 8), slot) || !getHex(token.substr(8, 8), gen) ||
+            !getHex(token.substr(16, 16), secret[0]) || !getHex(token.substr(32, 16), secret[1]))
+        {
+            return false;
+        }
+        index = static_cast<std::uint32_t>(slot);
+        generation = static_cast<std::uint32_t>(gen);
+        return true;
+    }
+};
+
+#endif // EasyAuth_SESSION_TABLE_HPP
@@ -0,0 +1,784 @@
+// shardedAuth.hpp
+// Several easyAuth instances behind one interface. Every username belongs to one shard (picked from its hash), and
+// every shard has its own Database, locks, journal, hashing pool and database file, so writes to different shards
+// never wait on each other and loading, saving, encrypting and replaying journals run a thread per shard.
+//
+// Account numbers are global: shard + local number * shards, so a number says which shard holds it and the numbers of
+// one shard stay dense. getAccountCount() is one past the highest number in use; numbers in between that another
+// shard hasnt reached yet are treated like deleted accounts. Session tokens start with the shard in two hex digits.
+//
+// The files of a store saved as "database.db" are "database.db.<shard>-of-<shards>" (and ".journal" next to each),
+// so a store is only loaded with the number of shards it was saved with. migrateDatabase() moves the accounts of a
+// store with another shard count, or of a single easyAuth file, into the shards.
+//
+// Every shard keeps its own 64 username index partitions, whose block tables cost about 8 MiB per shard. The default
+// is kDefaultShards on every machine, not one per core: the count is part of the file names and of every account
+// number, so a store moved to another machine, and a replica of it, must keep it. savedShardCount() finds the count
+// of a store on disk.
+
+#ifndef EasyAuth_SHARDED_AUTH_HPP
+#define EasyAuth_SHARDED_AUTH_HPP
+
+#include "easyAuth.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <future>
+#include <memory>
+#include <thread>
+
+class ShardedAuth {
+ public:
+    static constexpr std::size_t kMaxShards = 256;       // the shard is two hex digits of a session token
+    static constexpr std::size_t kDefaultShards = 8;
+
+    // shards = 0 uses kDefaultShards.
+    explicit ShardedAuth(std::size_t shards = 0) {
+        if (shards == 0)
+            shards = kDefaultShards;
+        if (shards > kMaxShards) {
+            throw std::invalid_argument("Too many shards");
+        }
+        for (std::size_t i = 0; i < shards; i++)
+            this->shards.emplace_back(new easyAuth());
+        // one pool per shard, split the cores between them instead of giving each a thread per core
+        configureHashing(0, HashPool::kDefaultQueueCapacity, std::chrono::milliseconds(500));
+    }
+
+    ShardedAuth(const ShardedAuth&) = delete;
+    ShardedAuth& operator=(const ShardedAuth&) = delete;
+
+    std::size_t getShardCount() const {
+        return shards.size();
+    }
+
+    // The shard a username belongs to. The index partitions and slots of a shard use the username hash as it is,
+    // so it is mixed again first: taking bits they use too would leave most partitions of every shard empty.
+    std::size_t shardOf(std::string_view username) const {
+        std::uint64_t mixed = static_cast<std::uint64_t>(UsernameIndex::hashUsername(username)) * 0x9E3779B97F4A7C15ull;
+        mixed ^= mixed >> 29;
+        return static_cast<std::size_t>(((mixed & 0xFFFFFFFFull) * shards.size()) >> 32);
+    }
+
+    // Direct access to one shard, its account numbers are local ones.
+    easyAuth& shard(std::size_t index) {
+        return *shards.at(index);
+    }
+
+    int globalAccountNumber(std::size_t shard, int localAccountNumber) const {
+        if (localAccountNumber < 0)
+            return -1;
+        std::uint64_t global = static_cast<std::uint64_t>(localAccountNumber) * shards.size() + shard;
+        if (global > static_cast<std::uint64_t>(INT32_MAX)) {
+            throw std::runtime_error("Account number out of range");
+        }
+        return static_cast<int>(global);
+    }
+
+    // Splits a global account number, false for a negative one.
+    bool localAccountNumber(int accountNumber, std::size_t& shard, int& local) const {
+        if (accountNumber < 0)
+            return false;
+        shard = static_cast<std::size_t>(accountNumber) % shards.size();
+        local = static_cast<int>(static_cast<std::size_t>(accountNumber) / shards.size());
+        return true;
+    }
+
+    // The number of shards of the store saved as `filename`, 0 if there is none with all of its files. Open a store
+    // with it to load it as it is instead of migrating it to another count.
+    static std::size_t savedShardCount(const std::string& filename) {
+        for (std::size_t count = 1; count <= kMaxShards; count++) {
+            std::size_t i = 0;
+            while (i < count && fileExists(filename + "." + std::to_string(i) + "-of-" + std::to_string(count)))
+                i++;
+            if (i == count)
+                return count;
+        }
+        return 0;
+    }
+
+    // File shard `index` of a store saved as `filename` is kept in.
+    std::string shardFilename(const std::string& filename, std::size_t index) const {
+        return filename + "." + std::to_string(index) + "-of-" + std::to_string(shards.size());
+    }
+
+    void initialize(int numberOfProperties) {
+        forEachShard([&](std::size_t i) { shards[i]->initialize(numberOfProperties); });
+    }
+
+    /* USERS / AUTH / CREDENTIALS */
+
+    bool checkCredentials(const std::string& username, const std::string& password) {
+        return checkCredentialsAsync(username, password).get();
+    }
+
+    std::future<bool> checkCredentialsAsync(const std::string& username, const std::string& password) {
+        return shards[shardOf(username)]->checkCredentialsAsync(username, password);
+    }
+
+    std::string login(const std::string& username, const std::string& password) {
+        std::size_t index = shardOf(username);
+        std::string token = shards[index]->login(username, password);
+        return token.empty() ? token : shardPrefix(index) + token;
+    }
+
+    std::future<std::string> loginAsync(const std::string& username, const std::string& password) {
+        std::size_t index = shardOf(username);
+        std::future<std::string> token = shards[index]->loginAsync(username, password);
+        return std::async(std::launch::deferred, [index](std::future<std::string> token) {
+            std::string local = token.get();
+            return local.empty() ? local : shardPrefix(index) + local;
+        }, std::move(token));
+    }
+
+    void loginAsync(const std::string& username, const std::string& password, std::function<void(const std::string&)> done) {
+        std::size_t index = shardOf(username);
+        shards[index]->loginAsync(username, password, [index, done](const std::string& local) {
+            done(local.empty() ? local : shardPrefix(index) + local);
+        });
+    }
+
+    void addCredentials(const std::string& username, const std::string& password) {
+        shards[shardOf(username)]->addCredentials(username, password);
+    }
+
+    void addCredentials(const std::string& username, const std::string& password, std::function<void(int)> done) {
+        std::size_t index = shardOf(username);
+        shards[index]->addCredentials(username, password, [this, index, done](int local) {
+            done(globalAccountNumber(index, local));
+        });
+    }
+
+    // Accounts of `batch` go to the shard of their username and every shard imports its part on its own thread.
+    // Duplicates are still found across the whole batch, a username always lands in the same shard.
+    ImportStats importAccounts(const Database& batch, bool hashPasswords = true) {
+        auto started = std::chrono::steady_clock::now();
+        if (batch.credentialTypes() != 2) {
+            throw std::invalid_argument("Batch must have 2 credential types");
+        }
+        std::vector<Database> parts(shards.size());
+        for (auto &part : parts)
+            part.resize(2, batch.propertyTypes());
+        for (std::size_t i = 0; i < batch.accountCount(); i++) {
+            std::string_view username = batch.credential(0, i);
+            Database& part = parts[shardOf(username)];
+            int accountNumber = part.addAccount();
+            part.setCredential(0, accountNumber, username);
+            part.setCredential(1, accountNumber, batch.credential(1, i));
+            for (std::size_t p = 0; p < batch.propertyTypes(); p++) {
+                for (std::size_t k = 0; k < batch.propertyCount(p, i); k++)
+                    part.addProperty(p, accountNumber, batch.property(p, i, k));
+            }
+        }
+        std::vector<ImportStats> results(shards.size());
+        forEachShard([&](std::size_t i) {
+            results[i] = shards[i]->importAccounts(parts[i], hashPasswords);
+            parts[i].clear();
+        });
+        ImportStats stats;
+        for (const auto &result : results) {
+            stats.added += result.added;
+            stats.duplicates += result.duplicates;
+            stats.invalid += result.invalid;
+            stats.hashSeconds = (std::max)(stats.hashSeconds, result.hashSeconds);
+        }
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return stats;
+    }
+
+    void deleteCredentials(int accountNumber) {
+        std::size_t index;
+        int local;
+        if (!localAccountNumber(accountNumber, index, local)) {
+            throw std::runtime_error("Account not found");
+        }
+        shards[index]->deleteCredentials(local);
+    }
+
+    // Returns the account number afterwards: a new username can belong to another shard, then the account is added
+    // there (with its properties) and deleted here, and gets a new number. That move is two steps, a crash in between
+    // leaves the account under both names.
+    int editCredentials(int accountNumber, const std::string& username, const std::string& password) {
+        std::size_t index;
+        int local;
+        if (!localAccountNumber(accountNumber, index, local)) {
+            throw std::runtime_error("Account not found");
+        }
+        std::size_t target = shardOf(username);
+        if (target == index) {
+            shards[index]->editCredentials(local, username, password);
+            return accountNumber;
+        }
+        easyAuth& from = *shards[index];
+        easyAuth& to = *shards[target];
+        from.getUsername(local); // throws if there is no such account
+        std::vector<std::vector<std::string>> properties = from.getProperties(local);
+        to.addCredentials(username, password);
+        int moved = to.getAccountNumberOfUser(username);
+        for (std::size_t p = 0; p < properties.size(); p++) {
+            for (const auto &value : properties[p])
+                to.addProperty(moved, p, value);
+        }
+        from.deleteCredentials(local);
+        return globalAccountNumber(target, moved);
+    }
+
+    // editCredentials() with a callback (see easyAuth::addCredentials()), `done` gets the account number afterwards or -1.
+    // A move to another shard copies the properties and deletes the old account on the hashing thread of the new shard.
+    void editCredentials(int accountNumber, const std::string& username, const std::string& password, std::function<void(int)> done) {
+        std::size_t index;
+        int local;
+        if (!localAccountNumber(accountNumber, index, local)) {
+            throw std::runtime_error("Account not found");
+        }
+        std::size_t target = shardOf(username);
+        if (target == index) {
+            shards[index]->editCredentials(local, username, password, [this, index, done](int edited) {
+                done(globalAccountNumber(index, edited));
+            });
+            return;
+        }
+        easyAuth* from = shards[index].get();
+        easyAuth* to = shards[target].get();
+        from->getUsername(local); // throws if there is no such account
+        std::vector<std::vector<std::string>> properties = from->getProperties(local);
+        to->addCredentials(username, password, [this, from, to, local, target, properties, done](int moved) {
+            try {
+                if (moved >= 0) {
+                    for (std::size_t p = 0; p < properties.size(); p++) {
+                        for (const auto &value : properties[p])
+                            to->addProperty(moved, p, value);
+                    }
+                    from->deleteCredentials(local);
+                }
+            } catch (const std::exception&) {
+                moved = -1;
+            }
+            done(globalAccountNumber(target, moved));
+        });
+    }
+
+    int getAccountNumberOfUser(const std::string& username) {
+        std::size_t index = shardOf(username);
+        return globalAccountNumber(index, shards[index]->getAccountNumberOfUser(username));
+    }
+
+    std::string getUsername(int accountNumber) {
+        return at(accountNumber).getUsername(localOf(accountNumber));
+    }
+
+    std::string getPassword(int accountNumber) {
+        return at(accountNumber).getPassword(localOf(accountNumber));
+    }
+
+    // False for a deleted account and for the numbers below getAccountCount() that another shard hasnt reached yet.
+    bool accountExists(int accountNumber) {
+        std::size_t index;
+        int local;
+        return localAccountNumber(accountNumber, index, local) && shards[index]->accountExists(local);
+    }
+
+    // One past the highest account number in use.
+    std::size_t getAccountCount() const {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < shards.size(); i++) {
+            std::size_t local = shards[i]->getAccountCount();
+            if (local > 0)
+                count = (std::max)(count, (local - 1) * shards.size() + i + 1);
+        }
+        return count;
+    }
+
+    // Accounts that exist, over every shard.
+    std::size_t getActiveAccountCount() {
+        std::size_t count = 0;
+        for (auto &shard : shards)
+            count += shard->getAccountCount() - shard->getDeletedAccountCount();
+        return count;
+    }
+
+    std::size_t getDeletedAccountCount() {
+        return getAccountCount() - getActiveAccountCount();
+    }
+
+    std::uint64_t getVersion() const {
+        std::uint64_t version = 0;
+        for (const auto &shard : shards)
+            version += shard->getVersion();
+        return version;
+    }
+
+    /* SESSIONS */
+
+    std::string createSession(int accountNumber) {
+        std::size_t index;
+        int local;
+        if (!localAccountNumber(accountNumber, index, local)) {
+            throw std::runtime_error("Account not found");
+        }
+        return shardPrefix(index) + shards[index]->createSession(local);
+    }
+
+    int resolveSession(std::string_view token) const {
+        std::size_t index;
+        if (!shardOfToken(token, index))
+            return -1;
+        return globalAccountNumber(index, shards[index]->resolveSession(token.substr(2)));
+    }
+
+    bool endSession(std::string_view token) {
+        std::size_t index;
+        return shardOfToken(token, index) && shards[index]->endSession(token.substr(2));
+    }
+
+    void setSessionLifetime(std::chrono::seconds lifetime) {
+        for (auto &shard : shards)
+            shard->setSessionLifetime(lifetime);
+    }
+
+    std::chrono::seconds getSessionLifetime() const {
+        return shards[0]->getSessionLifetime();
+    }
+
+    std::size_t expireSessions() {
+        std::size_t expired = 0;
+        for (auto &shard : shards)
+            expired += shard->expireSessions();
+        return expired;
+    }
+
+    std::size_t getSessionCount() const {
+        std::size_t count = 0;
+        for (const auto &shard : shards)
+            count += shard->getSessionCount();
+        return count;
+    }
+
+    /* PROPERTIES */
+
+    void addProperty(int accountNumber, std::size_t propertyIndex, const std::string& property) {
+        at(accountNumber).addProperty(localOf(accountNumber), propertyIndex, property);
+    }
+
+    void editProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber, const std::string& newProperty) {
+        at(accountNumber).editProperty(localOf(accountNumber), propertyIndex, propertyNumber, newProperty);
+    }
+
+    void deleteProperty(int accountNumber, std::size_t propertyIndex, std::size_t propertyNumber) {
+        at(accountNumber).deleteProperty(localOf(accountNumber), propertyIndex, propertyNumber);
+    }
+
+    std::vector<std::vector<std::string>> getProperties(int accountNumber) {
+        if (accountNumber < 0)
+            return {};
+        return at(accountNumber).getProperties(localOf(accountNumber));
+    }
+
+    bool hasProperty(int accountNumber, std::size_t propertyIndex, const std::string& property) const {
+        if (accountNumber < 0)
+            return false;
+        return at(accountNumber).hasProperty(localOf(accountNumber), propertyIndex, property);
+    }
+
+    // See easyAuth::registerValue(). Every shard registers it, they all hand out handles in the same order.
+    KnownValue registerValue(const std::string& value) {
+        KnownValue known;
+        for (auto &shard : shards)
+            known = shard->registerValue(value);
+        return known;
+    }
+
+    bool hasKnownProperty(int accountNumber, std::size_t propertyIndex, KnownValue value) const {
+        if (accountNumber < 0)
+            return false;
+        return at(accountNumber).hasKnownProperty(localOf(accountNumber), propertyIndex, value);
+    }
+
+    bool doesAccountHaveProperty(int accountNumber, std::string property) {
+        if (accountNumber < 0)
+            return false;
+        return at(accountNumber).doesAccountHaveProperty(localOf(accountNumber), property);
+    }
+
+    std::size_t getPropertyCount(int accountNumber, std::size_t propertyIndex) const {
+        return at(accountNumber).getPropertyCount(localOf(accountNumber), propertyIndex);
+    }
+
+    std::size_t getPropertyIndexFromPropertyNumber(int accountNumber, std::size_t propertyNumber) {
+        if (accountNumber < 0)
+            return static_cast<std::size_t>(-1);
+        return at(accountNumber).getPropertyIndexFromPropertyNumber(localOf(accountNumber), propertyNumber);
+    }
+
+    std::size_t getPropertyTypeCount() const {
+        return shards[0]->getPropertyTypeCount();
+    }
+
+    int getMaxNumberOfProperties() {
+        return shards[0]->getMaxNumberOfProperties();
+    }
+
+    /* PROPERTY QUERIES */
+
+    AccountSet getAccountsWithProperty(std::size_t propertyIndex, const std::string& property) {
+        return findAccounts(propertyIndex, {property});
+    }
+
+    std::size_t countAccountsWithProperty(std::size_t propertyIndex, const std::string& property) {
+        std::size_t count = 0;
+        for (auto &shard : shards)
+            count += shard->countAccountsWithProperty(propertyIndex, property);
+        return count;
+    }
+
+    // Every shard answers from its own index, the results are merged into global account numbers.
+    AccountSet findAccounts(std::size_t propertyIndex, const std::vector<std::string>& required,
+                            const std::vector<std::string>& excluded = {}) {
+        std::vector<std::uint32_t> found;
+        for (std::size_t i = 0; i < shards.size(); i++) {
+            for (std::uint32_t local : shards[i]->findAccounts(propertyIndex, required, excluded))
+                found.push_back(static_cast<std::uint32_t>(globalAccountNumber(i, static_cast<int>(local))));
+        }
+        std::sort(found.begin(), found.end());
+        AccountSet result;
+        for (std::uint32_t accountNumber : found)
+            result.insert(accountNumber);
+        return result;
+    }
+
+    /* SAVING / LOADING / ENCRYPTING / DECRYPTING */
+
+    // Every shard saves to its own file (see shardFilename()) on its own snapshot thread, all at once.
+    void saveDatabase(const std::string& filename, bool encrypted = false) {
+        waitForSnapshot();
+        startSnapshot(filename, encrypted);
+        SnapshotStats stats = waitForSnapshot();
+        if (!stats.ok) {
+            throw std::runtime_error(stats.error);
+        }
+    }
+
+    // Returns false if a snapshot of any shard is still running (the others are started anyway).
+    bool startSnapshot(const std::string& filename, bool encrypted) {
+        bool started = true;
+        for (std::size_t i = 0; i < shards.size(); i++)
+            started = shards[i]->startSnapshot(shardFilename(filename, i), encrypted) && started;
+        return started;
+    }
+
+    // See easyAuth::saveCompactBackup(). Every shard writes its own file (see shardFilename()), all at once.
+    void saveCompactBackup(const std::string& filename, bool encrypted = false, bool compressed = true) {
+        forEachShard([&](std::size_t i) { shards[i]->saveCompactBackup(shardFilename(filename, i), encrypted, compressed); });
+    }
+
+    // All shards together: ok if every one is, the longest time, the sum of the bytes.
+    SnapshotStats waitForSnapshot() {
+        SnapshotStats total;
+        total.ok = true;
+        for (auto &shard : shards) {
+            SnapshotStats stats = shard->waitForSnapshot();
+            total.ok = total.ok && stats.ok;
+            if (total.error.empty())
+                total.error = stats.error;
+            total.seconds = (std::max)(total.seconds, stats.seconds);
+            total.bytesWritten += stats.bytesWritten;
+            total.extraMemoryBytes += stats.extraMemoryBytes;
+            total.lsn = (std::max)(total.lsn, stats.lsn);
+        }
+        return total;
+    }
+
+    // Loads every shard from its file, a thread per shard. Returns false without changing anything if any of the
+    // files is missing (e.g. the store was saved with another number of shards, see migrateDatabase()).
+    // Throws if a file is there but doesnt load, a store with some shards missing would lose accounts.
+    bool loadDatabase(const std::string& filename) {
+        for (std::size_t i = 0; i < shards.size(); i++) {
+            if (!fileExists(shardFilename(filename, i))) {
+                return false;
+            }
+        }
+        forEachShard([&](std::size_t i) {
+            if (!shards[i]->loadDatabase(shardFilename(filename, i))) {
+                throw std::runtime_error("Could not load shard file: " + shardFilename(filename, i));
+            }
+        });
+        return true;
+    }
+
+    // Moves an existing store saved as `filename` in another layout into the shards and saves them: a store of the
+    // same name with another number of shards first, else a file saved by a single easyAuth. The source is loaded
+    // the way the server always has (decrypted if it wasnt saved encrypted, journals replayed), and once the shards
+    // are saved its files are renamed to "<file>.migrated", so they cant be picked up again later with stale data.
+    // Passwords are copied as they are, plaintext ones from before hashing get hashed when they log in, hashing them
+    // all here would keep the server down for hours on a big store.
+    // Returns false if there is nothing to move. Run it before openJournal().
+    bool migrateDatabase(const std::string& filename, bool encrypted = true) {
+        std::vector<std::string> sources;
+        for (std::size_t count = 1; count <= kMaxShards && sources.empty(); count++) {
+            if (count == shards.size() || !fileExists(filename + ".0-of-" + std::to_string(count)))
+                continue;
+            ShardedAuth old(count);
+            old.initialize(getMaxNumberOfProperties());
+            if (!old.loadDatabase(filename)) // some of its files are missing, keep looking
+                continue;
+            if (!old.wasDecryptedOnLoad())
+                old.decryptDatabase();
+            if (!old.openJournal(filename)) {
+                throw std::runtime_error("Could not open the journals of " + filename);
+            }
+            old.closeJournal();
+            for (std::size_t i = 0; i < count; i++) {
+                importAccounts(old.shard(i).getAllUsers(), false);
+                sources.push_back(old.shardFilename(filename, i));
+            }
+        }
+        if (sources.empty()) {
+            easyAuth single;
+            single.initialize(getMaxNumberOfProperties());
+            if (!single.loadDatabase(filename)) {
+                return false;
+            }
+            if (!single.wasDecryptedOnLoad())
+                single.decryptDatabase();
+            if (!single.openJournal(filename + ".journal")) {
+                throw std::runtime_error("Could not open journal: " + filename + ".journal");
+            }
+            single.closeJournal();
+            importAccounts(single.getAllUsers(), false);
+            sources.push_back(filename);
+        }
+        saveDatabase(filename, encrypted);
+        for (const auto &source : sources) {
+            std::rename(source.c_str(), (source + ".migrated").c_str());
+            std::rename((source + ".journal").c_str(), (source + ".journal.migrated").c_str());
+        }
+        return true;
+    }
+
+    bool wasDecryptedOnLoad() const {
+        for (const auto &shard : shards) {
+            if (!shard->wasDecryptedOnLoad())
+                return false;
+        }
+        return true;
+    }
+
+    void encryptDatabase() {
+        forEachShard([&](std::size_t i) { shards[i]->encryptDatabase(); });
+    }
+
+    void decryptDatabase() {
+        forEachShard([&](std::size_t i) { shards[i]->decryptDatabase(); });
+    }
+
+    /* JOURNAL */
+
+    // One journal per shard file, replayed a thread per shard. Returns false if any of them couldnt be opened.
+    bool openJournal(const std::string& filename) {
+        std::vector<char> opened(shards.size(), 0);
+        forEachShard([&](std::size_t i) { opened[i] = shards[i]->openJournal(shardFilename(filename, i) + ".journal"); });
+        return std::find(opened.begin(), opened.end(), 0) == opened.end();
+    }
+
+    void closeJournal() {
+        for (auto &shard : shards)
+            shard->closeJournal();
+    }
+
+    /* SETTINGS */
+
+    void enableUsernameFilter(bool enabled) {
+        for (auto &shard : shards)
+            shard->enableUsernameFilter(enabled);
+    }
+
+    bool isUsernameFilterEnabled() const {
+        return shards[0]->isUsernameFilterEnabled();
+    }
+
+    std::size_t getUsernameFilterMemory() const {
+        std::size_t bytes = 0;
+        for (const auto &shard : shards)
+            bytes += shard->getUsernameFilterMemory();
+        return bytes;
+    }
+
+    void setPasswordHashCost(std::uint32_t iterations) {
+        for (auto &shard : shards)
+            shard->setPasswordHashCost(iterations);
+    }
+
+    std::uint32_t getPasswordHashCost() const {
+        return shards[0]->getPasswordHashCost();
+    }
+
+    // `threads` (0 = one per core) and queueCapacity are for the whole store and split between the shard pools,
+    // every shard gets at least one thread.
+    void configureHashing(std::size_t threads, std::size_t queueCapacity, std::chrono::milliseconds maxQueueWait) {
+        if (threads == 0)
+            threads = (std::max)(1u, std::thread::hardware_concurrency());
+        for (auto &shard : shards) {
+            shard->configureHashing((std::max)(std::size_t(1), threads / shards.size()),
+                                    (std::max)(std::size_t(1), queueCapacity / shards.size()), maxQueueWait);
+        }
+    }
+
+    std::size_t countOutdatedPasswords() {
+        std::size_t count = 0;
+        for (auto &shard : shards)
+            count += shard->countOutdatedPasswords();
+        return count;
+    }
+
+    void startCompactor(double threshold = 0.25, std::size_t minGarbageBytes = std::size_t(16) << 20) {
+        for (auto &shard : shards)
+            shard->startCompactor(threshold, minGarbageBytes);
+    }
+
+    void stopCompactor() {
+        for (auto &shard : shards)
+            shard->stopCompactor();
+    }
+
+    // See easyAuth::enableTieredStorage(). Every shard gets its own page file (shardFilename(pageFilename, i)) and
+    // an equal part of the budget.
+    void enableTieredStorage(const std::string& pageFilename, std::size_t memoryBudget) {
+        for (std::size_t i = 0; i < shards.size(); i++)
+            shards[i]->enableTieredStorage(shardFilename(pageFilename, i), memoryBudget / shards.size());
+    }
+
+    void disableTieredStorage() {
+        for (auto &shard : shards)
+            shard->disableTieredStorage();
+    }
+
+    bool isTieredStorageEnabled() const {
+        return shards[0]->isTieredStorageEnabled();
+    }
+
+    // Summed over the shards, lastError is the first one a shard has.
+    TieredStorageStats getTieredStorageStats() {
+        TieredStorageStats total;
+        for (auto &shard : shards) {
+            TieredStorageStats stats = shard->getTieredStorageStats();
+            total.enabled = stats.enabled;
+            total.memoryBudget += stats.memoryBudget;
+            total.residentBytes += stats.residentBytes;
+            total.coldAccounts += stats.coldAccounts;
+            total.promotions += stats.promotions;
+            total.evictions += stats.evictions;
+            total.pageFileBytes += stats.pageFileBytes;
+            total.pageFileGarbage += stats.pageFileGarbage;
+            if (total.lastError.empty())
+                total.lastError = stats.lastError;
+        }
+        return total;
+    }
+
+    // See easyAuth::getStats(), summed over the shards. A call that goes to every shard (a property query, a save or a
+    // load) counts once per shard, and version is the sum of the shards' versions.
+    AuthStats getStats() {
+        AuthStats total;
+        for (auto &shard : shards)
+            total.merge(shard->getStats());
+        return total;
+    }
+
+    /* REPLICATION */
+
+    // See easyAuth::startReplicationLog(), every shard keeps its own. replication.hpp serves them to replicas.
+    void startReplicationLog(std::size_t maxBytes = ReplicationLog::kDefaultMaxBytes) {
+        for (auto &shard : shards)
+            shard->startReplicationLog((std::max)(std::size_t(1), maxBytes / shards.size()));
+    }
+
+    void stopReplicationLog() {
+        for (auto &shard : shards)
+            shard->stopReplicationLog();
+    }
+
+    // See easyAuth::setReadOnly(), a Replica sets it.
+    void setReadOnly(bool enabled) {
+        for (auto &shard : shards)
+            shard->setReadOnly(enabled);
+    }
+
+    bool isReadOnly() const {
+        return shards[0]->isReadOnly();
+    }
+
+    /* SNAPSHOTS */
+
+    // One read-only snapshot per shard, index = shard. Local account number i of shard s is
+    // globalAccountNumber(s, i).
+    std::vector<std::shared_ptr<const DatabaseSnapshot>> getSnapshots() {
+        std::vector<std::shared_ptr<const DatabaseSnapshot>> snapshots;
+        for (auto &shard : shards)
+            snapshots.push_back(shard->getSnapshot());
+        return snapshots;
+    }
+
+ private:
+    std::vector<std::unique_ptr<easyAuth>> shards;
+
+    easyAuth& at(int accountNumber) const {
+        std::size_t index;
+        int local;
+        if (!localAccountNumber(accountNumber, index, local)) {
+            throw std::runtime_error("Account not found");
+        }
+        return *shards[index];
+    }
+
+    int localOf(int accountNumber) const {
+        return static_cast<int>(static_cast<std::size_t>(accountNumber) / shards.size());
+    }
+
+    static bool fileExists(const std::string& filename) {
+        return static_cast<bool>(std::ifstream(filename, std::ios::binary));
+    }
+
+    static std::string shardPrefix(std::size_t index) {
+        static const char hex[] = "0123456789abcdef";
+        return std::string{hex[index >> 4], hex[index & 15]};
+    }
+
+    bool shardOfToken(std::string_view token, std::size_t& index) const {
+        if (token.size() < 2)
+            return false;
+        auto digit = [](char c) { return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1; };
+        int high = digit(token[0]), low = digit(token[1]);
+        if (high < 0 || low < 0)
+            return false;
+        index = static_cast<std::size_t>(high * 16 + low);
+        return index < shards.size();
+    }
+
+    // Runs f(shard) for every shard, a thread each, and rethrows the first exception once they are all done.
+    template <class F>
+    void forEachShard(F f) {
+        if (shards.size() == 1) {
+            f(0);
+            return;
+        }
+        std::vector<std::exception_ptr> errors(shards.size());
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < shards.size(); i++) {
+            threads.emplace_back([&, i] {
+                try {
+                    f(i);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        for (auto &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+};
+
+#endif // EasyAuth_SHARDED_AUTH_HPP
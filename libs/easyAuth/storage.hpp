@@ -0,0 +1,366 @@
+// storage.hpp
+// Storage building blocks for easyAuth's Database.
+//   StringArena: all string bytes live in a few big chunks, strings are referred to by a StringRef (offset + length).
+//   Column<T>:   a vector-like array split into fixed size blocks, so growing it never moves existing elements.
+// Both only ever append, so a pointer or string_view into them stays valid until the owner is cleared.
+// share() returns a frozen view that shares the blocks instead of copying them. Arena bytes are never changed in place
+// and a Column copies a block before writing to it while a view still holds it (copy-on-write), so a view stays
+// consistent no matter what happens to the original afterwards.
+//
+// Threads: one writer at a time, but readers may run next to it as long as they dont read the elements it is changing
+// (easyAuth makes sure of that with its lock stripes). Appends only touch memory no reader can see yet, and a block
+// replaced by copy-on-write is kept in a retired list, since a reader may still be using the old copy, until
+// releaseRetired() is called at a point where no reader is running.
+
+#ifndef EasyAuth_STORAGE_HPP
+#define EasyAuth_STORAGE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Location of a string inside a StringArena.
+struct StringRef {
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+};
+
+class StringArena {
+ public:
+    static constexpr std::size_t kChunkShift = 20; // 1 MiB chunks
+    static constexpr std::size_t kChunkSize = std::size_t(1) << kChunkShift;
+    static constexpr std::size_t kChunkMask = kChunkSize - 1;
+    static constexpr std::size_t kMaxChunks = 4096; // 4 GiB of string data, offsets are 32 bit
+
+    StringArena() = default;
+    StringArena(StringArena&&) = default;
+    StringArena& operator=(StringArena&&) = default;
+
+    // Copies are deep, so encrypting or editing a copy never touches the original.
+    StringArena(const StringArena& other) {
+        *this = other;
+    }
+
+    StringArena& operator=(const StringArena& other) {
+        if (this == &other)
+            return *this;
+        clear();
+        for (const auto &block : other.blocks) {
+            std::shared_ptr<char> memory(new char[block.chunkCount * kChunkSize], std::default_delete<char[]>());
+            std::memcpy(memory.get(), block.memory.get(), block.bytes);
+            addBlock(block.firstChunk, block.chunkCount, memory, block.bytes);
+        }
+        used = other.used;
+        garbage = other.garbage;
+        return *this;
+    }
+
+    // Read-only view of everything appended so far. Shares the chunks, so it costs O(chunks) and no string copies.
+    StringArena share() const {
+        StringArena view;
+        view.blocks = blocks;
+        if (chunks) {
+            view.chunks.reset(new char*[kMaxChunks]);
+            std::copy(chunks.get(), chunks.get() + chunkCount, view.chunks.get());
+        }
+        view.chunkCount = chunkCount;
+        view.used = used;
+        view.garbage = garbage;
+        return view;
+    }
+
+    void clear() {
+        blocks.clear();
+        chunks.reset();
+        chunkCount = 0;
+        used = 0;
+        garbage = 0;
+    }
+
+    // Reserves length bytes and returns where they are. The bytes are uninitialized.
+    StringRef allocate(std::size_t length) {
+        if (length == 0)
+            return StringRef{};
+        std::uint64_t chunk = used >> kChunkShift;
+        std::uint64_t pos = used & kChunkMask;
+        if (chunk >= chunkCount || pos + length > kChunkSize) {
+            // start a new block; strings never straddle two blocks
+            std::size_t needed = (length + kChunkSize - 1) / kChunkSize;
+            if (chunkCount + needed > kMaxChunks)
+                throw std::runtime_error("String arena is full");
+            std::shared_ptr<char> memory(new char[needed * kChunkSize], std::default_delete<char[]>());
+            addBlock(chunkCount, needed, memory, needed * kChunkSize);
+            used = static_cast<std::uint64_t>(chunkCount - needed) << kChunkShift;
+        }
+        StringRef ref{static_cast<std::uint32_t>(used), static_cast<std::uint32_t>(length)};
+        used += length;
+        return ref;
+    }
+
+    StringRef append(std::string_view s) {
+        StringRef ref = allocate(s.size());
+        if (!s.empty())
+            std::memcpy(data(ref), s.data(), s.size());
+        return ref;
+    }
+
+    char* data(StringRef ref) {
+        if (ref.length == 0)
+            return nullptr;
+        return chunks[ref.offset >> kChunkShift] + (ref.offset & kChunkMask);
+    }
+
+    std::string_view view(StringRef ref) const {
+        if (ref.length == 0)
+            return std::string_view();
+        return std::string_view(chunks[ref.offset >> kChunkShift] + (ref.offset & kChunkMask), ref.length);
+    }
+
+    // Uses `size` bytes at `data` (e.g. a mapped file) as the start of the arena, without copying them.
+    // `owner` keeps that memory alive for as long as the arena (or a copy of a block) needs it.
+    // New strings are appended in fresh chunks after it.
+    void adopt(char* data, std::size_t size, std::shared_ptr<void> owner) {
+        clear();
+        if (size == 0)
+            return;
+        std::size_t needed = (size + kChunkSize - 1) / kChunkSize;
+        if (needed > kMaxChunks)
+            throw std::runtime_error("String arena is full");
+        addBlock(0, needed, std::shared_ptr<char>(owner, data), size);
+        used = static_cast<std::uint64_t>(chunkCount) << kChunkShift;
+    }
+
+    // Appends `size` bytes at `data` as whole chunks without copying them and returns the offset data[0] got, a ref
+    // into it is that plus its position in `data`. The bytes must already be laid out like allocate() would: a string
+    // never runs from one chunk into the next unless it starts a chunk. Lets loaders build strings on several threads.
+    std::uint64_t appendChunks(char* data, std::size_t size, std::shared_ptr<void> owner) {
+        if (size == 0)
+            return used;
+        std::size_t needed = (size + kChunkSize - 1) / kChunkSize;
+        if (chunkCount + needed > kMaxChunks)
+            throw std::runtime_error("String arena is full");
+        std::uint64_t offset = static_cast<std::uint64_t>(chunkCount) << kChunkShift;
+        addBlock(chunkCount, needed, std::shared_ptr<char>(owner, data), size);
+        used = static_cast<std::uint64_t>(chunkCount) << kChunkShift;
+        return offset;
+    }
+
+    // Marks the bytes of ref as no longer used (e.g. the old value of an edited string).
+    void release(StringRef ref) {
+        garbage += ref.length;
+    }
+
+    std::size_t bytesUsed() const {
+        return static_cast<std::size_t>(used) - garbage;
+    }
+
+    std::size_t garbageBytes() const {
+        return garbage;
+    }
+
+    std::size_t memoryUsage() const {
+        return chunkCount * kChunkSize + (chunks ? kMaxChunks * sizeof(char*) : 0);
+    }
+
+ private:
+    struct Block {
+        std::size_t firstChunk;
+        std::size_t chunkCount;
+        std::shared_ptr<char> memory;
+        std::size_t bytes; // readable bytes, less than chunkCount * kChunkSize for an adopted block
+    };
+
+    std::vector<Block> blocks;
+    std::unique_ptr<char*[]> chunks; // chunk number -> start of that chunk
+    std::size_t chunkCount = 0;
+    std::uint64_t used = 0;          // offset of the next free byte
+    std::size_t garbage = 0;
+
+    void addBlock(std::size_t firstChunk, std::size_t count, std::shared_ptr<char> memory, std::size_t bytes) {
+        if (!chunks)
+            chunks.reset(new char*[kMaxChunks]);
+        for (std::size_t i = 0; i < count; i++)
+            chunks[firstChunk + i] = memory.get() + i * kChunkSize;
+        blocks.push_back(Block{firstChunk, count, std::move(memory), bytes});
+        chunkCount = firstChunk + count;
+    }
+};
+
+// Array of trivially copyable values stored in blocks of kBlockSize elements.
+// Smaller blocks waste less memory for small columns and copy less on copy-on-write, bigger ones need fewer directory
+// entries; the directory has room for kMaxBlocks blocks either way.
+template <typename T, std::size_t BlockShift = 16>
+class Column {
+    static_assert(std::is_trivially_copyable<T>::value, "Column only holds trivially copyable values");
+
+ public:
+    static constexpr std::size_t kBlockShift = BlockShift;
+    static constexpr std::size_t kBlockSize = std::size_t(1) << kBlockShift;
+    static constexpr std::size_t kBlockMask = kBlockSize - 1;
+    static constexpr std::size_t kMaxBlocks = 16384; // ~1 billion elements with the default block size
+
+    Column() = default;
+    Column(Column&&) = default;
+    Column& operator=(Column&&) = default;
+
+    Column(const Column& other) {
+        *this = other;
+    }
+
+    Column& operator=(const Column& other) {
+        if (this == &other)
+            return *this;
+        clear();
+        for (std::size_t i = 0; i < other.owners.size(); i++) {
+            addBlock();
+            std::memcpy(block(i), other.block(i), kBlockSize * sizeof(T));
+        }
+        count = other.count;
+        return *this;
+    }
+
+    void clear() {
+        owners.clear();
+        retired.clear();
+        table.reset();
+        count = 0;
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    const T& operator[](std::size_t i) const {
+        return block(i >> kBlockShift)[i & kBlockMask];
+    }
+
+    // Writable reference to element i. Copies its block first if a view from share() still uses it.
+    T& mut(std::size_t i) {
+        std::size_t index = i >> kBlockShift;
+        if (owners[index].use_count() > 1)
+            unshare(index);
+        return block(index)[i & kBlockMask];
+    }
+
+    void set(std::size_t i, const T& value) {
+        mut(i) = value;
+    }
+
+    void push_back(const T& value) {
+        if (count == owners.size() * kBlockSize)
+            addBlock();
+        set(count, value);
+        count++;
+    }
+
+    // Read-only view of the current contents, sharing the blocks. Costs O(blocks).
+    Column share() const {
+        Column view;
+        if (table) {
+            view.table.reset(new std::atomic<T*>[kMaxBlocks]);
+            for (std::size_t i = 0; i < owners.size(); i++)
+                view.table[i].store(block(i), std::memory_order_relaxed);
+        }
+        view.owners = owners;
+        view.count = count;
+        return view;
+    }
+
+    // Bytes of old blocks replaced by copy-on-write since the last releaseRetired().
+    std::size_t retiredBytes() const {
+        return retired.size() * kBlockSize * sizeof(T);
+    }
+
+    // Frees the retired blocks (unless a view still has them). No reader may be running.
+    void releaseRetired() {
+        retired.clear();
+    }
+
+    void resize(std::size_t newSize, const T& value = T()) {
+        while (count < newSize)
+            push_back(value);
+        count = newSize;
+    }
+
+    // Uses `size` elements at `data` (e.g. a mapped file) as the contents of the column. Whole blocks are used in place,
+    // only the last partial block is copied so appending never writes past the end of `data`.
+    // `data` must be writable (a private mapping is fine) and `owner` keeps it alive.
+    void adopt(T* data, std::size_t size, std::shared_ptr<void> owner) {
+        clear();
+        std::size_t fullBlocks = size >> kBlockShift;
+        if (fullBlocks + 1 > kMaxBlocks)
+            throw std::runtime_error("Column is full");
+        if (!table)
+            table.reset(new std::atomic<T*>[kMaxBlocks]);
+        for (std::size_t i = 0; i < fullBlocks; i++) {
+            T* start = data + (i << kBlockShift);
+            table[i].store(start, std::memory_order_relaxed);
+            // one control block per block (not an alias of `owner`), so use_count() tells if this block is shared
+            owners.push_back(std::shared_ptr<T>(start, [owner](T*) {}));
+        }
+        std::size_t rest = size & kBlockMask;
+        if (rest > 0) {
+            addBlock();
+            std::memcpy(block(fullBlocks), data + (fullBlocks << kBlockShift), rest * sizeof(T));
+        }
+        count = size;
+    }
+
+    // Calls f(pointer, length) for each block in order, covering all size() elements.
+    template <typename F>
+    void forEachBlock(F f) const {
+        for (std::size_t i = 0; i * kBlockSize < count; i++)
+            f(block(i), (std::min)(kBlockSize, count - i * kBlockSize));
+    }
+
+    // Removes element i and moves every later element down by one.
+    void erase(std::size_t i) {
+        for (std::size_t j = i; j + 1 < count; j++)
+            set(j, (*this)[j + 1]);
+        count--;
+    }
+
+    std::size_t memoryUsage() const {
+        return (owners.size() + retired.size()) * kBlockSize * sizeof(T) + (table ? kMaxBlocks * sizeof(T*) : 0);
+    }
+
+ private:
+    std::unique_ptr<std::atomic<T*>[]> table; // block number -> block, readers load it while the writer may swap it
+    std::vector<std::shared_ptr<T>> owners;
+    std::vector<std::shared_ptr<T>> retired;  // blocks replaced by unshare() that a reader may still be reading
+    std::size_t count = 0;
+
+    T* block(std::size_t index) const {
+        return table[index].load(std::memory_order_acquire);
+    }
+
+    void addBlock() {
+        if (owners.size() == kMaxBlocks)
+            throw std::runtime_error("Column is full");
+        if (!table)
+            table.reset(new std::atomic<T*>[kMaxBlocks]);
+        std::shared_ptr<T> memory(new T[kBlockSize], std::default_delete<T[]>());
+        table[owners.size()].store(memory.get(), std::memory_order_release);
+        owners.push_back(std::move(memory));
+    }
+
+    void unshare(std::size_t index) {
+        std::shared_ptr<T> copy(new T[kBlockSize], std::default_delete<T[]>());
+        std::memcpy(copy.get(), block(index), kBlockSize * sizeof(T));
+        table[index].store(copy.get(), std::memory_order_release);
+        retired.push_back(std::move(owners[index]));
+        owners[index] = std::move(copy);
+    }
+};
+
+#endif // EasyAuth_STORAGE_HPP
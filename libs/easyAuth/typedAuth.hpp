@@ -0,0 +1,165 @@
+// typedAuth.hpp
+// TypedAuth<Schema>: an easyAuth whose property types and property values are fixed at compile time.
+// A schema is a struct that names them:
+//
+//   struct ShopSchema {
+//       enum Property : std::size_t { ROLE, TAGS };
+//       static constexpr std::size_t kPropertyTypes = 2;
+//       enum Value : std::size_t { USER, PREMIUM, ADMIN };
+//       static constexpr const char* kValues[] = {"USER", "PREMIUM", "ADMIN"};
+//   };
+//
+//   TypedAuth<ShopSchema> auth;
+//   auth.add<ShopSchema::ROLE, ShopSchema::USER>(accountNumber);
+//   if (auth.has<ShopSchema::ROLE, ShopSchema::PREMIUM>(accountNumber)) ...
+//
+// Property and value indexes are template arguments checked with static_assert, and every value of the schema is
+// registered (easyAuth::registerValue()) when the object is made, so has<>() is the account's stripe lock and a mask
+// test without any checks left to do at run time. easyAuth is a private base: the calls that take a property index or
+// a value string (addProperty(), editProperty(), hasProperty(), ...) arent reachable, properties only change through
+// add<>() and importAccounts(), which refuses values that arent in the schema. Everything else (logins, sessions,
+// saving, the journal) is easyAuth's.
+// The storage is easyAuth's columns as they are, not a fixed record layout per schema, so the files are interchangeable
+// with a plain easyAuth.
+
+#ifndef EasyAuth_TYPED_AUTH_HPP
+#define EasyAuth_TYPED_AUTH_HPP
+
+#include "easyAuth.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+template <typename Schema>
+class TypedAuth : private easyAuth {
+ public:
+    static constexpr std::size_t kPropertyTypes = Schema::kPropertyTypes;
+    static constexpr std::size_t kValueCount = sizeof(Schema::kValues) / sizeof(Schema::kValues[0]);
+    static_assert(kPropertyTypes > 0, "A schema needs at least one property type");
+    static_assert(kValueCount <= 64, "easyAuth registers at most 64 values");
+
+    TypedAuth() {
+        easyAuth::initialize(static_cast<int>(kPropertyTypes));
+        for (std::size_t i = 0; i < kValueCount; i++)
+            values[i] = registerValue(Schema::kValues[i]);
+    }
+
+    // credentials and logins
+    using easyAuth::checkCredentials;
+    using easyAuth::checkCredentialsAsync;
+    using easyAuth::login;
+    using easyAuth::loginAsync;
+    using easyAuth::addCredentials;
+    using easyAuth::deleteCredentials;
+    using easyAuth::editCredentials;
+    using easyAuth::accountExists;
+    using easyAuth::getAccountCount;
+    using easyAuth::getDeletedAccountCount;
+    using easyAuth::getAccountNumberOfUser;
+    using easyAuth::getUsername;
+    using easyAuth::getPassword;
+
+    // reading properties cant break the schema
+    using easyAuth::getPropertyTypeCount;
+    using easyAuth::getPropertyCount;
+    using easyAuth::getProperties;
+
+    // sessions
+    using easyAuth::createSession;
+    using easyAuth::resolveSession;
+    using easyAuth::endSession;
+    using easyAuth::setSessionLifetime;
+    using easyAuth::getSessionLifetime;
+    using easyAuth::expireSessions;
+    using easyAuth::getSessionCount;
+
+    // files and the journal
+    using easyAuth::saveDatabase;
+    using easyAuth::startSnapshot;
+    using easyAuth::isSnapshotRunning;
+    using easyAuth::waitForSnapshot;
+    using easyAuth::saveCompactBackup;
+    using easyAuth::encryptDatabase;
+    using easyAuth::decryptDatabase;
+    using easyAuth::wasDecryptedOnLoad;
+    using easyAuth::openJournal;
+    using easyAuth::closeJournal;
+    using easyAuth::setJournalSync;
+
+    // settings and upkeep
+    using easyAuth::enableUsernameFilter;
+    using easyAuth::setPasswordHashCost;
+    using easyAuth::getPasswordHashCost;
+    using easyAuth::configureHashing;
+    using easyAuth::countOutdatedPasswords;
+    using easyAuth::compact;
+    using easyAuth::startCompactor;
+    using easyAuth::stopCompactor;
+    using easyAuth::getStats;
+
+    // easyAuth::loadDatabase(), false too if the file was saved with another number of property types than the
+    // schema. What it loaded is cut to the schema's property types then, so has<>() stays in range.
+    bool loadDatabase(const std::string& filename) {
+        bool loaded = easyAuth::loadDatabase(filename);
+        if (getPropertyTypeCount() == kPropertyTypes)
+            return loaded;
+        easyAuth::initialize(static_cast<int>(kPropertyTypes));
+        return false;
+    }
+
+    // easyAuth::importAccounts(). Throws std::invalid_argument (and adds nothing) if a property value of the batch
+    // isnt one of the schema's.
+    ImportStats importAccounts(const Database& batch, bool hashPasswords = true) {
+        for (std::size_t p = 0; p < batch.propertyTypes(); p++) {
+            for (std::size_t i = 0; i < batch.accountCount(); i++) {
+                for (std::size_t k = 0; k < batch.propertyCount(p, i); k++) {
+                    if (!isSchemaValue(batch.property(p, i, k))) {
+                        throw std::invalid_argument("Property value is not in the schema: " + std::string(batch.property(p, i, k)));
+                    }
+                }
+            }
+        }
+        return easyAuth::importAccounts(batch, hashPasswords);
+    }
+
+    // True if the account has the schema's Value for Property. False for an account that doesnt exist.
+    template <std::size_t Property, std::size_t Value>
+    bool has(int accountNumber) const {
+        static_assert(Property < kPropertyTypes, "Property is not in the schema");
+        static_assert(Value < kValueCount, "Value is not in the schema");
+        return hasKnownValue(accountNumber, Property, values[Value].index);
+    }
+
+    // Bit i is set if the account has kValues[i] for Property, e.g. every role at once.
+    template <std::size_t Property>
+    std::uint64_t valuesOf(int accountNumber) const {
+        static_assert(Property < kPropertyTypes, "Property is not in the schema");
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i < kValueCount; i++) {
+            if (hasKnownValue(accountNumber, Property, values[i].index))
+                bits |= std::uint64_t(1) << i;
+        }
+        return bits;
+    }
+
+    template <std::size_t Property, std::size_t Value>
+    void add(int accountNumber) {
+        static_assert(Property < kPropertyTypes, "Property is not in the schema");
+        static_assert(Value < kValueCount, "Value is not in the schema");
+        addProperty(accountNumber, Property, Schema::kValues[Value]);
+    }
+
+ private:
+    KnownValue values[kValueCount];
+
+    static bool isSchemaValue(std::string_view value) {
+        for (std::size_t i = 0; i < kValueCount; i++) {
+            if (value == Schema::kValues[i])
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif // EasyAuth_TYPED_AUTH_HPP
@@ -0,0 +1,154 @@
+// usernameFilter.hpp
+// A blocked Bloom filter over username hashes, checked before the username index so a lookup of a name that doesnt
+// exist is usually answered from one cache line, without probing the slot table or reading any username.
+// Every name sets 8 bits in one 64 byte block (one bit in each of its 8 words), so a lookup touches a single line.
+// At 12 bits per name about 0.5% of unknown names get through to the index, which still answers them correctly.
+// Bits can only be set, so removed names stay in the filter until it is rebuilt (the owner decides when).
+
+#ifndef EasyAuth_USERNAME_FILTER_HPP
+#define EasyAuth_USERNAME_FILTER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+class UsernameFilter {
+ public:
+    static constexpr std::size_t kBlockWords = 8;    // 512 bits, one cache line
+    static constexpr std::size_t kBitsPerName = 12;
+    static constexpr std::size_t kMinNames = 512;
+
+    UsernameFilter() = default;
+    UsernameFilter(UsernameFilter&&) = default;
+    UsernameFilter& operator=(UsernameFilter&&) = default;
+
+    // Copies own their words, even when `other` uses a mapped file.
+    UsernameFilter(const UsernameFilter& other) {
+        *this = other;
+    }
+
+    UsernameFilter& operator=(const UsernameFilter& other) {
+        if (this == &other)
+            return *this;
+        clear();
+        if (other.wordCount > 0) {
+            allocate(other.wordCount);
+            std::memcpy(words, other.words, wordCount * sizeof(std::uint64_t));
+        }
+        return *this;
+    }
+
+    // Number of words for a filter that holds `names` names at kBitsPerName. Always whole blocks.
+    static std::size_t wordsFor(std::size_t names) {
+        std::size_t blocks = ((std::max)(names, kMinNames) * kBitsPerName + kBlockWords * 64 - 1) / (kBlockWords * 64);
+        return blocks * kBlockWords;
+    }
+
+    // Empty filter sized for `names` names.
+    void reset(std::size_t names) {
+        clear();
+        allocate(wordsFor(names));
+        std::memset(words, 0, wordCount * sizeof(std::uint64_t));
+    }
+
+    void clear() {
+        memory.reset();
+        words = nullptr;
+        wordCount = 0;
+    }
+
+    // No filter at all (not the same as a filter without names, which rejects everything).
+    bool empty() const {
+        return wordCount == 0;
+    }
+
+    // Names this filter is sized for, more make false positives more likely.
+    std::size_t capacity() const {
+        return wordCount * 64 / kBitsPerName;
+    }
+
+    void add(std::uint32_t hash) {
+        add(words, wordCount, hash);
+    }
+
+    // Sets the bits of `hash` in a filter of `count` words that isnt held by a UsernameFilter, e.g. one being written.
+    static void add(std::uint64_t* data, std::size_t count, std::uint32_t hash) {
+        std::uint64_t mixed = mix(hash);
+        std::uint64_t* block = data + blockOf(mixed, count);
+        for (std::size_t i = 0; i < kBlockWords; i++)
+            block[i] |= bitOf(mixed, i);
+    }
+
+    // False means the hash was never added. True can be wrong.
+    bool mayContain(std::uint32_t hash) const {
+        std::uint64_t mixed = mix(hash);
+        const std::uint64_t* block = words + blockOf(mixed, wordCount);
+        for (std::size_t i = 0; i < kBlockWords; i++) {
+            if ((block[i] & bitOf(mixed, i)) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    // Uses `count` words at `data` (e.g. a mapped file) in place. `data` must be writable (a private mapping is fine)
+    // and `owner` keeps it alive. Returns false if the size cant be a filter.
+    bool adopt(std::uint64_t* data, std::size_t count, std::shared_ptr<void> owner) {
+        if (count == 0 || count % kBlockWords != 0)
+            return false;
+        clear();
+        memory = std::move(owner);
+        words = data;
+        wordCount = count;
+        return true;
+    }
+
+    const std::uint64_t* data() const {
+        return words;
+    }
+
+    std::size_t size() const {
+        return wordCount;
+    }
+
+    std::size_t memoryUsage() const {
+        return wordCount * sizeof(std::uint64_t);
+    }
+
+ private:
+    std::shared_ptr<void> memory; // owns `words`, or keeps the mapping they are in alive
+    std::uint64_t* words = nullptr;
+    std::size_t wordCount = 0;
+
+    void allocate(std::size_t count) {
+        std::shared_ptr<std::uint64_t> owned(new std::uint64_t[count], std::default_delete<std::uint64_t[]>());
+        words = owned.get();
+        memory = std::move(owned);
+        wordCount = count;
+    }
+
+    // The username hashes are 32 bit and already used for the index partition and slot, so spread them out again
+    // (splitmix64 finalizer) before taking the block and the bits from them.
+    static std::uint64_t mix(std::uint32_t hash) {
+        std::uint64_t x = hash + 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    static std::size_t blockOf(std::uint64_t mixed, std::size_t count) {
+        std::uint64_t blocks = count / kBlockWords;
+        return static_cast<std::size_t>(((mixed >> 32) * blocks) >> 32) * kBlockWords;
+    }
+
+    // One bit per word from the low half of the hash, each word multiplies it by its own odd constant.
+    static std::uint64_t bitOf(std::uint64_t mixed, std::size_t word) {
+        static constexpr std::uint32_t kSalts[kBlockWords] = {0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+                                                              0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u};
+        std::uint32_t x = static_cast<std::uint32_t>(mixed) * kSalts[word];
+        return std::uint64_t(1) << (x >> 26);
+    }
+};
+
+#endif // EasyAuth_USERNAME_FILTER_HPP
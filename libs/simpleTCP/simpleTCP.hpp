@@ -1,231 +1,1272 @@
-#pragma once
-
-// SimpleTCP.hpp
-// A header-only library to create a basic TCP server and client using WinSock.
-// Only Windows API and STL are used.
-// Usage:
-//   For the server, include this header, create a SimpleTCP::Server instance, and call start(port, handler).
-//     The handler is a function/lambda that takes a request string and returns a response string.
-//   For the client, include this header, create a SimpleTCP::Client instance, call connectToServer(address, port),
-//     and then call sendRequest() to exchange messages.
-
-#ifndef _WIN32_WINNT
-#define _WIN32_WINNT 0x0600
-#endif
-
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <windows.h>
-
-#include <iostream>
-#include <string>
-#include <thread>
-#include <vector>
-#include <functional>
-#include <atomic>
-#include <mutex>
-
-#pragma comment(lib, "Ws2_32.lib")
-
-namespace SimpleTCP {
-
-    // TCP Server class
-    class Server {
-    public:
-        // Define a callback type for processing client requests.
-        // The callback takes the request string and returns a response.
-        using RequestHandler = std::function<std::string(const std::string&)>;
-
-        Server() : listenSocket(INVALID_SOCKET), running(false) {
-            // Initialize WinSock
-            WSADATA wsaData;
-            int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-            if (iResult != 0) {
-                std::cerr << "WSAStartup failed: " << iResult << std::endl;
-            }
-        }
-
-        ~Server() {
-            stop();
-            WSACleanup();
-        }
-
-        // Starts the server on the given port. The provided handler is invoked for each incoming request.
-        bool start(unsigned short port, RequestHandler handler, std::string HOST_IP_ADDRESS) {
-            requestHandler = handler;
-            listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-            if (listenSocket == INVALID_SOCKET) {
-                std::cerr << "socket failed: " << WSAGetLastError() << std::endl;
-                return false;
-            }
-
-            sockaddr_in service;
-            service.sin_family = AF_INET; // IPv4
-            // Bind to the specific IP address
-            service.sin_addr.s_addr = inet_addr(HOST_IP_ADDRESS.c_str());
-            service.sin_port = htons(port);
-
-            if (bind(listenSocket, reinterpret_cast<sockaddr*>(&service), sizeof(service)) == SOCKET_ERROR) {
-                std::cerr << "bind failed: " << WSAGetLastError() << std::endl;
-                closesocket(listenSocket);
-                return false;
-            }
-
-            if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
-                std::cerr << "listen failed: " << WSAGetLastError() << std::endl;
-                closesocket(listenSocket);
-                return false;
-            }
-
-            running = true;
-            acceptThread = std::thread(&Server::acceptLoop, this);
-            return true;
-        }
-
-        // Stops the server and cleans up connections.
-        void stop() {
-            running = false;
-            if (listenSocket != INVALID_SOCKET) {
-                // Shutdown to unblock accept()
-                shutdown(listenSocket, SD_BOTH);
-                closesocket(listenSocket);
-                listenSocket = INVALID_SOCKET;
-            }
-            if (acceptThread.joinable())
-                acceptThread.join();
-
-            // Join all client threads.
-            {
-                std::lock_guard<std::mutex> lock(clientThreadsMutex);
-                for (auto& t : clientThreads) {
-                    if (t.joinable())
-                        t.join();
-                }
-                clientThreads.clear();
-            }
-        }
-
-    private:
-        SOCKET listenSocket;
-        std::thread acceptThread;
-        std::vector<std::thread> clientThreads;
-        std::mutex clientThreadsMutex;
-        RequestHandler requestHandler;
-        std::atomic<bool> running;
-
-        // The accept loop runs in its own thread.
-        void acceptLoop() {
-            while (running) {
-                SOCKET clientSocket = accept(listenSocket, nullptr, nullptr);
-                if (clientSocket != INVALID_SOCKET) {
-                    //std::cout << "Accepted a connection!" << std::endl;
-                }
-                if (clientSocket == INVALID_SOCKET) {
-                    if (running) {  // Only report errors if still running
-                        std::cerr << "accept failed: " << WSAGetLastError() << std::endl;
-                    }
-                    break;
-                }
-                // Spawn a thread to handle each client.
-                {
-                    std::lock_guard<std::mutex> lock(clientThreadsMutex);
-                    clientThreads.emplace_back(&Server::handleClient, this, clientSocket);
-                }
-            }
-        }
-
-        // Handles communication with a single client.
-        void handleClient(SOCKET clientSocket) {
-            const int bufSize = 512;
-            char buffer[bufSize];
-            int iResult = 0;
-
-            while ((iResult = recv(clientSocket, buffer, bufSize, 0)) > 0) {
-                std::string request(buffer, iResult);
-                std::string response;
-                if (requestHandler) {
-                    response = requestHandler(request);
-                }
-                // Send back the response.
-                int sendResult = send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
-                if (sendResult == SOCKET_ERROR) {
-                    std::cerr << "send failed: " << WSAGetLastError() << std::endl;
-                    break;
-                }
-            }
-            closesocket(clientSocket);
-        }
-    };
-
-    // TCP Client class
-    class Client {
-    public:
-        Client() : connectSocket(INVALID_SOCKET) {
-            WSADATA wsaData;
-            int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-            if (iResult != 0) {
-                std::cerr << "WSAStartup failed: " << iResult << std::endl;
-            }
-        }
-
-        ~Client() {
-            if (connectSocket != INVALID_SOCKET) {
-                closesocket(connectSocket);
-            }
-            WSACleanup();
-        }
-
-        // Connects to the server at the specified address and port.
-        bool connectToServer(const std::string& address, unsigned short port) {
-            connectSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-            if (connectSocket == INVALID_SOCKET) {
-                std::cerr << "socket failed: " << WSAGetLastError() << std::endl;
-                return false;
-            }
-
-            sockaddr_in serverAddr;
-            serverAddr.sin_family = AF_INET;
-            serverAddr.sin_port = htons(port);
-            // Use inet_pton instead of inet_addr to avoid deprecation warnings.
-            if (inet_pton(AF_INET, address.c_str(), &serverAddr.sin_addr) != 1) {
-                std::cerr << "Invalid IP address: " << address << std::endl;
-                closesocket(connectSocket);
-                connectSocket = INVALID_SOCKET;
-                return false;
-            }
-
-            if (::connect(connectSocket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) == SOCKET_ERROR) {
-                std::cerr << "connect failed: " << WSAGetLastError() << std::endl;
-                closesocket(connectSocket);
-                connectSocket = INVALID_SOCKET;
-                return false;
-            }
-            return true;
-        }
-
-        // Sends a request to the server and waits for a response.
-        std::string sendRequest(const std::string& request) {
-            if (connectSocket == INVALID_SOCKET) {
-                return "";
-            }
-
-            int sendResult = send(connectSocket, request.c_str(), static_cast<int>(request.size()), 0);
-            if (sendResult == SOCKET_ERROR) {
-                std::cerr << "send failed: " << WSAGetLastError() << std::endl;
-                return "";
-            }
-
-            const int bufSize = 512;
-            char buffer[bufSize];
-            int iResult = recv(connectSocket, buffer, bufSize, 0);
-            if (iResult > 0) {
-                return std::string(buffer, iResult);
-            }
-            return "";
-        }
-
-    private:
-        SOCKET connectSocket;
-    };
-
-} // namespace SimpleTCP
+#pragma once
+
+// SimpleTCP.hpp
+// A header-only library to create a basic TCP server and client, with WinSock on Windows and BSD sockets elsewhere.
+// Only the socket APIs and STL are used.
+// Usage:
+//   For the server, include this header, create a SimpleTCP::Server instance, and call start(port, handler).
+//     The handler is a function/lambda that takes a request string and returns a response string.
+//   For the client, include this header, create a SimpleTCP::Client instance, call connectToServer(address, port),
+//     and then call sendRequest() to exchange messages.
+//   SimpleTCP::AsyncClient keeps many requests in flight on one connection: sendRequestAsync() returns a future or
+//     calls a callback with the answer, sendRequests() sends a batch and gathers the answers.
+//   Both ends pass the same Protocol to start() and connectToServer():
+//     PLAIN:  a message is whatever one recv() returns (up to 512 bytes), so one request at a time and no more.
+//     FRAMED: every message is sent as [u32 length, little endian][bytes] and can be any size.
+//     TAGGED: FRAMED, and the bytes start with a u32 request id (little endian) the answer repeats.
+//   With FRAMED and TAGGED a client can send many requests before reading the answers (Client::sendRequests()), the
+//   server answers every complete frame of a read, in order, and sends the answers together.
+//   A server handler can also answer later: the AsyncRequestHandler overload of start() gets a Reply to call once
+//   with the response, from any thread (e.g. the one that finished a password hash). Answers still go out in order.
+// Server backends:
+//   Linux: non-blocking sockets on a few epoll event loops (setEventThreads(), one per core by default). Every loop
+//     waits on the listening socket and owns the connections it accepted, so a connection costs a small buffer
+//     instead of a thread and its stack. The loops only move bytes: the requests of a read go to a pool of worker
+//     threads (setWorkerThreads()) and the answers come back through the loop's eventfd, so a slow handler holds up
+//     its own connection and a worker, not the loop. Define SimpleTCP_THREADS to use the thread per connection backend.
+//   Elsewhere: one thread per connection.
+
+#if defined(__linux__) && !defined(SimpleTCP_THREADS)
+#define SimpleTCP_EPOLL
+#endif
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef SimpleTCP_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#endif
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <system_error>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <optional>
+
+namespace SimpleTCP {
+
+#ifndef _WIN32
+    // the WinSock names the rest of this file uses
+    typedef int SOCKET;
+    const SOCKET INVALID_SOCKET = -1;
+    const int SOCKET_ERROR = -1;
+    const int SD_BOTH = SHUT_RDWR;
+
+    inline int closesocket(SOCKET socket) {
+        return ::close(socket);
+    }
+
+    inline int WSAGetLastError() {
+        return errno;
+    }
+#endif
+
+    // a peer that closed its end is an error from send(), not a SIGPIPE that kills the process
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;
+#endif
+
+    const std::size_t MAX_FRAME_SIZE = std::size_t(64) << 20; // a bigger length means the stream is garbage
+    const std::size_t READ_SIZE = 65536; // framed connections read this much at a time, however many frames it holds
+
+    // How messages are cut out of the stream, see the top of this file.
+    enum Protocol {
+        PLAIN,
+        FRAMED,
+        TAGGED,
+    };
+
+    // WSAStartup() on Windows, nothing to do elsewhere.
+    inline void startNetworking() {
+#ifdef _WIN32
+        WSADATA wsaData;
+        int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+        if (iResult != 0) {
+            std::cerr << "WSAStartup failed: " << iResult << std::endl;
+        }
+#endif
+    }
+
+    inline void stopNetworking() {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    // send() until all of it is out.
+    inline bool sendAll(SOCKET socket, const char* data, std::size_t length) {
+        while (length > 0) {
+            int sent = send(socket, data, static_cast<int>((std::min)(length, std::size_t(1) << 30)), SEND_FLAGS);
+            if (sent == SOCKET_ERROR || sent == 0)
+                return false;
+            data += sent;
+            length -= static_cast<std::size_t>(sent);
+        }
+        return true;
+    }
+
+    // recv() until `length` bytes came in.
+    inline bool receiveAll(SOCKET socket, char* data, std::size_t length) {
+        while (length > 0) {
+            int received = recv(socket, data, static_cast<int>((std::min)(length, std::size_t(1) << 30)), 0);
+            if (received <= 0)
+                return false;
+            data += received;
+            length -= static_cast<std::size_t>(received);
+        }
+        return true;
+    }
+
+    // Frame lengths and request ids are u32, little endian.
+    inline void appendU32(std::string& out, std::size_t value) {
+        for (int i = 0; i < 4; i++)
+            out.push_back(static_cast<char>(value >> (i * 8)));
+    }
+
+    inline std::size_t readU32(const char* data) {
+        std::size_t value = 0;
+        for (int i = 0; i < 4; i++)
+            value |= static_cast<std::size_t>(static_cast<unsigned char>(data[i])) << (i * 8);
+        return value;
+    }
+
+    inline bool sendFrame(SOCKET socket, const std::string& message) {
+        std::string header;
+        appendU32(header, message.size());
+        return sendAll(socket, header.data(), 4) && sendAll(socket, message.data(), message.size());
+    }
+
+    inline bool receiveFrame(SOCKET socket, std::string& message) {
+        char header[4];
+        if (!receiveAll(socket, header, 4))
+            return false;
+        std::size_t length = readU32(header);
+        if (length > MAX_FRAME_SIZE)
+            return false;
+        message.resize(length);
+        return length == 0 || receiveAll(socket, &message[0], length);
+    }
+
+    // A request of a FRAMED or TAGGED connection. id only goes out with TAGGED.
+    inline void appendRequest(std::string& out, Protocol protocol, const std::string& request, std::uint32_t id) {
+        if (protocol == TAGGED) {
+            appendU32(out, 4 + request.size());
+            appendU32(out, id);
+        } else {
+            appendU32(out, request.size());
+        }
+        out += request;
+    }
+
+    // Takes the id off a TAGGED answer. An answer to anything but request `id` means the stream is out of step.
+    inline bool takeResponseId(Protocol protocol, std::string& response, std::uint32_t id) {
+        if (protocol != TAGGED)
+            return true;
+        if (response.size() < 4 || readU32(response.data()) != id) {
+            response.clear();
+            return false;
+        }
+        response.erase(0, 4);
+        return true;
+    }
+
+    // Both ends put whatever is ready into one send already. Nagle would hold a send back until the previous one is
+    // acknowledged, and the other end delays that ACK hoping to send it along with data, which stalls a pipelined
+    // connection for tens of milliseconds at a time.
+    inline void setNoDelay(SOCKET socket) {
+        int noDelay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+    }
+
+    // A connected socket, or INVALID_SOCKET.
+    inline SOCKET connectTo(const std::string& address, unsigned short port) {
+        SOCKET connectSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (connectSocket == INVALID_SOCKET) {
+            std::cerr << "socket failed: " << WSAGetLastError() << std::endl;
+            return INVALID_SOCKET;
+        }
+
+        sockaddr_in serverAddr;
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        // Use inet_pton instead of inet_addr to avoid deprecation warnings.
+        if (inet_pton(AF_INET, address.c_str(), &serverAddr.sin_addr) != 1) {
+            std::cerr << "Invalid IP address: " << address << std::endl;
+            closesocket(connectSocket);
+            return INVALID_SOCKET;
+        }
+
+        if (::connect(connectSocket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) == SOCKET_ERROR) {
+            std::cerr << "connect failed: " << WSAGetLastError() << std::endl;
+            closesocket(connectSocket);
+            return INVALID_SOCKET;
+        }
+        setNoDelay(connectSocket);
+        return connectSocket;
+    }
+
+    // Reads the frames of a connection, as much as arrived at a time, so one recv() can bring in many of them.
+    class FrameReader {
+    public:
+        // False if the connection broke or the stream is garbage.
+        bool next(SOCKET socket, std::string& message) {
+            while (true) {
+                if (input.size() - used >= 4) {
+                    std::size_t length = readU32(input.data() + used);
+                    if (length > MAX_FRAME_SIZE)
+                        return false;
+                    if (input.size() - used - 4 >= length) {
+                        message.assign(input, used + 4, length);
+                        used += 4 + length;
+                        return true;
+                    }
+                }
+                input.erase(0, used);
+                used = 0;
+                char buffer[READ_SIZE];
+                int received = recv(socket, buffer, static_cast<int>(sizeof(buffer)), 0);
+                if (received <= 0)
+                    return false;
+                input.append(buffer, static_cast<std::size_t>(received));
+            }
+        }
+
+        void clear() {
+            input.clear();
+            used = 0;
+        }
+
+    private:
+        std::string input;
+        std::size_t used = 0;
+    };
+
+    // TCP Server class
+    class Server {
+    public:
+        // Define a callback type for processing client requests.
+        // The callback takes the request string and returns a response.
+        using RequestHandler = std::function<std::string(const std::string&)>;
+        // Or it gets a Reply and calls it once with the response, then or later and from any thread. A handler that
+        // throws instead closes the connection. Calls after the first (or after stop()) are ignored.
+        using Reply = std::function<void(std::string)>;
+        using AsyncRequestHandler = std::function<void(const std::string&, Reply)>;
+
+        Server() : listenSocket(INVALID_SOCKET), running(false) {
+            startNetworking();
+        }
+
+        ~Server() {
+            stop();
+            stopNetworking();
+        }
+
+        // Number of event loop threads of the epoll backend, set it before start(). 0 uses one per core (at least 2).
+        // The thread per connection backend ignores it.
+        void setEventThreads(std::size_t threads) {
+            eventThreads = threads;
+        }
+
+        // Number of threads the epoll backend runs handlers on, set it before start(). 0 uses four per core (at least
+        // 8), so handlers that block for a while (a password hash) dont take all of them. The thread per connection
+        // backend runs a handler on the thread of its connection.
+        void setWorkerThreads(std::size_t threads) {
+            workerThreads = threads;
+        }
+
+        // Connections open right now.
+        std::size_t connectionCount() const {
+            return connections;
+        }
+
+        // Starts the server on the given port. The provided handler is invoked for each incoming request.
+        bool start(unsigned short port, RequestHandler handler, std::string HOST_IP_ADDRESS, Protocol protocol = PLAIN) {
+            requestHandler = handler;
+            asyncHandler = nullptr;
+            return listenOn(port, HOST_IP_ADDRESS, protocol);
+        }
+
+        // Same with a handler that answers through its Reply.
+        bool start(unsigned short port, AsyncRequestHandler handler, std::string HOST_IP_ADDRESS, Protocol protocol = PLAIN) {
+            requestHandler = nullptr;
+            asyncHandler = handler;
+            return listenOn(port, HOST_IP_ADDRESS, protocol);
+        }
+
+        // framed = true is FRAMED.
+        bool start(unsigned short port, RequestHandler handler, std::string HOST_IP_ADDRESS, bool framed) {
+            return start(port, handler, HOST_IP_ADDRESS, framed ? FRAMED : PLAIN);
+        }
+
+        // Stops the server and cleans up connections.
+        void stop() {
+            running = false;
+#ifdef SimpleTCP_EPOLL
+            // the loops use the listening socket until they are joined
+            stopEventLoops();
+#endif
+            if (listenSocket != INVALID_SOCKET) {
+                // Shutdown to unblock accept()
+                shutdown(listenSocket, SD_BOTH);
+                closesocket(listenSocket);
+                listenSocket = INVALID_SOCKET;
+            }
+            if (acceptThread.joinable())
+                acceptThread.join();
+
+            // Join all client threads.
+            {
+                std::lock_guard<std::mutex> lock(clientThreadsMutex);
+                for (auto& t : clientThreads) {
+                    if (t.joinable())
+                        t.join();
+                }
+                clientThreads.clear();
+            }
+        }
+
+    private:
+        SOCKET listenSocket;
+        std::thread acceptThread;
+        std::vector<std::thread> clientThreads;
+        std::mutex clientThreadsMutex;
+        RequestHandler requestHandler;
+        AsyncRequestHandler asyncHandler; // instead of requestHandler
+        std::atomic<bool> running;
+        std::atomic<std::size_t> connections{0};
+        std::size_t eventThreads = 0;
+        std::size_t workerThreads = 0;
+        Protocol protocol = PLAIN;
+
+        static const std::size_t MAX_PENDING_OUTPUT = std::size_t(4) << 20; // stop answering frames until it is sent
+
+        bool listenOn(unsigned short port, const std::string& HOST_IP_ADDRESS, Protocol protocol) {
+            this->protocol = protocol;
+            listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (listenSocket == INVALID_SOCKET) {
+                std::cerr << "socket failed: " << WSAGetLastError() << std::endl;
+                return false;
+            }
+#ifndef _WIN32
+            // so a restarted server can bind while the old connections are in TIME_WAIT
+            int reuse = 1;
+            setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+
+            sockaddr_in service;
+            service.sin_family = AF_INET; // IPv4
+            // Bind to the specific IP address
+            service.sin_addr.s_addr = inet_addr(HOST_IP_ADDRESS.c_str());
+            service.sin_port = htons(port);
+
+            if (bind(listenSocket, reinterpret_cast<sockaddr*>(&service), sizeof(service)) == SOCKET_ERROR) {
+                std::cerr << "bind failed: " << WSAGetLastError() << std::endl;
+                closesocket(listenSocket);
+                listenSocket = INVALID_SOCKET;
+                return false;
+            }
+
+            if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
+                std::cerr << "listen failed: " << WSAGetLastError() << std::endl;
+                closesocket(listenSocket);
+                listenSocket = INVALID_SOCKET;
+                return false;
+            }
+
+            running = true;
+#ifdef SimpleTCP_EPOLL
+            if (!startEventLoops()) {
+                stop();
+                return false;
+            }
+#else
+            acceptThread = std::thread(&Server::acceptLoop, this, listenSocket);
+#endif
+            return true;
+        }
+
+        // Runs the handler and waits for its answer. A handler that throws closes the connection, it has no answer to send.
+        bool answer(std::string& response, const std::string& request) {
+            try {
+                if (requestHandler) {
+                    response += requestHandler(request);
+                } else if (asyncHandler) {
+                    auto answered = std::make_shared<std::promise<std::string>>();
+                    std::future<std::string> answer = answered->get_future();
+                    auto replied = std::make_shared<std::atomic<bool>>(false);
+                    asyncHandler(request, [answered, replied](std::string reply) {
+                        if (!replied->exchange(true))
+                            answered->set_value(std::move(reply));
+                    });
+                    response += answer.get();
+                }
+                return true;
+            } catch (const std::exception& e) {
+                std::cerr << "request handler failed: " << e.what() << std::endl;
+                return false;
+            }
+        }
+
+        // Answers the complete frames at the front of input and drops them from it, until output holds outputLimit
+        // bytes. Returns false if the stream is garbage or a handler failed.
+        bool answerFrames(std::string& input, std::string& output, std::size_t outputLimit) {
+            std::size_t idSize = protocol == TAGGED ? 4 : 0;
+            std::size_t used = 0;
+            bool ok = true;
+            while (input.size() - used >= 4 && output.size() < outputLimit) {
+                std::size_t length = readU32(input.data() + used);
+                if (length > MAX_FRAME_SIZE || length < idSize) {
+                    ok = false;
+                    break;
+                }
+                if (input.size() - used - 4 < length)
+                    break;
+                std::string request = input.substr(used + 4 + idSize, length - idSize);
+                std::string response;
+                if (!answer(response, request)) {
+                    ok = false;
+                    break;
+                }
+                appendU32(output, idSize + response.size());
+                output.append(input, used + 4, idSize); // the request id
+                output += response;
+                used += 4 + length;
+            }
+            input.erase(0, used);
+            return ok;
+        }
+
+        // The accept loop runs in its own thread. It gets the socket instead of reading the member stop() resets.
+        void acceptLoop(SOCKET listener) {
+            while (running) {
+                SOCKET clientSocket = accept(listener, nullptr, nullptr);
+                if (clientSocket != INVALID_SOCKET) {
+                    //std::cout << "Accepted a connection!" << std::endl;
+                }
+                if (clientSocket == INVALID_SOCKET) {
+                    if (running) {  // Only report errors if still running
+                        std::cerr << "accept failed: " << WSAGetLastError() << std::endl;
+                    }
+                    break;
+                }
+                setNoDelay(clientSocket);
+                // Spawn a thread to handle each client.
+                connections++;
+                try {
+                    std::lock_guard<std::mutex> lock(clientThreadsMutex);
+                    clientThreads.emplace_back(&Server::handleClient, this, clientSocket);
+                } catch (const std::system_error& e) { // out of threads, turn this one away and keep the others
+                    std::cerr << "thread for a client failed: " << e.what() << std::endl;
+                    closesocket(clientSocket);
+                    connections--;
+                }
+            }
+        }
+
+        // Handles communication with a single client.
+        void handleClient(SOCKET clientSocket) {
+            if (protocol != PLAIN) {
+                std::vector<char> buffer(READ_SIZE);
+                std::string input, output;
+                int received;
+                bool ok = true;
+                while (ok && (received = recv(clientSocket, buffer.data(), static_cast<int>(buffer.size()), 0)) > 0) {
+                    input.append(buffer.data(), static_cast<std::size_t>(received));
+                    // the answers to everything this read completed go out in one send, the ones before a bad frame too
+                    while (ok) {
+                        ok = answerFrames(input, output, MAX_PENDING_OUTPUT);
+                        if (output.empty())
+                            break;
+                        ok = sendAll(clientSocket, output.data(), output.size()) && ok;
+                        output.clear();
+                    }
+                }
+                closesocket(clientSocket);
+                connections--;
+                return;
+            }
+            const int bufSize = 512;
+            char buffer[bufSize];
+            int iResult = 0;
+
+            while ((iResult = recv(clientSocket, buffer, bufSize, 0)) > 0) {
+                std::string request(buffer, iResult);
+                std::string response;
+                if (!answer(response, request)) {
+                    break;
+                }
+                // Send back the response.
+                int sendResult = send(clientSocket, response.c_str(), static_cast<int>(response.size()), SEND_FLAGS);
+                if (sendResult == SOCKET_ERROR) {
+                    std::cerr << "send failed: " << WSAGetLastError() << std::endl;
+                    break;
+                }
+            }
+            closesocket(clientSocket);
+            connections--;
+        }
+
+#ifdef SimpleTCP_EPOLL
+        static const std::size_t PLAIN_READ_SIZE = 512; // a plain message is one recv() of this, like handleClient()
+
+        struct Mailbox;
+
+        // The requests one read of a connection completed, answered on the workers. It goes back to the loop of the
+        // connection once every request has its answer, and the connection isnt read meanwhile, so the answers stay
+        // in order and a client cant queue up work without end.
+        struct Batch {
+            std::shared_ptr<Mailbox> mailbox;
+            SOCKET socket = INVALID_SOCKET;
+            std::uint64_t connection = 0;   // Connection::id, the socket can belong to a new connection by then
+            std::vector<std::string> requests;
+            std::string ids;                // TAGGED: the request ids, 4 bytes each
+            std::vector<std::string> responses;
+            std::vector<char> failed;       // the handler threw, no answer
+            std::unique_ptr<std::atomic<bool>[]> answered;
+            std::atomic<std::size_t> remaining{0};
+
+            // The first answer of request i counts, and the last one sends the batch home.
+            void finish(const std::shared_ptr<Batch>& self, std::size_t i, std::string response, bool threw) {
+                if (answered[i].exchange(true))
+                    return;
+                responses[i] = std::move(response);
+                failed[i] = threw;
+                if (remaining.fetch_sub(1) == 1)
+                    mailbox->post(self);
+            }
+        };
+
+        // Finished batches on their way back to a loop, posted from any thread. It outlives the loop, since a Reply
+        // can come after stop(), and drops what arrives once the loop is gone.
+        struct Mailbox {
+            std::mutex mutex;
+            int wake = -1; // the loop's eventfd, stop() writes to it too
+            std::vector<std::shared_ptr<Batch>> done;
+
+            void post(std::shared_ptr<Batch> batch) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (wake < 0)
+                    return;
+                done.push_back(std::move(batch));
+                // the loop reads the eventfd before it takes the list, so one write per empty list is enough
+                if (done.size() == 1)
+                    notify();
+            }
+
+            void notify() {
+                std::uint64_t one = 1;
+                if (wake >= 0 && write(wake, &one, sizeof(one)) < 0)
+                    std::cerr << "eventfd write failed: " << errno << std::endl;
+            }
+
+            void close() {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (wake >= 0)
+                    ::close(wake);
+                wake = -1;
+                done.clear();
+            }
+        };
+
+        struct Connection {
+            SOCKET socket = INVALID_SOCKET;
+            std::uint64_t id = 0;
+            std::string input;    // FRAMED and TAGGED: frames that arrived but arent answered yet
+            std::string output;   // responses the socket didnt take yet
+            std::size_t sent = 0; // of output
+            bool writing = false; // waiting to send output, so not reading meanwhile
+            bool busy = false;    // a batch is with the workers, not reading either
+            bool broken = false;  // a bad frame or a failed handler, closed once the answers before it are out
+            std::uint32_t events = EPOLLIN; // what epoll waits for
+        };
+
+        // Only its own thread touches a loop's connections.
+        struct EventLoop {
+            int epoll = -1;
+            std::shared_ptr<Mailbox> mailbox = std::make_shared<Mailbox>();
+            std::thread thread;
+            std::unordered_map<SOCKET, std::unique_ptr<Connection>> connections;
+            std::uint64_t nextId = 0;
+        };
+
+        std::vector<std::unique_ptr<EventLoop>> loops;
+        std::vector<std::thread> workers;
+        std::deque<std::shared_ptr<Batch>> jobs;
+        std::mutex jobsMutex; // jobs and workersStopping
+        std::condition_variable jobReady;
+        bool workersStopping = false;
+
+        static bool setNonBlocking(SOCKET socket) {
+            int flags = fcntl(socket, F_GETFL, 0);
+            return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+        }
+
+        bool startEventLoops() {
+            if (!setNonBlocking(listenSocket)) {
+                std::cerr << "fcntl failed: " << errno << std::endl;
+                return false;
+            }
+            std::size_t count = eventThreads != 0 ? eventThreads : (std::max)(2u, std::thread::hardware_concurrency());
+            for (std::size_t i = 0; i < count; i++) {
+                loops.emplace_back(new EventLoop());
+                EventLoop& loop = *loops.back();
+                loop.epoll = epoll_create1(EPOLL_CLOEXEC);
+                loop.mailbox->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (loop.epoll < 0 || loop.mailbox->wake < 0) {
+                    std::cerr << "epoll failed: " << errno << std::endl;
+                    return false;
+                }
+                epoll_event event{};
+                // every loop waits on the listening socket, EPOLLEXCLUSIVE wakes one of them instead of all
+                event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+                event.events |= EPOLLEXCLUSIVE;
+#endif
+                event.data.ptr = &listenSocket;
+                if (epoll_ctl(loop.epoll, EPOLL_CTL_ADD, listenSocket, &event) < 0) {
+                    std::cerr << "epoll_ctl failed: " << errno << std::endl;
+                    return false;
+                }
+                event.events = EPOLLIN;
+                event.data.ptr = &loop;
+                if (epoll_ctl(loop.epoll, EPOLL_CTL_ADD, loop.mailbox->wake, &event) < 0) {
+                    std::cerr << "epoll_ctl failed: " << errno << std::endl;
+                    return false;
+                }
+            }
+            std::size_t workerCount = workerThreads != 0 ? workerThreads : (std::max)(8u, 4 * std::thread::hardware_concurrency());
+            workersStopping = false;
+            for (std::size_t i = 0; i < workerCount; i++)
+                workers.emplace_back(&Server::runWorker, this);
+            for (auto& loop : loops)
+                loop->thread = std::thread(&Server::runEventLoop, this, loop.get());
+            return true;
+        }
+
+        void stopEventLoops() {
+            for (auto& loop : loops) {
+                std::lock_guard<std::mutex> lock(loop->mailbox->mutex);
+                loop->mailbox->notify();
+            }
+            for (auto& loop : loops) {
+                if (loop->thread.joinable())
+                    loop->thread.join();
+                for (auto& entry : loop->connections)
+                    closesocket(entry.first);
+                connections -= loop->connections.size();
+                loop->connections.clear();
+                if (loop->epoll >= 0)
+                    ::close(loop->epoll);
+                loop->mailbox->close();
+            }
+            loops.clear();
+            // the requests already handed over still run, their answers go nowhere
+            {
+                std::lock_guard<std::mutex> lock(jobsMutex);
+                workersStopping = true;
+            }
+            jobReady.notify_all();
+            for (auto& worker : workers)
+                worker.join();
+            workers.clear();
+        }
+
+        void runWorker() {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            while (true) {
+                jobReady.wait(lock, [this] { return workersStopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                std::shared_ptr<Batch> batch = std::move(jobs.front());
+                jobs.pop_front();
+                lock.unlock();
+                for (std::size_t i = 0; i < batch->requests.size(); i++) {
+                    try {
+                        if (asyncHandler) {
+                            asyncHandler(batch->requests[i], [batch, i](std::string response) {
+                                batch->finish(batch, i, std::move(response), false);
+                            });
+                        } else {
+                            batch->finish(batch, i, requestHandler ? requestHandler(batch->requests[i]) : std::string(), false);
+                        }
+                    } catch (const std::exception& e) {
+                        std::cerr << "request handler failed: " << e.what() << std::endl;
+                        batch->finish(batch, i, std::string(), true);
+                    }
+                }
+                lock.lock();
+            }
+        }
+
+        void runEventLoop(EventLoop* loop) {
+            std::vector<epoll_event> events(256);
+            while (running) {
+                int ready = epoll_wait(loop->epoll, events.data(), static_cast<int>(events.size()), -1);
+                if (ready < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    std::cerr << "epoll_wait failed: " << errno << std::endl;
+                    return;
+                }
+                bool answered = false;
+                for (int i = 0; i < ready; i++) {
+                    void* source = events[i].data.ptr;
+                    if (source == loop) {
+                        std::uint64_t count;
+                        if (read(loop->mailbox->wake, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                            std::cerr << "eventfd read failed: " << errno << std::endl;
+                        if (!running) // stop()
+                            return;
+                        answered = true;
+                        continue;
+                    }
+                    if (source == &listenSocket) {
+                        acceptConnections(loop);
+                        continue;
+                    }
+                    Connection* connection = static_cast<Connection*>(source);
+                    if (!serve(loop, connection, events[i].events))
+                        closeConnection(loop, connection);
+                }
+                // after the rest of the round, it can close connections whose events are still in the list
+                if (answered)
+                    receiveAnswers(loop);
+            }
+        }
+
+        void acceptConnections(EventLoop* loop) {
+            // a burst is taken a bit at a time, so the other loops get their share of it
+            for (int i = 0; i < 64; i++) {
+                SOCKET clientSocket = accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (clientSocket == INVALID_SOCKET) {
+                    if (errno == EMFILE || errno == ENFILE) {
+                        // the connection stays in the backlog, dont spin on it until a descriptor is free
+                        std::cerr << "accept failed: " << errno << std::endl;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED && errno != EINTR && running) {
+                        std::cerr << "accept failed: " << errno << std::endl;
+                    }
+                    return;
+                }
+                setNoDelay(clientSocket);
+                std::unique_ptr<Connection> connection(new Connection());
+                connection->socket = clientSocket;
+                connection->id = ++loop->nextId;
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.ptr = connection.get();
+                if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+                    std::cerr << "epoll_ctl failed: " << errno << std::endl;
+                    closesocket(clientSocket);
+                    continue;
+                }
+                loop->connections[clientSocket] = std::move(connection);
+                connections++;
+            }
+        }
+
+        void closeConnection(EventLoop* loop, Connection* connection) {
+            SOCKET socket = connection->socket;
+            closesocket(socket); // also takes it out of the epoll set
+            loop->connections.erase(socket);
+            connections--;
+        }
+
+        // Handles what epoll reported for a connection. Returns false once it should be closed.
+        bool serve(EventLoop* loop, Connection* connection, std::uint32_t events) {
+            if (events & EPOLLERR)
+                return false;
+            if (connection->busy) // epoll only reports a hang up while it waits for nothing
+                return (events & EPOLLHUP) == 0;
+            if (connection->writing) {
+                if (!flush(connection))
+                    return false;
+                // frames that came in while it was sending are answered now
+                if (!connection->writing && !dispatch(loop, connection))
+                    return false;
+                return updateEvents(loop, connection);
+            }
+            char buffer[READ_SIZE];
+            ssize_t received = recv(connection->socket, buffer, protocol != PLAIN ? READ_SIZE : PLAIN_READ_SIZE, 0);
+            if (received < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            if (received == 0)
+                return false;
+            connection->input.append(buffer, static_cast<std::size_t>(received));
+            return dispatch(loop, connection) && updateEvents(loop, connection);
+        }
+
+        // Hands the complete requests of the input to the workers as one batch. Returns false if there is nothing to
+        // wait for anymore and the connection should be closed.
+        bool dispatch(EventLoop* loop, Connection* connection) {
+            std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+            std::string& input = connection->input;
+            if (protocol == PLAIN) {
+                if (!input.empty())
+                    batch->requests.push_back(std::move(input));
+                input.clear();
+            } else {
+                std::size_t idSize = protocol == TAGGED ? 4 : 0;
+                std::size_t used = 0;
+                while (input.size() - used >= 4) {
+                    std::size_t length = readU32(input.data() + used);
+                    if (length > MAX_FRAME_SIZE || length < idSize) {
+                        connection->broken = true;
+                        break;
+                    }
+                    if (input.size() - used - 4 < length)
+                        break;
+                    batch->requests.push_back(input.substr(used + 4 + idSize, length - idSize));
+                    batch->ids.append(input, used + 4, idSize);
+                    used += 4 + length;
+                }
+                input.erase(0, used);
+            }
+            if (batch->requests.empty())
+                return !connection->broken;
+
+            std::size_t count = batch->requests.size();
+            batch->mailbox = loop->mailbox;
+            batch->socket = connection->socket;
+            batch->connection = connection->id;
+            batch->responses.resize(count);
+            batch->failed.assign(count, 0);
+            batch->answered.reset(new std::atomic<bool>[count]());
+            batch->remaining = count;
+            connection->busy = true;
+            {
+                std::lock_guard<std::mutex> lock(jobsMutex);
+                jobs.push_back(std::move(batch));
+            }
+            jobReady.notify_one();
+            return true;
+        }
+
+        // Sends the answers of the batches the workers finished, and hands those connections their next requests.
+        void receiveAnswers(EventLoop* loop) {
+            std::vector<std::shared_ptr<Batch>> done;
+            {
+                std::lock_guard<std::mutex> lock(loop->mailbox->mutex);
+                done.swap(loop->mailbox->done);
+            }
+            for (const auto& batch : done) {
+                auto found = loop->connections.find(batch->socket);
+                if (found == loop->connections.end() || found->second->id != batch->connection)
+                    continue; // closed meanwhile
+                Connection* connection = found->second.get();
+                connection->busy = false;
+                std::size_t idSize = protocol == TAGGED ? 4 : 0;
+                for (std::size_t i = 0; i < batch->responses.size(); i++) {
+                    if (batch->failed[i]) {
+                        connection->broken = true;
+                        break;
+                    }
+                    const std::string& response = batch->responses[i];
+                    if (protocol != PLAIN) {
+                        appendU32(connection->output, idSize + response.size());
+                        connection->output.append(batch->ids, i * idSize, idSize);
+                    }
+                    connection->output += response;
+                }
+                // after a bad frame or a failed handler the answers before it still get what the socket takes now
+                bool ok = flush(connection) && !connection->broken;
+                if (ok && !connection->writing)
+                    ok = dispatch(loop, connection);
+                if (!ok || !updateEvents(loop, connection))
+                    closeConnection(loop, connection);
+            }
+        }
+
+        // Sends as much of the output as the socket takes. What is left waits for EPOLLOUT (see updateEvents()), and the
+        // connection isnt read meanwhile, so a client that doesnt read its answers cant make the server buffer without end.
+        bool flush(Connection* connection) {
+            std::string& output = connection->output;
+            while (connection->sent < output.size()) {
+                ssize_t sent = send(connection->socket, output.data() + connection->sent, output.size() - connection->sent, SEND_FLAGS);
+                if (sent < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        break;
+                    return false;
+                }
+                connection->sent += static_cast<std::size_t>(sent);
+            }
+            if (connection->sent == output.size()) {
+                output.clear();
+                connection->sent = 0;
+            }
+            connection->writing = !output.empty();
+            return true;
+        }
+
+        // Waits for EPOLLOUT while there is output, for nothing while the workers have a batch and for EPOLLIN otherwise.
+        bool updateEvents(EventLoop* loop, Connection* connection) {
+            std::uint32_t events = connection->writing ? std::uint32_t(EPOLLOUT) : connection->busy ? 0u : std::uint32_t(EPOLLIN);
+            if (events == connection->events)
+                return true;
+            connection->events = events;
+            epoll_event event{};
+            event.events = events;
+            event.data.ptr = connection;
+            return epoll_ctl(loop->epoll, EPOLL_CTL_MOD, connection->socket, &event) == 0;
+        }
+#endif
+    };
+
+    // TCP Client class
+    class Client {
+    public:
+        Client() : connectSocket(INVALID_SOCKET) {
+            startNetworking();
+        }
+
+        ~Client() {
+            if (connectSocket != INVALID_SOCKET) {
+                closesocket(connectSocket);
+            }
+            stopNetworking();
+        }
+
+        // Connects to the server at the specified address and port. protocol has to match the server's.
+        bool connectToServer(const std::string& address, unsigned short port, Protocol protocol = PLAIN) {
+            if (connectSocket != INVALID_SOCKET)
+                disconnect();
+            this->protocol = protocol;
+            connectSocket = connectTo(address, port);
+            return connectSocket != INVALID_SOCKET;
+        }
+
+        // framed = true is FRAMED.
+        bool connectToServer(const std::string& address, unsigned short port, bool framed) {
+            return connectToServer(address, port, framed ? FRAMED : PLAIN);
+        }
+
+        // Sends a request to the server and waits for a response.
+        std::string sendRequest(const std::string& request) {
+            if (connectSocket == INVALID_SOCKET) {
+                return "";
+            }
+
+            if (protocol != PLAIN) {
+                std::string response;
+                std::uint32_t id = nextId++;
+                std::string frame;
+                appendRequest(frame, protocol, request, id);
+                if (!sendAll(connectSocket, frame.data(), frame.size()) || !receiveResponse(response, id))
+                    disconnect();
+                return response;
+            }
+
+            int sendResult = send(connectSocket, request.c_str(), static_cast<int>(request.size()), SEND_FLAGS);
+            if (sendResult == SOCKET_ERROR) {
+                std::cerr << "send failed: " << WSAGetLastError() << std::endl;
+                return "";
+            }
+
+            const int bufSize = 512;
+            char buffer[bufSize];
+            int iResult = recv(connectSocket, buffer, bufSize, 0);
+            if (iResult > 0) {
+                return std::string(buffer, iResult);
+            }
+            return "";
+        }
+
+        // Sends the requests without waiting for each answer (FRAMED and TAGGED), so a batch costs a round trip or a
+        // few instead of one per request. At most PIPELINE_WINDOW bytes of requests are sent ahead of the answers read
+        // so far: the server stops reading while its answers wait for us, and with no bound both ends could block on
+        // a full socket. The answers are in the order of the requests, "" for the ones a broken connection lost.
+        // PLAIN connections send them one at a time.
+        std::vector<std::string> sendRequests(const std::vector<std::string>& requests) {
+            std::vector<std::string> responses(requests.size());
+            if (protocol == PLAIN) {
+                for (std::size_t i = 0; i < requests.size(); i++)
+                    responses[i] = sendRequest(requests[i]);
+                return responses;
+            }
+            std::uint32_t firstId = nextId;
+            nextId += static_cast<std::uint32_t>(requests.size());
+            std::size_t sent = 0, answered = 0;
+            std::size_t inFlight = 0; // bytes of the requests sent and not answered yet
+            std::string out;
+            while (answered < requests.size() && connectSocket != INVALID_SOCKET) {
+                // refilled once half of it is answered, so the requests go out in big sends instead of one per answer.
+                // always at least one, however big
+                while (sent < requests.size() && (sent == answered || (inFlight + frameSize(requests[sent]) <= PIPELINE_WINDOW &&
+                                                                      (!out.empty() || inFlight <= PIPELINE_WINDOW / 2)))) {
+                    inFlight += frameSize(requests[sent]);
+                    appendRequest(out, protocol, requests[sent], firstId + static_cast<std::uint32_t>(sent));
+                    sent++;
+                }
+                if (!out.empty() && !sendAll(connectSocket, out.data(), out.size())) {
+                    disconnect();
+                    break;
+                }
+                out.clear();
+                if (!receiveResponse(responses[answered], firstId + static_cast<std::uint32_t>(answered))) {
+                    disconnect();
+                    break;
+                }
+                inFlight -= frameSize(requests[answered]);
+                answered++;
+            }
+            return responses;
+        }
+
+    private:
+        static const std::size_t PIPELINE_WINDOW = 32768; // fits the socket buffers of both ends
+
+        SOCKET connectSocket;
+        Protocol protocol = PLAIN;
+        std::uint32_t nextId = 0; // TAGGED
+        FrameReader reader;
+
+        std::size_t frameSize(const std::string& request) const {
+            return (protocol == TAGGED ? 8 : 4) + request.size();
+        }
+
+        bool receiveResponse(std::string& response, std::uint32_t id) {
+            return reader.next(connectSocket, response) && takeResponseId(protocol, response, id);
+        }
+
+        // After an error the stream is out of step, dont try to use it again.
+        void disconnect() {
+            closesocket(connectSocket);
+            connectSocket = INVALID_SOCKET;
+            reader.clear();
+        }
+    };
+
+    // TCP client that keeps many requests in flight on one connection, for FRAMED and TAGGED servers (TAGGED checks
+    // the ids). Any thread can send: the requests queue up and a writer thread sends everything queued so far in one
+    // go, so nobody waits for the socket, and a reader thread hands each answer to its future or callback, in the
+    // order the requests went out.
+    class AsyncClient {
+    public:
+        // Gets the answer, or "" if the connection broke or closed before it came. Runs on the reader thread: it can
+        // send more requests, but waiting for an answer there would wait forever, and the next answers wait for it.
+        using Callback = std::function<void(const std::string&)>;
+
+        AsyncClient() {
+            startNetworking();
+        }
+
+        ~AsyncClient() {
+            close();
+            stopNetworking();
+        }
+
+        AsyncClient(const AsyncClient&) = delete;
+        AsyncClient& operator=(const AsyncClient&) = delete;
+
+        bool connectToServer(const std::string& address, unsigned short port, Protocol protocol = TAGGED) {
+            close();
+            if (protocol == PLAIN) {
+                std::cerr << "AsyncClient needs a FRAMED or TAGGED server" << std::endl;
+                return false;
+            }
+            SOCKET socket = connectTo(address, port);
+            if (socket == INVALID_SOCKET)
+                return false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                connectSocket = socket;
+                this->protocol = protocol;
+                open = true;
+            }
+            reader.clear();
+            readerThread = std::thread(&AsyncClient::readLoop, this);
+            writerThread = std::thread(&AsyncClient::writeLoop, this);
+            return true;
+        }
+
+        // Closes the connection. Requests still waiting for their answers get "".
+        void close() {
+            if (!readerThread.joinable())
+                return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                open = false;
+            }
+            queued.notify_all();
+            shutdown(connectSocket, SD_BOTH); // wakes the reader, which fails what is left
+            readerThread.join();
+            writerThread.join();
+            closesocket(connectSocket);
+            connectSocket = INVALID_SOCKET;
+        }
+
+        std::future<std::string> sendRequestAsync(const std::string& request) {
+            Pending pending;
+            pending.promise.emplace();
+            std::future<std::string> answer = pending.promise->get_future();
+            enqueue(&request, &pending, 1);
+            return answer;
+        }
+
+        void sendRequestAsync(const std::string& request, Callback callback) {
+            Pending pending;
+            pending.callback = std::move(callback);
+            enqueue(&request, &pending, 1);
+        }
+
+        // Waits for the answer.
+        std::string sendRequest(const std::string& request) {
+            return sendRequestAsync(request).get();
+        }
+
+        // Sends all of requests together and waits for every answer. They are in the order of the requests, "" for the
+        // ones the connection lost.
+        std::vector<std::string> sendRequests(const std::vector<std::string>& requests) {
+            std::vector<Pending> pending(requests.size());
+            std::vector<std::future<std::string>> answers;
+            answers.reserve(requests.size());
+            for (Pending& p : pending) {
+                p.promise.emplace();
+                answers.push_back(p.promise->get_future());
+            }
+            enqueue(requests.data(), pending.data(), requests.size());
+            std::vector<std::string> responses;
+            responses.reserve(requests.size());
+            for (auto& answer : answers)
+                responses.push_back(answer.get());
+            return responses;
+        }
+
+    private:
+        struct Pending {
+            std::uint32_t id = 0;
+            std::optional<std::promise<std::string>> promise; // when there is no callback
+            Callback callback;
+
+            void complete(const std::string& response) {
+                if (!callback) {
+                    promise->set_value(response);
+                    return;
+                }
+                try {
+                    callback(response);
+                } catch (const std::exception& e) {
+                    std::cerr << "request callback failed: " << e.what() << std::endl;
+                }
+            }
+        };
+
+        SOCKET connectSocket = INVALID_SOCKET; // set before the threads start and closed after they are joined
+        std::thread readerThread, writerThread;
+        FrameReader reader;                    // reader thread
+
+        std::mutex mutex;                      // everything below
+        std::condition_variable queued;        // out has something, or the connection closed
+        bool open = false;
+        Protocol protocol = TAGGED;
+        std::uint32_t nextId = 0;
+        std::string out;                       // requests the writer hasnt taken yet
+        std::deque<Pending> pending;           // sent or queued, in order, waiting for their answers
+
+        void enqueue(const std::string* requests, Pending* waiting, std::size_t count) {
+            bool wake;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (open) {
+                    wake = out.empty() && count > 0; // otherwise the writer is busy and takes it after its send
+                    for (std::size_t i = 0; i < count; i++) {
+                        waiting[i].id = nextId++;
+                        appendRequest(out, protocol, requests[i], waiting[i].id);
+                        pending.push_back(std::move(waiting[i]));
+                    }
+                    count = 0;
+                } else {
+                    wake = false;
+                }
+            }
+            if (wake)
+                queued.notify_one();
+            for (std::size_t i = 0; i < count; i++) // not connected
+                waiting[i].complete("");
+        }
+
+        void writeLoop() {
+            std::string sending;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                queued.wait(lock, [this] { return !out.empty() || !open; });
+                if (!open)
+                    return;
+                sending.swap(out);
+                lock.unlock();
+                bool sent = sendAll(connectSocket, sending.data(), sending.size());
+                sending.clear();
+                if (!sent) {
+                    shutdown(connectSocket, SD_BOTH); // the reader fails the requests
+                    return;
+                }
+                lock.lock();
+            }
+        }
+
+        void readLoop() {
+            std::string response;
+            while (reader.next(connectSocket, response)) {
+                Pending done;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (pending.empty()) // an answer nobody asked for
+                        break;
+                    done = std::move(pending.front());
+                    pending.pop_front();
+                }
+                bool inStep = takeResponseId(protocol, response, done.id);
+                done.complete(response);
+                if (!inStep)
+                    break;
+            }
+            // broke or closing: nothing more is sent, and what is still waiting wont be answered
+            std::deque<Pending> lost;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                open = false;
+                out.clear();
+                lost.swap(pending);
+            }
+            queued.notify_all();
+            shutdown(connectSocket, SD_BOTH);
+            for (Pending& p : lost)
+                p.complete("");
+        }
+    };
+
+} // namespace SimpleTCP
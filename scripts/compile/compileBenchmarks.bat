@@ -0,0 +1,17 @@
+@echo off
+
+echo Compiling benchmarks...
+g++ -O2 -std=c++17 "..\..\src\benchmark\lookupBenchmark.cpp" -o "..\..\output\lookupBenchmark"
+g++ -O2 -std=c++17 "..\..\src\benchmark\concurrencyBenchmark.cpp" -o "..\..\output\concurrencyBenchmark"
+g++ -O2 -std=c++17 "..\..\src\benchmark\deleteBenchmark.cpp" -o "..\..\output\deleteBenchmark"
+g++ -O2 -std=c++17 "..\..\src\benchmark\shardBenchmark.cpp" -o "..\..\output\shardBenchmark"
+g++ -O2 -std=c++17 "..\..\src\benchmark\tieredBenchmark.cpp" -o "..\..\output\tieredBenchmark"
+g++ -O2 -std=c++17 "..\..\src\benchmark\formatBenchmark.cpp" -o "..\..\output\formatBenchmark"
+g++ -O2 -std=c++17 "..\..\src\benchmark\schemaBenchmark.cpp" -o "..\..\output\schemaBenchmark"
+g++ -O2 -std=c++17 "..\..\src\benchmark\tcpBenchmark.cpp" -o "..\..\output\tcpBenchmark" -lws2_32
+g++ -O2 -std=c++17 "..\..\src\benchmark\pipelineBenchmark.cpp" -o "..\..\output\pipelineBenchmark" -lws2_32
+
+echo Compilation completed.
+pause
+
+exit
@@ -0,0 +1,9 @@
+@echo off
+
+echo Compiling importer...
+g++ -O2 -std=c++17 "..\..\src\importer\importer.cpp" -o "..\..\output\importer"
+
+echo Compilation completed.
+pause
+
+exit
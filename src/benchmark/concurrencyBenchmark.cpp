@@ -0,0 +1,89 @@
+// Concurrency stress benchmark for easyAuth.
+// Fills a database with N accounts (1M by default, or the first argument) and runs a server-like mix from 1 to 32
+// threads: 90% logins, 9% property reads and 1% property edits. Each step runs for a fixed time (1 second by default,
+// or the second argument) and prints the throughput, once with easyAuth's own striped locks and once with every call
+// wrapped in one global reader/writer lock, for comparison.
+// Throughput should grow with the thread count up to the number of cores, and the gap to the global lock should grow with it.
+#include "../../libs/easyAuth/easyAuth.hpp"
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+struct Workload {
+    std::vector<std::string> names;
+    std::vector<std::string> passwords;
+};
+
+// Runs the mix on `threads` threads for `seconds` and returns calls per second.
+double run(easyAuth& auth, const Workload& work, int threads, double seconds, std::shared_mutex* globalLock) {
+    std::atomic<bool> stop{false};
+    std::atomic<long long> total{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            long long calls = 0;
+            volatile long long sink = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::size_t i = rng() % work.names.size();
+                int kind = static_cast<int>(rng() % 100);
+                if (kind < 90) {
+                    std::shared_lock<std::shared_mutex> lock;
+                    if (globalLock)
+                        lock = std::shared_lock<std::shared_mutex>(*globalLock);
+                    sink += auth.checkCredentials(work.names[i], work.passwords[i]);
+                } else if (kind < 99) {
+                    std::shared_lock<std::shared_mutex> lock;
+                    if (globalLock)
+                        lock = std::shared_lock<std::shared_mutex>(*globalLock);
+                    sink += auth.getProperties(static_cast<int>(i)).size();
+                } else {
+                    std::unique_lock<std::shared_mutex> lock;
+                    if (globalLock)
+                        lock = std::unique_lock<std::shared_mutex>(*globalLock);
+                    auth.editProperty(static_cast<int>(i), 0, 0, (calls & 1) ? "PREMIUM" : "USER");
+                }
+                calls++;
+            }
+            total += calls;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &worker : workers)
+        worker.join();
+    return total / seconds;
+}
+
+int main(int argc, char** argv) {
+    long long accounts = argc > 1 ? std::atoll(argv[1]) : 1000000;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+
+    easyAuth auth;
+    auth.initialize(1);
+    auth.setPasswordHashCost(1); // so the logins measure the locks and the hashing pool, not the KDF itself
+    Workload work;
+    for (long long i = 0; i < accounts; i++) {
+        work.names.push_back("user" + std::to_string(i));
+        work.passwords.push_back("pass" + std::to_string(i));
+        auth.addCredentials(work.names.back(), work.passwords.back());
+        auth.addProperty(static_cast<int>(i), 0, "USER");
+    }
+
+    std::cout << accounts << " accounts, " << std::thread::hardware_concurrency() << " hardware threads\n";
+    std::cout << "threads   striped (calls/s)   speedup   global lock (calls/s)   speedup\n";
+
+    std::shared_mutex globalLock;
+    double baseStriped = 0, baseGlobal = 0;
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        double striped = run(auth, work, threads, seconds, nullptr);
+        double global = run(auth, work, threads, seconds, &globalLock);
+        if (threads == 1) {
+            baseStriped = striped;
+            baseGlobal = global;
+        }
+        std::printf("%-7d   %17.0f   %6.2fx   %21.0f   %6.2fx\n", threads, striped, striped / baseStriped, global, global / baseGlobal);
+    }
+
+    return 0;
+}
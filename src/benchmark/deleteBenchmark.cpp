@@ -0,0 +1,103 @@
+// Delete and compaction benchmark for easyAuth.
+// Fills a database with N accounts for N from 1k up to the max number of accounts (1M by default, or the first
+// argument), deletes a random 10% of them and adds as many new ones, which reuse the deleted slots. Then it compacts
+// and prints how long that took, how long writers were paused and the memory before and after.
+// Delete time should stay flat as N grows (it used to shift every account after the deleted one).
+// Last it compares the latency of property edits with and without a compaction running next to them.
+#include "../../libs/easyAuth/easyAuth.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+void fill(easyAuth& auth, long long accounts) {
+    auth.initialize(1);
+    auth.setPasswordHashCost(1); // the lowest cost, otherwise filling the database is all hashing
+    for (long long i = 0; i < accounts; i++) {
+        auth.addCredentials("user" + std::to_string(i), "pass" + std::to_string(i));
+        auth.addProperty(static_cast<int>(i), 0, (i % 10 == 0) ? "PREMIUM" : "USER");
+    }
+}
+
+// Edits properties of random accounts for `seconds` and returns the latencies in microseconds, sorted.
+std::vector<double> editLatencies(easyAuth& auth, long long accounts, double seconds) {
+    std::vector<double> latencies;
+    std::mt19937_64 rng(7);
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    while (std::chrono::steady_clock::now() < end) {
+        int accountNumber = static_cast<int>(rng() % accounts);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            auth.editProperty(accountNumber, 0, 0, (rng() & 1) ? "PREMIUM" : "USER");
+        } catch (const std::runtime_error&) { // deleted account
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    return sorted.empty() ? 0 : sorted[static_cast<std::size_t>(p * (sorted.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+    long long maxAccounts = argc > 1 ? std::atoll(argv[1]) : 1000000;
+
+    std::cout << "accounts    delete (ns)   re-add (ns)   garbage   compact (ms)   pause (ms)   memory before -> after (MB)\n";
+
+    for (long long accounts = 1000; accounts <= maxAccounts; accounts *= 10) {
+        easyAuth auth;
+        fill(auth, accounts);
+
+        std::vector<int> victims(accounts);
+        for (long long i = 0; i < accounts; i++)
+            victims[i] = static_cast<int>(i);
+        std::shuffle(victims.begin(), victims.end(), std::mt19937_64(42));
+        victims.resize(accounts / 10);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int accountNumber : victims)
+            auth.deleteCredentials(accountNumber);
+        double deleteTime = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / victims.size();
+
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < victims.size(); i++)
+            auth.addCredentials("new" + std::to_string(i), "pass" + std::to_string(i));
+        double addTime = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / victims.size();
+
+        // the deletes and re-adds left the old strings behind, edits leave more
+        double garbage = auth.getGarbageRatio();
+        CompactionStats stats = auth.compact();
+
+        std::printf("%-10lld  %11.1f   %11.1f   %6.1f%%   %12.2f   %10.3f   %8.1f -> %.1f\n", accounts, deleteTime, addTime, garbage * 100,
+                    stats.seconds * 1000, stats.pauseSeconds * 1000, stats.memoryBefore / 1048576.0, stats.memoryAfter / 1048576.0);
+    }
+
+    // writer latency with a compaction running on another thread
+    easyAuth auth;
+    fill(auth, maxAccounts);
+    for (long long i = 0; i < maxAccounts; i += 4)
+        auth.deleteCredentials(static_cast<int>(i));
+
+    std::vector<double> quiet = editLatencies(auth, maxAccounts, 1.0);
+    std::atomic<bool> compacting{true};
+    std::thread compactor([&] {
+        auth.compact();
+        compacting = false;
+    });
+    std::vector<double> busy;
+    while (compacting) {
+        std::vector<double> more = editLatencies(auth, maxAccounts, 0.05);
+        busy.insert(busy.end(), more.begin(), more.end());
+    }
+    compactor.join();
+    std::sort(busy.begin(), busy.end());
+
+    std::cout << "\nedit latency at " << maxAccounts << " accounts (us)   p50      p99      max\n";
+    std::printf("without compaction                 %7.2f  %7.2f  %7.1f\n", percentile(quiet, 0.5), percentile(quiet, 0.99), percentile(quiet, 1));
+    std::printf("during compaction                  %7.2f  %7.2f  %7.1f   (pause %.2f ms)\n", percentile(busy, 0.5), percentile(busy, 0.99),
+                percentile(busy, 1), auth.getLastCompaction().pauseSeconds * 1000);
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+// File format benchmark for easyAuth.
+// Compares the database file formats on the same accounts: the legacy one (saveLegacyDatabase(), a size_t before every
+// string), the mapped one saveDatabase() writes, and the compact one from saveCompactBackup() with and without block
+// compression. For each it prints the file size (and how it compares to the mapped file), how long saving and loading
+// took, and how long a pass reading every username took after the load. The mapped file loads almost instantly and
+// pays on that first pass instead, the others are parsed up front.
+// The first argument is the number of accounts to make up (1M by default) or a database file to compare on instead.
+#include "../../libs/easyAuth/easyAuth.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <random>
+
+const char* FILENAME = "formatBenchmark.db";
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::uint64_t fileSize(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    return file ? static_cast<std::uint64_t>(file.tellg()) : 0;
+}
+
+// Accounts that look like a real store: names with numbers, hashed passwords, mostly USER with some PREMIUM and
+// ADMIN, and 1% of them deleted.
+void fill(easyAuth& auth, long long accounts) {
+    const char* names[] = {"alex", "sam", "jordan", "taylor", "morgan", "casey", "riley", "jamie", "drew", "robin"};
+    std::mt19937_64 rng(42);
+    Database batch;
+    batch.resize(2, 1);
+    for (long long i = 0; i < accounts; i++) {
+        int accountNumber = batch.addAccount();
+        batch.setCredential(0, accountNumber, std::string(names[rng() % 10]) + "_" + std::to_string(i));
+        batch.setCredential(1, accountNumber, "pass" + std::to_string(rng() % 1000000));
+        batch.addProperty(0, accountNumber, "USER");
+        if (i % 10 == 0)
+            batch.addProperty(0, accountNumber, "PREMIUM");
+        if (i % 1000 == 0)
+            batch.addProperty(0, accountNumber, "ADMIN");
+    }
+    auth.setPasswordHashCost(1); // the records look the same at any cost, only making them is slower
+    auth.importAccounts(batch);
+    for (long long i = 0; i < accounts; i += 100)
+        auth.deleteCredentials(static_cast<int>(i));
+}
+
+int main(int argc, char** argv) {
+    std::string source = argc > 1 ? argv[1] : "";
+    easyAuth auth;
+    auth.initialize(1);
+    if (!source.empty() && std::ifstream(source)) {
+        if (!auth.loadDatabase(source)) {
+            std::cerr << "Could not load " << source << "\n";
+            return 1;
+        }
+        if (!auth.wasDecryptedOnLoad())
+            auth.decryptDatabase();
+    } else {
+        fill(auth, source.empty() ? 1000000 : std::atoll(source.c_str()));
+    }
+    std::cout << auth.getAccountCount() << " account slots, " << auth.getDeletedAccountCount() << " deleted\n";
+
+    struct Format {
+        const char* name;
+        std::function<void(const std::string&)> save;
+    };
+    std::vector<Format> formats = {
+        {"mapped", [&](const std::string& filename) { auth.saveDatabase(filename); }},
+        {"legacy", [&](const std::string& filename) { auth.saveLegacyDatabase(filename); }},
+        {"compact", [&](const std::string& filename) { auth.saveCompactBackup(filename, false, false); }},
+        {"compact+lz", [&](const std::string& filename) { auth.saveCompactBackup(filename); }},
+    };
+
+    std::cout << "format         size (MiB)   vs mapped   save (s)   load (s)   first pass (s)\n";
+    std::uint64_t mappedSize = 0;
+    for (const Format& format : formats) {
+        std::string filename = std::string(FILENAME) + "." + format.name;
+        auto start = std::chrono::steady_clock::now();
+        format.save(filename);
+        double saveSeconds = secondsSince(start);
+        std::uint64_t size = fileSize(filename);
+        if (std::string(format.name) == "mapped")
+            mappedSize = size;
+
+        easyAuth loaded;
+        loaded.initialize(1);
+        start = std::chrono::steady_clock::now();
+        if (!loaded.loadDatabase(filename) || loaded.getAccountCount() != auth.getAccountCount()) {
+            std::cerr << "Could not load " << filename << " back\n";
+            return 1;
+        }
+        double loadSeconds = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        std::size_t usernameBytes = 0;
+        for (std::size_t i = 0; i < loaded.getAccountCount(); i++) {
+            try {
+                usernameBytes += loaded.getUsername(static_cast<int>(i)).size();
+            } catch (const std::runtime_error&) {
+                // deleted
+            }
+        }
+        double passSeconds = secondsSince(start);
+        if (usernameBytes == 0)
+            std::cerr << "No usernames in " << filename << "\n";
+
+        std::string ratio = mappedSize > 0 ? std::to_string(static_cast<double>(size) / mappedSize).substr(0, 4) + "x" : "";
+        std::printf("%-12s   %10.1f   %9s   %8.3f   %8.3f   %14.3f\n", format.name, size / 1048576.0, ratio.c_str(), saveSeconds,
+                    loadSeconds, passSeconds);
+        std::remove(filename.c_str());
+    }
+    return 0;
+}
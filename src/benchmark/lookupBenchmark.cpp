@@ -0,0 +1,64 @@
+// Lookup benchmark for easyAuth.
+// Fills a database with N accounts and times getAccountNumberOfUser and checkCredentials for
+// hits and misses, for N from 1k up to the max number of accounts (10M by default, or the first argument).
+// Lookup time should stay flat as N grows. The misses are timed again with the username filter on (filtered).
+#include "../../libs/easyAuth/easyAuth.hpp"
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+const int LOOKUPS = 1000000;
+
+double timeLookups(easyAuth& auth, const std::vector<std::string>& names, const std::vector<std::string>& passwords, bool checkPassword) {
+    volatile long long sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const std::string& name = names[i % names.size()];
+        if (checkPassword) {
+            sink += auth.checkCredentials(name, passwords[i % passwords.size()]);
+        } else {
+            sink += auth.getAccountNumberOfUser(name);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / LOOKUPS;
+}
+
+int main(int argc, char** argv) {
+    long long maxAccounts = argc > 1 ? std::atoll(argv[1]) : 10000000;
+
+    std::cout << "accounts    lookup hit   lookup miss   filtered   login hit   login miss   filtered  (ns per call)\n";
+
+    for (long long accounts = 1000; accounts <= maxAccounts; accounts *= 10) {
+        easyAuth auth;
+        auth.initialize(1);
+        auth.setPasswordHashCost(1); // a login still goes through the hashing pool, but with a single PBKDF2 iteration
+        for (long long i = 0; i < accounts; i++) {
+            auth.addCredentials("user" + std::to_string(i), "pass" + std::to_string(i));
+        }
+
+        // random sample of existing users and of names that dont exist
+        std::mt19937_64 rng(42);
+        std::vector<std::string> hits, hitPasswords, misses, missPasswords;
+        for (int i = 0; i < 100000; i++) {
+            long long n = rng() % accounts;
+            hits.push_back("user" + std::to_string(n));
+            hitPasswords.push_back("pass" + std::to_string(n));
+            misses.push_back("nobody" + std::to_string(rng() % accounts));
+            missPasswords.push_back("wrong");
+        }
+
+        double lookupHit = timeLookups(auth, hits, hitPasswords, false);
+        double lookupMiss = timeLookups(auth, misses, missPasswords, false);
+        double loginHit = timeLookups(auth, hits, hitPasswords, true);
+        double loginMiss = timeLookups(auth, misses, missPasswords, true);
+        auth.enableUsernameFilter(true);
+        double filteredLookupMiss = timeLookups(auth, misses, missPasswords, false);
+        double filteredLoginMiss = timeLookups(auth, misses, missPasswords, true);
+
+        std::printf("%-10lld  %10.1f   %11.1f   %8.1f   %9.1f   %10.1f   %8.1f\n", accounts, lookupHit, lookupMiss,
+                    filteredLookupMiss, loginHit, loginMiss, filteredLoginMiss);
+    }
+
+    return 0;
+}
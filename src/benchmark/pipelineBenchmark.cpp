@@ -0,0 +1,158 @@
+// Pipelining benchmark for SimpleTCP.
+// Serves GET_PROPERTIES and LOGIN (with the password hash cost at 1, so it measures the round trips and not the KDF)
+// from a ShardedAuth of 10k accounts on loopback, like the server does, and measures requests/s from 1 and 4 client
+// connections for a fixed time each (1 second by default, or the first argument):
+//   plain:  the 512 byte messages, one request in flight per connection (what the server used before TAGGED)
+//   tagged: framed messages with request ids, one request in flight, then batches of 10, 100 and 1000 sent with
+//           sendRequests() before reading the answers
+//   async:  AsyncClient keeping 10, 100 and 1000 requests in flight, every answer's callback sends the next request
+// The batches should beat one in flight by about the cost of a round trip per request, more on a real network, and
+// async a bit more again: it doesnt wait for the slowest answer of a batch before sending the next one.
+#include "../../libs/easyAuth/shardedAuth.hpp"
+#include "../../libs/simpleTCP/simpleTCP.hpp"
+#include <chrono>
+#include <cstdlib>
+
+const unsigned short PLAIN_PORT = 27030;
+const unsigned short TAGGED_PORT = 27031;
+const int ACCOUNTS = 10000;
+
+std::string handle(ShardedAuth& auth, const std::string& request) {
+    if (request.compare(0, 15, "GET_PROPERTIES ") == 0) {
+        int accountNumber = auth.resolveSession(request.substr(15));
+        if (accountNumber < 0)
+            return "INVALID_SESSION";
+        std::string properties;
+        for (const auto &values : auth.getProperties(accountNumber)) {
+            for (const auto &value : values) {
+                properties += value;
+                properties += "|";
+            }
+        }
+        return properties;
+    }
+    if (request.compare(0, 6, "LOGIN ") == 0) {
+        std::size_t separator = request.find('|');
+        std::string token = auth.login(request.substr(6, separator - 6), request.substr(separator + 1));
+        return token.empty() ? "USERNAME_OR_PASSWORD_INVALID" : "LOGIN_SUCCESS " + token;
+    }
+    return "INVALID_REQUEST";
+}
+
+// `connections` clients send requests (batch at a time, 1 = one in flight) for `seconds`, returns requests per second.
+double run(SimpleTCP::Protocol protocol, const std::vector<std::string>& requests, int connections, std::size_t batch, double seconds) {
+    std::atomic<bool> stop{false};
+    std::atomic<long long> total{0};
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; c++) {
+        clients.emplace_back([&, c] {
+            SimpleTCP::Client client;
+            if (!client.connectToServer("127.0.0.1", protocol == SimpleTCP::PLAIN ? PLAIN_PORT : TAGGED_PORT, protocol))
+                return;
+            std::size_t next = static_cast<std::size_t>(c) * 7919;
+            std::vector<std::string> sending(batch);
+            long long done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (auto &request : sending)
+                    request = requests[next++ % requests.size()];
+                if (batch == 1) {
+                    if (client.sendRequest(sending[0]).empty())
+                        break;
+                } else if (client.sendRequests(sending).back().empty()) {
+                    break;
+                }
+                done += static_cast<long long>(batch);
+            }
+            total += done;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &client : clients)
+        client.join();
+    return total / seconds;
+}
+
+// Like run(), with AsyncClient callbacks keeping `inFlight` requests going on each connection.
+double runAsync(const std::vector<std::string>& requests, int connections, std::size_t inFlight, double seconds) {
+    std::atomic<bool> stop{false};
+    std::atomic<long long> total{0};
+    std::atomic<std::size_t> next{0};
+    std::vector<std::unique_ptr<SimpleTCP::AsyncClient>> clients;
+    std::vector<SimpleTCP::AsyncClient::Callback> callbacks(connections);
+    for (int c = 0; c < connections; c++) {
+        clients.emplace_back(new SimpleTCP::AsyncClient());
+        if (!clients.back()->connectToServer("127.0.0.1", TAGGED_PORT))
+            return 0;
+        SimpleTCP::AsyncClient& client = *clients.back();
+        SimpleTCP::AsyncClient::Callback& callback = callbacks[c];
+        callback = [&](const std::string& response) {
+            if (response.empty())
+                return; // closed
+            total.fetch_add(1, std::memory_order_relaxed);
+            if (!stop.load(std::memory_order_relaxed))
+                client.sendRequestAsync(requests[next++ % requests.size()], callback);
+        };
+    }
+    auto started = std::chrono::steady_clock::now();
+    for (int c = 0; c < connections; c++) {
+        for (std::size_t i = 0; i < inFlight; i++)
+            clients[c]->sendRequestAsync(requests[next++ % requests.size()], callbacks[c]);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &client : clients)
+        client->close();
+    return total / std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+
+    ShardedAuth auth;
+    auth.initialize(1);
+    auth.setPasswordHashCost(1);
+    std::vector<std::string> propertyRequests, loginRequests;
+    for (int i = 0; i < ACCOUNTS; i++) {
+        std::string username = "user" + std::to_string(i), password = "pass" + std::to_string(i);
+        auth.addCredentials(username, password);
+        int accountNumber = auth.getAccountNumberOfUser(username);
+        auth.addProperty(accountNumber, 0, "USER");
+        propertyRequests.push_back("GET_PROPERTIES " + auth.createSession(accountNumber));
+        loginRequests.push_back("LOGIN " + username + "|" + password);
+    }
+
+    SimpleTCP::Server plainServer, taggedServer;
+    auto handler = [&auth](const std::string& request) { return handle(auth, request); };
+    if (!plainServer.start(PLAIN_PORT, handler, "127.0.0.1") || !taggedServer.start(TAGGED_PORT, handler, "127.0.0.1", SimpleTCP::TAGGED))
+        return 1;
+
+    std::cout << ACCOUNTS << " accounts, " << std::thread::hardware_concurrency() << " hardware threads\n";
+    std::cout << "connections   protocol   in flight   GET_PROPERTIES (req/s)   speedup   LOGIN (req/s)   speedup\n";
+    for (int connections : {1, 4}) {
+        double baseProperties = 0, baseLogins = 0;
+        struct Mode {
+            SimpleTCP::Protocol protocol;
+            std::size_t batch;
+        };
+        for (Mode mode : {Mode{SimpleTCP::PLAIN, 1}, Mode{SimpleTCP::TAGGED, 1}, Mode{SimpleTCP::TAGGED, 10},
+                          Mode{SimpleTCP::TAGGED, 100}, Mode{SimpleTCP::TAGGED, 1000}}) {
+            double properties = run(mode.protocol, propertyRequests, connections, mode.batch, seconds);
+            double logins = run(mode.protocol, loginRequests, connections, mode.batch, seconds);
+            if (mode.protocol == SimpleTCP::PLAIN) {
+                baseProperties = properties;
+                baseLogins = logins;
+            }
+            std::printf("%-11d   %-8s   %9zu   %22.0f   %6.2fx   %13.0f   %6.2fx\n", connections,
+                        mode.protocol == SimpleTCP::PLAIN ? "plain" : "tagged", mode.batch, properties,
+                        properties / baseProperties, logins, logins / baseLogins);
+        }
+        for (std::size_t inFlight : {10, 100, 1000}) {
+            double properties = runAsync(propertyRequests, connections, inFlight, seconds);
+            double logins = runAsync(loginRequests, connections, inFlight, seconds);
+            std::printf("%-11d   %-8s   %9zu   %22.0f   %6.2fx   %13.0f   %6.2fx\n", connections, "async", inFlight,
+                        properties, properties / baseProperties, logins, logins / baseLogins);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Schema benchmark for easyAuth.
+// Fills a plain easyAuth and a TypedAuth (typedAuth.hpp) with the same N accounts (1M by default, or the first
+// argument) and compares their role checks, from 1 to 16 threads, for a fixed time each (1 second by default, or the
+// second argument):
+//   role check    hasProperty(account, 0, "PREMIUM")  vs  hasKnownProperty(account, 0, premium)  on the easyAuth,
+//                 and has<ROLE, PREMIUM>(account) on the TypedAuth
+//   login + role  login() and a role check on the new session's account, like the server's BUY_PREMIUM after a LOGIN
+// A registered value (registerValue(), which any easyAuth has) should be about twice as fast as the dynamic check since
+// it skips hashing the value and the shared dictionary lock. The typed check only skips the range checks on top.
+// The logins are hashed at the lowest cost and still hide the difference, with a real cost both columns are the hash.
+#include "../../libs/easyAuth/typedAuth.hpp"
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+struct ShopSchema {
+    enum Property : std::size_t { ROLE };
+    static constexpr std::size_t kPropertyTypes = 1;
+    enum Value : std::size_t { USER, PREMIUM, ADMIN };
+    static constexpr const char* kValues[] = {"USER", "PREMIUM", "ADMIN"};
+};
+
+typedef TypedAuth<ShopSchema> ShopAuth;
+
+// Runs call(accountNumber) for random accounts on `threads` threads for `seconds` and returns calls per second.
+template <typename F>
+double run(int threads, double seconds, long long accounts, F call) {
+    std::atomic<bool> stop{false};
+    std::atomic<long long> total{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            long long calls = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                call(static_cast<int>(rng() % accounts));
+                calls++;
+            }
+            total += calls;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &worker : workers)
+        worker.join();
+    return total / seconds;
+}
+
+int main(int argc, char** argv) {
+    long long accounts = argc > 1 ? std::atoll(argv[1]) : 1000000;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+
+    easyAuth auth;
+    auth.initialize(1);
+    auth.setPasswordHashCost(1);
+    const KnownValue premiumValue = auth.registerValue("PREMIUM");
+    ShopAuth typed;
+    typed.setPasswordHashCost(1);
+    {
+        Database batch;
+        batch.resize(2, 1);
+        for (long long i = 0; i < accounts; i++) {
+            int accountNumber = batch.addAccount();
+            batch.setCredential(0, accountNumber, "user" + std::to_string(i));
+            batch.setCredential(1, accountNumber, "pass" + std::to_string(i));
+            batch.addProperty(0, accountNumber, "USER");
+            if (i % 10 == 0)
+                batch.addProperty(0, accountNumber, "PREMIUM");
+            if (i % 1000 == 0)
+                batch.addProperty(0, accountNumber, "ADMIN");
+        }
+        auth.importAccounts(batch);
+        typed.importAccounts(batch);
+    }
+    std::vector<std::string> names, passwords;
+    for (long long i = 0; i < accounts; i++) {
+        names.push_back("user" + std::to_string(i));
+        passwords.push_back("pass" + std::to_string(i));
+    }
+    std::atomic<long long> premium{0};
+
+    std::cout << accounts << " accounts, " << seconds << " s a step\n";
+    std::cout << "threads   role checks/s dynamic   registered      typed   speedup   logins+role/s dynamic      typed\n";
+    for (int threads : {1, 2, 4, 8, 16}) {
+        double dynamicRole = run(threads, seconds, accounts, [&](int i) {
+            premium += auth.hasProperty(i, 0, "PREMIUM");
+        });
+        double registeredRole = run(threads, seconds, accounts, [&](int i) {
+            premium += auth.hasKnownProperty(i, 0, premiumValue);
+        });
+        double typedRole = run(threads, seconds, accounts, [&](int i) {
+            premium += typed.has<ShopSchema::ROLE, ShopSchema::PREMIUM>(i);
+        });
+        double dynamicLogin = run(threads, seconds, accounts, [&](int i) {
+            std::string token = auth.login(names[i], passwords[i]);
+            premium += auth.hasProperty(auth.resolveSession(token), 0, "PREMIUM");
+            auth.endSession(token);
+        });
+        double typedLogin = run(threads, seconds, accounts, [&](int i) {
+            std::string token = typed.login(names[i], passwords[i]);
+            premium += typed.has<ShopSchema::ROLE, ShopSchema::PREMIUM>(typed.resolveSession(token));
+            typed.endSession(token);
+        });
+        std::printf("%7d   %21.0f   %10.0f   %8.0f   %6.2fx   %21.0f   %8.0f\n", threads, dynamicRole, registeredRole, typedRole,
+                    typedRole / dynamicRole, dynamicLogin, typedLogin);
+    }
+    if (premium == 0)
+        std::cerr << "no premium accounts found\n";
+    return 0;
+}
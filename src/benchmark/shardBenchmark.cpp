@@ -0,0 +1,82 @@
+// Shard benchmark for ShardedAuth.
+// For 1, 2, 4 and 8 shards: imports N accounts (1M by default, or the first argument), saves them, loads them again
+// into a new ShardedAuth, and adds more accounts from 8 threads at once. Loading and saving run a thread per shard and
+// writers of different shards dont share any lock, so all of them should get faster with more shards, up to the
+// number of cores.
+#include "../../libs/easyAuth/shardedAuth.hpp"
+#include <chrono>
+#include <cstdlib>
+
+const char* FILENAME = "shardBenchmark.db";
+const int WRITER_THREADS = 8;
+const int ADDS_PER_THREAD = 20000;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void removeFiles(ShardedAuth& auth) {
+    for (std::size_t i = 0; i < auth.getShardCount(); i++) {
+        std::remove(auth.shardFilename(FILENAME, i).c_str());
+        std::remove((auth.shardFilename(FILENAME, i) + ".journal").c_str());
+    }
+}
+
+int main(int argc, char** argv) {
+    long long accounts = argc > 1 ? std::atoll(argv[1]) : 1000000;
+
+    Database batch;
+    batch.resize(2, 1);
+    for (long long i = 0; i < accounts; i++) {
+        int accountNumber = batch.addAccount();
+        batch.setCredential(0, accountNumber, "user" + std::to_string(i));
+        batch.setCredential(1, accountNumber, "pass" + std::to_string(i));
+        batch.addProperty(0, accountNumber, "USER");
+    }
+
+    std::cout << accounts << " accounts, " << std::thread::hardware_concurrency() << " hardware threads\n";
+    std::cout << "shards   import (s)   save (s)   load (s)   adds from " << WRITER_THREADS << " threads (adds/s)\n";
+
+    for (std::size_t shards = 1; shards <= 8; shards *= 2) {
+        double importSeconds, saveSeconds, loadSeconds, addsPerSecond;
+        {
+            ShardedAuth auth(shards);
+            auth.initialize(1);
+            auth.setPasswordHashCost(1); // time the storage, not the KDF
+            auto start = std::chrono::steady_clock::now();
+            auth.importAccounts(batch);
+            importSeconds = secondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            auth.saveDatabase(FILENAME);
+            saveSeconds = secondsSince(start);
+        }
+
+        ShardedAuth auth(shards);
+        auth.initialize(1);
+        auth.setPasswordHashCost(1);
+        auto start = std::chrono::steady_clock::now();
+        if (!auth.loadDatabase(FILENAME)) {
+            std::cerr << "Could not load " << FILENAME << "\n";
+            return 1;
+        }
+        loadSeconds = secondsSince(start);
+
+        std::vector<std::thread> writers;
+        start = std::chrono::steady_clock::now();
+        for (int t = 0; t < WRITER_THREADS; t++) {
+            writers.emplace_back([&auth, t] {
+                for (int i = 0; i < ADDS_PER_THREAD; i++)
+                    auth.addCredentials("new" + std::to_string(t) + "_" + std::to_string(i), "pass");
+            });
+        }
+        for (auto &writer : writers)
+            writer.join();
+        addsPerSecond = WRITER_THREADS * ADDS_PER_THREAD / secondsSince(start);
+
+        std::printf("%-6zu   %10.3f   %8.3f   %8.3f   %12.0f\n", shards, importSeconds, saveSeconds, loadSeconds, addsPerSecond);
+        removeFiles(auth);
+    }
+
+    return 0;
+}
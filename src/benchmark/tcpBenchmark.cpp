@@ -0,0 +1,234 @@
+// Connection scaling benchmark for SimpleTCP::Server.
+// Starts an echo-like server on loopback and, for 100, 1k, 10k and 50k clients (or the counts given after the first
+// argument), connects them all and runs two phases of a fixed time each (2 seconds by default, or the first argument):
+//   idle:   100 of the clients send requests back to back while the rest stay connected and quiet
+//   active: every client sends a request, waits for the answer and sends the next one
+// It prints the connect time, requests/s and p99 latency of both phases, and the memory and threads of the process
+// (Linux only), which holds the server and the clients. Build it with -DSimpleTCP_THREADS to compare the thread per
+// connection backend with the epoll one.
+// Every connection takes two descriptors here (both ends), so 50k clients need a ulimit -n of about 100k. The soft
+// limit is raised to the hard one, and the run stops at the first count that cant be connected.
+#include "../../libs/simpleTCP/simpleTCP.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+typedef WSAPOLLFD PollSocket;
+inline int pollSockets(PollSocket* sockets, std::size_t count, int timeoutMs) {
+    return WSAPoll(sockets, static_cast<ULONG>(count), timeoutMs);
+}
+#else
+#include <poll.h>
+#include <sys/resource.h>
+typedef pollfd PollSocket;
+inline int pollSockets(PollSocket* sockets, std::size_t count, int timeoutMs) {
+    return poll(sockets, static_cast<nfds_t>(count), timeoutMs);
+}
+#endif
+
+using namespace SimpleTCP;
+
+const unsigned short kPort = 27016;
+const std::size_t kIdleSenders = 100;
+const std::size_t kClientsPerAddress = 20000; // loopback has ~28k ephemeral ports per source address
+
+struct PhaseResult {
+    double requestsPerSecond = 0;
+    double p99Micros = 0;
+    std::size_t failed = 0; // clients whose connection broke
+};
+
+// VmRSS (kB) and Threads of this process, -1 where /proc isnt there.
+void processStatus(long& rssKb, long& threads) {
+    rssKb = threads = -1;
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            rssKb = std::atol(line.c_str() + 6);
+        else if (line.compare(0, 8, "Threads:") == 0)
+            threads = std::atol(line.c_str() + 8);
+    }
+}
+
+void raiseDescriptorLimit() {
+#ifndef _WIN32
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+// Opens `count` blocking connections to the server. Stops at the first one that fails.
+std::vector<SOCKET> connectClients(std::size_t count) {
+    std::vector<SOCKET> clients;
+    clients.reserve(count);
+    sockaddr_in server{};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(kPort);
+    inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+    for (std::size_t i = 0; i < count; i++) {
+        SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (client == INVALID_SOCKET) {
+            std::cerr << "socket failed after " << i << " clients: " << WSAGetLastError() << std::endl;
+            break;
+        }
+        // the port is picked at connect() (where it only has to be unique for the pair of addresses), not at bind(),
+        // and ports still in TIME_WAIT from an earlier count can be taken again
+        int on = 1;
+        setsockopt(client, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+#ifdef IP_BIND_ADDRESS_NO_PORT
+        setsockopt(client, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on));
+#endif
+        sockaddr_in source{};
+        source.sin_family = AF_INET;
+        source.sin_addr.s_addr = htonl(0x7F000001 + static_cast<std::uint32_t>(i / kClientsPerAddress));
+        if (bind(client, reinterpret_cast<sockaddr*>(&source), sizeof(source)) == SOCKET_ERROR ||
+            connect(client, reinterpret_cast<sockaddr*>(&server), sizeof(server)) == SOCKET_ERROR) {
+            std::cerr << "connect failed after " << i << " clients: " << WSAGetLastError() << std::endl;
+            closesocket(client);
+            break;
+        }
+        clients.push_back(client);
+    }
+    return clients;
+}
+
+// Waits until the server counts `count` connections, false if it doesnt get there.
+bool waitForConnections(const Server& server, std::size_t count) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (server.connectionCount() != count) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+// The first `senders` clients send a request, wait for its answer and send the next one, for `seconds`.
+PhaseResult runPhase(const std::vector<SOCKET>& clients, std::size_t senders, double seconds) {
+    typedef std::chrono::steady_clock Clock;
+    const char request[] = "PING";
+    std::vector<PollSocket> waiting(senders);
+    std::vector<Clock::time_point> sentAt(senders);
+    std::vector<std::uint32_t> latencies;
+    PhaseResult result;
+
+    Clock::time_point start = Clock::now();
+    std::size_t pending = 0;
+    for (std::size_t i = 0; i < senders; i++) {
+        waiting[i].fd = clients[i];
+        waiting[i].events = POLLIN;
+        waiting[i].revents = 0;
+        sentAt[i] = Clock::now();
+        if (send(clients[i], request, 4, SEND_FLAGS) == 4) {
+            pending++;
+        } else {
+            waiting[i].fd = INVALID_SOCKET; // poll() skips it
+            result.failed++;
+        }
+    }
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    // after the end the answers still on their way are waited for, but no new requests go out
+    while (pending > 0) {
+        int ready = pollSockets(waiting.data(), waiting.size(), 1000);
+        if (ready <= 0) {
+            if (Clock::now() > end + std::chrono::seconds(5)) {
+                result.failed += pending;
+                break;
+            }
+            continue;
+        }
+        Clock::time_point now = Clock::now();
+        bool sending = now < end;
+        for (std::size_t i = 0; i < senders && ready > 0; i++) {
+            if (waiting[i].revents == 0)
+                continue;
+            ready--;
+            waiting[i].revents = 0;
+            char answer[512];
+            int received = recv(clients[i], answer, sizeof(answer), 0);
+            if (received <= 0) {
+                waiting[i].fd = INVALID_SOCKET;
+                pending--;
+                result.failed++;
+                continue;
+            }
+            latencies.push_back(static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - sentAt[i]).count()));
+            if (!sending || send(clients[i], request, 4, SEND_FLAGS) != 4) {
+                waiting[i].fd = INVALID_SOCKET;
+                pending--;
+                continue;
+            }
+            sentAt[i] = now;
+        }
+    }
+    double took = std::chrono::duration<double>(Clock::now() - start).count();
+    result.requestsPerSecond = latencies.size() / took;
+    if (!latencies.empty()) {
+        std::size_t rank = latencies.size() * 99 / 100;
+        std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+        result.p99Micros = latencies[rank];
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+    std::vector<std::size_t> counts;
+    for (int i = 2; i < argc; i++)
+        counts.push_back(static_cast<std::size_t>(std::atoll(argv[i])));
+    if (counts.empty())
+        counts = {100, 1000, 10000, 50000};
+
+    raiseDescriptorLimit();
+    Server server;
+    bool started = server.start(kPort, [](const std::string& request) {
+        return request == "PING" ? std::string("PONG") : request;
+    }, "127.0.0.1");
+    if (!started)
+        return 1;
+
+#ifdef SimpleTCP_EPOLL
+    std::cout << "backend: epoll event loops\n";
+#else
+    std::cout << "backend: thread per connection\n";
+#endif
+    long baseRss, baseThreads;
+    processStatus(baseRss, baseThreads);
+
+    std::cout << "clients   connect (ms)   RSS (MiB)   KiB/conn   threads   idle (req/s)   idle p99 (us)   active (req/s)   active p99 (us)\n";
+    for (std::size_t count : counts) {
+        auto connecting = std::chrono::steady_clock::now();
+        std::vector<SOCKET> clients = connectClients(count);
+        bool connected = clients.size() == count && waitForConnections(server, count);
+        double connectMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - connecting).count();
+
+        if (connected) {
+            long rss, threads;
+            processStatus(rss, threads);
+            PhaseResult idle = runPhase(clients, (std::min)(kIdleSenders, count), seconds);
+            PhaseResult active = runPhase(clients, count, seconds);
+            std::printf("%-7zu   %12.0f   %9.1f   %8.1f   %7ld   %12.0f   %13.0f   %14.0f   %15.0f\n", count, connectMs,
+                        rss / 1024.0, (rss - baseRss) / static_cast<double>(count), threads, idle.requestsPerSecond,
+                        idle.p99Micros, active.requestsPerSecond, active.p99Micros);
+            if (idle.failed + active.failed > 0)
+                std::printf("          %zu requests failed\n", idle.failed + active.failed);
+        } else {
+            std::printf("%-7zu   only %zu clients connected (%zu on the server side), stopping here\n", count,
+                        clients.size(), server.connectionCount());
+        }
+
+        for (SOCKET client : clients)
+            closesocket(client);
+        if (!connected || !waitForConnections(server, 0))
+            break;
+    }
+    server.stop();
+    return 0;
+}
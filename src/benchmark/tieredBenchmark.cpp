@@ -0,0 +1,85 @@
+// Tiered storage benchmark for easyAuth.
+// Saves N accounts (1M by default, or the first argument) and loads them again with no budget and with shrinking
+// memory budgets. For each it reports how long the load took, the string bytes in memory after it, and the login
+// rate for a working set of WORKING_SET accounts: the first pass reads them from the page file, the second one from
+// memory after they were brought back. Memory should follow the budget (or the working set if that is bigger)
+// instead of the number of accounts, while warm logins stay as fast as without a budget.
+#include "../../libs/easyAuth/easyAuth.hpp"
+#include <chrono>
+#include <cstdlib>
+
+const char* FILENAME = "tieredBenchmark.db";
+const int WORKING_SET = 20000;
+const int LOGIN_THREADS = 4;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Logs every account of the working set in once, split over LOGIN_THREADS. Returns logins per second.
+double loginPass(easyAuth& auth, long long accounts) {
+    std::vector<std::thread> threads;
+    std::atomic<int> failed{0};
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < LOGIN_THREADS; t++) {
+        threads.emplace_back([&auth, &failed, accounts, t] {
+            for (int i = t; i < WORKING_SET; i += LOGIN_THREADS) {
+                long long user = (static_cast<long long>(i) * 7919) % accounts; // spread over the whole file
+                if (!auth.checkCredentials("user" + std::to_string(user), "pass" + std::to_string(user)))
+                    failed++;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    if (failed > 0)
+        std::cerr << failed << " logins failed\n";
+    return WORKING_SET / secondsSince(start);
+}
+
+int main(int argc, char** argv) {
+    long long accounts = argc > 1 ? std::atoll(argv[1]) : 1000000;
+    {
+        Database batch;
+        batch.resize(2, 1);
+        for (long long i = 0; i < accounts; i++) {
+            int accountNumber = batch.addAccount();
+            batch.setCredential(0, accountNumber, "user" + std::to_string(i));
+            batch.setCredential(1, accountNumber, "pass" + std::to_string(i));
+            batch.addProperty(0, accountNumber, "USER");
+        }
+        easyAuth auth;
+        auth.initialize(1);
+        auth.importAccounts(batch);
+        auth.saveDatabase(FILENAME);
+    }
+
+    std::cout << accounts << " accounts, working set of " << WORKING_SET << "\n";
+    std::cout << "budget (MiB)   load (s)   in memory after load (MiB)   cold logins/s   warm logins/s   in memory after (MiB)\n";
+    for (std::size_t budgetMiB : {std::size_t(0), std::size_t(64), std::size_t(16), std::size_t(4)}) {
+        easyAuth auth;
+        auth.initialize(1);
+        auth.setPasswordHashCost(1); // time the storage, not the KDF
+        if (budgetMiB > 0)
+            auth.enableTieredStorage(std::string(FILENAME) + ".pages", budgetMiB << 20);
+        auto start = std::chrono::steady_clock::now();
+        if (!auth.loadDatabase(FILENAME)) {
+            std::cerr << "Could not load " << FILENAME << "\n";
+            return 1;
+        }
+        double loadSeconds = secondsSince(start);
+        // without a budget these are the strings of the mapped file
+        std::size_t loadedBytes = auth.getTieredStorageStats().residentBytes;
+
+        double cold = loginPass(auth, accounts);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500)); // lets the tiering thread bring them back
+        double warm = loginPass(auth, accounts);
+        std::size_t afterBytes = auth.getTieredStorageStats().residentBytes;
+
+        std::string budget = budgetMiB > 0 ? std::to_string(budgetMiB) : "off";
+        std::printf("%-12s   %8.3f   %26.1f   %13.0f   %13.0f   %21.1f\n", budget.c_str(), loadSeconds, loadedBytes / 1048576.0, cold, warm,
+                    afterBytes / 1048576.0);
+    }
+    std::remove(FILENAME);
+    return 0;
+}
@@ -0,0 +1,418 @@
+// Bulk account importer for easyAuth.
+// Usage: importer <input file> [database file, database.db by default] [password hash cost] [--shards <count>]
+// Reads accounts from a CSV file, or from newline delimited JSON if the file ends in .ndjson / .jsonl / .json,
+// adds them to the database with ShardedAuth::importAccounts() and saves every shard file (encrypted, like the server
+// does on exit).
+// Run it while the server is stopped, the server keeps the database files open.
+// An existing database keeps the number of shards it was saved with (ShardedAuth::kDefaultShards for a new one),
+// --shards moves it to another count, like the server's option.
+//
+// CSV:    username,password,property 0,property 1,...   one account per line, an optional header line starting with
+//         "username" is skipped. Fields can be quoted ("a ""b"", c"). A property field holds that property type's
+//         values separated by '|', an empty field means no values.
+// NDJSON: {"username": "...", "password": "...", "properties": [["USER"], "value", ...]}   one object per line,
+//         "properties" is optional and holds one entry (a string or a list of strings) per property type.
+// Accounts without a property 0 value get "USER", like REGISTER on the server.
+// Plaintext passwords are hashed on every core (PasswordHash::kDefaultIterations by default, which takes a while
+// for millions of accounts), passwords that are "$pbkdf2-sha256$..." records already are imported as they are.
+#include "../../libs/easyAuth/shardedAuth.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+const std::string DEFAULT_ROLE = "USER";
+
+// One parsed line: credentials and the values of each property type.
+struct Record {
+    std::string username;
+    std::string password;
+    std::vector<std::vector<std::string>> properties;
+};
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::vector<std::string> splitValues(const std::string& field) {
+    std::vector<std::string> values;
+    if (field.empty())
+        return values;
+    std::size_t start = 0;
+    while (true) {
+        std::size_t end = field.find('|', start);
+        values.push_back(field.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos)
+            break;
+        start = end + 1;
+    }
+    return values;
+}
+
+// Splits one CSV line into fields, handling quotes. Returns false if a quote is not closed.
+bool parseCsvLine(std::string_view line, std::vector<std::string>& fields) {
+    fields.clear();
+    std::string field;
+    std::size_t i = 0;
+    while (true) {
+        field.clear();
+        if (i < line.size() && line[i] == '"') {
+            i++;
+            while (true) {
+                if (i >= line.size())
+                    return false;
+                if (line[i] == '"') {
+                    if (i + 1 < line.size() && line[i + 1] == '"') {
+                        field += '"';
+                        i += 2;
+                        continue;
+                    }
+                    i++;
+                    break;
+                }
+                field += line[i++];
+            }
+        }
+        while (i < line.size() && line[i] != ',')
+            field += line[i++];
+        fields.push_back(field);
+        if (i >= line.size())
+            return true;
+        i++; // skip the comma
+    }
+}
+
+bool parseCsvRecord(std::string_view line, Record& record) {
+    static std::vector<std::string> fields;
+    if (!parseCsvLine(line, fields) || fields.size() < 2)
+        return false;
+    record.username = fields[0];
+    record.password = fields[1];
+    record.properties.clear();
+    for (std::size_t i = 2; i < fields.size(); i++)
+        record.properties.push_back(splitValues(fields[i]));
+    return true;
+}
+
+// Just enough JSON for one flat object per line.
+class JsonLine {
+ public:
+    explicit JsonLine(std::string_view text) : text(text) {}
+
+    bool parseRecord(Record& record) {
+        record = Record();
+        if (!consume('{'))
+            return false;
+        if (consume('}'))
+            return atEnd();
+        do {
+            std::string key;
+            if (!parseString(key) || !consume(':'))
+                return false;
+            if (key == "username") {
+                if (!parseString(record.username))
+                    return false;
+            } else if (key == "password") {
+                if (!parseString(record.password))
+                    return false;
+            } else if (key == "properties") {
+                if (!parseProperties(record.properties))
+                    return false;
+            } else if (!skipValue()) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}') && atEnd();
+    }
+
+ private:
+    std::string_view text;
+    std::size_t pos = 0;
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r'))
+            pos++;
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos < text.size() && text[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c) {
+        skipSpace();
+        return pos < text.size() && text[pos] == c;
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return pos == text.size();
+    }
+
+    static void appendUtf8(std::string& out, std::uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool parseHex4(std::uint32_t& code) {
+        if (pos + 4 > text.size())
+            return false;
+        code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text[pos++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool parseString(std::string& out) {
+        out.clear();
+        if (!consume('"'))
+            return false;
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"')
+                return true;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size())
+                return false;
+            switch (text[pos++]) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    std::uint32_t code;
+                    if (!parseHex4(code))
+                        return false;
+                    // surrogate pair
+                    if (code >= 0xD800 && code < 0xDC00 && pos + 1 < text.size() && text[pos] == '\\' && text[pos + 1] == 'u') {
+                        pos += 2;
+                        std::uint32_t low;
+                        if (!parseHex4(low))
+                            return false;
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    // [ "a", ["b", "c"], [] ]
+    bool parseProperties(std::vector<std::vector<std::string>>& properties) {
+        if (!consume('['))
+            return false;
+        if (consume(']'))
+            return true;
+        do {
+            properties.emplace_back();
+            std::vector<std::string>& values = properties.back();
+            if (peek('"')) {
+                values.emplace_back();
+                if (!parseString(values.back()))
+                    return false;
+                continue;
+            }
+            if (!consume('['))
+                return false;
+            if (consume(']'))
+                continue;
+            do {
+                values.emplace_back();
+                if (!parseString(values.back()))
+                    return false;
+            } while (consume(','));
+            if (!consume(']'))
+                return false;
+        } while (consume(','));
+        return consume(']');
+    }
+
+    // Skips a value of a key we dont use.
+    bool skipValue() {
+        skipSpace();
+        if (pos >= text.size())
+            return false;
+        char c = text[pos];
+        if (c == '"') {
+            std::string ignored;
+            return parseString(ignored);
+        }
+        if (c == '[' || c == '{') {
+            char close = c == '[' ? ']' : '}';
+            pos++;
+            if (consume(close))
+                return true;
+            do {
+                if (c == '{') {
+                    std::string key;
+                    if (!parseString(key) || !consume(':'))
+                        return false;
+                }
+                if (!skipValue())
+                    return false;
+            } while (consume(','));
+            return consume(close);
+        }
+        // number, true, false or null
+        std::size_t start = pos;
+        while (pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']' && text[pos] != ' ')
+            pos++;
+        return pos > start;
+    }
+};
+
+bool readFile(const std::string& filename, std::string& contents) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    std::streamsize size = file.tellg();
+    file.seekg(0);
+    contents.resize(static_cast<std::size_t>(size));
+    return static_cast<bool>(file.read(&contents[0], size));
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args;
+    std::size_t shards = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--shards" && i + 1 < argc) {
+            shards = static_cast<std::size_t>(std::atoll(argv[++i]));
+            if (shards == 0 || shards > ShardedAuth::kMaxShards) {
+                std::cerr << "--shards takes 1 to " << ShardedAuth::kMaxShards << "\n";
+                return 1;
+            }
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.empty()) {
+        std::cerr << "Usage: importer <input.csv | input.ndjson> [database file] [password hash cost] [--shards <count>]\n";
+        return 1;
+    }
+    std::string inputFilename = args[0];
+    std::string databaseFilename = args.size() > 1 ? args[1] : "database.db";
+    bool json = endsWith(inputFilename, ".ndjson") || endsWith(inputFilename, ".jsonl") || endsWith(inputFilename, ".json");
+
+    auto started = std::chrono::steady_clock::now();
+    std::string input;
+    if (!readFile(inputFilename, input)) {
+        std::cerr << "Could not read " << inputFilename << "\n";
+        return 1;
+    }
+
+    // open the database the same way the server does, in as many shards
+    if (shards == 0)
+        shards = ShardedAuth::savedShardCount(databaseFilename);
+    ShardedAuth auth(shards);
+    auth.initialize(1); // same as the server: 1 property type, the level of the account
+    if (auth.loadDatabase(databaseFilename)) {
+        if (!auth.wasDecryptedOnLoad())
+            auth.decryptDatabase();
+    } else if (auth.migrateDatabase(databaseFilename)) {
+        std::cout << "Moved " << databaseFilename << " into " << auth.getShardCount() << " shards\n";
+    } else {
+        std::cout << "No database at " << databaseFilename << ", creating a new one\n";
+    }
+    // Fold whatever the journal has on top of the file into it, so the imported accounts dont have to be journaled:
+    // if the import is cut short the old file and the empty journal are still consistent.
+    std::uint64_t versionBefore = auth.getVersion();
+    if (!auth.openJournal(databaseFilename)) {
+        std::cerr << "Could not open the journals of " << databaseFilename << "\n";
+        return 1;
+    }
+    if (auth.getVersion() != versionBefore)
+        auth.saveDatabase(databaseFilename, true);
+    auth.closeJournal();
+
+    std::size_t propertyTypes = auth.getPropertyTypeCount();
+    Database batch;
+    batch.resize(2, propertyTypes);
+
+    std::size_t lineNumber = 0;
+    std::size_t badLines = 0;
+    Record record;
+    std::size_t start = 0;
+    while (start < input.size()) {
+        std::size_t end = input.find('\n', start);
+        if (end == std::string::npos)
+            end = input.size();
+        std::string_view line(input.data() + start, end - start);
+        start = end + 1;
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        if (line.empty())
+            continue;
+
+        bool parsed = json ? JsonLine(line).parseRecord(record) : parseCsvRecord(line, record);
+        if (!json && lineNumber == 1 && parsed && record.username == "username")
+            continue; // header
+        if (!parsed || record.properties.size() > propertyTypes) {
+            if (badLines < 10)
+                std::cerr << "Line " << lineNumber << ": " << (parsed ? "too many properties" : "cant parse") << "\n";
+            badLines++;
+            continue;
+        }
+        record.properties.resize(propertyTypes);
+        if (propertyTypes > 0 && record.properties[0].empty())
+            record.properties[0].push_back(DEFAULT_ROLE);
+
+        int accountNumber = batch.addAccount();
+        batch.setCredential(0, accountNumber, record.username);
+        batch.setCredential(1, accountNumber, record.password);
+        for (std::size_t p = 0; p < propertyTypes; p++) {
+            for (const auto &value : record.properties[p])
+                batch.addProperty(p, accountNumber, value);
+        }
+    }
+    input = std::string();
+    double parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    if (args.size() > 2)
+        auth.setPasswordHashCost(static_cast<std::uint32_t>(std::strtoul(args[2].c_str(), nullptr, 10)));
+    ImportStats stats = auth.importAccounts(batch);
+    batch.clear();
+
+    auto saveStarted = std::chrono::steady_clock::now();
+    auth.saveDatabase(databaseFilename, true);
+    double saveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - saveStarted).count();
+
+    std::cout << stats.added << " accounts added, " << stats.duplicates << " duplicates skipped, "
+              << stats.invalid + badLines << " invalid lines skipped\n";
+    std::cout << "read " << parseSeconds << " s, import " << stats.seconds << " s (hashing " << stats.hashSeconds << " s), save " << saveSeconds << " s, "
+              << auth.getActiveAccountCount() << " accounts in " << databaseFilename << "\n";
+    return 0;
+}
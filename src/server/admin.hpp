@@ -1,25 +1,70 @@
 #include "../../include/includes.h"
 
-void viewDatabase(easyAuth& auth) { // function to view user credentials and properties in database
-    Database users = auth.getAllUsers();
+void viewDatabase(ShardedAuth& auth) { // function to view user credentials and properties in database
+    // a snapshot shares the database instead of copying it, so this doesnt copy every string or block the server.
+    // one per shard, the numbers shown are the global ones the other options take
+    std::vector<std::shared_ptr<const DatabaseSnapshot>> snapshots = auth.getSnapshots();
     std::cout << "\nUSERS IN DATABASE:\n";
-    std::cout << "(Max number of SET properties: " << users.properties.size() << ")\n\n"; // Log size of properties
-    for (int i = 0; i < users.credentials[0].size(); i++) {
-        std::cout << i << ". Username: " << users.credentials[0][i] << "\n" << i << ". Password: " << users.credentials[1][i] << "\n";
+    std::cout << "(Max number of SET properties: " << auth.getPropertyTypeCount() << ")\n\n"; // Log size of properties
+    for (std::size_t s = 0; s < snapshots.size(); s++) {
+        const Database& users = snapshots[s]->data;
+        for (int local = 0; local < users.accountCount(); local++) {
+            if (users.isDeleted(local)) { // deleted accounts keep their number until a new account reuses it
+                continue;
+            }
+            int i = auth.globalAccountNumber(s, local);
+            std::cout << i << ". Username: " << users.credential(0, local) << "\n" << i << ". Password hash: " << users.credential(1, local) << "\n";
 
-        if (!users.properties[0][i].empty()) { // only show properties if the account has them
-            std::cout << "Properties for user " << i << ":\n";
-            for (int j = 0; j < users.properties[0][i].size(); j++) {
-                std::cout << "  - Property " << j + 1 << ": " << users.properties[0][i][j] << "\n";
+            if (users.propertyTypes() > 0 && users.propertyCount(0, local) > 0) { // only show properties if the account has them
+                std::cout << "Properties for user " << i << ":\n";
+                for (int j = 0; j < users.propertyCount(0, local); j++) {
+                    std::cout << "  - Property " << j + 1 << ": " << users.property(0, local, j) << "\n";
+                }
+                std::cout << "\n";
+            } else {
+                std::cout << "No properties found for user " << i << "\n\n";
             }
-            std::cout << "\n";
-        } else {
-            std::cout << "No properties found for user " << i << "\n\n";
         }
     }
 }
 
-void adminPanel(easyAuth& auth) {
+void viewStats(ShardedAuth& auth) { // function to show what the database holds and how it is used
+    AuthStats stats = auth.getStats();
+    const MemoryStats& memory = stats.memory;
+    auto mib = [](std::size_t bytes) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f MiB", bytes / 1048576.0);
+        return std::string(text);
+    };
+
+    std::cout << "\nSTATS:\n";
+    std::cout << "Accounts: " << stats.accounts << " (" << stats.tombstones << " deleted slots, " << stats.coldAccounts << " cold)\n";
+    std::cout << "Sessions: " << stats.sessions << "\n\n";
+
+    std::cout << "Memory: " << mib(memory.total()) << "\n";
+    std::cout << "  strings:         " << mib(memory.strings) << " (" << mib(memory.garbage) << " garbage)\n";
+    std::cout << "  credentials:     " << mib(memory.credentials) << "\n";
+    std::cout << "  properties:      " << mib(memory.properties) << "\n";
+    std::cout << "  dictionary:      " << mib(memory.dictionary) << "\n";
+    std::cout << "  deleted slots:   " << mib(memory.tombstones) << "\n";
+    std::cout << "  username index:  " << mib(memory.usernameIndex) << "\n";
+    std::cout << "  property index:  " << mib(memory.valueIndex) << "\n";
+    std::cout << "  sessions:        " << mib(memory.sessions) << "\n";
+    std::cout << "  replication log: " << mib(memory.replicationLog) << "\n";
+    std::cout << "  tiering:         " << mib(memory.tiering) << "\n\n";
+
+    // latencies of the fast operations come from a sample of the calls, see operationStats.hpp
+    std::printf("%-14s %12s %12s %12s %12s %12s\n", "operation", "calls", "avg (us)", "p50 (us)", "p99 (us)", "max (us)");
+    for (std::size_t i = 0; i < OperationStats::kOperations; i++) {
+        const OperationTotals& op = stats.operations[i];
+        std::printf("%-14s %12llu %12.2f %12.2f %12.2f %12.2f\n", OperationStats::name(static_cast<OperationStats::Operation>(i)),
+                    static_cast<unsigned long long>(op.calls), op.averageMicros(), op.percentileMicros(0.5),
+                    op.percentileMicros(0.99), op.maxMicros());
+    }
+    std::cout << "\n";
+}
+
+void adminPanel(ShardedAuth& auth) {
     while (true) {
         std::cout << "---ADMIN PANEL---\n";
         std::cout << "\nOptions: \n\n";
@@ -33,7 +78,11 @@ void adminPanel(easyAuth& auth) {
         std::cout << "-PROPERTIES\n";
         std::cout << "5. Add properties\n";
         std::cout << "6. Edit properties\n";
-        std::cout << "7. Delete properties\n\n";
+        std::cout << "7. Delete properties\n";
+        std::cout << "8. Find users by property\n\n";
+
+        std::cout << "-DATABASE\n";
+        std::cout << "9. View stats\n\n";
 
         std::cout << "0. Exit\n\n";
 
@@ -90,13 +139,21 @@ void adminPanel(easyAuth& auth) {
             std::cout << "Enter account number: ";
             std::cin >> accountNumber;
 
+            if (!auth.accountExists(accountNumber)) {
+                std::cout << "Account number not found!\n";
+                continue;
+            }
+
             std::cout << "Enter new username: ";
             std::cin >> username;
 
             std::cout << "Enter new password: ";
             std::cin >> password;
 
-            auth.editCredentials(accountNumber, username, password);
+            int newAccountNumber = auth.editCredentials(accountNumber, username, password);
+            if (newAccountNumber != accountNumber) { // the new username belongs to another shard
+                std::cout << "Account moved to number " << newAccountNumber << "\n";
+            }
         }
 
         else if (choice == 3) { // delete user
@@ -104,6 +161,10 @@ void adminPanel(easyAuth& auth) {
             int accountNumber;
             std::cout << "Enter account number: ";
             std::cin >> accountNumber;
+            if (!auth.accountExists(accountNumber)) {
+                std::cout << "Account number not found!\n";
+                continue;
+            }
             auth.deleteCredentials(accountNumber);
         }
 
@@ -117,7 +178,7 @@ void adminPanel(easyAuth& auth) {
             std::cout << "Enter account number of user to add properties to: ";
             std::cin >> accountNumber;
 
-            if (accountNumber >= auth.getAllUsers().credentials[0].size()) {
+            if (!auth.accountExists(accountNumber)) { // a deleted number, or a gap between the shards
                 std::cout << "Account number not found!\n";
                 continue;
             }
@@ -147,7 +208,7 @@ void adminPanel(easyAuth& auth) {
             std::cout << "Enter account number of user to edit properties from: ";
             std::cin >> accountNumber;
 
-            if (accountNumber >= auth.getAllUsers().credentials[0].size()) {
+            if (!auth.accountExists(accountNumber)) { // a deleted number, or a gap between the shards
                 std::cout << "Account number not found!\n";
                 continue;
             }
@@ -158,7 +219,7 @@ void adminPanel(easyAuth& auth) {
 
             propertyNumber--;
 
-            if (propertyNumber >= auth.getAllUsers().properties[accountNumber].size()) {
+            if (propertyNumber >= auth.getPropertyCount(accountNumber, 0)) {
                 std::cout << "Property number not found!\n";
                 continue;
             }
@@ -181,7 +242,7 @@ void adminPanel(easyAuth& auth) {
             std::cout << "Enter account number of user to remove properties from: ";
             std::cin >> accountNumber;
 
-            if (accountNumber >= auth.getAllUsers().credentials[0].size()) {
+            if (!auth.accountExists(accountNumber)) { // a deleted number, or a gap between the shards
                 std::cout << "Account number not found!\n";
                 continue;
             }
@@ -190,12 +251,12 @@ void adminPanel(easyAuth& auth) {
             std::cout << "Enter property number to remove: ";
             std::cin >> propertyNumber;
 
-            if (propertyNumber >= auth.getAllUsers().properties.size()) {
+            if (propertyNumber >= auth.getPropertyTypeCount()) {
                 std::cout << "Property number not found!\n";
                 continue;
             }
 
-            if (propertyNumber >= auth.getAllUsers().properties[propertyNumber].size()) {
+            if (propertyNumber >= auth.getAccountCount()) {
                 std::cout << "Property number not found!\n";
                 continue;
             }
@@ -203,6 +264,31 @@ void adminPanel(easyAuth& auth) {
             auth.deleteProperty(accountNumber, auth.getPropertyIndexFromPropertyNumber(accountNumber, propertyNumber), propertyNumber);
         }
 
+        else if (choice == 8) { // find users by property, answered from the property index instead of walking every user
+            std::string property, excluded;
+            std::cout << "Enter property (e.g. PREMIUM): ";
+            std::cin >> property;
+            std::cout << "Enter property they must NOT have (- for none): ";
+            std::cin >> excluded;
+
+            AccountSet found = excluded == "-" ? auth.getAccountsWithProperty(0, property)
+                                               : auth.findAccounts(0, {property}, {excluded});
+            std::cout << found.size() << " users found\n";
+            std::size_t shown = 0;
+            for (std::uint32_t accountNumber : found) {
+                if (shown++ == 100) {
+                    std::cout << "  ...\n";
+                    break;
+                }
+                std::cout << "  " << accountNumber << ". " << auth.getUsername(accountNumber) << "\n";
+            }
+            std::cout << "\n";
+        }
+
+        else if (choice == 9) { // view stats
+            viewStats(auth);
+        }
+
         else if (choice == 0) { // exit
             break;
         }
@@ -1,281 +1,586 @@
-#include "../../include/includes.h"
-#include "admin.hpp"
-#include <string>
-
-#define USE_PORT_FROM_FILE false // if true, make sure to put a port in the port.txt file
-#define PORT 5816 // set this to the port you want to use IF you're not using the port from a file
-#define HOST_IP_ADDRESS "127.0.0.1" // set this to the IP address you want to use
-
-bool has_prefix(const std::string& s, const std::string& prefix) { // function to check if a string has a prefix
-    if (s.length() < prefix.length()) {
-        return false;
-    }
-    return s.substr(0, prefix.length()) == prefix;
-}
-
-void initServer(SimpleTCP::Server& server, easyAuth& auth, std::ofstream& logfile) {
-    int port;
-    if (USE_PORT_FROM_FILE) {
-        std::ifstream ifs("../src/port/port.txt");
-
-        if (!ifs.is_open()) {
-            std::cerr << "Could not open file at port.txt\n";
-            throw std::runtime_error("Failed to open port.txt");
-        }
-
-        if (!(ifs >> port)) {
-            std::cerr << "Failed to read an integer from port.txt\n";
-            throw std::runtime_error("Failed to extract port from file");
-        }
-    } else {
-        port = PORT;
-    }
-
-    std::cout << "Server started on port: " << port << "\n";
-
-    if (!server.start(port, [&auth, &logfile] (std::string request) -> std::string {
-        logfile << "Received request: " << request << "\n";
-        if (has_prefix(request, "LOGIN ")) {
-            // Remove the "LOGIN " prefix (which is 6 characters)
-            std::string credentials = request.substr(6);
-
-            // Find the position of the '|' separator
-            size_t separatorPos = credentials.find("|");
-
-            if (separatorPos != std::string::npos) {
-                // Extract the username (from start up to the separator)
-                std::string username = credentials.substr(0, separatorPos);
-                // Extract the password (from just after the separator to the end)
-                std::string password = credentials.substr(separatorPos + 1);
-
-                // Now username and password contain only the desired parts.
-
-                if (auth.checkCredentials(username, password)) {
-                    logfile << "Login successful: " << username << " " + password << "\n\n";
-                    return "LOGIN_SUCCESS";
-                } else {
-                    logfile << "Username or password invalid: " << username << " " + password << "\n\n";
-                    return "USERNAME_OR_PASSWORD_INVALID";
-                }
-            } else { // if separator not found
-                logfile << "Invalid request format" << "\n\n";
-                return "INVALID_REQUEST_FORMAT";
-            }
-        }
-
-        if (has_prefix(request, "REGISTER ")) {
-            // Remove the "REGISTER " prefix (which is 9 characters)
-            std::string credentials = request.substr(9);
-
-            // Find the position of the '|' separator
-            size_t separatorPos = credentials.find("|");
-
-            if (separatorPos != std::string::npos) {
-                // Extract the username (from start up to the separator)
-                std::string username = credentials.substr(0, separatorPos);
-                // Extract the password (from just after the separator to the end)
-                std::string password = credentials.substr(separatorPos + 1);
-                
-                if (!auth.checkCredentials(username, password)) {
-                    auth.addCredentials(username, password);
-                    auth.addProperty(auth.getAccountNumberOfUser(username), 0, "USER");
-                    logfile << "Account registered: " << username << " " + password << "\n\n";
-                    return "REGISTER_SUCCESS";
-                } else {
-                    logfile << "Account already exists: " << username << " " + password << "\n\n";
-                    return "ACCOUNT_ALREADY_EXISTS";
-                }
-            } else { // if separator not found
-                logfile << "Invalid request format" << "\n\n";
-                return "INVALID_REQUEST_FORMAT";
-            }
-        }
-
-        if (has_prefix(request, "GET_PROPERTIES ")) {
-            // properties request is "GET_PROPERTIES " + username
-            // Remove the "GET_PROPERTIES " prefix (which is 15 characters)
-            std::string username = request.substr(15);
-
-            // get the properties of the user
-            std::vector<std::vector<std::string>> properties = auth.getProperties(auth.getAccountNumberOfUser(username));
-
-            if (properties.empty()) {
-                logfile << "No properties found for user: " << username << "\n\n";
-                return "NO_PROPERTIES_FOUND";
-            }
-
-            // return the properties
-            std::string propertiesString;
-            for (const auto& propVector : properties) {
-                for (const auto& prop : propVector) {
-                    propertiesString += prop + "|";
-                }
-            }
-            if (!propertiesString.empty()) {
-                propertiesString.pop_back(); // remove the trailing '|'
-            }
-            logfile << "Properties returned: " << propertiesString << "\n\n";
-            return propertiesString;
-        }
-
-        if (has_prefix(request, "RESET_PASSWORD ")) {
-            // reset password request is "RESET_PASSWORD " + username + "|" + new password
-            // Remove the "RESET_PASSWORD " prefix (which is 15 characters)
-            std::string credentials = request.substr(15);
-
-            // find the position of the '|' separator
-            size_t separatorPos = credentials.find("|");
-
-            if (separatorPos != std::string::npos) {
-                // Extract the username (from start up to the separator)
-                std::string username = credentials.substr(0, separatorPos);
-                // Extract the password (from just after the separator to the end)
-                std::string newPassword = credentials.substr(separatorPos + 1);
-
-                std::string password = auth.getPassword(auth.getAccountNumberOfUser(username));
-
-                if (auth.checkCredentials(username, password)) {
-                    auth.editCredentials(auth.getAccountNumberOfUser(username), username, newPassword);
-                    logfile << "Password reset for user: " << username << "\n\n";
-                    return "PASSWORD_RESET_SUCCESS";
-                } else {
-                    logfile << "Invalid credentials" << "\n\n";
-                    return "INVALID_CREDENTIALS";
-                }
-            } else {
-                logfile << "Invalid request format" << "\n\n";
-                return "INVALID_REQUEST_FORMAT";
-            }
-        }
-
-        if (has_prefix(request, "BUY_PREMIUM ")) {
-            // buy premium request is "BUY_PREMIUM " + username
-            // Remove the "BUY_PREMIUM " prefix (which is 12 characters)
-            std::string username = request.substr(12);
-
-            if (auth.doesAccountHaveProperty(auth.getAccountNumberOfUser(username), "PREMIUM")) {
-                logfile << "User already has premium: " << username << "\n\n";
-                return "USER_ALREADY_HAS_PREMIUM";
-            }
-
-            auth.editProperty(auth.getAccountNumberOfUser(username), 0, 0, "PREMIUM");
-            logfile << "Premium purchased for user: " << username << "\n\n";
-            return "PREMIUM_PURCHASED";
-        }
-
-        logfile << "Invalid request: " << request << "\n\n";
-        return "INVALID_REQUEST"; // if request is not valid
-    }, HOST_IP_ADDRESS)) {
-        std::cerr << "Failed to start server." << std::endl;
-        return;
-    }
-}
-
-void initDatabase(easyAuth& auth, std::string filename) {
-    if (!auth.loadDatabase(filename)) { // cant load database
-        return;
-    }
-    auth.decryptDatabase();
-}
-
-void closeDatabase(easyAuth& auth, std::string filename) {
-    auth.encryptDatabase();
-    auth.saveDatabase(filename);
-}
-
-int main() {
-    int choice;
-    bool running = false;
-    bool stopped = false;
-
-    easyAuth auth; // create object
-    SimpleTCP::Server server;
-
-    std::ofstream logfile("log.txt", std::ios::app);
-
-    logfile << "\n\n-----NEW SESSION-----\n";
-
-    while (true) {
-        std::cout << "---SERVER---\n";
-        std::cout << "RUNNING: "; if (running) std::cout << "true\n"; else std::cout << "false\n";
-        std::cout << "STOPPED: "; if (stopped) std::cout << "true\n"; else std::cout << "false\n";
-        std::cout << "0. Init, start, and goto admin panel\n1. Init and start server\n2. Admin panel\n3. Stop server\n4. Save database and exit\n5. Force exit\nEnter your choice: ";
-        std::cin >> choice;
-        std::cout << "\n";
-
-        if (choice == 0) {
-            if (!running) {
-                std::cout << "1. Initializing database..\n";
-                auth.initialize(1); // init with 1 special property for each user, being the level of the account
-                std::cout << "initialized\n";
-                initDatabase(auth, "database.db");
-                std::cout << "Database initialized..\n";
-
-                // setup server
-                std::cout << "2. Starting server..\n";
-                initServer(server, auth, logfile);
-                std::cout << "Server started. Waiting for connections\n\n";
-                running = true;
-
-                adminPanel(auth);
-            }
-        }
-
-        if (choice == 1) { // init and start server
-            if (!running) {
-                std::cout << "1. Initializing database..\n";
-                auth.initialize(1); // init with 1 special property for each user, being the level of the account
-                std::cout << "initialized\n";
-                initDatabase(auth, "database.db");
-                std::cout << "Database initialized..\n";
-
-                // setup server
-                std::cout << "2. Starting server..\n";
-                initServer(server, auth, logfile);
-                std::cout << "Server started. Waiting for connections\n\n";
-                running = true;
-            }
-        }
-
-        if (choice == 2) { // admin panel
-            adminPanel(auth);
-        }
-
-        if (choice == 3) { // stop server
-            std::cout << "Are you sure you want to stop the server? (y/n): ";
-            std::string confirm;
-            std::cin >> confirm;
-
-            if (confirm != "y") {
-                std::cout << "Cancelled\n";
-                continue;
-            }
-
-            server.stop();
-            running = false;
-            stopped = true;
-        }
-
-        if (choice == 4) { // save and exit
-            if (stopped && !running) {
-                std::cout << "3. Saving database..\n";
-                closeDatabase(auth, "database.db");
-                logfile.close();
-                std::cout << "Database saved. Exiting..\n";
-                std::cin.clear();
-                std::cin.get();
-                return 0;
-            }
-        }
-
-        if (choice == 5) { // force exit
-            server.stop();
-            logfile.close();
-            std::cin.clear();
-            std::cin.get();
-            return 0;
-        }
-    }
-
-    return 0;
+#include "../../include/includes.h"
+#include "admin.hpp"
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#define USE_PORT_FROM_FILE false // if true, make sure to put a port in the port.txt file
+#define PORT 5816 // set this to the port you want to use IF you're not using the port from a file
+#define HOST_IP_ADDRESS "127.0.0.1" // set this to the IP address you want to use
+#define REPLICATION_PORT 5817 // replicas pull from this port (framed SimpleTCP), see --replica-of below
+
+bool has_prefix(const std::string& s, const std::string& prefix) { // function to check if a string has a prefix
+    if (s.length() < prefix.length()) {
+        return false;
+    }
+    return s.substr(0, prefix.length()) == prefix;
+}
+
+// log.txt. The server's worker threads and the hashing threads that answer logins write to it at the same time, so
+// every write goes in whole under the lock.
+class ServerLog {
+ public:
+    explicit ServerLog(const std::string& filename) : file(filename, std::ios::app) {}
+
+    template <class... Parts>
+    void write(const Parts&... parts) {
+        std::ostringstream text;
+        (text << ... << parts);
+        std::lock_guard<std::mutex> lock(mutex);
+        file << text.str();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        file.close();
+    }
+
+ private:
+    std::mutex mutex;
+    std::ofstream file;
+};
+
+// port 0 = from port.txt or PORT
+void initServer(SimpleTCP::Server& server, ShardedAuth& auth, ServerLog& logfile, int port = 0) {
+    if (port != 0) {
+        // given on the command line
+    } else if (USE_PORT_FROM_FILE) {
+        std::ifstream ifs("../src/port/port.txt");
+
+        if (!ifs.is_open()) {
+            std::cerr << "Could not open file at port.txt\n";
+            throw std::runtime_error("Failed to open port.txt");
+        }
+
+        if (!(ifs >> port)) {
+            std::cerr << "Failed to read an integer from port.txt\n";
+            throw std::runtime_error("Failed to extract port from file");
+        }
+    } else {
+        port = PORT;
+    }
+
+    std::cout << "Server started on port: " << port << "\n";
+
+    // BUY_PREMIUM checks it on every request, registered it skips the dictionary
+    const KnownValue premium = auth.registerValue("PREMIUM");
+
+    // every request but LOGIN, REGISTER and RESET_PASSWORD is answered right away, on a worker thread of the server
+    auto handleRequest = [&auth, &logfile, premium] (const std::string& request) -> std::string {
+        if (has_prefix(request, "GET_PROPERTIES ")) {
+            // properties request is "GET_PROPERTIES " + session token
+            // Remove the "GET_PROPERTIES " prefix (which is 15 characters)
+            int accountNumber = auth.resolveSession(request.substr(15));
+            if (accountNumber < 0) {
+                logfile.write("Invalid session", "\n\n");
+                return "INVALID_SESSION";
+            }
+            std::string username(auth.getUsername(accountNumber));
+
+            // get the properties of the user
+            std::vector<std::vector<std::string>> properties = auth.getProperties(accountNumber);
+
+            if (properties.empty()) {
+                logfile.write("No properties found for user: ", username, "\n\n");
+                return "NO_PROPERTIES_FOUND";
+            }
+
+            // return the properties
+            std::string propertiesString;
+            for (const auto& propVector : properties) {
+                for (const auto& prop : propVector) {
+                    propertiesString += prop;
+                    propertiesString += "|";
+                }
+            }
+            if (!propertiesString.empty()) {
+                propertiesString.pop_back(); // remove the trailing '|'
+            }
+            logfile.write("Properties returned: ", propertiesString, "\n\n");
+            return propertiesString;
+        }
+
+        if (has_prefix(request, "BUY_PREMIUM ")) {
+            // buy premium request is "BUY_PREMIUM " + session token
+            // Remove the "BUY_PREMIUM " prefix (which is 12 characters)
+            int accountNumber = auth.resolveSession(request.substr(12));
+            if (accountNumber < 0) {
+                logfile.write("Invalid session", "\n\n");
+                return "INVALID_SESSION";
+            }
+            std::string username(auth.getUsername(accountNumber));
+
+            if (auth.hasKnownProperty(accountNumber, 0, premium)) {
+                logfile.write("User already has premium: ", username, "\n\n");
+                return "USER_ALREADY_HAS_PREMIUM";
+            }
+
+            auth.editProperty(accountNumber, 0, 0, "PREMIUM");
+            logfile.write("Premium purchased for user: ", username, "\n\n");
+            return "PREMIUM_PURCHASED";
+        }
+
+        if (has_prefix(request, "LOGOUT ")) {
+            // logout request is "LOGOUT " + session token
+            // Remove the "LOGOUT " prefix (which is 7 characters)
+            if (!auth.endSession(request.substr(7))) {
+                logfile.write("Invalid session", "\n\n");
+                return "INVALID_SESSION";
+            }
+            logfile.write("Logged out", "\n\n");
+            return "LOGGED_OUT";
+        }
+
+        logfile.write("Invalid request: ", request, "\n\n");
+        return "INVALID_REQUEST"; // if request is not valid
+    };
+
+    // REGISTER hashes the password on the hashing pool like LOGIN, the account is added and answered from there
+    auto handleRegister = [&auth, &logfile] (const std::string& request, SimpleTCP::Server::Reply reply) {
+        // Remove the "REGISTER " prefix (which is 9 characters)
+        std::string credentials = request.substr(9);
+
+        // Find the position of the '|' separator
+        size_t separatorPos = credentials.find("|");
+
+        if (separatorPos == std::string::npos) { // if separator not found
+            logfile.write("Invalid request format", "\n\n");
+            reply("INVALID_REQUEST_FORMAT");
+            return;
+        }
+        // Extract the username (from start up to the separator)
+        std::string username = credentials.substr(0, separatorPos);
+        // Extract the password (from just after the separator to the end)
+        std::string password = credentials.substr(separatorPos + 1);
+
+        try {
+            auth.addCredentials(username, password, [&auth, &logfile, username, reply] (int accountNumber) {
+                if (accountNumber < 0) { // taken while it was hashed, or the write failed
+                    if (auth.getAccountNumberOfUser(username) >= 0) {
+                        logfile.write("Account already exists: ", username, "\n\n");
+                        reply("ACCOUNT_ALREADY_EXISTS");
+                    } else {
+                        logfile.write("Server busy, register turned away: ", username, "\n\n");
+                        reply("SERVER_BUSY");
+                    }
+                    return;
+                }
+                auth.addProperty(accountNumber, 0, "USER");
+                logfile.write("Account registered: ", username, "\n\n");
+                reply("REGISTER_SUCCESS " + auth.createSession(accountNumber));
+            });
+        } catch (const std::runtime_error&) { // taken already (found before hashing), or the hashing queue is full
+            if (auth.getAccountNumberOfUser(username) >= 0) {
+                logfile.write("Account already exists: ", username, "\n\n");
+                reply("ACCOUNT_ALREADY_EXISTS");
+                return;
+            }
+            logfile.write("Server busy, register turned away: ", username, "\n\n");
+            reply("SERVER_BUSY");
+        }
+    };
+
+    // RESET_PASSWORD hashes the new password on the hashing pool too
+    auto handleResetPassword = [&auth, &logfile] (const std::string& request, SimpleTCP::Server::Reply reply) {
+        // reset password request is "RESET_PASSWORD " + session token + "|" + new password
+        // Remove the "RESET_PASSWORD " prefix (which is 15 characters)
+        std::string credentials = request.substr(15);
+
+        // find the position of the '|' separator
+        size_t separatorPos = credentials.find("|");
+
+        if (separatorPos == std::string::npos) {
+            logfile.write("Invalid request format", "\n\n");
+            reply("INVALID_REQUEST_FORMAT");
+            return;
+        }
+        // Extract the token (from start up to the separator)
+        std::string token = credentials.substr(0, separatorPos);
+        // Extract the password (from just after the separator to the end)
+        std::string newPassword = credentials.substr(separatorPos + 1);
+
+        int accountNumber = auth.resolveSession(token);
+        if (accountNumber < 0) {
+            logfile.write("Invalid session", "\n\n");
+            reply("INVALID_SESSION");
+            return;
+        }
+        std::string username(auth.getUsername(accountNumber));
+        try {
+            // same username, so the account stays in its shard and keeps its number
+            auth.editCredentials(accountNumber, username, newPassword, [&auth, &logfile, username, reply] (int edited) {
+                if (edited < 0) { // deleted while it was hashed
+                    logfile.write("Invalid session", "\n\n");
+                    reply("INVALID_SESSION");
+                    return;
+                }
+                // changing the password ends every session of the account, this one included
+                logfile.write("Password reset for user: ", username, "\n\n");
+                reply("PASSWORD_RESET_SUCCESS " + auth.createSession(edited));
+            });
+        } catch (const std::runtime_error&) { // hashing queue full
+            logfile.write("Server busy, password reset turned away: ", username, "\n\n");
+            reply("SERVER_BUSY");
+        }
+    };
+
+    if (!server.start(port, [&auth, &logfile, handleRequest, handleRegister, handleResetPassword] (const std::string& request, SimpleTCP::Server::Reply reply) {
+        // only the command goes in the log, the rest is a password or a session token
+        logfile.write("Received request: ", request.substr(0, request.find(' ')), "\n");
+        if (auth.isReadOnly() && (has_prefix(request, "REGISTER ") || has_prefix(request, "RESET_PASSWORD ") || has_prefix(request, "BUY_PREMIUM "))) {
+            // a replica only changes with its primary
+            logfile.write("Write refused on a replica", "\n\n");
+            reply("READ_ONLY_REPLICA");
+            return;
+        }
+
+        if (has_prefix(request, "REGISTER ")) {
+            handleRegister(request, reply);
+            return;
+        }
+        if (has_prefix(request, "RESET_PASSWORD ")) {
+            handleResetPassword(request, reply);
+            return;
+        }
+        if (!has_prefix(request, "LOGIN ")) {
+            reply(handleRequest(request));
+            return;
+        }
+        // Remove the "LOGIN " prefix (which is 6 characters)
+        std::string credentials = request.substr(6);
+
+        // Find the position of the '|' separator
+        size_t separatorPos = credentials.find("|");
+
+        if (separatorPos == std::string::npos) { // if separator not found
+            logfile.write("Invalid request format", "\n\n");
+            reply("INVALID_REQUEST_FORMAT");
+            return;
+        }
+        // Extract the username (from start up to the separator)
+        std::string username = credentials.substr(0, separatorPos);
+        // Extract the password (from just after the separator to the end)
+        std::string password = credentials.substr(separatorPos + 1);
+
+        // Now username and password contain only the desired parts.
+
+        try {
+            // hashed on the hashing pool, which answers when it is done. The worker moves on meanwhile, so every
+            // login waiting for a hash sits in the pool's queue and a full queue turns the next ones away
+            auth.loginAsync(username, password, [&logfile, username, reply] (const std::string& token) {
+                if (!token.empty()) {
+                    // the client sends the token with every request from now on instead of the username
+                    logfile.write("Login successful: ", username, "\n\n");
+                    reply("LOGIN_SUCCESS " + token);
+                } else {
+                    logfile.write("Username or password invalid: ", username, "\n\n");
+                    reply("USERNAME_OR_PASSWORD_INVALID");
+                }
+            });
+        } catch (const std::runtime_error&) { // too many logins waiting to be hashed
+            logfile.write("Server busy, login turned away: ", username, "\n\n");
+            reply("SERVER_BUSY");
+        }
+    }, HOST_IP_ADDRESS, SimpleTCP::TAGGED)) { // framed with request ids, a client can send many before the answers
+        std::cerr << "Failed to start server." << std::endl;
+        return;
+    }
+}
+
+void initDatabase(ShardedAuth& auth, std::string filename) {
+    // on before loading so the filter saved in the file is used. REGISTER already tells anyone whether a name is
+    // taken, so answering unknown usernames early gives nothing away
+    auth.enableUsernameFilter(true);
+    // every shard loads its own file on its own thread
+    if (auth.loadDatabase(filename)) {
+        if (!auth.wasDecryptedOnLoad())
+            auth.decryptDatabase();
+    } else if (auth.migrateDatabase(filename)) {
+        // a database from before the shards (or saved with another number of them), now saved as shard files too
+        std::cout << "Moved " << filename << " into " << auth.getShardCount() << " shards\n";
+    }
+    // replay whatever happened after the last save, then keep logging every change so nothing is lost on a crash
+    if (!auth.openJournal(filename)) {
+        std::cerr << "Could not open the journals of " << filename << "\n";
+    }
+    // frees what deleted accounts and edits leave behind once it adds up, without stopping the server
+    auth.startCompactor();
+}
+
+void closeDatabase(ShardedAuth& auth, std::string filename) {
+    auth.saveDatabase(filename, true);
+}
+
+// Lets replicas follow this server: keeps the newest journal records in memory and serves them and snapshots.
+void initReplication(SimpleTCP::Server& replicationServer, ShardedAuth& auth, ReplicationSource& source, int port) {
+    try {
+        auth.startReplicationLog();
+    } catch (const std::runtime_error& e) { // no journal
+        std::cerr << "Replication is off: " << e.what() << "\n";
+        return;
+    }
+    if (!replicationServer.start(port, [&source] (const std::string& request) { return source.handle(request); }, HOST_IP_ADDRESS, true)) {
+        std::cerr << "Failed to start replication on port " << port << "\n";
+        return;
+    }
+    std::cout << "Replicas can follow on port " << port << "\n";
+}
+
+// Follows the primary instead of loading database.db. Waits a while for the first snapshot so the server doesnt
+// start out empty.
+void initReplica(Replica& replica) {
+    replica.start();
+    std::cout << "Waiting for a snapshot from the primary..\n";
+    if (replica.waitUntilReady(std::chrono::seconds(30))) {
+        std::cout << "Caught up with the primary\n";
+    } else {
+        std::cerr << "No snapshot from the primary yet, still trying in the background\n";
+    }
+}
+
+void printReplication(const ReplicationSource& source, const Replica* replica) {
+    if (replica) {
+        ReplicaStats stats = replica->getStats();
+        std::cout << "Replica, " << (stats.ready ? "ready" : "waiting for a snapshot") << ", " << stats.lagRecords
+                  << " records / " << stats.lagSeconds << " s behind\n";
+        for (std::size_t i = 0; i < stats.shards.size(); i++) {
+            const ReplicaShardStats& shard = stats.shards[i];
+            std::cout << "  shard " << i << ": " << (shard.connected ? "connected" : "disconnected") << ", lsn " << shard.lsn
+                      << " of " << shard.primaryLsn << ", " << shard.recordsApplied << " records applied, "
+                      << shard.snapshotsLoaded << " snapshots, last contact " << shard.secondsSinceContact << " s ago";
+            if (!shard.lastError.empty())
+                std::cout << ", last error: " << shard.lastError;
+            std::cout << "\n";
+        }
+    } else {
+        std::vector<ReplicaInfo> replicas = source.getReplicas();
+        std::cout << "Primary, " << replicas.size() << " replica shards seen\n";
+        for (const auto &info : replicas) {
+            std::cout << "  " << info.name << " shard " << info.shard << ": lsn " << info.lsn << " of " << info.primaryLsn
+                      << ", last pull " << info.secondsSinceSeen << " s ago\n";
+        }
+    }
+    std::cout << "\n";
+}
+
+// server [--port <port>] [--replication-port <port>] [--replica-of <primary ip>:<primary replication port>]
+//        [--memory-budget <MiB>] [--shards <count>]
+// Several servers can run on one machine with different ports, e.g. a primary and replicas of it.
+// The database keeps the number of shards it was saved with (ShardedAuth::kDefaultShards for a new one), --shards
+// moves it to another count on the next start. A replica always takes the count of its primary.
+// With --memory-budget only the credentials of recently used accounts stay in memory, the rest go to a page file
+// next to the database (see easyAuth::enableTieredStorage()).
+int main(int argc, char** argv) {
+    int choice;
+    bool running = false;
+    bool stopped = false;
+
+    int port = 0;
+    int replicationPort = REPLICATION_PORT;
+    std::string primary;
+    std::size_t memoryBudgetMiB = 0;
+    std::size_t shards = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--port") {
+            port = std::atoi(argv[i + 1]);
+        } else if (option == "--replication-port") {
+            replicationPort = std::atoi(argv[i + 1]);
+        } else if (option == "--replica-of") {
+            primary = argv[i + 1];
+        } else if (option == "--memory-budget") {
+            memoryBudgetMiB = static_cast<std::size_t>(std::atoll(argv[i + 1]));
+        } else if (option == "--shards") {
+            shards = static_cast<std::size_t>(std::atoll(argv[i + 1]));
+            if (shards == 0 || shards > ShardedAuth::kMaxShards) {
+                std::cerr << "--shards takes 1 to " << ShardedAuth::kMaxShards << "\n";
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option: " << option << "\n";
+            return 1;
+        }
+    }
+
+    std::string databaseFilename = "database.db";
+    std::string replicaName;
+    Replica::Connect connectToPrimary;
+    if (!primary.empty()) {
+        std::string host = primary.substr(0, primary.find(':'));
+        int primaryPort = primary.find(':') == std::string::npos ? REPLICATION_PORT : std::atoi(primary.c_str() + primary.find(':') + 1);
+        replicaName = std::string(HOST_IP_ADDRESS) + ":" + std::to_string(port != 0 ? port : PORT);
+        // its own files, a replica on the same machine must not touch the primary's database.db
+        databaseFilename = "replica-" + std::to_string(port != 0 ? port : PORT) + ".db";
+        connectToPrimary = [host, primaryPort] {
+            std::shared_ptr<SimpleTCP::Client> client = std::make_shared<SimpleTCP::Client>();
+            if (!client->connectToServer(host, static_cast<unsigned short>(primaryPort), true))
+                return Replica::Transport();
+            return Replica::Transport([client] (const std::string& request) { return client->sendRequest(request); });
+        };
+        // every shard follows the primary shard of the same number, so the counts have to match
+        std::cout << "Asking the primary for its number of shards..\n";
+        std::size_t primaryShards = Replica::primaryShardCount(connectToPrimary, std::chrono::seconds(30));
+        if (primaryShards != 0) {
+            shards = primaryShards;
+        } else {
+            std::cerr << "The primary didnt answer, using " << (shards != 0 ? shards : ShardedAuth::kDefaultShards) << " shards\n";
+        }
+    } else if (shards == 0) {
+        // the count it was saved with, a store moved from a machine with another number of cores keeps its account numbers
+        shards = ShardedAuth::savedShardCount(databaseFilename);
+    }
+
+    ShardedAuth auth(shards); // each shard with its own locks and database file
+    ReplicationSource replicationSource(auth, "database.db");
+    std::unique_ptr<Replica> replica;
+    if (connectToPrimary)
+        replica.reset(new Replica(auth, databaseFilename, replicaName, connectToPrimary));
+    if (memoryBudgetMiB > 0) {
+        // before anything is loaded, so the accounts start out in the page file
+        try {
+            auth.enableTieredStorage(databaseFilename + ".pages", memoryBudgetMiB << 20);
+        } catch (const std::exception& e) {
+            std::cerr << "Could not enable tiered storage: " << e.what() << "\n";
+            return 1;
+        }
+        auth.startCompactor(); // the memory evicted accounts leave behind is only freed by a compaction
+        std::cout << "Keeping " << memoryBudgetMiB << " MiB of credentials in memory, the rest in " << databaseFilename << ".pages\n";
+    }
+    SimpleTCP::Server replicationServer;
+    SimpleTCP::Server server;
+
+    ServerLog logfile("log.txt");
+
+    logfile.write("\n\n-----NEW SESSION-----\n");
+
+    while (true) {
+        std::cout << "---SERVER---\n";
+        std::cout << "RUNNING: "; if (running) std::cout << "true\n"; else std::cout << "false\n";
+        std::cout << "STOPPED: "; if (stopped) std::cout << "true\n"; else std::cout << "false\n";
+        std::cout << "0. Init, start, and goto admin panel\n1. Init and start server\n2. Admin panel\n3. Stop server\n4. Save database and exit\n5. Force exit\n6. Save snapshot (server keeps running)\n7. Replication status\nEnter your choice: ";
+        std::cin >> choice;
+        std::cout << "\n";
+
+        if (choice == 0) {
+            if (!running) {
+                std::cout << "1. Initializing database..\n";
+                auth.initialize(1); // init with 1 special property for each user, being the level of the account
+                std::cout << "initialized\n";
+                if (replica) {
+                    initReplica(*replica);
+                } else {
+                    initDatabase(auth, "database.db");
+                    initReplication(replicationServer, auth, replicationSource, replicationPort);
+                }
+                std::cout << "Database initialized..\n";
+
+                // setup server
+                std::cout << "2. Starting server..\n";
+                initServer(server, auth, logfile, port);
+                std::cout << "Server started. Waiting for connections\n\n";
+                running = true;
+
+                if (replica) {
+                    std::cout << "A replica is read-only, use the admin panel of the primary\n\n";
+                } else {
+                    adminPanel(auth);
+                }
+            }
+        }
+
+        if (choice == 1) { // init and start server
+            if (!running) {
+                std::cout << "1. Initializing database..\n";
+                auth.initialize(1); // init with 1 special property for each user, being the level of the account
+                std::cout << "initialized\n";
+                if (replica) {
+                    initReplica(*replica);
+                } else {
+                    initDatabase(auth, "database.db");
+                    initReplication(replicationServer, auth, replicationSource, replicationPort);
+                }
+                std::cout << "Database initialized..\n";
+
+                // setup server
+                std::cout << "2. Starting server..\n";
+                initServer(server, auth, logfile, port);
+                std::cout << "Server started. Waiting for connections\n\n";
+                running = true;
+            }
+        }
+
+        if (choice == 2) { // admin panel
+            if (replica) {
+                std::cout << "A replica is read-only, use the admin panel of the primary\n\n";
+            } else {
+                adminPanel(auth);
+            }
+        }
+
+        if (choice == 3) { // stop server
+            std::cout << "Are you sure you want to stop the server? (y/n): ";
+            std::string confirm;
+            std::cin >> confirm;
+
+            if (confirm != "y") {
+                std::cout << "Cancelled\n";
+                continue;
+            }
+
+            server.stop();
+            running = false;
+            stopped = true;
+        }
+
+        if (choice == 4) { // save and exit
+            if (stopped && !running) {
+                std::cout << "3. Saving database..\n";
+                if (replica) {
+                    replica->stop(); // it has nothing of its own to save, the next start gets a new snapshot
+                } else {
+                    replicationServer.stop();
+                    closeDatabase(auth, "database.db");
+                }
+                logfile.close();
+                std::cout << "Database saved. Exiting..\n";
+                std::cin.clear();
+                std::cin.get();
+                return 0;
+            }
+        }
+
+        if (choice == 6 && replica) {
+            std::cout << "A replica doesnt save the database, the primary does\n\n";
+            continue;
+        }
+
+        if (choice == 6) { // snapshot while the server keeps serving requests
+            std::cout << "Saving snapshot..\n";
+            if (!auth.startSnapshot("database.db", true)) {
+                std::cout << "A snapshot is already running\n";
+                continue;
+            }
+            SnapshotStats stats = auth.waitForSnapshot();
+            if (stats.ok) {
+                std::cout << "Snapshot saved in " << stats.seconds * 1000 << " ms, " << stats.bytesWritten << " bytes written, "
+                          << stats.extraMemoryBytes / 1024 << " KiB extra memory\n\n";
+            } else {
+                std::cout << "Snapshot failed: " << stats.error << "\n\n";
+            }
+        }
+
+        if (choice == 7) { // how far behind the replicas are, or this replica is
+            printReplication(replicationSource, replica.get());
+        }
+
+        if (choice == 5) { // force exit
+            server.stop();
+            logfile.close();
+            std::cin.clear();
+            std::cin.get();
+            return 0;
+        }
+    }
+
+    return 0;
 }
\ No newline at end of file